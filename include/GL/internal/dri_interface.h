@@ -437,7 +437,7 @@ struct __DRIdamageExtensionRec {
  * SWRast Loader extension.
  */
 #define __DRI_SWRAST_LOADER "DRI_SWRastLoader"
-#define __DRI_SWRAST_LOADER_VERSION 1
+#define __DRI_SWRAST_LOADER_VERSION 2
 struct __DRIswrastLoaderExtensionRec {
     __DRIextension base;
 
@@ -461,6 +461,24 @@ struct __DRIswrastLoaderExtensionRec {
     void (*getImage)(__DRIdrawable *readable,
 		     int x, int y, int width, int height,
 		     char *data, void *loaderPrivate);
+
+    /**
+     * Put image to drawable, from a System V shared memory segment
+     *
+     * The image starts at \c offset bytes into segment \c shmid, which
+     * the driver has mapped at \c shmaddr.  The loader may let the X
+     * server read it from there instead of copying it, and must fall back
+     * to a plain copy if it can't.
+     *
+     * \return non-zero if the server read the image from the segment, zero
+     * if it was copied (or not drawn at all).
+     *
+     * \since 2
+     */
+    int (*putImageShm)(__DRIdrawable *drawable, int op,
+                       int x, int y, int width, int height, int stride,
+                       int shmid, char *shmaddr, unsigned offset,
+                       void *loaderPrivate);
 };
 
 /**
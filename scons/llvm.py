@@ -195,7 +195,7 @@ def generate(env):
             if '-fno-rtti' in cxxflags:
                 env.Append(CXXFLAGS = ['-fno-rtti'])
 
-            components = ['engine', 'bitwriter', 'x86asmprinter']
+            components = ['engine', 'bitwriter', 'bitreader', 'linker', 'x86asmprinter']
 
             if llvm_version >= distutils.version.LooseVersion('3.1'):
                 components.append('mcjit')
@@ -432,6 +432,21 @@ struct cso_hash_iter cso_hash_erase(struct cso_hash *hash, struct cso_hash_iter
    return ret;
 }
 
+boolean cso_hash_erase_data(struct cso_hash *hash, unsigned key, void *data)
+{
+   struct cso_hash_iter iter = cso_hash_find(hash, key);
+
+   while (!cso_hash_iter_is_null(iter) && cso_hash_iter_key(iter) == key) {
+      if (cso_hash_iter_data(iter) == data) {
+         cso_hash_erase(hash, iter);
+         return TRUE;
+      }
+      iter = cso_hash_iter_next(iter);
+   }
+
+   return FALSE;
+}
+
 boolean cso_hash_contains(struct cso_hash *hash, unsigned key)
 {
    struct cso_node **node = cso_hash_find_node(hash, key);
@@ -87,6 +87,12 @@ struct cso_hash_iter cso_hash_erase(struct cso_hash *hash, struct cso_hash_iter
 
 void  *cso_hash_take(struct cso_hash *hash, unsigned key);
 
+/**
+ * Removes the entry with the given key whose data is the given pointer.
+ * Returns false if there is no such entry.
+ */
+boolean cso_hash_erase_data(struct cso_hash *hash, unsigned key, void *data);
+
 
 
 struct cso_hash_iter cso_hash_first_node(struct cso_hash *hash);
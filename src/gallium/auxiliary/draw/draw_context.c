@@ -493,6 +493,21 @@ draw_set_force_passthrough( struct draw_context *draw, boolean enable )
 }
 
 
+#ifdef HAVE_LLVM
+/**
+ * Share the JIT'd vertex shader code through the given cache, normally
+ * owned by the screen and shared by all its contexts.
+ */
+void
+draw_set_code_cache(struct draw_context *draw,
+                    struct gallivm_code_cache *cache)
+{
+   if (draw->llvm)
+      draw->llvm->code_cache = cache;
+}
+#endif
+
+
 
 /**
  * Allocate an extra vertex/geometry shader vertex attribute, if it doesn't
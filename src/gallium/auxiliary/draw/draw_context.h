@@ -291,6 +291,12 @@ draw_get_shader_param_no_llvm(unsigned shader, enum pipe_shader_cap param);
 #ifdef HAVE_LLVM
 boolean
 draw_get_option_use_llvm(void);
+
+struct gallivm_code_cache;
+
+void
+draw_set_code_cache(struct draw_context *draw,
+                    struct gallivm_code_cache *cache);
 #endif
 
 #endif /* DRAW_CONTEXT_H */
@@ -226,63 +226,47 @@ llvm_fetch_gs_input(struct draw_geometry_shader *shader,
                     unsigned num_vertices,
                     unsigned prim_idx)
 {
-   unsigned slot, i;
-   int vs_slot;
-   unsigned input_vertex_stride = shader->input_vertex_stride;
-   const float (*input_ptr)[4];
-   float (*input_data)[6][PIPE_MAX_SHADER_INPUTS][TGSI_NUM_CHANNELS][TGSI_NUM_CHANNELS] = &shader->gs_input->data;
+   unsigned i;
+   int *offsets = shader->llvm_input_offsets + prim_idx;
 
    shader->llvm_prim_ids[shader->fetched_prim_count] =
       shader->in_prim_idx;
 
-   input_ptr = shader->input;
-
    for (i = 0; i < num_vertices; ++i) {
-      const float (*input)[4];
 #if DEBUG_INPUTS
       debug_printf("%d) vertex index = %d (prim idx = %d)\n",
                    i, indices[i], prim_idx);
 #endif
-      input = (const float (*)[4])(
-         (const char *)input_ptr + (indices[i] * input_vertex_stride));
-      for (slot = 0, vs_slot = 0; slot < shader->info.num_inputs; ++slot) {
-         if (shader->info.input_semantic_name[slot] == TGSI_SEMANTIC_PRIMID) {
-            /* skip. we handle system values through gallivm */
-         } else {
-            vs_slot = draw_gs_get_input_index(
-               shader->info.input_semantic_name[slot],
-               shader->info.input_semantic_index[slot],
-               shader->input_info);
-            if (vs_slot < 0) {
-               debug_printf("VS/GS signature mismatch!\n");
-               (*input_data)[i][slot][0][prim_idx] = 0;
-               (*input_data)[i][slot][1][prim_idx] = 0;
-               (*input_data)[i][slot][2][prim_idx] = 0;
-               (*input_data)[i][slot][3][prim_idx] = 0;
-            } else {
-#if DEBUG_INPUTS
-               debug_printf("\tSlot = %d, vs_slot = %d, i = %d:\n",
-                            slot, vs_slot, i);
-               assert(!util_is_inf_or_nan(input[vs_slot][0]));
-               assert(!util_is_inf_or_nan(input[vs_slot][1]));
-               assert(!util_is_inf_or_nan(input[vs_slot][2]));
-               assert(!util_is_inf_or_nan(input[vs_slot][3]));
-#endif
-               (*input_data)[i][slot][0][prim_idx] = input[vs_slot][0];
-               (*input_data)[i][slot][1][prim_idx] = input[vs_slot][1];
-               (*input_data)[i][slot][2][prim_idx] = input[vs_slot][2];
-               (*input_data)[i][slot][3][prim_idx] = input[vs_slot][3];
-#if DEBUG_INPUTS
-               debug_printf("\t\t%f %f %f %f\n",
-                            (*input_data)[i][slot][0][prim_idx],
-                            (*input_data)[i][slot][1][prim_idx],
-                            (*input_data)[i][slot][2][prim_idx],
-                            (*input_data)[i][slot][3][prim_idx]);
-#endif
-               ++vs_slot;
-            }
+      offsets[i * shader->vector_length] =
+         indices[i] * shader->input_vertex_stride;
+   }
+}
+
+/**
+ * Map the geometry shader inputs to the vertex shader outputs, for the
+ * jit code to fetch them in place.
+ */
+static void
+llvm_setup_gs_input_slots(struct draw_geometry_shader *shader)
+{
+   unsigned slot;
+
+   for (slot = 0; slot < shader->info.num_inputs; ++slot) {
+      int vs_slot = -1;
+
+      if (shader->info.input_semantic_name[slot] != TGSI_SEMANTIC_PRIMID) {
+         /* system values are handled through gallivm */
+         vs_slot = draw_gs_get_input_index(
+            shader->info.input_semantic_name[slot],
+            shader->info.input_semantic_index[slot],
+            shader->input_info);
+         if (vs_slot < 0) {
+            debug_printf("VS/GS signature mismatch!\n");
          }
       }
+
+      shader->llvm_input_slots[slot] =
+         vs_slot < 0 ? -1 : vs_slot * 4 * sizeof(float);
    }
 }
 
@@ -378,11 +362,27 @@ llvm_gs_run(struct draw_geometry_shader *shader,
 {
    unsigned ret;
    char *input = (char*)shader->gs_output;
+   unsigned i;
 
    input += (shader->emitted_vertices * shader->vertex_size);
 
+   /* The inputs of all lanes are gathered.  Point the lanes without a
+    * primitive at the first vertex rather than at vertices of an earlier
+    * batch, which may lie past the end of the current vertex buffer.
+    */
+   if (input_primitives < shader->vector_length) {
+      for (i = 0; i < 6; i++) {
+         memset(shader->llvm_input_offsets + i * shader->vector_length +
+                input_primitives, 0,
+                (shader->vector_length - input_primitives) * sizeof(int));
+      }
+   }
+
    ret = shader->current_variant->jit_func(
-      shader->jit_context, shader->gs_input->data,
+      shader->jit_context,
+      shader->input,
+      shader->llvm_input_offsets,
+      shader->llvm_input_slots,
       (struct vertex_header*)input,
       input_primitives,
       shader->draw->instance_id,
@@ -404,7 +404,7 @@ static void gs_flush(struct draw_geometry_shader *shader)
    }
 
    debug_assert(input_primitives > 0 &&
-                input_primitives <= 4);
+                input_primitives <= shader->vector_length);
 
    out_prim_count = shader->run(shader, input_primitives);
    shader->fetch_outputs(shader, out_prim_count,
@@ -614,6 +614,8 @@ int draw_geometry_shader_run(struct draw_geometry_shader *shader,
       shader->jit_context->prim_lengths = shader->llvm_prim_lengths;
       shader->jit_context->emitted_vertices = shader->llvm_emitted_vertices;
       shader->jit_context->emitted_prims = shader->llvm_emitted_primitives;
+
+      llvm_setup_gs_input_slots(shader);
    }
 #endif
 
@@ -754,11 +756,7 @@ draw_create_geometry_shader(struct draw_context *draw,
 
 #ifdef HAVE_LLVM
    if (use_llvm) {
-      /* TODO: change the input array to handle the following
-         vector length, instead of the currently hardcoded
-         TGSI_NUM_CHANNELS
-      gs->vector_length = lp_native_vector_width / 32;*/
-      gs->vector_length = TGSI_NUM_CHANNELS;
+      gs->vector_length = lp_native_vector_width / 32;
    } else
 #endif
    {
@@ -810,13 +808,13 @@ draw_create_geometry_shader(struct draw_context *draw,
 #ifdef HAVE_LLVM
    if (use_llvm) {
       int vector_size = gs->vector_length * sizeof(float);
-      gs->gs_input = align_malloc(sizeof(struct draw_gs_inputs), 16);
-      memset(gs->gs_input, 0, sizeof(struct draw_gs_inputs));
       gs->llvm_prim_lengths = 0;
 
       gs->llvm_emitted_primitives = align_malloc(vector_size, vector_size);
       gs->llvm_emitted_vertices = align_malloc(vector_size, vector_size);
       gs->llvm_prim_ids = align_malloc(vector_size, vector_size);
+      gs->llvm_input_offsets = align_malloc(6 * vector_size, vector_size);
+      memset(gs->llvm_input_offsets, 0, 6 * vector_size);
 
       gs->fetch_outputs = llvm_fetch_gs_outputs;
       gs->fetch_inputs = llvm_fetch_gs_input;
@@ -889,8 +887,7 @@ void draw_delete_geometry_shader(struct draw_context *draw,
       align_free(dgs->llvm_emitted_primitives);
       align_free(dgs->llvm_emitted_vertices);
       align_free(dgs->llvm_prim_ids);
-
-      align_free(dgs->gs_input);
+      align_free(dgs->llvm_input_offsets);
    }
 #endif
 
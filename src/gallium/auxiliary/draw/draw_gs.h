@@ -39,18 +39,6 @@ struct draw_context;
 struct draw_gs_jit_context;
 struct draw_gs_llvm_variant;
 
-/**
- * Structure holding the inputs to the geometry shader. It uses SOA layout.
- * The dimensions are as follows:
- * - maximum number of vertices for a geometry shader input primitive
- *   (6 for triangle_adjacency)
- * - maximum number of attributes for each vertex
- * - four channels per each attribute (x,y,z,w)
- * - number of input primitives equal to the SOA vector length
- */
-struct draw_gs_inputs {
-   float data[6][PIPE_MAX_SHADER_INPUTS][TGSI_NUM_CHANNELS][TGSI_NUM_CHANNELS];
-};
 #endif
 
 /**
@@ -91,7 +79,6 @@ struct draw_geometry_shader {
    unsigned max_out_prims;
 
 #ifdef HAVE_LLVM
-   struct draw_gs_inputs *gs_input;
    struct draw_gs_jit_context *jit_context;
    struct draw_gs_llvm_variant *current_variant;
    struct vertex_header *gs_output;
@@ -100,6 +87,15 @@ struct draw_geometry_shader {
    int *llvm_emitted_primitives;
    int *llvm_emitted_vertices;
    int *llvm_prim_ids;
+
+   /*
+    * The jit code fetches its inputs straight from the vertex shader
+    * outputs: the byte offset of each input vertex, [vertex][lane], and
+    * the byte offset of each input within a vertex, or -1 if the vertex
+    * shader does not write it.
+    */
+   int *llvm_input_offsets;
+   int llvm_input_slots[PIPE_MAX_SHADER_INPUTS];
 #endif
 
    void (*fetch_inputs)(struct draw_geometry_shader *shader,
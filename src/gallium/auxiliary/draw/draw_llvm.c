@@ -40,6 +40,8 @@
 #include "gallivm/lp_bld_type.h"
 #include "gallivm/lp_bld_flow.h"
 #include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_code_cache.h"
+#include "gallivm/lp_bld_disk_cache.h"
 #include "gallivm/lp_bld_tgsi.h"
 #include "gallivm/lp_bld_printf.h"
 #include "gallivm/lp_bld_intr.h"
@@ -47,14 +49,18 @@
 #include "gallivm/lp_bld_type.h"
 #include "gallivm/lp_bld_pack.h"
 #include "gallivm/lp_bld_format.h"
+#include "gallivm/lp_bld_gather.h"
 
 #include "tgsi/tgsi_exec.h"
 #include "tgsi/tgsi_dump.h"
+#include "tgsi/tgsi_parse.h"
 
 #include "util/u_math.h"
 #include "util/u_pointer.h"
 #include "util/u_string.h"
 #include "util/u_simple_list.h"
+#include "util/u_hash.h"
+#include "cso_cache/cso_hash.h"
 
 
 #define DEBUG_STORE 0
@@ -70,6 +76,8 @@ struct draw_gs_llvm_iface {
 
    struct draw_gs_llvm_variant *variant;
    LLVMValueRef input;
+   LLVMValueRef input_offsets;
+   LLVMValueRef input_slots;
 };
 
 static INLINE const struct draw_gs_llvm_iface *
@@ -349,20 +357,6 @@ create_gs_jit_context_type(struct gallivm_state *gallivm,
 }
 
 
-static LLVMTypeRef
-create_gs_jit_input_type(struct gallivm_state *gallivm)
-{
-   LLVMTypeRef float_type = LLVMFloatTypeInContext(gallivm->context);
-   LLVMTypeRef input_array;
-
-   input_array = LLVMVectorType(float_type, TGSI_NUM_CHANNELS); /* num primitives */
-   input_array = LLVMArrayType(input_array, TGSI_NUM_CHANNELS); /* num channels */
-   input_array = LLVMArrayType(input_array, PIPE_MAX_SHADER_INPUTS); /* num attrs per vertex */
-   input_array = LLVMPointerType(input_array, 0); /* num vertices per prim */
-
-   return input_array;
-}
-
 /**
  * Create LLVM type for struct pipe_vertex_buffer
  */
@@ -537,6 +531,13 @@ draw_llvm_create(struct draw_context *draw)
    llvm->nr_gs_variants = 0;
    make_empty_list(&llvm->gs_variants_list);
 
+   llvm->vs_variants_hash = cso_hash_create();
+   llvm->gs_variants_hash = cso_hash_create();
+   if (!llvm->vs_variants_hash || !llvm->gs_variants_hash) {
+      draw_llvm_destroy(llvm);
+      return NULL;
+   }
+
    return llvm;
 }
 
@@ -548,10 +549,83 @@ void
 draw_llvm_destroy(struct draw_llvm *llvm)
 {
    /* XXX free other draw_llvm data? */
+   if (llvm->vs_variants_hash)
+      cso_hash_delete(llvm->vs_variants_hash);
+   if (llvm->gs_variants_hash)
+      cso_hash_delete(llvm->gs_variants_hash);
    FREE(llvm);
 }
 
 
+/**
+ * Hash a variant key.  The variants of all the shaders share one table,
+ * so the shader is part of the hash too.
+ */
+static INLINE unsigned
+variant_hash(const void *shader, const void *key, unsigned key_size)
+{
+   return util_hash_fast(key, key_size) ^
+          (unsigned) pointer_to_uintptr(shader);
+}
+
+
+/**
+ * Find the current vertex shader's variant matching the key, or NULL.
+ */
+struct draw_llvm_variant *
+draw_llvm_find_variant(struct draw_llvm *llvm,
+                       const struct draw_llvm_variant_key *key)
+{
+   struct llvm_vertex_shader *shader =
+      llvm_vertex_shader(llvm->draw->vs.vertex_shader);
+   unsigned hash = variant_hash(shader, key, shader->variant_key_size);
+   struct cso_hash_iter iter = cso_hash_find(llvm->vs_variants_hash, hash);
+
+   while (!cso_hash_iter_is_null(iter) && cso_hash_iter_key(iter) == hash) {
+      struct draw_llvm_variant *variant = cso_hash_iter_data(iter);
+
+      if (variant->shader == shader &&
+          memcmp(&variant->key, key, shader->variant_key_size) == 0)
+         return variant;
+
+      iter = cso_hash_iter_next(iter);
+   }
+
+   return NULL;
+}
+
+
+/**
+ * Build the disk cache key of a vertex shader variant.  Besides the variant
+ * key this must capture all the draw state draw_llvm_generate() looks at.
+ */
+static void
+make_cache_key(struct draw_llvm *llvm,
+               unsigned num_inputs,
+               const struct draw_llvm_variant_key *key,
+               unsigned key_size,
+               struct gallivm_cache_key *cache_key)
+{
+   struct draw_context *draw = llvm->draw;
+   const struct tgsi_token *tokens = draw->vs.vertex_shader->state.tokens;
+   unsigned state[6];
+
+   state[0] = num_inputs;
+   state[1] = draw_current_shader_position_output(draw);
+   state[2] = draw_current_shader_clipvertex_output(draw);
+   state[3] = draw_current_shader_clipdistance_output(draw, 0);
+   state[4] = draw_current_shader_clipdistance_output(draw, 1);
+   state[5] = draw->num_sampler_views[PIPE_SHADER_VERTEX] &&
+              draw->num_samplers[PIPE_SHADER_VERTEX];
+
+   gallivm_cache_key_init(cache_key, "draw vs");
+   gallivm_cache_key_add(cache_key, tokens,
+                         tgsi_num_tokens(tokens) * sizeof(struct tgsi_token));
+   gallivm_cache_key_add(cache_key, key, key_size);
+   gallivm_cache_key_add(cache_key, state, sizeof state);
+}
+
+
 /**
  * Create LLVM-generated code for a vertex shader.
  */
@@ -564,35 +638,102 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
    struct llvm_vertex_shader *shader =
       llvm_vertex_shader(llvm->draw->vs.vertex_shader);
    LLVMTypeRef vertex_header;
-
-   variant = MALLOC(sizeof *variant +
-                    shader->variant_key_size -
-                    sizeof variant->key);
+   struct gallivm_cache_key cache_key;
+   boolean need_key = llvm->code_cache || gallivm_disk_cache_enabled();
+   LLVMValueRef functions[2];
+   boolean cached = FALSE;
+
+   variant = CALLOC(1, sizeof *variant +
+                       shader->variant_key_size -
+                       sizeof variant->key);
    if (variant == NULL)
       return NULL;
 
    variant->llvm = llvm;
 
-   variant->gallivm = gallivm_create();
+   memcpy(&variant->key, key, shader->variant_key_size);
+
+   if (need_key) {
+      make_cache_key(llvm, num_inputs, key, shader->variant_key_size,
+                     &cache_key);
+   }
 
-   create_jit_types(variant);
+   /* Another context may have compiled the same code already */
+   if (llvm->code_cache) {
+      variant->code = gallivm_code_cache_lookup(llvm->code_cache, &cache_key);
+   }
 
-   memcpy(&variant->key, key, shader->variant_key_size);
+   if (variant->code) {
+      variant->jit_func = (draw_jit_vert_func)
+            variant->code->jit_functions[0];
+      variant->jit_func_elts = (draw_jit_vert_func_elts)
+            variant->code->jit_functions[1];
+   }
+   else {
+      variant->gallivm = gallivm_create();
 
-   vertex_header = create_jit_vertex_header(variant->gallivm, num_inputs);
+      variant->code = gallivm_code_create(variant->gallivm);
 
-   variant->vertex_header_ptr_type = LLVMPointerType(vertex_header, 0);
+      create_jit_types(variant);
 
-   draw_llvm_generate(llvm, variant, FALSE);  /* linear */
-   draw_llvm_generate(llvm, variant, TRUE);   /* elts */
+      vertex_header = create_jit_vertex_header(variant->gallivm, num_inputs);
 
-   gallivm_compile_module(variant->gallivm);
+      variant->vertex_header_ptr_type = LLVMPointerType(vertex_header, 0);
 
-   variant->jit_func = (draw_jit_vert_func)
-         gallivm_jit_function(variant->gallivm, variant->function);
+      if (gallivm_disk_cache_enabled()) {
+         cached = gallivm_disk_cache_load(variant->gallivm, &cache_key,
+                                          functions, Elements(functions));
+      }
+
+      if (cached) {
+         variant->function = functions[0];
+         variant->function_elts = functions[1];
+      }
+      else {
+         draw_llvm_generate(llvm, variant, FALSE);  /* linear */
+         draw_llvm_generate(llvm, variant, TRUE);   /* elts */
+
+         if (gallivm_disk_cache_enabled()) {
+            functions[0] = variant->function;
+            functions[1] = variant->function_elts;
+            gallivm_disk_cache_store(variant->gallivm, &cache_key,
+                                     functions, Elements(functions));
+         }
+      }
 
-   variant->jit_func_elts = (draw_jit_vert_func_elts)
-         gallivm_jit_function(variant->gallivm, variant->function_elts);
+      if (variant->code) {
+         variant->code->num_functions = 2;
+         variant->code->functions[0] = variant->function;
+         variant->code->functions[1] = variant->function_elts;
+         variant->code->nr_instrs =
+            lp_build_count_instructions(variant->function) +
+            lp_build_count_instructions(variant->function_elts);
+      }
+
+      gallivm_compile_module(variant->gallivm);
+
+      variant->jit_func = (draw_jit_vert_func)
+            gallivm_jit_function(variant->gallivm, variant->function);
+
+      variant->jit_func_elts = (draw_jit_vert_func_elts)
+            gallivm_jit_function(variant->gallivm, variant->function_elts);
+
+      if (variant->code) {
+         /* The code object owns the LLVM objects from now on */
+         variant->code->jit_functions[0] = (func_pointer) variant->jit_func;
+         variant->code->jit_functions[1] =
+            (func_pointer) variant->jit_func_elts;
+
+         if (llvm->code_cache) {
+            gallivm_code_cache_add(llvm->code_cache, variant->code,
+                                   &cache_key);
+         }
+      }
+   }
+
+   if (need_key) {
+      gallivm_cache_key_release(&cache_key);
+   }
 
    variant->shader = shader;
    variant->list_item_global.base = variant;
@@ -600,6 +741,9 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
    /*variant->no = */shader->variants_created++;
    variant->list_item_global.base = variant;
 
+   variant->hash = variant_hash(shader, key, shader->variant_key_size);
+   cso_hash_insert(llvm->vs_variants_hash, variant->hash, variant);
+
    return variant;
 }
 
@@ -625,7 +769,8 @@ generate_vs(struct draw_llvm_variant *variant,
       draw_llvm_dump_variant_key(&variant->key);
    }
 
-   if (llvm->draw->num_sampler_views && llvm->draw->num_samplers)
+   if (llvm->draw->num_sampler_views[PIPE_SHADER_VERTEX] &&
+       llvm->draw->num_samplers[PIPE_SHADER_VERTEX])
       sampler = draw_sampler;
 
    lp_build_tgsi_soa(variant->gallivm,
@@ -638,6 +783,7 @@ generate_vs(struct draw_llvm_variant *variant,
                      outputs,
                      sampler,
                      &llvm->draw->vs.vertex_shader->info,
+                     NULL,
                      NULL);
 
    {
@@ -1359,6 +1505,15 @@ clipmask_booli32(struct gallivm_state *gallivm,
    return ret;
 }
 
+/**
+ * Fetch a geometry shader input channel for all the primitive lanes.
+ *
+ * The inputs are gathered straight from the vertex shader outputs: the
+ * input_offsets array holds the byte offset of each vertex of each lane
+ * ([vertex][lane]) and input_slots maps the geometry shader inputs to
+ * byte offsets within a vertex, negative when the vertex shader does not
+ * write that input.
+ */
 static LLVMValueRef
 draw_gs_llvm_fetch_input(const struct lp_build_tgsi_gs_iface *gs_iface,
                          struct lp_build_tgsi_context * bld_base,
@@ -1371,48 +1526,70 @@ draw_gs_llvm_fetch_input(const struct lp_build_tgsi_gs_iface *gs_iface,
    const struct draw_gs_llvm_iface *gs = draw_gs_llvm_iface(gs_iface);
    struct gallivm_state *gallivm = bld_base->base.gallivm;
    LLVMBuilderRef builder = gallivm->builder;
-   LLVMValueRef indices[3];
-   LLVMValueRef res;
    struct lp_type type = bld_base->base.type;
+   struct lp_build_context *int_bld = &bld_base->int_bld;
+   LLVMValueRef length = lp_build_const_int32(gallivm, type.length);
+   LLVMValueRef vertex_offsets, slot_offsets, offsets, valid;
+   LLVMValueRef res;
 
-   if (is_vindex_indirect || is_aindex_indirect) {
+   if (is_vindex_indirect) {
       int i;
-      res = bld_base->base.zero;
+      vertex_offsets = int_bld->undef;
       for (i = 0; i < type.length; ++i) {
          LLVMValueRef idx = lp_build_const_int32(gallivm, i);
-         LLVMValueRef vert_chan_index = vertex_index;
-         LLVMValueRef attr_chan_index = attrib_index;
-         LLVMValueRef channel_vec, value;
-
-         if (is_vindex_indirect) {
-            vert_chan_index = LLVMBuildExtractElement(builder,
-                                                      vertex_index, idx, "");
-         }
-         if (is_aindex_indirect) {
-            attr_chan_index = LLVMBuildExtractElement(builder,
-                                                      attrib_index, idx, "");
-         }
-
-         indices[0] = vert_chan_index;
-         indices[1] = attr_chan_index;
-         indices[2] = swizzle_index;
+         LLVMValueRef index, ptr;
+
+         index = LLVMBuildExtractElement(builder, vertex_index, idx, "");
+         index = LLVMBuildMul(builder, index, length, "");
+         index = LLVMBuildAdd(builder, index, idx, "");
+         ptr = LLVMBuildGEP(builder, gs->input_offsets, &index, 1, "");
+         vertex_offsets = LLVMBuildInsertElement(builder, vertex_offsets,
+                                                 LLVMBuildLoad(builder, ptr, ""),
+                                                 idx, "");
+      }
+   } else {
+      LLVMValueRef index = LLVMBuildMul(builder, vertex_index, length, "");
+      LLVMValueRef ptr = LLVMBuildGEP(builder, gs->input_offsets, &index, 1, "");
+      ptr = LLVMBuildBitCast(builder, ptr,
+                             LLVMPointerType(int_bld->vec_type, 0), "");
+      vertex_offsets = LLVMBuildLoad(builder, ptr, "vertex_offsets");
+   }
 
-         channel_vec = LLVMBuildGEP(builder, gs->input, indices, 3, "");
-         channel_vec = LLVMBuildLoad(builder, channel_vec, "");
-         value = LLVMBuildExtractElement(builder, channel_vec, idx, "");
+   if (is_aindex_indirect) {
+      int i;
+      slot_offsets = int_bld->undef;
+      for (i = 0; i < type.length; ++i) {
+         LLVMValueRef idx = lp_build_const_int32(gallivm, i);
+         LLVMValueRef index, ptr;
 
-         res = LLVMBuildInsertElement(builder, res, value, idx, "");
+         index = LLVMBuildExtractElement(builder, attrib_index, idx, "");
+         ptr = LLVMBuildGEP(builder, gs->input_slots, &index, 1, "");
+         slot_offsets = LLVMBuildInsertElement(builder, slot_offsets,
+                                               LLVMBuildLoad(builder, ptr, ""),
+                                               idx, "");
       }
    } else {
-      indices[0] = vertex_index;
-      indices[1] = attrib_index;
-      indices[2] = swizzle_index;
-
-      res = LLVMBuildGEP(builder, gs->input, indices, 3, "");
-      res = LLVMBuildLoad(builder, res, "");
+      LLVMValueRef ptr = LLVMBuildGEP(builder, gs->input_slots,
+                                      &attrib_index, 1, "");
+      slot_offsets = lp_build_broadcast_scalar(int_bld,
+                                               LLVMBuildLoad(builder, ptr, ""));
    }
 
-   return res;
+   valid = lp_build_cmp(int_bld, PIPE_FUNC_GEQUAL, slot_offsets, int_bld->zero);
+   slot_offsets = lp_build_select(int_bld, valid, slot_offsets, int_bld->zero);
+
+   offsets = LLVMBuildAdd(builder, vertex_offsets, slot_offsets, "");
+   offsets = LLVMBuildAdd(builder, offsets,
+                          lp_build_broadcast_scalar(int_bld,
+                             LLVMBuildMul(builder, swizzle_index,
+                                          lp_build_const_int32(gallivm, 4), "")),
+                          "");
+
+   res = lp_build_gather(gallivm, type.length, 32, 32,
+                         gs->input, offsets, FALSE);
+   res = lp_build_select(int_bld, valid, res, int_bld->zero);
+
+   return LLVMBuildBitCast(builder, res, bld_base->base.vec_type, "");
 }
 
 static void
@@ -2001,18 +2178,24 @@ draw_llvm_destroy_variant(struct draw_llvm_variant *variant)
 {
    struct draw_llvm *llvm = variant->llvm;
 
-   if (variant->function_elts) {
-      gallivm_free_function(variant->gallivm,
-                            variant->function_elts, variant->jit_func_elts);
+   if (variant->code) {
+      gallivm_code_reference(&variant->code, NULL);
    }
+   else {
+      if (variant->function_elts) {
+         gallivm_free_function(variant->gallivm,
+                               variant->function_elts, variant->jit_func_elts);
+      }
 
-   if (variant->function) {
-      gallivm_free_function(variant->gallivm,
-                            variant->function, variant->jit_func);
-   }
+      if (variant->function) {
+         gallivm_free_function(variant->gallivm,
+                               variant->function, variant->jit_func);
+      }
 
-   gallivm_destroy(variant->gallivm);
+      gallivm_destroy(variant->gallivm);
+   }
 
+   cso_hash_erase_data(llvm->vs_variants_hash, variant->hash, variant);
    remove_from_list(&variant->list_item_local);
    variant->shader->variants_cached--;
    remove_from_list(&variant->list_item_global);
@@ -2038,8 +2221,6 @@ create_gs_jit_types(struct draw_gs_llvm_variant *var)
                                              texture_type, sampler_type,
                                              "draw_gs_jit_context");
    var->context_ptr_type = LLVMPointerType(context_type, 0);
-
-   var->input_array_type = create_gs_jit_input_type(gallivm);
 }
 
 static LLVMTypeRef
@@ -2063,7 +2244,7 @@ generate_mask_value(struct draw_gs_llvm_variant *variant,
 
    num_prims = lp_build_broadcast(gallivm, lp_build_vec_type(gallivm, mask_type),
                                   variant->num_prims);
-   for (i = 0; i <= gs_type.length; i++) {
+   for (i = 0; i < gs_type.length; i++) {
       LLVMValueRef idx = lp_build_const_int32(gallivm, i);
       mask_val = LLVMBuildInsertElement(builder, mask_val, idx, idx, "");
    }
@@ -2080,14 +2261,14 @@ draw_gs_llvm_generate(struct draw_llvm *llvm,
    struct gallivm_state *gallivm = variant->gallivm;
    LLVMContextRef context = gallivm->context;
    LLVMTypeRef int32_type = LLVMInt32TypeInContext(context);
-   LLVMTypeRef arg_types[6];
+   LLVMTypeRef arg_types[8];
    LLVMTypeRef func_type;
    LLVMValueRef variant_func;
    LLVMValueRef context_ptr;
    LLVMValueRef prim_id_ptr;
    LLVMBasicBlockRef block;
    LLVMBuilderRef builder;
-   LLVMValueRef io_ptr, input_array, num_prims, mask_val;
+   LLVMValueRef io_ptr, input, input_offsets, input_slots, num_prims, mask_val;
    struct lp_build_sampler_soa *sampler = 0;
    struct lp_build_context bld;
    struct lp_bld_tgsi_system_values system_values;
@@ -2106,11 +2287,14 @@ draw_gs_llvm_generate(struct draw_llvm *llvm,
    assert(variant->vertex_header_ptr_type);
 
    arg_types[0] = get_gs_context_ptr_type(variant);    /* context */
-   arg_types[1] = variant->input_array_type;           /* input */
-   arg_types[2] = variant->vertex_header_ptr_type;     /* vertex_header */
-   arg_types[3] = int32_type;                          /* num_prims */
-   arg_types[4] = int32_type;                          /* instance_id */
-   arg_types[5] = LLVMPointerType(
+   arg_types[1] = LLVMPointerType(
+      LLVMInt8TypeInContext(context), 0);              /* input */
+   arg_types[2] = LLVMPointerType(int32_type, 0);      /* input_offsets */
+   arg_types[3] = LLVMPointerType(int32_type, 0);      /* input_slots */
+   arg_types[4] = variant->vertex_header_ptr_type;     /* vertex_header */
+   arg_types[5] = int32_type;                          /* num_prims */
+   arg_types[6] = int32_type;                          /* instance_id */
+   arg_types[7] = LLVMPointerType(
       LLVMVectorType(int32_type, vector_length), 0);   /* prim_id_ptr */
 
    func_type = LLVMFunctionType(int32_type, arg_types, Elements(arg_types), 0);
@@ -2127,14 +2311,18 @@ draw_gs_llvm_generate(struct draw_llvm *llvm,
                           LLVMNoAliasAttribute);
 
    context_ptr               = LLVMGetParam(variant_func, 0);
-   input_array               = LLVMGetParam(variant_func, 1);
-   io_ptr                    = LLVMGetParam(variant_func, 2);
-   num_prims                 = LLVMGetParam(variant_func, 3);
-   system_values.instance_id = LLVMGetParam(variant_func, 4);
-   prim_id_ptr               = LLVMGetParam(variant_func, 5);
+   input                     = LLVMGetParam(variant_func, 1);
+   input_offsets             = LLVMGetParam(variant_func, 2);
+   input_slots               = LLVMGetParam(variant_func, 3);
+   io_ptr                    = LLVMGetParam(variant_func, 4);
+   num_prims                 = LLVMGetParam(variant_func, 5);
+   system_values.instance_id = LLVMGetParam(variant_func, 6);
+   prim_id_ptr               = LLVMGetParam(variant_func, 7);
 
    lp_build_name(context_ptr, "context");
-   lp_build_name(input_array, "input");
+   lp_build_name(input, "input");
+   lp_build_name(input_offsets, "input_offsets");
+   lp_build_name(input_slots, "input_slots");
    lp_build_name(io_ptr, "io");
    lp_build_name(num_prims, "num_prims");
    lp_build_name(system_values.instance_id, "instance_id");
@@ -2148,7 +2336,9 @@ draw_gs_llvm_generate(struct draw_llvm *llvm,
    gs_iface.base.emit_vertex = draw_gs_llvm_emit_vertex;
    gs_iface.base.end_primitive = draw_gs_llvm_end_primitive;
    gs_iface.base.gs_epilogue = draw_gs_llvm_epilogue;
-   gs_iface.input = input_array;
+   gs_iface.input = input;
+   gs_iface.input_offsets = input_offsets;
+   gs_iface.input_slots = input_slots;
    gs_iface.variant = variant;
 
    /*
@@ -2196,7 +2386,8 @@ draw_gs_llvm_generate(struct draw_llvm *llvm,
                      outputs,
                      sampler,
                      &llvm->draw->gs.geometry_shader->info,
-                     (const struct lp_build_tgsi_gs_iface *)&gs_iface);
+                     (const struct lp_build_tgsi_gs_iface *)&gs_iface,
+                     NULL);
 
    sampler->destroy(sampler);
 
@@ -2249,6 +2440,9 @@ draw_gs_llvm_create_variant(struct draw_llvm *llvm,
    /*variant->no = */shader->variants_created++;
    variant->list_item_global.base = variant;
 
+   variant->hash = variant_hash(shader, key, shader->variant_key_size);
+   cso_hash_insert(llvm->gs_variants_hash, variant->hash, variant);
+
    return variant;
 }
 
@@ -2264,6 +2458,7 @@ draw_gs_llvm_destroy_variant(struct draw_gs_llvm_variant *variant)
 
    gallivm_destroy(variant->gallivm);
 
+   cso_hash_erase_data(llvm->gs_variants_hash, variant->hash, variant);
    remove_from_list(&variant->list_item_local);
    variant->shader->variants_cached--;
    remove_from_list(&variant->list_item_global);
@@ -2271,6 +2466,32 @@ draw_gs_llvm_destroy_variant(struct draw_gs_llvm_variant *variant)
    FREE(variant);
 }
 
+
+/**
+ * Find the current geometry shader's variant matching the key, or NULL.
+ */
+struct draw_gs_llvm_variant *
+draw_gs_llvm_find_variant(struct draw_llvm *llvm,
+                          const struct draw_gs_llvm_variant_key *key)
+{
+   struct llvm_geometry_shader *shader =
+      llvm_geometry_shader(llvm->draw->gs.geometry_shader);
+   unsigned hash = variant_hash(shader, key, shader->variant_key_size);
+   struct cso_hash_iter iter = cso_hash_find(llvm->gs_variants_hash, hash);
+
+   while (!cso_hash_iter_is_null(iter) && cso_hash_iter_key(iter) == hash) {
+      struct draw_gs_llvm_variant *variant = cso_hash_iter_data(iter);
+
+      if (variant->shader == shader &&
+          memcmp(&variant->key, key, shader->variant_key_size) == 0)
+         return variant;
+
+      iter = cso_hash_iter_next(iter);
+   }
+
+   return NULL;
+}
+
 struct draw_gs_llvm_variant_key *
 draw_gs_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
 {
@@ -43,6 +43,9 @@
 struct draw_llvm;
 struct llvm_vertex_shader;
 struct llvm_geometry_shader;
+struct cso_hash;
+struct gallivm_code;
+struct gallivm_code_cache;
 
 struct draw_jit_texture
 {
@@ -282,7 +285,9 @@ typedef int
 
 typedef int
 (*draw_gs_jit_func)(struct draw_gs_jit_context *context,
-                    float inputs[6][PIPE_MAX_SHADER_INPUTS][TGSI_NUM_CHANNELS][TGSI_NUM_CHANNELS],
+                    const void *input,
+                    const int *input_offsets,
+                    const int *input_slots,
                     struct vertex_header *output,
                     unsigned num_prims,
                     unsigned instance_id,
@@ -378,6 +383,7 @@ struct draw_gs_llvm_variant_list_item
 
 struct draw_llvm_variant
 {
+   /* LLVM objects, owned by the code object if any, NULL on cache hits */
    struct gallivm_state *gallivm;
 
    /* LLVM JIT builder types */
@@ -391,12 +397,18 @@ struct draw_llvm_variant
    draw_jit_vert_func jit_func;
    draw_jit_vert_func_elts jit_func_elts;
 
+   /** The JIT'd code, possibly shared with other contexts */
+   struct gallivm_code *code;
+
    struct llvm_vertex_shader *shader;
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant_list_item list_item_global;
    struct draw_llvm_variant_list_item list_item_local;
 
+   /* index in draw_llvm::vs_variants_hash */
+   unsigned hash;
+
    /* key is variable-sized, must be last */
    struct draw_llvm_variant_key key;
 };
@@ -409,7 +421,6 @@ struct draw_gs_llvm_variant
    /* LLVM JIT builder types */
    LLVMTypeRef context_ptr_type;
    LLVMTypeRef vertex_header_ptr_type;
-   LLVMTypeRef input_array_type;
 
    LLVMValueRef context_ptr;
    LLVMValueRef io_ptr;
@@ -423,6 +434,9 @@ struct draw_gs_llvm_variant
    struct draw_gs_llvm_variant_list_item list_item_global;
    struct draw_gs_llvm_variant_list_item list_item_local;
 
+   /* index in draw_llvm::gs_variants_hash */
+   unsigned hash;
+
    /* key is variable-sized, must be last */
    struct draw_gs_llvm_variant_key key;
 };
@@ -453,10 +467,15 @@ struct draw_llvm {
    struct draw_gs_jit_context gs_jit_context;
 
    struct draw_llvm_variant_list_item vs_variants_list;
+   struct cso_hash *vs_variants_hash;
    int nr_variants;
 
    struct draw_gs_llvm_variant_list_item gs_variants_list;
+   struct cso_hash *gs_variants_hash;
    int nr_gs_variants;
+
+   /** Vertex shader code shared with other contexts, may be NULL */
+   struct gallivm_code_cache *code_cache;
 };
 
 
@@ -489,6 +508,10 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
 void
 draw_llvm_destroy_variant(struct draw_llvm_variant *variant);
 
+struct draw_llvm_variant *
+draw_llvm_find_variant(struct draw_llvm *llvm,
+                       const struct draw_llvm_variant_key *key);
+
 struct draw_llvm_variant_key *
 draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store);
 
@@ -504,6 +527,10 @@ draw_gs_llvm_create_variant(struct draw_llvm *llvm,
 void
 draw_gs_llvm_destroy_variant(struct draw_gs_llvm_variant *variant);
 
+struct draw_gs_llvm_variant *
+draw_gs_llvm_find_variant(struct draw_llvm *llvm,
+                          const struct draw_gs_llvm_variant_key *key);
+
 struct draw_gs_llvm_variant_key *
 draw_gs_llvm_make_variant_key(struct draw_llvm *llvm, char *store);
 
@@ -25,6 +25,9 @@
  *
  **************************************************************************/
 
+#include "os/os_thread.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
@@ -39,6 +42,51 @@
 #include "gallivm/lp_bld_init.h"
 
 
+/** Most threads fetching and shading the vertices of a draw */
+#define DRAW_VS_MAX_THREADS 8
+
+/** Draws fetching fewer vertices are shaded by the calling thread alone */
+#define DRAW_VS_MT_MIN_VERTICES 1024
+
+/** Don't split draws into smaller chunks than this */
+#define DRAW_VS_MT_MIN_CHUNK 256
+
+
+struct llvm_middle_end;
+
+
+struct llvm_vs_job {
+   struct llvm_vs_mt *mt;
+
+   unsigned begin, end;   /**< range of fetched vertices */
+   int clipped;
+
+   /* Not used by jobs[0], which runs in the calling thread */
+   pipe_semaphore work_ready;
+   pipe_semaphore work_done;
+   pipe_thread thread;
+};
+
+
+/**
+ * Threads shading the vertices of large draws: the fetched vertices are
+ * split into contiguous chunks, one per thread, and each thread runs the
+ * fetch/shade/cliptest code for its chunk straight into its part of the
+ * vertex buffer, so the results are in order when all threads are done.
+ */
+struct llvm_vs_mt {
+   unsigned num_jobs;   /**< including the calling thread */
+   struct llvm_vs_job jobs[DRAW_VS_MAX_THREADS];
+
+   /** The current draw */
+   struct llvm_middle_end *fpme;
+   const struct draw_fetch_info *fetch_info;
+   struct vertex_header *verts;
+
+   boolean exit_flag;
+};
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -56,9 +104,16 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   unsigned num_vs_threads;
+   struct llvm_vs_mt *vs_mt;
 };
 
 
+DEBUG_GET_ONCE_NUM_OPTION(draw_num_vs_threads, "DRAW_NUM_VS_THREADS",
+                          MIN2(util_cpu_caps.nr_cpus, DRAW_VS_MAX_THREADS))
+
+
 static void
 llvm_middle_end_prepare_gs(struct llvm_middle_end *fpme)
 {
@@ -66,22 +121,14 @@ llvm_middle_end_prepare_gs(struct llvm_middle_end *fpme)
    struct draw_geometry_shader *gs = draw->gs.geometry_shader;
    struct draw_gs_llvm_variant_key *key;
    struct draw_gs_llvm_variant *variant = NULL;
-   struct draw_gs_llvm_variant_list_item *li;
    struct llvm_geometry_shader *shader = llvm_geometry_shader(gs);
    char store[DRAW_GS_LLVM_MAX_VARIANT_KEY_SIZE];
    unsigned i;
 
    key = draw_gs_llvm_make_variant_key(fpme->llvm, store);
 
-   /* Search shader's list of variants for the key */
-   li = first_elem(&shader->variants);
-   while (!at_end(&shader->variants, li)) {
-      if (memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
-         variant = li->base;
-         break;
-      }
-      li = next_elem(li);
-   }
+   /* Search the variants for the key */
+   variant = draw_gs_llvm_find_variant(fpme->llvm, key);
 
    if (variant) {
       /* found the variant, move to head of global list (for LRU) */
@@ -184,22 +231,14 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
    {
       struct draw_llvm_variant_key *key;
       struct draw_llvm_variant *variant = NULL;
-      struct draw_llvm_variant_list_item *li;
       struct llvm_vertex_shader *shader = llvm_vertex_shader(vs);
       char store[DRAW_LLVM_MAX_VARIANT_KEY_SIZE];
       unsigned i;
 
       key = draw_llvm_make_variant_key(fpme->llvm, store);
 
-      /* Search shader's list of variants for the key */
-      li = first_elem(&shader->variants);
-      while (!at_end(&shader->variants, li)) {
-         if (memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
-            variant = li->base;
-            break;
-         }
-         li = next_elem(li);
-      }
+      /* Search the variants for the key */
+      variant = draw_llvm_find_variant(fpme->llvm, key);
 
       if (variant) {
          /* found the variant, move to head of global list (for LRU) */
@@ -304,6 +343,183 @@ static void emit(struct pt_emit *emit,
    }
 }
 
+/**
+ * Fetch, shade and clip test fetched vertices [begin, end) into verts.
+ * Returns non-zero if any of them needs clipping.
+ */
+static int
+llvm_shade_vertices(struct llvm_middle_end *fpme,
+                    const struct draw_fetch_info *fetch_info,
+                    struct vertex_header *verts,
+                    unsigned begin, unsigned end)
+{
+   struct draw_context *draw = fpme->draw;
+   struct vertex_header *io = (struct vertex_header *)
+      ((char *)verts + begin * fpme->vertex_size);
+
+   if (fetch_info->linear)
+      return fpme->current_variant->jit_func( &fpme->llvm->jit_context,
+                                       io,
+                                       draw->pt.user.vbuffer,
+                                       fetch_info->start + begin,
+                                       end - begin,
+                                       fpme->vertex_size,
+                                       draw->pt.vertex_buffer,
+                                       draw->instance_id,
+                                       draw->start_index);
+   else
+      return fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
+                                            io,
+                                            draw->pt.user.vbuffer,
+                                            fetch_info->elts + begin,
+                                            draw->pt.user.eltMax - begin,
+                                            end - begin,
+                                            fpme->vertex_size,
+                                            draw->pt.vertex_buffer,
+                                            draw->instance_id,
+                                            draw->pt.user.eltBias);
+}
+
+
+static void
+llvm_vs_run_job(struct llvm_vs_job *job)
+{
+   struct llvm_vs_mt *mt = job->mt;
+
+   job->clipped = llvm_shade_vertices(mt->fpme, mt->fetch_info, mt->verts,
+                                      job->begin, job->end);
+}
+
+
+static PIPE_THREAD_ROUTINE( llvm_vs_thread, init_data )
+{
+   struct llvm_vs_job *job = (struct llvm_vs_job *) init_data;
+
+   while (1) {
+      pipe_semaphore_wait(&job->work_ready);
+
+      if (job->mt->exit_flag)
+         break;
+
+      llvm_vs_run_job(job);
+
+      pipe_semaphore_signal(&job->work_done);
+   }
+
+   return NULL;
+}
+
+
+static struct llvm_vs_mt *
+llvm_vs_mt_create(unsigned num_threads)
+{
+   struct llvm_vs_mt *mt = CALLOC_STRUCT(llvm_vs_mt);
+   unsigned i;
+
+   if (!mt)
+      return NULL;
+
+   mt->num_jobs = MIN2(num_threads, DRAW_VS_MAX_THREADS);
+
+   for (i = 0; i < mt->num_jobs; i++) {
+      struct llvm_vs_job *job = &mt->jobs[i];
+
+      job->mt = mt;
+
+      if (i > 0) {
+         pipe_semaphore_init(&job->work_ready, 0);
+         pipe_semaphore_init(&job->work_done, 0);
+         job->thread = pipe_thread_create(llvm_vs_thread, job);
+      }
+   }
+
+   return mt;
+}
+
+
+static void
+llvm_vs_mt_destroy(struct llvm_vs_mt *mt)
+{
+   unsigned i;
+
+   mt->exit_flag = TRUE;
+
+   for (i = 1; i < mt->num_jobs; i++) {
+      pipe_semaphore_signal(&mt->jobs[i].work_ready);
+   }
+
+   for (i = 1; i < mt->num_jobs; i++) {
+      pipe_thread_wait(mt->jobs[i].thread);
+      pipe_semaphore_destroy(&mt->jobs[i].work_ready);
+      pipe_semaphore_destroy(&mt->jobs[i].work_done);
+   }
+
+   FREE(mt);
+}
+
+
+/**
+ * Fetch, shade and clip test all the vertices of a draw, splitting large
+ * draws among the vertex shading threads.
+ */
+static int
+llvm_shade_draw(struct llvm_middle_end *fpme,
+                const struct draw_fetch_info *fetch_info,
+                struct vertex_header *verts)
+{
+   const unsigned count = fetch_info->count;
+   const unsigned vector_length = lp_native_vector_width / 32;
+   struct llvm_vs_mt *mt;
+   unsigned num_jobs, chunk;
+   int clipped = 0;
+   unsigned i;
+
+   if (fpme->num_vs_threads < 2 ||
+       count < DRAW_VS_MT_MIN_VERTICES ||
+       (!fetch_info->linear && count > fpme->draw->pt.user.eltMax))
+      return llvm_shade_vertices(fpme, fetch_info, verts, 0, count);
+
+   if (!fpme->vs_mt) {
+      fpme->vs_mt = llvm_vs_mt_create(fpme->num_vs_threads);
+      if (!fpme->vs_mt) {
+         fpme->num_vs_threads = 0;
+         return llvm_shade_vertices(fpme, fetch_info, verts, 0, count);
+      }
+   }
+
+   mt = fpme->vs_mt;
+   mt->fpme = fpme;
+   mt->fetch_info = fetch_info;
+   mt->verts = verts;
+
+   num_jobs = MIN2(mt->num_jobs, count / DRAW_VS_MT_MIN_CHUNK);
+
+   /* Whole vectors per chunk, so that no thread writes past its chunk */
+   chunk = align((count + num_jobs - 1) / num_jobs, vector_length);
+
+   for (i = 0; i < num_jobs; i++) {
+      struct llvm_vs_job *job = &mt->jobs[i];
+
+      job->begin = MIN2(i * chunk, count);
+      job->end = MIN2(job->begin + chunk, count);
+      job->clipped = 0;
+
+      if (i > 0)
+         pipe_semaphore_signal(&job->work_ready);
+   }
+
+   llvm_vs_run_job(&mt->jobs[0]);
+   clipped = mt->jobs[0].clipped;
+
+   for (i = 1; i < num_jobs; i++) {
+      pipe_semaphore_wait(&mt->jobs[i].work_done);
+      clipped |= mt->jobs[i].clipped;
+   }
+
+   return clipped;
+}
+
+
 static void
 llvm_pipeline_generic( struct draw_pt_middle_end *middle,
                        const struct draw_fetch_info *fetch_info,
@@ -341,27 +557,7 @@ llvm_pipeline_generic( struct draw_pt_middle_end *middle,
       draw->statistics.vs_invocations += fetch_info->count;
    }
 
-   if (fetch_info->linear)
-      clipped = fpme->current_variant->jit_func( &fpme->llvm->jit_context,
-                                       llvm_vert_info.verts,
-                                       draw->pt.user.vbuffer,
-                                       fetch_info->start,
-                                       fetch_info->count,
-                                       fpme->vertex_size,
-                                       draw->pt.vertex_buffer,
-                                       draw->instance_id,
-                                       draw->start_index);
-   else
-      clipped = fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
-                                            llvm_vert_info.verts,
-                                            draw->pt.user.vbuffer,
-                                            fetch_info->elts,
-                                            draw->pt.user.eltMax,
-                                            fetch_info->count,
-                                            fpme->vertex_size,
-                                            draw->pt.vertex_buffer,
-                                            draw->instance_id,
-                                            draw->pt.user.eltBias);
+   clipped = llvm_shade_draw(fpme, fetch_info, llvm_vert_info.verts);
 
    /* Finished with fetch and vs:
     */
@@ -538,6 +734,9 @@ static void llvm_middle_end_destroy( struct draw_pt_middle_end *middle )
 {
    struct llvm_middle_end *fpme = (struct llvm_middle_end *)middle;
 
+   if (fpme->vs_mt)
+      llvm_vs_mt_destroy( fpme->vs_mt );
+
    if (fpme->fetch)
       draw_pt_fetch_destroy( fpme->fetch );
 
@@ -598,6 +797,11 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   /* The threads are only started by the first large draw */
+#ifndef PIPE_SUBSYSTEM_EMBEDDED
+   fpme->num_vs_threads = debug_get_option_draw_num_vs_threads();
+#endif
+
    return &fpme->base;
 
  fail:
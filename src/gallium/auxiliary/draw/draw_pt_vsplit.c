@@ -23,6 +23,7 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 
@@ -30,8 +31,11 @@
 #include "draw/draw_private.h"
 #include "draw/draw_pt.h"
 
-#define SEGMENT_SIZE 1024
-#define MAP_SIZE     256
+#define SEGMENT_SIZE 4096
+
+/* Default number of vertex cache entries, and entries per set */
+#define CACHE_SIZE   4096
+#define CACHE_WAYS   4
 
 /* The largest possible index withing an index buffer */
 #define MAX_ELT_IDX 0xffffffff
@@ -52,11 +56,17 @@ struct vsplit_frontend {
    ushort draw_elts[SEGMENT_SIZE];
    ushort identity_draw_elts[SEGMENT_SIZE];
 
+   /*
+    * Post-transform vertex cache, mapping a fetch element to the draw
+    * element of its first occurrence in the segment.  The cache is
+    * set-associative, indexed by a hash of the fetch element.  An entry
+    * is only valid if it points into the fetch elements of the current
+    * segment and the fetch element there matches, so that the cache never
+    * needs to be cleared.
+    */
    struct {
-      /* map a fetch element to a draw element */
-      unsigned fetches[MAP_SIZE];
-      ushort draws[MAP_SIZE];
-      boolean has_max_fetch;
+      ushort *draws;
+      unsigned set_shift;
 
       ushort num_fetch_elts;
       ushort num_draw_elts;
@@ -64,11 +74,12 @@ struct vsplit_frontend {
 };
 
 
+DEBUG_GET_ONCE_NUM_OPTION(vsplit_cache_size, "DRAW_VSPLIT_CACHE_SIZE", CACHE_SIZE)
+
+
 static void
 vsplit_clear_cache(struct vsplit_frontend *vsplit)
 {
-   memset(vsplit->cache.fetches, 0xff, sizeof(vsplit->cache.fetches));
-   vsplit->cache.has_max_fetch = FALSE;
    vsplit->cache.num_fetch_elts = 0;
    vsplit->cache.num_draw_elts = 0;
 }
@@ -87,23 +98,40 @@ vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 static INLINE void
 vsplit_add_cache(struct vsplit_frontend *vsplit, unsigned fetch, unsigned ofbias)
 {
-   unsigned hash;
-
-   hash = fetch % MAP_SIZE;
-
-   /* If the value isn't in the cache of it's an overflow due to the
-    * element bias */
-   if (vsplit->cache.fetches[hash] != fetch || ofbias) {
-      /* update cache */
-      vsplit->cache.fetches[hash] = fetch;
-      vsplit->cache.draws[hash] = vsplit->cache.num_fetch_elts;
+   ushort *set;
+   ushort draw;
+   unsigned i;
+
+   set = vsplit->cache.draws +
+      ((fetch * 2654435761u) >> vsplit->cache.set_shift) * CACHE_WAYS;
+
+   /* Overflows due to the element bias are never looked up */
+   if (!ofbias) {
+      for (i = 0; i < CACHE_WAYS; i++) {
+         draw = set[i];
+         if (draw < vsplit->cache.num_fetch_elts &&
+             vsplit->fetch_elts[draw] == fetch) {
+            vsplit->draw_elts[vsplit->cache.num_draw_elts++] = draw;
+            return;
+         }
+      }
+   }
 
-      /* add fetch */
-      assert(vsplit->cache.num_fetch_elts < vsplit->segment_size);
-      vsplit->fetch_elts[vsplit->cache.num_fetch_elts++] = fetch;
+   /* replace a stale entry, or evict one */
+   for (i = 0; i < CACHE_WAYS; i++) {
+      if (set[i] >= vsplit->cache.num_fetch_elts)
+         break;
    }
+   if (i == CACHE_WAYS)
+      i = vsplit->cache.num_fetch_elts % CACHE_WAYS;
+
+   /* add fetch */
+   assert(vsplit->cache.num_fetch_elts < vsplit->segment_size);
+   draw = vsplit->cache.num_fetch_elts++;
+   vsplit->fetch_elts[draw] = fetch;
+   set[i] = draw;
 
-   vsplit->draw_elts[vsplit->cache.num_draw_elts++] = vsplit->cache.draws[hash];
+   vsplit->draw_elts[vsplit->cache.num_draw_elts++] = draw;
 }
 
 /**
@@ -198,16 +226,7 @@ vsplit_add_cache_uint(struct vsplit_frontend *vsplit, const uint *elts,
                       unsigned start, unsigned fetch, int elt_bias)
 {
    struct draw_context *draw = vsplit->draw;
-   unsigned raw_elem_idx = start + fetch + elt_bias;
    VSPLIT_CREATE_IDX(elts, start, fetch, elt_bias);
-
-   /* special care for DRAW_MAX_FETCH_IDX */
-   if (raw_elem_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = fetch % MAP_SIZE;
-      vsplit->cache.fetches[hash] = raw_elem_idx - 1; /* force update */
-      vsplit->cache.has_max_fetch = TRUE;
-   }
-
    vsplit_add_cache(vsplit, elt_idx, ofbias);
 }
 
@@ -279,6 +298,9 @@ static void vsplit_flush(struct draw_pt_front_end *frontend, unsigned flags)
 
 static void vsplit_destroy(struct draw_pt_front_end *frontend)
 {
+   struct vsplit_frontend *vsplit = (struct vsplit_frontend *) frontend;
+
+   FREE(vsplit->cache.draws);
    FREE(frontend);
 }
 
@@ -286,11 +308,21 @@ static void vsplit_destroy(struct draw_pt_front_end *frontend)
 struct draw_pt_front_end *draw_pt_vsplit(struct draw_context *draw)
 {
    struct vsplit_frontend *vsplit = CALLOC_STRUCT(vsplit_frontend);
+   unsigned cache_size;
    ushort i;
 
    if (!vsplit)
       return NULL;
 
+   cache_size = util_next_power_of_two(
+      CLAMP(debug_get_option_vsplit_cache_size(), 4 * CACHE_WAYS, 65536));
+   vsplit->cache.set_shift = 32 - util_logbase2(cache_size / CACHE_WAYS);
+   vsplit->cache.draws = CALLOC(cache_size, sizeof(ushort));
+   if (!vsplit->cache.draws) {
+      FREE(vsplit);
+      return NULL;
+   }
+
    vsplit->base.prepare = vsplit_prepare;
    vsplit->base.run     = NULL;
    vsplit->base.flush   = vsplit_flush;
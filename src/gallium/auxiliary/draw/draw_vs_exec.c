@@ -80,6 +80,79 @@ vs_exec_prepare( struct draw_vertex_shader *shader,
  * complexity of code-generating all the above operations together,
  * it's time to try doing all the other stuff separately.
  */
+/**
+ * Like vs_exec_run_linear(), for shaders the machine can run on more than
+ * a quad of vertices at once (see tgsi_exec_machine_run_wide()).
+ */
+static void
+vs_exec_run_linear_wide( struct draw_vertex_shader *shader,
+                         const float (*input)[4],
+                         float (*output)[4],
+                         unsigned count,
+                         unsigned input_stride,
+                         unsigned output_stride,
+                         unsigned width )
+{
+   struct exec_vertex_shader *evs = exec_vertex_shader(shader);
+   struct tgsi_exec_machine *machine = evs->machine;
+   struct tgsi_exec_wide_vector *inputs = machine->WideInputs;
+   const struct tgsi_exec_wide_vector *outputs = machine->WideOutputs;
+   unsigned int i, j;
+   unsigned slot;
+   boolean clamp_vertex_color = shader->draw->rasterizer->clamp_vertex_color;
+
+   for (i = 0; i < count; i += width) {
+      unsigned int max_vertices = MIN2(width, count - i);
+
+      /* Swizzle inputs.
+       */
+      for (j = 0; j < max_vertices; j++) {
+         for (slot = 0; slot < shader->info.num_inputs; slot++) {
+            inputs[slot].xyzw[0].f[j] = input[slot][0];
+            inputs[slot].xyzw[1].f[j] = input[slot][1];
+            inputs[slot].xyzw[2].f[j] = input[slot][2];
+            inputs[slot].xyzw[3].f[j] = input[slot][3];
+         }
+
+	 input = (const float (*)[4])((const char *)input + input_stride);
+      }
+
+      /* run interpreter, on whole quads */
+      tgsi_exec_machine_run_wide(machine, align(max_vertices, TGSI_QUAD_SIZE));
+
+      /* Unswizzle all output results.
+       */
+      for (j = 0; j < max_vertices; j++) {
+         for (slot = 0; slot < shader->info.num_outputs; slot++) {
+            unsigned name = shader->info.output_semantic_name[slot];
+            if(clamp_vertex_color &&
+                  (name == TGSI_SEMANTIC_COLOR || name == TGSI_SEMANTIC_BCOLOR))
+            {
+               output[slot][0] = CLAMP(outputs[slot].xyzw[0].f[j], 0.0f, 1.0f);
+               output[slot][1] = CLAMP(outputs[slot].xyzw[1].f[j], 0.0f, 1.0f);
+               output[slot][2] = CLAMP(outputs[slot].xyzw[2].f[j], 0.0f, 1.0f);
+               output[slot][3] = CLAMP(outputs[slot].xyzw[3].f[j], 0.0f, 1.0f);
+            }
+            else if (name == TGSI_SEMANTIC_FOG) {
+               output[slot][0] = outputs[slot].xyzw[0].f[j];
+               output[slot][1] = 0;
+               output[slot][2] = 0;
+               output[slot][3] = 1;
+            }
+            else {
+               output[slot][0] = outputs[slot].xyzw[0].f[j];
+               output[slot][1] = outputs[slot].xyzw[1].f[j];
+               output[slot][2] = outputs[slot].xyzw[2].f[j];
+               output[slot][3] = outputs[slot].xyzw[3].f[j];
+            }
+         }
+
+	 output = (float (*)[4])((char *)output + output_stride);
+      }
+   }
+}
+
+
 static void
 vs_exec_run_linear( struct draw_vertex_shader *shader,
 		    const float (*input)[4],
@@ -99,6 +172,14 @@ vs_exec_run_linear( struct draw_vertex_shader *shader,
    tgsi_exec_set_constant_buffers(machine, PIPE_MAX_CONSTANT_BUFFERS,
                                   constants, const_size);
 
+   if (count > TGSI_QUAD_SIZE &&
+       tgsi_exec_machine_width(machine) > TGSI_QUAD_SIZE) {
+      vs_exec_run_linear_wide(shader, input, output, count,
+                              input_stride, output_stride,
+                              tgsi_exec_machine_width(machine));
+      return;
+   }
+
    if (shader->info.uses_instanceid) {
       unsigned i = machine->SysSemanticToIndex[TGSI_SEMANTIC_INSTANCEID];
       assert(i < Elements(machine->SystemValue));
@@ -0,0 +1,378 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * In-memory cache of JIT'd code.
+ *
+ * The entries are kept in a hash table indexed by a hash of their key, and
+ * in a list ordered from most to least recently used.  Reference counts of
+ * cached code are only changed with the cache mutex held, which makes
+ * looking up an entry and releasing the last reference to it atomic with
+ * respect to each other.
+ */
+
+
+#include "util/u_debug.h"
+#include "util/u_hash.h"
+#include "util/u_memory.h"
+#include "util/u_simple_list.h"
+#include "os/os_thread.h"
+#include "cso_cache/cso_hash.h"
+
+#include "lp_bld_init.h"
+#include "lp_bld_code_cache.h"
+
+
+struct gallivm_code_cache
+{
+   pipe_mutex mutex;
+
+   struct cso_hash *hash;
+
+   /** Most recently used first */
+   struct gallivm_code lru;
+
+   unsigned max_entries;
+
+   struct gallivm_code_cache_stats stats;
+};
+
+
+/**
+ * Create a code object for the given gallivm, with a single reference.
+ * The caller fills in the functions once they are compiled.
+ */
+struct gallivm_code *
+gallivm_code_create(struct gallivm_state *gallivm)
+{
+   struct gallivm_code *code = CALLOC_STRUCT(gallivm_code);
+
+   if (code) {
+      code->gallivm = gallivm;
+      code->reference = 1;
+   }
+
+   return code;
+}
+
+
+/**
+ * Free the JIT'd functions, the gallivm and the code object.
+ */
+void
+gallivm_code_destroy(struct gallivm_code *code)
+{
+   unsigned i;
+
+   assert(!code->cache);
+
+   if (code->gallivm) {
+      for (i = 0; i < code->num_functions; i++) {
+         if (code->functions[i]) {
+            gallivm_free_function(code->gallivm,
+                                  code->functions[i],
+                                  func_to_pointer(code->jit_functions[i]));
+         }
+      }
+
+      gallivm_destroy(code->gallivm);
+   }
+
+   gallivm_cache_key_release(&code->key);
+   FREE(code);
+}
+
+
+static void
+release_code(struct gallivm_code *code)
+{
+   if (code->destroy)
+      code->destroy(code, code->destroy_data);
+   else
+      gallivm_code_destroy(code);
+}
+
+
+/**
+ * Drop a reference to code, with the cache mutex held if it is cached.
+ * Returns TRUE if it was the last one.
+ */
+static INLINE boolean
+unreference_locked(struct gallivm_code *code)
+{
+   assert(code->reference > 0);
+   return --code->reference == 0;
+}
+
+
+void
+gallivm_code_reference(struct gallivm_code **ptr, struct gallivm_code *code)
+{
+   struct gallivm_code *old = *ptr;
+   boolean release = FALSE;
+
+   if (old == code)
+      return;
+
+   if (code) {
+      if (code->cache) {
+         pipe_mutex_lock(code->cache->mutex);
+         code->reference++;
+         pipe_mutex_unlock(code->cache->mutex);
+      }
+      else {
+         code->reference++;
+      }
+   }
+
+   if (old) {
+      struct gallivm_code_cache *cache = old->cache;
+
+      if (cache) {
+         pipe_mutex_lock(cache->mutex);
+         release = unreference_locked(old);
+         pipe_mutex_unlock(cache->mutex);
+      }
+      else {
+         release = unreference_locked(old);
+      }
+   }
+
+   *ptr = code;
+
+   if (release)
+      release_code(old);
+}
+
+
+/**
+ * Create a cache keeping up to max_entries unused code objects.
+ */
+struct gallivm_code_cache *
+gallivm_code_cache_create(unsigned max_entries)
+{
+   struct gallivm_code_cache *cache = CALLOC_STRUCT(gallivm_code_cache);
+
+   if (!cache)
+      return NULL;
+
+   cache->hash = cso_hash_create();
+   if (!cache->hash) {
+      FREE(cache);
+      return NULL;
+   }
+
+   pipe_mutex_init(cache->mutex);
+   make_empty_list(&cache->lru);
+   cache->max_entries = max_entries;
+
+   return cache;
+}
+
+
+/**
+ * Remove an entry, with the mutex held.  Returns TRUE if the cache held
+ * the last reference.
+ */
+static boolean
+remove_entry_locked(struct gallivm_code_cache *cache,
+                    struct gallivm_code *code)
+{
+   cso_hash_erase_data(cache->hash, code->hash, code);
+   remove_from_list(code);
+   code->cache = NULL;
+
+   cache->stats.entries--;
+   cache->stats.nr_instrs -= code->nr_instrs;
+
+   return unreference_locked(code);
+}
+
+
+/**
+ * Destroy the cache.  Code still in use by variants lives on, uncached.
+ */
+void
+gallivm_code_cache_destroy(struct gallivm_code_cache *cache)
+{
+   while (!is_empty_list(&cache->lru)) {
+      struct gallivm_code *code = last_elem(&cache->lru);
+      boolean release;
+
+      pipe_mutex_lock(cache->mutex);
+      release = remove_entry_locked(cache, code);
+      pipe_mutex_unlock(cache->mutex);
+
+      if (release)
+         release_code(code);
+   }
+
+   cso_hash_delete(cache->hash);
+   pipe_mutex_destroy(cache->mutex);
+   FREE(cache);
+}
+
+
+static INLINE unsigned
+key_hash(const struct gallivm_cache_key *key)
+{
+   return util_hash_fast(key->data, key->size);
+}
+
+
+static struct gallivm_code *
+find_locked(struct gallivm_code_cache *cache,
+            const struct gallivm_cache_key *key,
+            unsigned hash)
+{
+   struct cso_hash_iter iter = cso_hash_find(cache->hash, hash);
+
+   while (!cso_hash_iter_is_null(iter) && cso_hash_iter_key(iter) == hash) {
+      struct gallivm_code *code = cso_hash_iter_data(iter);
+
+      if (code->key.size == key->size &&
+          memcmp(code->key.data, key->data, key->size) == 0)
+         return code;
+
+      iter = cso_hash_iter_next(iter);
+   }
+
+   return NULL;
+}
+
+
+/**
+ * Find the code built for the key.  Returns a new reference, or NULL.
+ */
+struct gallivm_code *
+gallivm_code_cache_lookup(struct gallivm_code_cache *cache,
+                          const struct gallivm_cache_key *key)
+{
+   struct gallivm_code *code;
+   unsigned hash;
+
+   if (!key->data)
+      return NULL;
+
+   hash = key_hash(key);
+
+   pipe_mutex_lock(cache->mutex);
+
+   code = find_locked(cache, key, hash);
+   if (code) {
+      code->reference++;
+      move_to_head(&cache->lru, code);
+      cache->stats.hits++;
+   }
+   else {
+      cache->stats.misses++;
+   }
+
+   pipe_mutex_unlock(cache->mutex);
+
+   return code;
+}
+
+
+/**
+ * Add compiled code to the cache, unless another context got there first,
+ * in which case the code simply stays private to its user.
+ */
+void
+gallivm_code_cache_add(struct gallivm_code_cache *cache,
+                       struct gallivm_code *code,
+                       const struct gallivm_cache_key *key)
+{
+   struct gallivm_code *evicted[8];
+   unsigned num_evicted = 0;
+   struct gallivm_code *victim;
+   unsigned hash;
+   unsigned i;
+
+   assert(!code->cache);
+
+   if (!key->data)
+      return;
+
+   code->key.data = MALLOC(key->size);
+   if (!code->key.data)
+      return;
+   memcpy(code->key.data, key->data, key->size);
+   code->key.size = code->key.capacity = key->size;
+
+   hash = key_hash(key);
+
+   pipe_mutex_lock(cache->mutex);
+
+   if (find_locked(cache, key, hash)) {
+      pipe_mutex_unlock(cache->mutex);
+      gallivm_cache_key_release(&code->key);
+      return;
+   }
+
+   code->cache = cache;
+   code->hash = hash;
+   code->reference++;
+   cso_hash_insert(cache->hash, hash, code);
+   insert_at_head(&cache->lru, code);
+
+   cache->stats.entries++;
+   cache->stats.nr_instrs += code->nr_instrs;
+
+   /* Evict the least recently used code nothing else refers to */
+   victim = last_elem(&cache->lru);
+   while (cache->stats.entries > cache->max_entries &&
+          num_evicted < Elements(evicted) &&
+          !at_end(&cache->lru, victim)) {
+      struct gallivm_code *prev = prev_elem(victim);
+
+      if (victim->reference == 1) {
+         remove_entry_locked(cache, victim);
+         evicted[num_evicted++] = victim;
+      }
+
+      victim = prev;
+   }
+
+   pipe_mutex_unlock(cache->mutex);
+
+   for (i = 0; i < num_evicted; i++) {
+      release_code(evicted[i]);
+   }
+}
+
+
+void
+gallivm_code_cache_get_stats(struct gallivm_code_cache *cache,
+                             struct gallivm_code_cache_stats *stats)
+{
+   pipe_mutex_lock(cache->mutex);
+   *stats = cache->stats;
+   pipe_mutex_unlock(cache->mutex);
+}
@@ -0,0 +1,129 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * In-memory cache of JIT'd code, shared by all the contexts of a screen.
+ *
+ * Code is looked up with the same content keys as the disk cache, so
+ * contexts creating identical variants of identical shaders only compile
+ * them once.  Code objects are reference counted: every variant using one
+ * holds a reference, and so does the cache while the code is in it, which
+ * keeps unused code around for later contexts.  Only code no variant uses
+ * is evicted, least recently used first.
+ *
+ * All the functions are thread safe.
+ */
+
+
+#ifndef LP_BLD_CODE_CACHE_H
+#define LP_BLD_CODE_CACHE_H
+
+
+#include "pipe/p_compiler.h"
+#include "util/u_pointer.h"
+#include "gallivm/lp_bld.h"
+#include "gallivm/lp_bld_disk_cache.h"
+
+
+#define GALLIVM_CODE_MAX_FUNCTIONS 2
+
+
+struct gallivm_state;
+struct gallivm_code_cache;
+
+
+/**
+ * A module's JIT'd functions.
+ */
+struct gallivm_code
+{
+   struct gallivm_state *gallivm;
+   unsigned num_functions;
+   LLVMValueRef functions[GALLIVM_CODE_MAX_FUNCTIONS];
+   func_pointer jit_functions[GALLIVM_CODE_MAX_FUNCTIONS];
+
+   /** Number of LLVM instructions, for statistics */
+   unsigned nr_instrs;
+
+   /**
+    * Called instead of gallivm_code_destroy() when the last reference
+    * goes away, e.g. to destroy code living in another thread's LLVM
+    * context in that thread.
+    */
+   void (*destroy)(struct gallivm_code *code, void *data);
+   void *destroy_data;
+
+   /* Private to the cache */
+   unsigned reference;
+   struct gallivm_code_cache *cache;
+   unsigned hash;
+   struct gallivm_cache_key key;
+   struct gallivm_code *prev, *next;
+};
+
+
+struct gallivm_code_cache_stats
+{
+   unsigned entries;
+   unsigned nr_instrs;  /**< LLVM instructions of the cached code */
+   unsigned hits;
+   unsigned misses;
+};
+
+
+struct gallivm_code *
+gallivm_code_create(struct gallivm_state *gallivm);
+
+void
+gallivm_code_destroy(struct gallivm_code *code);
+
+void
+gallivm_code_reference(struct gallivm_code **ptr, struct gallivm_code *code);
+
+struct gallivm_code_cache *
+gallivm_code_cache_create(unsigned max_entries);
+
+void
+gallivm_code_cache_destroy(struct gallivm_code_cache *cache);
+
+struct gallivm_code *
+gallivm_code_cache_lookup(struct gallivm_code_cache *cache,
+                          const struct gallivm_cache_key *key);
+
+void
+gallivm_code_cache_add(struct gallivm_code_cache *cache,
+                       struct gallivm_code *code,
+                       const struct gallivm_cache_key *key);
+
+void
+gallivm_code_cache_get_stats(struct gallivm_code_cache *cache,
+                             struct gallivm_code_cache_stats *stats);
+
+
+#endif /* !LP_BLD_CODE_CACHE_H */
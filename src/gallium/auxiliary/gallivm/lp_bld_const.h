@@ -147,6 +147,10 @@ lp_build_const_int_pointer(struct gallivm_state *gallivm, const void *ptr)
    v = LLVMBuildIntToPtr(gallivm->builder, v,
                          LLVMPointerType(int_type, 0),
                          "cast int to ptr");
+
+   /* Only meaningful in this process */
+   gallivm->cache_unsafe = TRUE;
+
    return v;
 }
 
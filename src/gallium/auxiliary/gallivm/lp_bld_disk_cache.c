@@ -0,0 +1,705 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Persistent on-disk cache of optimized LLVM modules.
+ *
+ * Each entry is a file named after two hashes of the key, containing a
+ * header, the full key (compared on load, so hash collisions are harmless),
+ * the names of the entry points, and finally the module bitcode.
+ *
+ * Entries are written to a temporary file and renamed into place, so
+ * several processes may share the same directory.  When the directory grows
+ * past GALLIVM_CACHE_SIZE megabytes the least recently used entries (by
+ * modification time, which is refreshed on every hit) are removed.
+ *
+ * We only cache the optimized IR, not machine code: the JIT resolves
+ * symbols and constant pools to absolute addresses that are meaningless in
+ * another process.  For the same reason modules that embed host pointers
+ * (see lp_build_const_int_pointer) are never stored.
+ *
+ * Keys include the build id of the binary containing this code (the GNU
+ * build-id ELF note, or failing that the size and modification time of
+ * the file), so entries written by any other build are never used.
+ */
+
+
+#include "pipe/p_config.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
+#include "util/u_hash.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_string.h"
+#include "os/os_thread.h"
+
+#include "lp_bld.h"
+#include "lp_bld_debug.h"
+#include "lp_bld_init.h"
+#include "lp_bld_type.h"
+#include "lp_bld_disk_cache.h"
+
+#if defined(PIPE_OS_UNIX) && HAVE_LLVM >= 0x0303
+#define GALLIVM_HAVE_DISK_CACHE 1
+#else
+#define GALLIVM_HAVE_DISK_CACHE 0
+#endif
+
+#if GALLIVM_HAVE_DISK_CACHE
+
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Linker.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if defined(PIPE_OS_LINUX)
+#include <link.h>
+#endif
+
+
+#define CACHE_MAGIC    0x434d5647 /* "GVMC" */
+#define CACHE_VERSION  1
+
+
+struct cache_header
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t key_size;
+   uint32_t num_functions;
+   uint32_t names_size;
+};
+
+
+struct cache_entry
+{
+   char name[32];
+   off_t size;
+   time_t mtime;
+};
+
+
+#define MAX_BUILD_ID_SIZE 64
+
+
+static boolean cache_initialized = FALSE;
+static const char *cache_dir = NULL;
+static uint8_t build_id[MAX_BUILD_ID_SIZE];
+static unsigned build_id_size = 0;
+static struct gallivm_disk_cache_stats cache_stats;
+pipe_static_mutex(cache_mutex);
+
+
+#if defined(PIPE_OS_LINUX)
+
+struct build_id_search
+{
+   ElfW(Addr) addr;
+   boolean found;
+};
+
+
+/**
+ * dl_iterate_phdr() callback looking for the GNU build-id note of the
+ * loaded object containing search->addr.
+ */
+static int
+find_build_id_note(struct dl_phdr_info *info, size_t size, void *data)
+{
+   struct build_id_search *search = data;
+   boolean contains_addr = FALSE;
+   int i;
+
+   (void) size;
+
+   for (i = 0; i < info->dlpi_phnum; i++) {
+      const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+      ElfW(Addr) start = info->dlpi_addr + phdr->p_vaddr;
+
+      if (phdr->p_type == PT_LOAD &&
+          search->addr >= start && search->addr < start + phdr->p_memsz)
+         contains_addr = TRUE;
+   }
+
+   if (!contains_addr)
+      return 0;
+
+   for (i = 0; i < info->dlpi_phnum; i++) {
+      const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+      const char *note, *end;
+
+      if (phdr->p_type != PT_NOTE)
+         continue;
+
+      note = (const char *) (info->dlpi_addr + phdr->p_vaddr);
+      end = note + phdr->p_memsz;
+      while (note + sizeof(ElfW(Nhdr)) <= end) {
+         const ElfW(Nhdr) *nhdr = (const ElfW(Nhdr) *) note;
+         const char *name = note + sizeof *nhdr;
+         const char *desc = name + align(nhdr->n_namesz, 4);
+
+         if (nhdr->n_type == NT_GNU_BUILD_ID &&
+             nhdr->n_namesz == 4 && memcmp(name, "GNU", 4) == 0 &&
+             nhdr->n_descsz <= MAX_BUILD_ID_SIZE) {
+            memcpy(build_id, desc, nhdr->n_descsz);
+            build_id_size = nhdr->n_descsz;
+            search->found = TRUE;
+            return 1;
+         }
+
+         note = desc + align(nhdr->n_descsz, 4);
+      }
+   }
+
+   /* Right object, but built without a build-id */
+   return 1;
+}
+
+#endif /* PIPE_OS_LINUX */
+
+
+/**
+ * Identify the build of the binary containing this code.  Returns FALSE
+ * if that isn't possible.
+ */
+static boolean
+init_build_id(void)
+{
+   const void *addr = (const void *) (uintptr_t) gallivm_cache_key_init;
+   Dl_info info;
+   struct stat st;
+
+#if defined(PIPE_OS_LINUX)
+   struct build_id_search search;
+
+   search.addr = (ElfW(Addr)) addr;
+   search.found = FALSE;
+   dl_iterate_phdr(find_build_id_note, &search);
+   if (search.found)
+      return TRUE;
+#endif
+
+   if (!dladdr(addr, &info) || !info.dli_fname ||
+       stat(info.dli_fname, &st) != 0)
+      return FALSE;
+
+   build_id_size = 0;
+   memcpy(build_id + build_id_size, &st.st_size, sizeof st.st_size);
+   build_id_size += sizeof st.st_size;
+   memcpy(build_id + build_id_size, &st.st_mtime, sizeof st.st_mtime);
+   build_id_size += sizeof st.st_mtime;
+   return TRUE;
+}
+
+
+/**
+ * Read the settings the first time, and return whether the cache is
+ * enabled.
+ */
+static boolean
+cache_init(void)
+{
+   boolean enabled;
+
+   pipe_mutex_lock(cache_mutex);
+   if (!cache_initialized) {
+      struct stat st;
+
+      cache_dir = debug_get_option("GALLIVM_CACHE_DIR", NULL);
+      cache_stats.max_size =
+         (uint64_t) debug_get_num_option("GALLIVM_CACHE_SIZE", 256) << 20;
+
+      if (cache_dir) {
+         if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+            debug_printf("gallivm: cannot create cache directory %s\n",
+                         cache_dir);
+            cache_dir = NULL;
+         }
+         else if (stat(cache_dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            cache_dir = NULL;
+         }
+         else if (!init_build_id()) {
+            debug_printf("gallivm: no build id, shader cache disabled\n");
+            cache_dir = NULL;
+         }
+      }
+
+      cache_initialized = TRUE;
+   }
+   enabled = cache_dir != NULL;
+   pipe_mutex_unlock(cache_mutex);
+
+   return enabled;
+}
+
+
+static void
+cache_entry_path(char *path, size_t size, const struct gallivm_cache_key *key)
+{
+   uint32_t h0, h1;
+   unsigned i;
+
+   h0 = util_hash_crc32(key->data, key->size);
+
+   /* A second, unrelated hash (FNV-1a) to make collisions vanishingly rare */
+   h1 = 2166136261u;
+   for (i = 0; i < key->size; i++) {
+      h1 ^= key->data[i];
+      h1 *= 16777619u;
+   }
+
+   util_snprintf(path, size, "%s/%08x%08x.bc", cache_dir, h0, h1);
+}
+
+
+static int
+compare_entries(const void *a, const void *b)
+{
+   const struct cache_entry *ea = (const struct cache_entry *) a;
+   const struct cache_entry *eb = (const struct cache_entry *) b;
+
+   if (ea->mtime != eb->mtime)
+      return ea->mtime < eb->mtime ? -1 : 1;
+   return 0;
+}
+
+
+/**
+ * Walk the cache directory, recompute its size and, if it exceeds the
+ * limit, remove the least recently used entries until it is back under
+ * three quarters of the limit.
+ *
+ * Called with cache_mutex held.
+ */
+static void
+cache_evict(void)
+{
+   struct cache_entry *entries = NULL;
+   unsigned num_entries = 0, max_entries = 0;
+   uint64_t total = 0;
+   struct dirent *dent;
+   DIR *dir;
+   unsigned i;
+
+   dir = opendir(cache_dir);
+   if (!dir)
+      return;
+
+   while ((dent = readdir(dir)) != NULL) {
+      char path[1024];
+      struct stat st;
+      size_t len = strlen(dent->d_name);
+
+      if (len < 3 || len >= sizeof entries[0].name ||
+          strcmp(dent->d_name + len - 3, ".bc") != 0)
+         continue;
+
+      util_snprintf(path, sizeof path, "%s/%s", cache_dir, dent->d_name);
+      if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+         continue;
+
+      if (num_entries == max_entries) {
+         unsigned new_max = max_entries ? max_entries * 2 : 64;
+         struct cache_entry *tmp =
+            REALLOC(entries, max_entries * sizeof *entries,
+                    new_max * sizeof *entries);
+         if (!tmp)
+            break;
+         entries = tmp;
+         max_entries = new_max;
+      }
+
+      memcpy(entries[num_entries].name, dent->d_name, len + 1);
+      entries[num_entries].size = st.st_size;
+      entries[num_entries].mtime = st.st_mtime;
+      total += st.st_size;
+      num_entries++;
+   }
+   closedir(dir);
+
+   if (total > cache_stats.max_size) {
+      uint64_t target = cache_stats.max_size / 4 * 3;
+
+      qsort(entries, num_entries, sizeof *entries, compare_entries);
+
+      for (i = 0; i < num_entries && total > target; i++) {
+         char path[1024];
+         util_snprintf(path, sizeof path, "%s/%s", cache_dir, entries[i].name);
+         if (unlink(path) == 0) {
+            total -= entries[i].size;
+            cache_stats.evictions++;
+         }
+      }
+   }
+
+   cache_stats.size = total;
+
+   FREE(entries);
+}
+
+
+static void *
+read_file(const char *path, size_t *size)
+{
+   struct stat st;
+   FILE *f;
+   void *data;
+
+   f = fopen(path, "rb");
+   if (!f)
+      return NULL;
+
+   if (fstat(fileno(f), &st) != 0 || st.st_size <= 0) {
+      fclose(f);
+      return NULL;
+   }
+
+   data = MALLOC(st.st_size);
+   if (data && fread(data, 1, st.st_size, f) != (size_t) st.st_size) {
+      FREE(data);
+      data = NULL;
+   }
+   fclose(f);
+
+   *size = st.st_size;
+   return data;
+}
+
+#endif /* GALLIVM_HAVE_DISK_CACHE */
+
+
+boolean
+gallivm_disk_cache_enabled(void)
+{
+#if GALLIVM_HAVE_DISK_CACHE
+   return cache_init();
+#else
+   return FALSE;
+#endif
+}
+
+
+/**
+ * Start a new key.  The key always includes the state which influences
+ * code generation but is not part of any shader variant key.
+ * \param kind  distinguishes different variant types sharing the cache
+ */
+void
+gallivm_cache_key_init(struct gallivm_cache_key *key, const char *kind)
+{
+   struct util_cpu_caps caps = util_cpu_caps;
+   unsigned llvm_version = HAVE_LLVM;
+   unsigned pointer_size = sizeof(void *);
+   unsigned debug_flags = gallivm_debug & ~(GALLIVM_DEBUG_TGSI |
+                                            GALLIVM_DEBUG_IR |
+                                            GALLIVM_DEBUG_ASM |
+                                            GALLIVM_DEBUG_PERF);
+
+   memset(key, 0, sizeof *key);
+
+   /* The number of CPUs does not affect code generation. */
+   caps.nr_cpus = 0;
+
+   gallivm_cache_key_add(key, kind, strlen(kind) + 1);
+#if GALLIVM_HAVE_DISK_CACHE
+   /* Only needed for entries shared with other processes */
+   if (gallivm_disk_cache_enabled())
+      gallivm_cache_key_add(key, build_id, build_id_size);
+#endif
+   gallivm_cache_key_add(key, &llvm_version, sizeof llvm_version);
+   gallivm_cache_key_add(key, &pointer_size, sizeof pointer_size);
+   gallivm_cache_key_add(key, &caps, sizeof caps);
+   gallivm_cache_key_add(key, &lp_native_vector_width,
+                         sizeof lp_native_vector_width);
+   gallivm_cache_key_add(key, &debug_flags, sizeof debug_flags);
+}
+
+
+void
+gallivm_cache_key_add(struct gallivm_cache_key *key,
+                      const void *data, unsigned size)
+{
+   if (key->size + size > key->capacity) {
+      unsigned new_capacity = MAX2(key->capacity * 2, key->size + size);
+      uint8_t *new_data = REALLOC(key->data, key->capacity, new_capacity);
+      if (!new_data) {
+         /* An incomplete key must never match, so poison it */
+         FREE(key->data);
+         key->data = NULL;
+         key->size = key->capacity = 0;
+         return;
+      }
+      key->data = new_data;
+      key->capacity = new_capacity;
+   }
+
+   memcpy(key->data + key->size, data, size);
+   key->size += size;
+}
+
+
+void
+gallivm_cache_key_release(struct gallivm_cache_key *key)
+{
+   FREE(key->data);
+   memset(key, 0, sizeof *key);
+}
+
+
+/**
+ * Look up the key in the cache and, on a hit, link the cached module into
+ * gallivm's (still empty) module.
+ *
+ * \param functions  returns the entry points, in the same order they were
+ *                   passed to gallivm_disk_cache_store().
+ * \return TRUE on a hit.  On a miss gallivm is left untouched.
+ */
+boolean
+gallivm_disk_cache_load(struct gallivm_state *gallivm,
+                        const struct gallivm_cache_key *key,
+                        LLVMValueRef *functions,
+                        unsigned num_functions)
+{
+#if GALLIVM_HAVE_DISK_CACHE
+   const struct cache_header *header;
+   LLVMMemoryBufferRef buffer;
+   LLVMModuleRef module = NULL;
+   const char *names, *name;
+   char path[1024];
+   char *error = NULL;
+   uint8_t *data;
+   size_t size = 0, offset;
+   unsigned i;
+
+   if (!gallivm_disk_cache_enabled() || !key->data)
+      return FALSE;
+
+   cache_entry_path(path, sizeof path, key);
+
+   data = read_file(path, &size);
+   if (!data)
+      goto miss;
+
+   header = (const struct cache_header *) data;
+   offset = sizeof *header;
+   if (size < offset ||
+       header->magic != CACHE_MAGIC ||
+       header->version != CACHE_VERSION ||
+       header->key_size != key->size ||
+       header->num_functions != num_functions ||
+       size < offset + header->key_size + header->names_size ||
+       memcmp(data + offset, key->data, key->size) != 0) {
+      goto miss;
+   }
+   offset += header->key_size;
+
+   names = (const char *) data + offset;
+   if (header->names_size == 0 || names[header->names_size - 1] != '\0')
+      goto miss;
+   offset += header->names_size;
+
+   buffer = LLVMCreateMemoryBufferWithMemoryRangeCopy((const char *) data + offset,
+                                                      size - offset,
+                                                      "gallivm cache");
+   if (!buffer)
+      goto miss;
+
+   if (LLVMParseBitcodeInContext(gallivm->context, buffer, &module, &error)) {
+      debug_printf("gallivm: corrupt cache entry %s: %s\n", path, error);
+      LLVMDisposeMessage(error);
+      LLVMDisposeMemoryBuffer(buffer);
+      unlink(path);
+      goto miss;
+   }
+   LLVMDisposeMemoryBuffer(buffer);
+
+   /* Make sure every entry point is there before touching gallivm */
+   for (i = 0, name = names; i < num_functions; i++) {
+      if (name >= names + header->names_size ||
+          (*name && !LLVMGetNamedFunction(module, name))) {
+         LLVMDisposeModule(module);
+         goto miss;
+      }
+      name += strlen(name) + 1;
+   }
+
+   if (LLVMLinkModules(gallivm->module, module,
+                       LLVMLinkerDestroySource, &error)) {
+      debug_printf("gallivm: failed to link cached module: %s\n", error);
+      LLVMDisposeMessage(error);
+      LLVMDisposeModule(module);
+      goto miss;
+   }
+   LLVMDisposeModule(module);
+
+   for (i = 0, name = names; i < num_functions; i++) {
+      functions[i] = *name ? LLVMGetNamedFunction(gallivm->module, name) : NULL;
+      name += strlen(name) + 1;
+   }
+
+   FREE(data);
+
+   /* Refresh the modification time, which drives the LRU eviction */
+   utime(path, NULL);
+
+   pipe_mutex_lock(cache_mutex);
+   cache_stats.hits++;
+   pipe_mutex_unlock(cache_mutex);
+
+   return TRUE;
+
+miss:
+   FREE(data);
+   pipe_mutex_lock(cache_mutex);
+   cache_stats.misses++;
+   pipe_mutex_unlock(cache_mutex);
+#else
+   (void) gallivm;
+   (void) key;
+   (void) functions;
+   (void) num_functions;
+#endif
+   return FALSE;
+}
+
+
+/**
+ * Store gallivm's module in the cache.  Must be called after all the
+ * functions have been generated and optimized, but before the module is
+ * compiled, as compilation discards the function bodies.
+ */
+void
+gallivm_disk_cache_store(struct gallivm_state *gallivm,
+                         const struct gallivm_cache_key *key,
+                         const LLVMValueRef *functions,
+                         unsigned num_functions)
+{
+#if GALLIVM_HAVE_DISK_CACHE
+   struct cache_header header;
+   char path[1024];
+   char tmp_path[1024 + 32];
+   char *names = NULL;
+   unsigned names_size = 0;
+   unsigned i;
+   struct stat st;
+   FILE *f;
+   boolean ok;
+
+   if (!gallivm_disk_cache_enabled() || !key->data)
+      return;
+
+   if (gallivm->cache_unsafe) {
+      /* The module references addresses in this process */
+      return;
+   }
+
+   for (i = 0; i < num_functions; i++) {
+      const char *name = functions[i] ? LLVMGetValueName(functions[i]) : "";
+      unsigned len = strlen(name) + 1;
+      char *tmp = REALLOC(names, names_size, names_size + len);
+      if (!tmp) {
+         FREE(names);
+         return;
+      }
+      names = tmp;
+      memcpy(names + names_size, name, len);
+      names_size += len;
+   }
+
+   cache_entry_path(path, sizeof path, key);
+   util_snprintf(tmp_path, sizeof tmp_path, "%s.%u.tmp", path,
+                 (unsigned) getpid());
+
+   f = fopen(tmp_path, "wb");
+   if (!f) {
+      FREE(names);
+      return;
+   }
+
+   header.magic = CACHE_MAGIC;
+   header.version = CACHE_VERSION;
+   header.key_size = key->size;
+   header.num_functions = num_functions;
+   header.names_size = names_size;
+
+   ok = fwrite(&header, sizeof header, 1, f) == 1 &&
+        fwrite(key->data, key->size, 1, f) == 1 &&
+        fwrite(names, names_size, 1, f) == 1 &&
+        fflush(f) == 0 &&
+        LLVMWriteBitcodeToFD(gallivm->module, fileno(f), 0, 0) == 0;
+   ok = fclose(f) == 0 && ok;
+
+   FREE(names);
+
+   if (!ok || stat(tmp_path, &st) != 0 || rename(tmp_path, path) != 0) {
+      unlink(tmp_path);
+      return;
+   }
+
+   pipe_mutex_lock(cache_mutex);
+   cache_stats.stores++;
+   if (cache_stats.size == 0 ||
+       cache_stats.size + st.st_size > cache_stats.max_size) {
+      /* Resynchronize with the directory (other processes may write to it
+       * too) and evict if needed.
+       */
+      cache_evict();
+   }
+   else {
+      cache_stats.size += st.st_size;
+   }
+   pipe_mutex_unlock(cache_mutex);
+#else
+   (void) gallivm;
+   (void) key;
+   (void) functions;
+   (void) num_functions;
+#endif
+}
+
+
+void
+gallivm_disk_cache_get_stats(struct gallivm_disk_cache_stats *stats)
+{
+#if GALLIVM_HAVE_DISK_CACHE
+   pipe_mutex_lock(cache_mutex);
+   *stats = cache_stats;
+   pipe_mutex_unlock(cache_mutex);
+#else
+   memset(stats, 0, sizeof *stats);
+#endif
+}
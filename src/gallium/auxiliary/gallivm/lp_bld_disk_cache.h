@@ -0,0 +1,104 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Persistent on-disk cache of optimized LLVM modules.
+ *
+ * Variants are looked up by a content key made of everything that
+ * influences code generation (shader tokens, variant key, LLVM version,
+ * CPU capabilities, ...).  A hit replaces IR construction and the
+ * optimization passes with loading the previously optimized bitcode,
+ * leaving only the machine code generation to the JIT.
+ *
+ * The cache is disabled unless GALLIVM_CACHE_DIR is set.
+ */
+
+
+#ifndef LP_BLD_DISK_CACHE_H
+#define LP_BLD_DISK_CACHE_H
+
+
+#include "pipe/p_compiler.h"
+#include "gallivm/lp_bld.h"
+
+
+struct gallivm_state;
+
+
+/**
+ * Content key, built incrementally from arbitrary blobs.
+ */
+struct gallivm_cache_key
+{
+   uint8_t *data;
+   unsigned size;
+   unsigned capacity;
+};
+
+
+struct gallivm_disk_cache_stats
+{
+   unsigned hits;
+   unsigned misses;
+   unsigned stores;
+   unsigned evictions;
+   uint64_t size;      /**< current size of the cache directory, in bytes */
+   uint64_t max_size;  /**< eviction threshold, in bytes */
+};
+
+
+boolean
+gallivm_disk_cache_enabled(void);
+
+void
+gallivm_cache_key_init(struct gallivm_cache_key *key, const char *kind);
+
+void
+gallivm_cache_key_add(struct gallivm_cache_key *key,
+                      const void *data, unsigned size);
+
+void
+gallivm_cache_key_release(struct gallivm_cache_key *key);
+
+boolean
+gallivm_disk_cache_load(struct gallivm_state *gallivm,
+                        const struct gallivm_cache_key *key,
+                        LLVMValueRef *functions,
+                        unsigned num_functions);
+
+void
+gallivm_disk_cache_store(struct gallivm_state *gallivm,
+                         const struct gallivm_cache_key *key,
+                         const LLVMValueRef *functions,
+                         unsigned num_functions);
+
+void
+gallivm_disk_cache_get_stats(struct gallivm_disk_cache_stats *stats);
+
+
+#endif /* !LP_BLD_DISK_CACHE_H */
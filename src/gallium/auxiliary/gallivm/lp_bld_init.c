@@ -30,12 +30,14 @@
 #include "pipe/p_compiler.h"
 #include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
+#include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_simple_list.h"
 #include "lp_bld.h"
 #include "lp_bld_debug.h"
 #include "lp_bld_misc.h"
 #include "lp_bld_init.h"
+#include "lp_bld_type.h"
 
 #include <llvm-c/Analysis.h>
 #include <llvm-c/Transforms/Scalar.h>
@@ -89,6 +91,10 @@ DEBUG_GET_ONCE_FLAGS_OPTION(gallivm_debug, "GALLIVM_DEBUG", lp_bld_debug_flags,
 #endif
 
 
+/** Code generator optimization level of the optimized tier, 0 to 3 */
+DEBUG_GET_ONCE_NUM_OPTION(opt_level, "GALLIVM_OPT_LEVEL", 2)
+
+
 static boolean gallivm_initialized = FALSE;
 
 unsigned lp_native_vector_width;
@@ -143,7 +149,8 @@ create_pass_manager(struct gallivm_state *gallivm)
 
    LLVMAddTargetData(gallivm->target, gallivm->passmgr);
 
-   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0) {
+   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0 &&
+       gallivm->tier == GALLIVM_TIER_OPT) {
       /* These are the passes currently listed in llvm-c/Transforms/Scalar.h,
        * but there are more on SVN.
        * TODO: Add more passes.
@@ -180,6 +187,12 @@ create_pass_manager(struct gallivm_state *gallivm)
        * unexpected ways.
        */
       LLVMAddPromoteMemoryToRegisterPass(gallivm->passmgr);
+
+      /* The fast tier only cleans up the control flow, which costs little
+       * and leaves less code to generate.
+       */
+      if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0)
+         LLVMAddCFGSimplificationPass(gallivm->passmgr);
    }
 
    return TRUE;
@@ -256,11 +269,17 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_debug & GALLIVM_DEBUG_NO_OPT) {
+      if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) ||
+          gallivm->tier == GALLIVM_TIER_FAST) {
          optlevel = None;
       }
       else {
+#if HAVE_LLVM >= 0x207
+         optlevel = (enum LLVM_CodeGenOpt_Level)
+            MIN2(debug_get_option_opt_level(), Aggressive);
+#else
          optlevel = Default;
+#endif
       }
 
 #if HAVE_LLVM >= 0x0301
@@ -334,7 +353,7 @@ static LLVMContextRef gallivm_context = NULL;
  * \return  TRUE for success, FALSE for failure
  */
 static boolean
-init_gallivm_state(struct gallivm_state *gallivm)
+init_gallivm_state(struct gallivm_state *gallivm, LLVMContextRef context)
 {
    assert(!gallivm->context);
    assert(!gallivm->module);
@@ -342,10 +361,13 @@ init_gallivm_state(struct gallivm_state *gallivm)
 
    lp_build_init();
 
-   if (!gallivm_context) {
-      gallivm_context = LLVMContextCreate();
+   if (!context) {
+      if (!gallivm_context) {
+         gallivm_context = LLVMContextCreate();
+      }
+      context = gallivm_context;
    }
-   gallivm->context = gallivm_context;
+   gallivm->context = context;
    if (!gallivm->context)
       goto fail;
 
@@ -460,6 +482,18 @@ lp_build_init(void)
    lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH",
                                                  lp_native_vector_width);
 
+   /* 512 bits is opt-in only: it processes a whole 4x4 block per fragment
+    * shader vector, which only pays off with AVX-512.  Anything else is
+    * rounded down to a supported power of two.
+    */
+   lp_native_vector_width = CLAMP(lp_native_vector_width,
+                                  128, LP_MAX_VECTOR_WIDTH);
+   lp_native_vector_width = 1 << util_logbase2(lp_native_vector_width);
+
+   if (lp_native_vector_width < 512) {
+      util_cpu_caps.has_avx512f = 0;
+   }
+
    if (lp_native_vector_width <= 128) {
       /* Hide AVX support, as often LLVM AVX intrinsics are only guarded by
        * "util_cpu_caps.has_avx" predicate, and lack the
@@ -480,6 +514,7 @@ lp_build_init(void)
        */
       util_cpu_caps.has_f16c = 0;
       util_cpu_caps.has_xop = 0;
+      util_cpu_caps.has_avx512f = 0;
    }
 
 #ifdef PIPE_ARCH_PPC_64
@@ -524,6 +559,32 @@ lp_build_init(void)
  */
 struct gallivm_state *
 gallivm_create(void)
+{
+   return gallivm_create_in_context(NULL);
+}
+
+
+/**
+ * Create a new gallivm_state object whose LLVM objects live in the given
+ * context, or in the shared singleton context if NULL.
+ *
+ * LLVM contexts are not thread safe, so every thread building code
+ * concurrently with the others must pass its own context.  As with the
+ * singleton, the caller must never free it.
+ */
+struct gallivm_state *
+gallivm_create_in_context(LLVMContextRef context)
+{
+   return gallivm_create_tiered(context, GALLIVM_TIER_OPT);
+}
+
+
+/**
+ * Create a new gallivm_state object, like gallivm_create_in_context(),
+ * whose code is optimized according to the given tier.
+ */
+struct gallivm_state *
+gallivm_create_tiered(LLVMContextRef context, enum gallivm_tier tier)
 {
    struct gallivm_state *gallivm;
 
@@ -535,7 +596,8 @@ gallivm_create(void)
 
    gallivm = CALLOC_STRUCT(gallivm_state);
    if (gallivm) {
-      if (!init_gallivm_state(gallivm)) {
+      gallivm->tier = tier;
+      if (!init_gallivm_state(gallivm, context)) {
          FREE(gallivm);
          gallivm = NULL;
       }
@@ -36,6 +36,19 @@
 #include <llvm-c/ExecutionEngine.h>
 
 
+/**
+ * Optimization tiers.  Code which must be available quickly is built at
+ * the fast tier, with few IR passes and no code generator optimizations,
+ * and rebuilt at the optimized tier if it turns out to be hot.
+ */
+enum gallivm_tier
+{
+   GALLIVM_TIER_FAST = 0,
+   GALLIVM_TIER_OPT,
+   GALLIVM_NUM_TIERS
+};
+
+
 struct gallivm_state
 {
    LLVMModuleRef module;
@@ -46,6 +59,10 @@ struct gallivm_state
    LLVMContextRef context;
    LLVMBuilderRef builder;
    unsigned compiled;
+   enum gallivm_tier tier;
+
+   /** The module embeds host addresses, so must not go to the disk cache */
+   boolean cache_unsafe;
 };
 
 
@@ -56,6 +73,12 @@ lp_build_init(void);
 struct gallivm_state *
 gallivm_create(void);
 
+struct gallivm_state *
+gallivm_create_in_context(LLVMContextRef context);
+
+struct gallivm_state *
+gallivm_create_tiered(LLVMContextRef context, enum gallivm_tier tier);
+
 void
 gallivm_destroy(struct gallivm_state *gallivm);
 
@@ -312,6 +312,11 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       if (util_cpu_caps.has_f16c) {
          MAttrs.push_back("+f16c");
       }
+#if HAVE_LLVM >= 0x0304
+      if (util_cpu_caps.has_avx512f) {
+         MAttrs.push_back("+avx512f");
+      }
+#endif
       builder.setMAttrs(MAttrs);
    }
    builder.setJITMemoryManager(JITMemoryManager::CreateDefaultMemManager());
@@ -2024,6 +2024,83 @@ lp_build_sample_partial_offset(struct lp_build_context *bld,
 }
 
 
+/**
+ * Compute the partial offset of a texel along the x or y axis of a tiled
+ * image, see LP_TEXEL_TILE_SIZE.
+ *
+ * @param axis    0 for x, 1 for y
+ * @param texel_size  texel size in bytes
+ * @param coord   coordinate in pixels
+ * @param stride  number of bytes between rows (only used for y)
+ * @param out_offset    resulting relative offset of the texel in bytes
+ */
+void
+lp_build_sample_tiled_partial_offset(struct lp_build_context *bld,
+                                     unsigned axis,
+                                     unsigned texel_size,
+                                     LLVMValueRef coord,
+                                     LLVMValueRef stride,
+                                     LLVMValueRef *out_offset)
+{
+   LLVMBuilderRef builder = bld->gallivm->builder;
+   LLVMValueRef tile_mask, outer, inner;
+
+   assert(axis < 2);
+
+   tile_mask = lp_build_const_int_vec(bld->gallivm, bld->type,
+                                      LP_TEXEL_TILE_SIZE - 1);
+   inner = LLVMBuildAnd(builder, coord, tile_mask, "");
+   outer = LLVMBuildSub(builder, coord, inner, "");
+
+   if (axis == 0) {
+      /* tiles are a whole tile of texels apart */
+      outer = lp_build_mul_imm(bld, outer, LP_TEXEL_TILE_SIZE * texel_size);
+      inner = lp_build_mul_imm(bld, inner, texel_size);
+   }
+   else {
+      /* rows of tiles are LP_TEXEL_TILE_SIZE rows apart, and rows within
+       * a tile one row of tile texels */
+      outer = lp_build_mul(bld, outer, stride);
+      inner = lp_build_mul_imm(bld, inner, LP_TEXEL_TILE_SIZE * texel_size);
+   }
+
+   *out_offset = lp_build_add(bld, outer, inner);
+}
+
+
+/**
+ * Compute the partial offset of a pixel block along the x (0), y (1) or
+ * z (2) axis of the texture being sampled, taking its layout into
+ * account.
+ *
+ * @param stride  the linear stride along the axis
+ */
+void
+lp_build_sample_axis_offset(struct lp_build_sample_context *bld,
+                            unsigned axis,
+                            LLVMValueRef coord,
+                            LLVMValueRef stride,
+                            LLVMValueRef *out_offset,
+                            LLVMValueRef *out_subcoord)
+{
+   const struct util_format_description *format_desc = bld->format_desc;
+
+   if (bld->static_texture_state->tiled && axis < 2) {
+      lp_build_sample_tiled_partial_offset(&bld->int_coord_bld, axis,
+                                           format_desc->block.bits / 8,
+                                           coord, stride, out_offset);
+      *out_subcoord = bld->int_coord_bld.zero;
+   }
+   else {
+      unsigned block_length = axis == 0 ? format_desc->block.width :
+                              axis == 1 ? format_desc->block.height : 1;
+      lp_build_sample_partial_offset(&bld->int_coord_bld, block_length,
+                                     coord, stride,
+                                     out_offset, out_subcoord);
+   }
+}
+
+
 /**
  * Compute the offset of a pixel block.
  *
@@ -2034,6 +2111,7 @@ lp_build_sample_partial_offset(struct lp_build_context *bld,
 void
 lp_build_sample_offset(struct lp_build_context *bld,
                        const struct util_format_description *format_desc,
+                       boolean tiled,
                        LLVMValueRef x,
                        LLVMValueRef y,
                        LLVMValueRef z,
@@ -2049,17 +2127,32 @@ lp_build_sample_offset(struct lp_build_context *bld,
    x_stride = lp_build_const_vec(bld->gallivm, bld->type,
                                  format_desc->block.bits/8);
 
-   lp_build_sample_partial_offset(bld,
-                                  format_desc->block.width,
-                                  x, x_stride,
-                                  &offset, out_i);
+   if (tiled) {
+      assert(format_desc->block.width == 1 && format_desc->block.height == 1);
+      lp_build_sample_tiled_partial_offset(bld, 0, format_desc->block.bits/8,
+                                           x, x_stride, &offset);
+      *out_i = bld->zero;
+   }
+   else {
+      lp_build_sample_partial_offset(bld,
+                                     format_desc->block.width,
+                                     x, x_stride,
+                                     &offset, out_i);
+   }
 
    if (y && y_stride) {
       LLVMValueRef y_offset;
-      lp_build_sample_partial_offset(bld,
-                                     format_desc->block.height,
-                                     y, y_stride,
-                                     &y_offset, out_j);
+      if (tiled) {
+         lp_build_sample_tiled_partial_offset(bld, 1, format_desc->block.bits/8,
+                                              y, y_stride, &y_offset);
+         *out_j = bld->zero;
+      }
+      else {
+         lp_build_sample_partial_offset(bld,
+                                        format_desc->block.height,
+                                        y, y_stride,
+                                        &y_offset, out_j);
+      }
       offset = lp_build_add(bld, offset, y_offset);
    }
    else {
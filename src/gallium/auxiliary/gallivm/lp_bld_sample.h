@@ -68,6 +68,19 @@ enum lp_sampler_lod_property {
 };
 
 
+/**
+ * Texel tiling, for textures with lp_static_texture_state::tiled set.
+ *
+ * The images are made of LP_TEXEL_TILE_SIZE x LP_TEXEL_TILE_SIZE texel
+ * tiles, each stored contiguously with its texels in raster order, the
+ * tiles themselves being in raster order too.  Rows of tiles are
+ * LP_TEXEL_TILE_SIZE * row_stride bytes apart, so that a tiled image
+ * takes exactly as much space as a linear one with 4x4 aligned size.
+ */
+#define LP_TEXEL_TILE_ORDER 2
+#define LP_TEXEL_TILE_SIZE (1 << LP_TEXEL_TILE_ORDER)
+
+
 /**
  * Texture static state.
  *
@@ -89,6 +102,7 @@ struct lp_static_texture_state
    unsigned pot_height:1;
    unsigned pot_depth:1;
    unsigned level_zero_only:1;
+   unsigned tiled:1;         /**< texels are tiled, see LP_TEXEL_TILE_SIZE */
 };
 
 
@@ -485,9 +499,28 @@ lp_build_sample_partial_offset(struct lp_build_context *bld,
                                LLVMValueRef *out_i);
 
 
+void
+lp_build_sample_tiled_partial_offset(struct lp_build_context *bld,
+                                     unsigned axis,
+                                     unsigned texel_size,
+                                     LLVMValueRef coord,
+                                     LLVMValueRef stride,
+                                     LLVMValueRef *out_offset);
+
+
+void
+lp_build_sample_axis_offset(struct lp_build_sample_context *bld,
+                            unsigned axis,
+                            LLVMValueRef coord,
+                            LLVMValueRef stride,
+                            LLVMValueRef *out_offset,
+                            LLVMValueRef *out_subcoord);
+
+
 void
 lp_build_sample_offset(struct lp_build_context *bld,
                        const struct util_format_description *format_desc,
+                       boolean tiled,
                        LLVMValueRef x,
                        LLVMValueRef y,
                        LLVMValueRef z,
@@ -62,8 +62,7 @@
 /**
  * Build LLVM code for texture coord wrapping, for nearest filtering,
  * for scaled integer texcoords.
- * \param block_length  is the length of the pixel block along the
- *                      coordinate axis
+ * \param axis  0, 1 or 2 for the s, t or r coordinate
  * \param coord  the incoming texcoord (s,t or r) scaled to the texture size
  * \param coord_f  the incoming texcoord (s,t or r) as float vec
  * \param length  the texture size along one dimension
@@ -76,7 +75,7 @@
  */
 static void
 lp_build_sample_wrap_nearest_int(struct lp_build_sample_context *bld,
-                                 unsigned block_length,
+                                 unsigned axis,
                                  LLVMValueRef coord,
                                  LLVMValueRef coord_f,
                                  LLVMValueRef length,
@@ -126,8 +125,7 @@ lp_build_sample_wrap_nearest_int(struct lp_build_sample_context *bld,
       assert(0);
    }
 
-   lp_build_sample_partial_offset(int_coord_bld, block_length, coord, stride,
-                                  out_offset, out_i);
+   lp_build_sample_axis_offset(bld, axis, coord, stride, out_offset, out_i);
 }
 
 
@@ -196,8 +194,7 @@ lp_build_sample_wrap_nearest_float(struct lp_build_sample_context *bld,
 /**
  * Build LLVM code for texture coord wrapping, for linear filtering,
  * for scaled integer texcoords.
- * \param block_length  is the length of the pixel block along the
- *                      coordinate axis
+ * \param axis  0, 1 or 2 for the s, t or r coordinate
  * \param coord0  the incoming texcoord (s,t or r) scaled to the texture size
  * \param coord_f  the incoming texcoord (s,t or r) as float vec
  * \param length  the texture size along one dimension
@@ -212,7 +209,7 @@ lp_build_sample_wrap_nearest_float(struct lp_build_sample_context *bld,
  */
 static void
 lp_build_sample_wrap_linear_int(struct lp_build_sample_context *bld,
-                                unsigned block_length,
+                                unsigned axis,
                                 LLVMValueRef coord0,
                                 LLVMValueRef *weight_i,
                                 LLVMValueRef coord_f,
@@ -230,17 +227,20 @@ lp_build_sample_wrap_linear_int(struct lp_build_sample_context *bld,
    LLVMBuilderRef builder = bld->gallivm->builder;
    LLVMValueRef length_minus_one;
    LLVMValueRef lmask, umask, mask;
+   unsigned block_length = axis == 0 ? bld->format_desc->block.width :
+                           axis == 1 ? bld->format_desc->block.height : 1;
 
    /*
-    * If the pixel block covers more than one pixel then there is no easy
-    * way to calculate offset1 relative to offset0. Instead, compute them
-    * independently. Otherwise, try to compute offset0 and offset1 with
-    * a single stride multiplication.
+    * If the pixel block covers more than one pixel (or texels are tiled)
+    * then there is no easy way to calculate offset1 relative to offset0.
+    * Instead, compute them independently. Otherwise, try to compute
+    * offset0 and offset1 with a single stride multiplication.
     */
 
    length_minus_one = lp_build_sub(int_coord_bld, length, int_coord_bld->one);
 
-   if (block_length != 1) {
+   if (block_length != 1 ||
+       (bld->static_texture_state->tiled && axis < 2)) {
       LLVMValueRef coord1;
       switch(wrap_mode) {
       case PIPE_TEX_WRAP_REPEAT:
@@ -292,10 +292,8 @@ lp_build_sample_wrap_linear_int(struct lp_build_sample_context *bld,
          coord1 = int_coord_bld->zero;
          break;
       }
-      lp_build_sample_partial_offset(int_coord_bld, block_length, coord0, stride,
-                                     offset0, i0);
-      lp_build_sample_partial_offset(int_coord_bld, block_length, coord1, stride,
-                                     offset1, i1);
+      lp_build_sample_axis_offset(bld, axis, coord0, stride, offset0, i0);
+      lp_build_sample_axis_offset(bld, axis, coord1, stride, offset1, i1);
       return;
    }
 
@@ -645,7 +643,7 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
 
    /* Do texcoord wrapping, compute texel offset */
    lp_build_sample_wrap_nearest_int(bld,
-                                    bld->format_desc->block.width,
+                                    0,
                                     s_ipart, s_float,
                                     width_vec, x_stride, offsets[0],
                                     bld->static_texture_state->pot_width,
@@ -655,7 +653,7 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
    if (dims >= 2) {
       LLVMValueRef y_offset;
       lp_build_sample_wrap_nearest_int(bld,
-                                       bld->format_desc->block.height,
+                                       1,
                                        t_ipart, t_float,
                                        height_vec, row_stride_vec, offsets[1],
                                        bld->static_texture_state->pot_height,
@@ -665,7 +663,7 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
       if (dims >= 3) {
          LLVMValueRef z_offset;
          lp_build_sample_wrap_nearest_int(bld,
-                                          1, /* block length (depth) */
+                                          2,
                                           r_ipart, r_float,
                                           depth_vec, img_stride_vec, offsets[2],
                                           bld->static_texture_state->pot_depth,
@@ -769,6 +767,7 @@ lp_build_sample_image_nearest_afloat(struct lp_build_sample_context *bld,
     */
    lp_build_sample_offset(&bld->int_coord_bld,
                           bld->format_desc,
+                          bld->static_texture_state->tiled,
                           x_icoord, y_icoord,
                           z_icoord,
                           row_stride_vec, img_stride_vec,
@@ -1089,7 +1088,7 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
 
    /* do texcoord wrapping and compute texel offsets */
    lp_build_sample_wrap_linear_int(bld,
-                                   bld->format_desc->block.width,
+                                   0,
                                    s_ipart, &s_fpart, s_float,
                                    width_vec, x_stride, offsets[0],
                                    bld->static_texture_state->pot_width,
@@ -1121,7 +1120,7 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
 
    if (dims >= 2) {
       lp_build_sample_wrap_linear_int(bld,
-                                      bld->format_desc->block.height,
+                                      1,
                                       t_ipart, &t_fpart, t_float,
                                       height_vec, y_stride, offsets[1],
                                       bld->static_texture_state->pot_height,
@@ -1141,7 +1140,7 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
 
    if (dims >= 3) {
       lp_build_sample_wrap_linear_int(bld,
-                                      1, /* block length (depth) */
+                                      2,
                                       r_ipart, &r_fpart, r_float,
                                       depth_vec, z_stride, offsets[2],
                                       bld->static_texture_state->pot_depth,
@@ -1259,14 +1258,10 @@ lp_build_sample_image_linear_afloat(struct lp_build_sample_context *bld,
     * cannot do offset calc with floats, difficult for block-based formats,
     * and not enough precision anyway.
     */
-   lp_build_sample_partial_offset(&bld->int_coord_bld,
-                                  bld->format_desc->block.width,
-                                  x_icoord0, x_stride,
-                                  &x_offset0, &x_subcoord[0]);
-   lp_build_sample_partial_offset(&bld->int_coord_bld,
-                                  bld->format_desc->block.width,
-                                  x_icoord1, x_stride,
-                                  &x_offset1, &x_subcoord[1]);
+   lp_build_sample_axis_offset(bld, 0, x_icoord0, x_stride,
+                               &x_offset0, &x_subcoord[0]);
+   lp_build_sample_axis_offset(bld, 0, x_icoord1, x_stride,
+                               &x_offset1, &x_subcoord[1]);
 
    /* add potential cube/array/mip offsets now as they are constant per pixel */
    if (bld->static_texture_state->target == PIPE_TEXTURE_CUBE ||
@@ -1291,14 +1286,10 @@ lp_build_sample_image_linear_afloat(struct lp_build_sample_context *bld,
    }
 
    if (dims >= 2) {
-      lp_build_sample_partial_offset(&bld->int_coord_bld,
-                                     bld->format_desc->block.height,
-                                     y_icoord0, y_stride,
-                                     &y_offset0, &y_subcoord[0]);
-      lp_build_sample_partial_offset(&bld->int_coord_bld,
-                                     bld->format_desc->block.height,
-                                     y_icoord1, y_stride,
-                                     &y_offset1, &y_subcoord[1]);
+      lp_build_sample_axis_offset(bld, 1, y_icoord0, y_stride,
+                                  &y_offset0, &y_subcoord[0]);
+      lp_build_sample_axis_offset(bld, 1, y_icoord1, y_stride,
+                                  &y_offset1, &y_subcoord[1]);
       for (z = 0; z < 2; z++) {
          for (x = 0; x < 2; x++) {
             offset[z][0][x] = lp_build_add(&bld->int_coord_bld,
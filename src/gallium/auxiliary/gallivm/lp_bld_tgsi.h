@@ -63,6 +63,7 @@ struct lp_build_mask_context;
 struct gallivm_state;
 struct lp_derivatives;
 struct lp_build_tgsi_gs_iface;
+struct lp_build_tgsi_cs_iface;
 
 
 enum lp_build_tex_modifier {
@@ -157,6 +158,12 @@ struct lp_bld_tgsi_system_values {
    LLVMValueRef instance_id;
    LLVMValueRef vertex_id;
    LLVMValueRef prim_id;
+
+   /* Compute shaders: thread_id is a vector, the others are scalars */
+   LLVMValueRef thread_id[3];
+   LLVMValueRef block_id[3];
+   LLVMValueRef block_size[3];
+   LLVMValueRef grid_size[3];
 };
 
 
@@ -230,7 +237,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef (*outputs)[4],
                   struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface);
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_cs_iface *cs_iface);
 
 
 void
@@ -419,6 +427,53 @@ struct lp_build_tgsi_gs_iface
                        LLVMValueRef emitted_prims_vec);
 };
 
+/**
+ * Compute shader code generation interface.
+ *
+ * Memory resources (TGSI_FILE_RESOURCE, including the TGSI_RESOURCE_*
+ * special ones) are accessed as raw 32 bit words, addressed in bytes.
+ *
+ * BARRIER instructions split the shader in phases: the shader returns at
+ * each barrier, and is called again with the next phase number once the
+ * other threads of the block got there too.  Temporaries are kept in the
+ * caller provided temps storage in between, other registers aren't kept.
+ * Barriers are only supported outside of any control flow.
+ */
+struct lp_build_tgsi_cs_iface
+{
+   /** Load the word at address + offset from each active lane */
+   LLVMValueRef (*load)(const struct lp_build_tgsi_cs_iface *cs_iface,
+                        struct lp_build_tgsi_context *bld_base,
+                        unsigned resource,
+                        const LLVMValueRef *address,
+                        unsigned offset,
+                        LLVMValueRef exec_mask);
+
+   /** Store the word to address + offset for each active lane */
+   void (*store)(const struct lp_build_tgsi_cs_iface *cs_iface,
+                 struct lp_build_tgsi_context *bld_base,
+                 unsigned resource,
+                 const LLVMValueRef *address,
+                 unsigned offset,
+                 LLVMValueRef value,
+                 LLVMValueRef exec_mask);
+
+   /** Return from the shader, to be resumed at the given phase */
+   void (*barrier)(const struct lp_build_tgsi_cs_iface *cs_iface,
+                   struct lp_build_tgsi_context *bld_base,
+                   unsigned phase);
+
+   /** Phase to start at, 0 for the beginning (int32) */
+   LLVMValueRef phase;
+
+   /** Storage for the temporaries of shaders with barriers */
+   LLVMValueRef temps;
+
+   /** First instruction to execute */
+   unsigned pc;
+};
+
+
 struct lp_build_tgsi_soa_context
 {
    struct lp_build_tgsi_context bld_base;
@@ -432,6 +487,11 @@ struct lp_build_tgsi_soa_context
    LLVMValueRef emitted_vertices_vec_ptr;
    LLVMValueRef max_output_vertices_vec;
 
+   const struct lp_build_tgsi_cs_iface *cs_iface;
+   /** Dispatch to the phase to resume at, for compute shaders with barriers */
+   LLVMValueRef phase_switch;
+   unsigned num_phases;
+
    LLVMValueRef consts_ptr;
    const LLVMValueRef (*inputs)[TGSI_NUM_CHANNELS];
    LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS];
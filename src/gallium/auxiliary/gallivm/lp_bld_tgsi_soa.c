@@ -1258,6 +1258,21 @@ emit_fetch_temporary(
    return res;
 }
 
+/**
+ * Broadcast component 'swizzle' of a scalar compute shader system value.
+ */
+static LLVMValueRef
+cs_system_value(struct lp_build_tgsi_context *bld_base,
+                const LLVMValueRef *values,
+                unsigned swizzle)
+{
+   if (swizzle >= 3 || !values[swizzle]) {
+      return bld_base->uint_bld.zero;
+   }
+
+   return lp_build_broadcast_scalar(&bld_base->uint_bld, values[swizzle]);
+}
+
 static LLVMValueRef
 emit_fetch_system_value(
    struct lp_build_tgsi_context * bld_base,
@@ -1290,6 +1305,27 @@ emit_fetch_system_value(
       atype = TGSI_TYPE_UNSIGNED;
       break;
 
+   case TGSI_SEMANTIC_THREAD_ID:
+      res = swizzle < 3 ? bld->system_values.thread_id[swizzle] :
+                          bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_ID:
+      res = cs_system_value(bld_base, bld->system_values.block_id, swizzle);
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_SIZE:
+      res = cs_system_value(bld_base, bld->system_values.block_size, swizzle);
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_GRID_SIZE:
+      res = cs_system_value(bld_base, bld->system_values.grid_size, swizzle);
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
    default:
       assert(!"unexpected semantic in emit_fetch_system_value");
       res = bld_base->base.zero;
@@ -1591,7 +1627,9 @@ emit_store(
    unsigned chan_index;
    struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
 
-   if(info->num_dst) {
+   /* Resources are written by the STORE emitter itself */
+   if(info->num_dst &&
+      inst->Dst[0].Register.File != TGSI_FILE_RESOURCE) {
       LLVMValueRef pred[TGSI_NUM_CHANNELS];
 
       emit_fetch_predicate( bld, inst, pred );
@@ -2528,6 +2566,13 @@ void lp_emit_immediate_soa(
       unsigned index = bld->num_immediates;
       struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
       LLVMBuilderRef builder = gallivm->builder;
+      LLVMBasicBlockRef block = LLVMGetInsertBlock(builder);
+
+      /* every phase needs the immediates */
+      if (bld->phase_switch) {
+         LLVMPositionBuilderBefore(builder, bld->phase_switch);
+      }
+
       for (i = 0; i < 4; ++i ) {
          LLVMValueRef lindex = lp_build_const_int32(
             bld->bld_base.base.gallivm, index * 4 + i);
@@ -2537,6 +2582,8 @@ void lp_emit_immediate_soa(
                         bld->immediates[index][i],
                         imm_ptr);
       }
+
+      LLVMPositionBuilderAtEnd(builder, block);
    }
 
    bld->num_immediates++;
@@ -2922,6 +2969,119 @@ end_primitive(
    }
 }
 
+static void
+load_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   LLVMBuilderRef builder = bld_base->base.gallivm->builder;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   LLVMValueRef address[3];
+   LLVMValueRef mask = mask_vec(bld_base);
+   unsigned chan;
+
+   for (chan = 0; chan < 3; ++chan) {
+      address[chan] = lp_build_emit_fetch(bld_base, inst, 1, chan);
+      address[chan] = LLVMBuildBitCast(builder, address[chan],
+                                       bld_base->uint_bld.vec_type, "");
+   }
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      unsigned word = tgsi_util_get_full_src_register_swizzle(&inst->Src[0],
+                                                              chan);
+      LLVMValueRef res;
+
+      res = bld->cs_iface->load(bld->cs_iface, bld_base,
+                                inst->Src[0].Register.Index,
+                                address, 4 * word, mask);
+      emit_data->output[chan] = LLVMBuildBitCast(builder, res,
+                                                 bld_base->base.vec_type, "");
+   }
+}
+
+static void
+store_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   LLVMBuilderRef builder = bld_base->base.gallivm->builder;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   LLVMValueRef address[3];
+   LLVMValueRef mask = mask_vec(bld_base);
+   unsigned chan;
+
+   for (chan = 0; chan < 3; ++chan) {
+      address[chan] = lp_build_emit_fetch(bld_base, inst, 0, chan);
+      address[chan] = LLVMBuildBitCast(builder, address[chan],
+                                       bld_base->uint_bld.vec_type, "");
+   }
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      LLVMValueRef value = lp_build_emit_fetch(bld_base, inst, 1, chan);
+
+      value = LLVMBuildBitCast(builder, value,
+                               bld_base->uint_bld.vec_type, "");
+      bld->cs_iface->store(bld->cs_iface, bld_base,
+                           inst->Dst[0].Register.Index,
+                           address, 4 * chan, value, mask);
+   }
+}
+
+static void
+fence_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   /* Loads and stores are not reordered across the lanes of a thread
+    * group, and other groups only run at barriers. */
+}
+
+/**
+ * Split the shader at a barrier.  The caller's barrier() ends the
+ * current phase, and the code that follows becomes the phase the
+ * function is resumed at once all threads of the block got there.
+ */
+static void
+barrier_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   struct lp_exec_mask *exec_mask = &bld->exec_mask;
+   LLVMBasicBlockRef block;
+   unsigned phase;
+
+   if (!bld->phase_switch)
+      return;
+
+   if (exec_mask->cond_stack_size ||
+       exec_mask->loop_stack_size ||
+       exec_mask->switch_stack_size ||
+       exec_mask->call_stack_size ||
+       exec_mask->ret_in_main) {
+      /* There is no phase to resume at, drivers must reject such shaders */
+      assert(0);
+      return;
+   }
+
+   phase = ++bld->num_phases;
+   bld->cs_iface->barrier(bld->cs_iface, bld_base, phase);
+
+   block = lp_build_insert_new_block(gallivm, "phase");
+   LLVMAddCase(bld->phase_switch,
+               lp_build_const_int32(gallivm, phase), block);
+   LLVMPositionBuilderAtEnd(gallivm->builder, block);
+
+   lp_exec_mask_init(exec_mask, &bld_base->int_bld);
+}
+
 static void
 cal_emit(
    const struct lp_build_tgsi_action * action,
@@ -3222,7 +3382,14 @@ static void emit_prologue(struct lp_build_tgsi_context * bld_base)
    struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
    struct gallivm_state * gallivm = bld_base->base.gallivm;
 
-   if (bld->indirect_files & (1 << TGSI_FILE_TEMPORARY)) {
+   if (bld->num_phases) {
+      /* temporaries must survive the barriers */
+      bld->temps_array =
+         LLVMBuildBitCast(gallivm->builder, bld->cs_iface->temps,
+                          LLVMPointerType(bld_base->base.vec_type, 0),
+                          "temp_array");
+   }
+   else if (bld->indirect_files & (1 << TGSI_FILE_TEMPORARY)) {
       LLVMValueRef array_size =
          lp_build_const_int32(gallivm,
                          bld_base->info->file_max[TGSI_FILE_TEMPORARY] * 4 + 4);
@@ -3305,6 +3472,18 @@ static void emit_prologue(struct lp_build_tgsi_context * bld_base)
       emit_dump_file(bld, TGSI_FILE_CONSTANT);
       emit_dump_file(bld, TGSI_FILE_INPUT);
    }
+
+   if (bld->num_phases) {
+      /* Jump to the code following the barrier to resume from, the cases
+       * are added by barrier_emit() */
+      LLVMBasicBlockRef block = lp_build_insert_new_block(gallivm, "phase0");
+
+      bld->phase_switch = LLVMBuildSwitch(gallivm->builder,
+                                          bld->cs_iface->phase, block,
+                                          bld->num_phases);
+      LLVMPositionBuilderAtEnd(gallivm->builder, block);
+      bld->num_phases = 0;
+   }
 }
 
 static void emit_epilogue(struct lp_build_tgsi_context * bld_base)
@@ -3356,7 +3535,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS],
                   struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface)
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_cs_iface *cs_iface)
 {
    struct lp_build_tgsi_soa_context bld;
 
@@ -3466,6 +3646,25 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                                 max_output_vertices);
    }
 
+   if (cs_iface) {
+      bld.cs_iface = cs_iface;
+      bld.bld_base.op_actions[TGSI_OPCODE_LOAD].emit = load_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_STORE].emit = store_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_MFENCE].emit = fence_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_LFENCE].emit = fence_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_SFENCE].emit = fence_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_BARRIER].emit = barrier_emit;
+
+      if (info->opcode_count[TGSI_OPCODE_BARRIER]) {
+         /* the prologue builds the phase dispatch, sized with this */
+         bld.num_phases = info->opcode_count[TGSI_OPCODE_BARRIER];
+         bld.indirect_files |= (1 << TGSI_FILE_TEMPORARY);
+      }
+
+      /* start at the kernel entry point */
+      bld.bld_base.pc = cs_iface->pc;
+   }
+
    lp_exec_mask_init(&bld.exec_mask, &bld.bld_base.int_bld);
 
    bld.system_values = *system_values;
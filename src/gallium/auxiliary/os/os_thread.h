@@ -439,6 +439,88 @@ pipe_semaphore_wait(pipe_semaphore *sema)
 
 
 
+/*
+ * Thread affinity.
+ */
+
+/**
+ * Get the CPUs the calling thread is allowed to run on, in ascending order.
+ * \return the number of CPUs stored in cpus, or zero if not supported.
+ */
+static INLINE unsigned
+pipe_thread_get_cpus(unsigned *cpus, unsigned max_cpus)
+{
+#if defined(PIPE_OS_LINUX) && defined(CPU_SET)
+   cpu_set_t set;
+   unsigned cpu, num_cpus = 0;
+
+   if (sched_getaffinity(0, sizeof set, &set) != 0)
+      return 0;
+
+   for (cpu = 0; cpu < CPU_SETSIZE && num_cpus < max_cpus; cpu++) {
+      if (CPU_ISSET(cpu, &set))
+         cpus[num_cpus++] = cpu;
+   }
+   return num_cpus;
+#elif defined(PIPE_SUBSYSTEM_WINDOWS_USER)
+   DWORD_PTR process_mask, system_mask;
+   unsigned cpu, num_cpus = 0;
+
+   if (!GetProcessAffinityMask(GetCurrentProcess(),
+                               &process_mask, &system_mask))
+      return 0;
+
+   for (cpu = 0; cpu < sizeof(DWORD_PTR) * 8 && num_cpus < max_cpus; cpu++) {
+      if (process_mask & ((DWORD_PTR)1 << cpu))
+         cpus[num_cpus++] = cpu;
+   }
+   return num_cpus;
+#else
+   (void) cpus;
+   (void) max_cpus;
+   return 0;
+#endif
+}
+
+/**
+ * Restrict a thread to run on the given CPUs only.
+ * \return TRUE on success, FALSE on failure or if not supported.
+ */
+static INLINE boolean
+pipe_thread_set_affinity(pipe_thread thread,
+                         const unsigned *cpus, unsigned num_cpus)
+{
+#if defined(PIPE_OS_LINUX) && defined(CPU_SET)
+   cpu_set_t set;
+   unsigned i;
+
+   CPU_ZERO(&set);
+   for (i = 0; i < num_cpus; i++) {
+      if (cpus[i] >= CPU_SETSIZE)
+         return FALSE;
+      CPU_SET(cpus[i], &set);
+   }
+   return pthread_setaffinity_np(thread, sizeof set, &set) == 0;
+#elif defined(PIPE_SUBSYSTEM_WINDOWS_USER)
+   DWORD_PTR mask = 0;
+   unsigned i;
+
+   for (i = 0; i < num_cpus; i++) {
+      if (cpus[i] >= sizeof(DWORD_PTR) * 8)
+         return FALSE;
+      mask |= (DWORD_PTR)1 << cpus[i];
+   }
+   return SetThreadAffinityMask(thread, mask) != 0;
+#else
+   (void) thread;
+   (void) cpus;
+   (void) num_cpus;
+   return FALSE;
+#endif
+}
+
+
+
 /*
  * Thread-specific data.
  */
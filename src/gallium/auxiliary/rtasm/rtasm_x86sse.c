@@ -123,6 +123,15 @@ void x86_print_reg( struct x86_reg reg )
    debug_printf( ", %u", I );                   \
 } while( 0 )
 
+#define DUMP_RRR( R0, R1, R2 ) do {             \
+   DUMP();                                      \
+   x86_print_reg( R0 );                            \
+   debug_printf( ", " );                        \
+   x86_print_reg( R1 );                            \
+   debug_printf( ", " );                        \
+   x86_print_reg( R2 );                            \
+} while( 0 )
+
 #else
 
 #define DUMP_START()
@@ -133,6 +142,7 @@ void x86_print_reg( struct x86_reg reg )
 #define DUMP_RR( R0, R1 )
 #define DUMP_RI( R0, I )
 #define DUMP_RRI( R0, R1, I )
+#define DUMP_RRR( R0, R1, R2 )
 
 #endif
 
@@ -1490,6 +1500,13 @@ void sse2_por( struct x86_function *p, struct x86_reg dst, struct x86_reg src )
    emit_modrm(p, dst, src);
 }
 
+void sse2_pand( struct x86_function *p, struct x86_reg dst, struct x86_reg src )
+{
+   DUMP_RR(dst, src);
+   emit_3ub(p, 0x66, 0x0f, 0xdb);
+   emit_modrm(p, dst, src);
+}
+
 void sse2_rcpps( struct x86_function *p,
                  struct x86_reg dst,
                  struct x86_reg src )
@@ -1508,6 +1525,289 @@ void sse2_rcpss( struct x86_function *p,
    emit_modrm( p, dst, src );
 }
 
+/***********************************************************************
+ * SSE4.1 instructions
+ */
+
+/* 66 0F 38 xx /r */
+static void emit_sse41_op( struct x86_function *p,
+                           unsigned char op,
+                           struct x86_reg dst,
+                           struct x86_reg src )
+{
+   emit_3ub(p, 0x66, X86_TWOB, 0x38);
+   emit_1ub(p, op);
+   emit_modrm(p, dst, src);
+}
+
+void sse41_pmovsxbd( struct x86_function *p, struct x86_reg dst, struct x86_reg src )
+{
+   DUMP_RR( dst, src );
+   emit_sse41_op(p, 0x21, dst, src);
+}
+
+void sse41_pmovsxwd( struct x86_function *p, struct x86_reg dst, struct x86_reg src )
+{
+   DUMP_RR( dst, src );
+   emit_sse41_op(p, 0x23, dst, src);
+}
+
+void sse41_pmovzxbd( struct x86_function *p, struct x86_reg dst, struct x86_reg src )
+{
+   DUMP_RR( dst, src );
+   emit_sse41_op(p, 0x31, dst, src);
+}
+
+void sse41_pmovzxwd( struct x86_function *p, struct x86_reg dst, struct x86_reg src )
+{
+   DUMP_RR( dst, src );
+   emit_sse41_op(p, 0x33, dst, src);
+}
+
+void sse41_pmulld( struct x86_function *p, struct x86_reg dst, struct x86_reg src )
+{
+   DUMP_RR( dst, src );
+   emit_sse41_op(p, 0x40, dst, src);
+}
+
+/***********************************************************************
+ * AVX, AVX2 and F16C instructions, on registers 0-7.  The *256
+ * functions emit the 256 bit forms: their XMM arguments name the YMM
+ * register with the same number.
+ */
+
+#define VEX_MAP_0F    1
+#define VEX_MAP_0F38  2
+#define VEX_MAP_0F3A  3
+
+#define VEX_PP_NONE   0
+#define VEX_PP_66     1
+#define VEX_PP_F3     2
+#define VEX_PP_F2     3
+
+/* Three byte VEX prefix.  The R, X and B bits are stored inverted, as is
+ * vvvv, the extra source register (pass 0 when unused).  l selects the
+ * 256 bit form.
+ */
+static void emit_vex3( struct x86_function *p,
+                       unsigned map,
+                       unsigned w,
+                       unsigned l,
+                       unsigned vvvv,
+                       unsigned pp )
+{
+   assert(vvvv < 8);
+   emit_3ub(p, 0xc4, 0xe0 | map,
+            (w << 7) | ((~vvvv & 0xf) << 3) | (l << 2) | pp);
+}
+
+/* VEX.256 op with the usual dst, src0 (vvvv), src1 (r/m) operands.
+ */
+static void emit_vex256_op( struct x86_function *p,
+                            unsigned map,
+                            unsigned pp,
+                            unsigned char op,
+                            struct x86_reg dst,
+                            struct x86_reg src0,
+                            struct x86_reg src1 )
+{
+   assert(src0.file == file_XMM && src0.mod == mod_REG);
+   emit_vex3(p, map, 0, 1, src0.idx, pp);
+   emit_1ub(p, op);
+   emit_modrm(p, dst, src1);
+}
+
+void avx_vcvtph2ps( struct x86_function *p, struct x86_reg dst, struct x86_reg src )
+{
+   DUMP_RR( dst, src );
+   emit_vex3(p, VEX_MAP_0F38, 0, 0, 0, VEX_PP_66);
+   emit_1ub(p, 0x13);
+   emit_modrm(p, dst, src);
+}
+
+void avx2_vpsllvd( struct x86_function *p, struct x86_reg dst,
+                   struct x86_reg src0, struct x86_reg src1 )
+{
+   DUMP_RRR( dst, src0, src1 );
+   assert(src0.file == file_XMM && src0.mod == mod_REG);
+   emit_vex3(p, VEX_MAP_0F38, 0, 0, src0.idx, VEX_PP_66);
+   emit_1ub(p, 0x47);
+   emit_modrm(p, dst, src1);
+}
+
+void avx2_vpsrlvd( struct x86_function *p, struct x86_reg dst,
+                   struct x86_reg src0, struct x86_reg src1 )
+{
+   DUMP_RRR( dst, src0, src1 );
+   assert(src0.file == file_XMM && src0.mod == mod_REG);
+   emit_vex3(p, VEX_MAP_0F38, 0, 0, src0.idx, VEX_PP_66);
+   emit_1ub(p, 0x45);
+   emit_modrm(p, dst, src1);
+}
+
+void avx_vzeroupper( struct x86_function *p )
+{
+   DUMP();
+   emit_vex3(p, VEX_MAP_0F, 0, 0, 0, VEX_PP_NONE);
+   emit_1ub(p, 0x77);
+}
+
+void avx_vmovdqu256( struct x86_function *p, struct x86_reg dst, struct x86_reg src )
+{
+   DUMP_RR( dst, src );
+   assert(dst.mod == mod_REG);
+   emit_vex3(p, VEX_MAP_0F, 0, 1, 0, VEX_PP_F3);
+   emit_1ub(p, 0x6f);
+   emit_modrm(p, dst, src);
+}
+
+void avx_vbroadcastss256( struct x86_function *p, struct x86_reg dst, struct x86_reg src )
+{
+   DUMP_RR( dst, src );
+   assert(src.mod != mod_REG);
+   emit_vex3(p, VEX_MAP_0F38, 0, 1, 0, VEX_PP_66);
+   emit_1ub(p, 0x18);
+   emit_modrm(p, dst, src);
+}
+
+/* Stores (or moves) the low (imm 0) or high (imm 1) half of src.
+ */
+void avx_vextractf128( struct x86_function *p, struct x86_reg dst,
+                       struct x86_reg src, uint8_t imm )
+{
+   DUMP_RRI( dst, src, imm );
+   assert(src.file == file_XMM && src.mod == mod_REG);
+   emit_vex3(p, VEX_MAP_0F3A, 0, 1, 0, VEX_PP_66);
+   emit_1ub(p, 0x19);
+   emit_modrm(p, src, dst);
+   emit_1ub(p, imm);
+}
+
+void avx_vxorps256( struct x86_function *p, struct x86_reg dst,
+                    struct x86_reg src0, struct x86_reg src1 )
+{
+   DUMP_RRR( dst, src0, src1 );
+   emit_vex256_op(p, VEX_MAP_0F, VEX_PP_NONE, 0x57, dst, src0, src1);
+}
+
+void avx_vunpcklps256( struct x86_function *p, struct x86_reg dst,
+                       struct x86_reg src0, struct x86_reg src1 )
+{
+   DUMP_RRR( dst, src0, src1 );
+   emit_vex256_op(p, VEX_MAP_0F, VEX_PP_NONE, 0x14, dst, src0, src1);
+}
+
+void avx_vunpckhps256( struct x86_function *p, struct x86_reg dst,
+                       struct x86_reg src0, struct x86_reg src1 )
+{
+   DUMP_RRR( dst, src0, src1 );
+   emit_vex256_op(p, VEX_MAP_0F, VEX_PP_NONE, 0x15, dst, src0, src1);
+}
+
+void avx_vshufps256( struct x86_function *p, struct x86_reg dst,
+                     struct x86_reg src0, struct x86_reg src1, uint8_t imm )
+{
+   DUMP_RRR( dst, src0, src1 );
+   emit_vex256_op(p, VEX_MAP_0F, VEX_PP_NONE, 0xc6, dst, src0, src1);
+   emit_1ub(p, imm);
+}
+
+void avx2_vpbroadcastd256( struct x86_function *p, struct x86_reg dst, struct x86_reg src )
+{
+   DUMP_RR( dst, src );
+   emit_vex3(p, VEX_MAP_0F38, 0, 1, 0, VEX_PP_66);
+   emit_1ub(p, 0x58);
+   emit_modrm(p, dst, src);
+}
+
+void avx2_vpmovzxbd256( struct x86_function *p, struct x86_reg dst, struct x86_reg src )
+{
+   DUMP_RR( dst, src );
+   emit_vex3(p, VEX_MAP_0F38, 0, 1, 0, VEX_PP_66);
+   emit_1ub(p, 0x31);
+   emit_modrm(p, dst, src);
+}
+
+void avx2_vpmovzxwd256( struct x86_function *p, struct x86_reg dst, struct x86_reg src )
+{
+   DUMP_RR( dst, src );
+   emit_vex3(p, VEX_MAP_0F38, 0, 1, 0, VEX_PP_66);
+   emit_1ub(p, 0x33);
+   emit_modrm(p, dst, src);
+}
+
+void avx2_vpcmpeqd256( struct x86_function *p, struct x86_reg dst,
+                       struct x86_reg src0, struct x86_reg src1 )
+{
+   DUMP_RRR( dst, src0, src1 );
+   emit_vex256_op(p, VEX_MAP_0F, VEX_PP_66, 0x76, dst, src0, src1);
+}
+
+void avx2_vpxor256( struct x86_function *p, struct x86_reg dst,
+                    struct x86_reg src0, struct x86_reg src1 )
+{
+   DUMP_RRR( dst, src0, src1 );
+   emit_vex256_op(p, VEX_MAP_0F, VEX_PP_66, 0xef, dst, src0, src1);
+}
+
+void avx2_vpminud256( struct x86_function *p, struct x86_reg dst,
+                      struct x86_reg src0, struct x86_reg src1 )
+{
+   DUMP_RRR( dst, src0, src1 );
+   emit_vex256_op(p, VEX_MAP_0F38, VEX_PP_66, 0x3b, dst, src0, src1);
+}
+
+void avx2_vpmulld256( struct x86_function *p, struct x86_reg dst,
+                      struct x86_reg src0, struct x86_reg src1 )
+{
+   DUMP_RRR( dst, src0, src1 );
+   emit_vex256_op(p, VEX_MAP_0F38, VEX_PP_66, 0x40, dst, src0, src1);
+}
+
+void avx2_vpslld256_imm( struct x86_function *p, struct x86_reg dst,
+                         struct x86_reg src, unsigned imm )
+{
+   DUMP_RRI( dst, src, imm );
+   assert(dst.file == file_XMM && dst.mod == mod_REG);
+   emit_vex3(p, VEX_MAP_0F, 0, 1, dst.idx, VEX_PP_66);
+   emit_1ub(p, 0x72);
+   emit_modrm_noreg(p, 6, src);
+   emit_1ub(p, imm);
+}
+
+/* vgatherdps dst, [base + index * 1], mask: loads the lanes of dst whose
+ * mask sign bit is set from base plus the signed 32 bit offsets in index,
+ * and clears mask.  dst, index and mask must all differ.
+ */
+void avx2_vgatherdps256( struct x86_function *p, struct x86_reg dst,
+                         struct x86_reg base, struct x86_reg index,
+                         struct x86_reg mask )
+{
+   DUMP_RRR( dst, base, index );
+   assert(base.file == file_REG32 && base.mod != mod_REG);
+   assert(base.idx != reg_SP);
+   assert(index.file == file_XMM && index.mod == mod_REG);
+   assert(dst.idx != index.idx && dst.idx != mask.idx && index.idx != mask.idx);
+   emit_vex3(p, VEX_MAP_0F38, 0, 1, mask.idx, VEX_PP_66);
+   emit_1ub(p, 0x92);
+   emit_1ub(p, (base.mod << 6) | (dst.idx << 3) | 4);  /* SIB follows */
+   emit_1ub(p, (index.idx << 3) | base.idx);           /* scale 1 */
+
+   switch (base.mod) {
+   case mod_INDIRECT:
+      break;
+   case mod_DISP8:
+      emit_1b(p, (char) base.disp);
+      break;
+   case mod_DISP32:
+      emit_1i(p, base.disp);
+      break;
+   default:
+      assert(0);
+      break;
+   }
+}
+
 /***********************************************************************
  * x87 instructions
  */
@@ -2164,6 +2464,13 @@ static void x86_init_func_common( struct x86_function *p )
       p->caps |= X86_SSE3;
    if(util_cpu_caps.has_sse4_1)
       p->caps |= X86_SSE4_1;
+   if(util_cpu_caps.has_avx) {
+      p->caps |= X86_AVX;
+      if(util_cpu_caps.has_avx2)
+         p->caps |= X86_AVX2;
+      if(util_cpu_caps.has_f16c)
+         p->caps |= X86_F16C;
+   }
    p->csr = p->store;
    DUMP_START();
 }
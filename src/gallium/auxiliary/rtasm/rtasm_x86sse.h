@@ -47,6 +47,9 @@ struct x86_reg {
 #define X86_SSE2 8
 #define X86_SSE3 0x10
 #define X86_SSE4_1 0x20
+#define X86_AVX 0x40
+#define X86_AVX2 0x80
+#define X86_F16C 0x100
 
 struct x86_function {
    unsigned caps;
@@ -265,6 +268,7 @@ void sse2_psraw_imm( struct x86_function *p, struct x86_reg dst, unsigned imm );
 void sse2_psrad_imm( struct x86_function *p, struct x86_reg dst, unsigned imm );
 
 void sse2_por( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
+void sse2_pand( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
 
 void sse2_pshuflw( struct x86_function *p, struct x86_reg dst, struct x86_reg src, uint8_t imm );
 void sse2_pshufhw( struct x86_function *p, struct x86_reg dst, struct x86_reg src, uint8_t imm );
@@ -308,6 +312,48 @@ void sse_unpcklps( struct x86_function *p, struct x86_reg dst, struct x86_reg sr
 void sse_pmovmskb( struct x86_function *p, struct x86_reg dest, struct x86_reg src );
 void sse_movmskps( struct x86_function *p, struct x86_reg dst, struct x86_reg src);
 
+void sse41_pmovsxbd( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
+void sse41_pmovsxwd( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
+void sse41_pmovzxbd( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
+void sse41_pmovzxwd( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
+void sse41_pmulld( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
+
+void avx_vcvtph2ps( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
+void avx2_vpsllvd( struct x86_function *p, struct x86_reg dst,
+                   struct x86_reg src0, struct x86_reg src1 );
+void avx2_vpsrlvd( struct x86_function *p, struct x86_reg dst,
+                   struct x86_reg src0, struct x86_reg src1 );
+
+void avx_vzeroupper( struct x86_function *p );
+void avx_vmovdqu256( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
+void avx_vbroadcastss256( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
+void avx_vextractf128( struct x86_function *p, struct x86_reg dst,
+                       struct x86_reg src, uint8_t imm );
+void avx_vxorps256( struct x86_function *p, struct x86_reg dst,
+                    struct x86_reg src0, struct x86_reg src1 );
+void avx_vunpcklps256( struct x86_function *p, struct x86_reg dst,
+                       struct x86_reg src0, struct x86_reg src1 );
+void avx_vunpckhps256( struct x86_function *p, struct x86_reg dst,
+                       struct x86_reg src0, struct x86_reg src1 );
+void avx_vshufps256( struct x86_function *p, struct x86_reg dst,
+                     struct x86_reg src0, struct x86_reg src1, uint8_t imm );
+void avx2_vpbroadcastd256( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
+void avx2_vpmovzxbd256( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
+void avx2_vpmovzxwd256( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
+void avx2_vpcmpeqd256( struct x86_function *p, struct x86_reg dst,
+                       struct x86_reg src0, struct x86_reg src1 );
+void avx2_vpxor256( struct x86_function *p, struct x86_reg dst,
+                    struct x86_reg src0, struct x86_reg src1 );
+void avx2_vpminud256( struct x86_function *p, struct x86_reg dst,
+                      struct x86_reg src0, struct x86_reg src1 );
+void avx2_vpmulld256( struct x86_function *p, struct x86_reg dst,
+                      struct x86_reg src0, struct x86_reg src1 );
+void avx2_vpslld256_imm( struct x86_function *p, struct x86_reg dst,
+                         struct x86_reg src, unsigned imm );
+void avx2_vgatherdps256( struct x86_function *p, struct x86_reg dst,
+                         struct x86_reg base, struct x86_reg index,
+                         struct x86_reg mask );
+
 void x86_add( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
 void x86_and( struct x86_function *p, struct x86_reg dst, struct x86_reg src );
 void x86_cmovcc( struct x86_function *p, struct x86_reg dst, struct x86_reg src, enum x86_cc cc );
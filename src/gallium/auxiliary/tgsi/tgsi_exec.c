@@ -58,6 +58,7 @@
 #include "tgsi/tgsi_parse.h"
 #include "tgsi/tgsi_util.h"
 #include "tgsi_exec.h"
+#include "util/u_debug.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
 
@@ -578,6 +579,13 @@ tgsi_exec_set_constant_buffers(struct tgsi_exec_machine *mach,
 }
 
 
+static void
+compile_uops(struct tgsi_exec_machine *mach);
+
+static void
+free_uops(struct tgsi_exec_machine *mach);
+
+
 /**
  * Check if there's a potential src/dst register data dependency when
  * using SOA execution.
@@ -670,6 +678,8 @@ tgsi_exec_machine_bind_shader(
       mach->Instructions = NULL;
       mach->NumInstructions = 0;
 
+      free_uops(mach);
+
       return;
    }
 
@@ -804,6 +814,8 @@ tgsi_exec_machine_bind_shader(
    FREE(mach->Instructions);
    mach->Instructions = instructions;
    mach->NumInstructions = numInstructions;
+
+   compile_uops(mach);
 }
 
 
@@ -822,12 +834,22 @@ tgsi_exec_machine_create( void )
    mach->Addrs = &mach->Temps[TGSI_EXEC_TEMP_ADDR];
    mach->MaxGeometryShaderOutputs = TGSI_MAX_TOTAL_VERTICES;
    mach->Predicates = &mach->Temps[TGSI_EXEC_TEMP_P0];
+   mach->NoUops = debug_get_bool_option("TGSI_EXEC_NO_UOPS", FALSE);
+   mach->MaxWidth = debug_get_num_option("TGSI_EXEC_WIDTH", TGSI_EXEC_MAX_WIDTH);
+   mach->MaxWidth = CLAMP(mach->MaxWidth, TGSI_QUAD_SIZE, TGSI_EXEC_MAX_WIDTH);
+   mach->MaxWidth &= ~(TGSI_QUAD_SIZE - 1);
 
    mach->Inputs = align_malloc(sizeof(struct tgsi_exec_vector) * PIPE_MAX_ATTRIBS, 16);
    mach->Outputs = align_malloc(sizeof(struct tgsi_exec_vector) * PIPE_MAX_ATTRIBS, 16);
    if (!mach->Inputs || !mach->Outputs)
       goto fail;
 
+   if (mach->MaxWidth > TGSI_QUAD_SIZE) {
+      /* not fatal, the shaders then run a quad at a time */
+      mach->WideInputs = align_malloc(sizeof(struct tgsi_exec_wide_vector) * PIPE_MAX_ATTRIBS, 16);
+      mach->WideOutputs = align_malloc(sizeof(struct tgsi_exec_wide_vector) * PIPE_MAX_ATTRIBS, 16);
+   }
+
    /* Setup constants needed by the SSE2 executor. */
    for( i = 0; i < 4; i++ ) {
       mach->Temps[TGSI_EXEC_TEMP_00000000_I].xyzw[TGSI_EXEC_TEMP_00000000_C].u[i] = 0x00000000;
@@ -854,6 +876,8 @@ fail:
    if (mach) {
       align_free(mach->Inputs);
       align_free(mach->Outputs);
+      align_free(mach->WideInputs);
+      align_free(mach->WideOutputs);
       align_free(mach);
    }
    return NULL;
@@ -864,11 +888,14 @@ void
 tgsi_exec_machine_destroy(struct tgsi_exec_machine *mach)
 {
    if (mach) {
+      free_uops(mach);
       FREE(mach->Instructions);
       FREE(mach->Declarations);
 
       align_free(mach->Inputs);
       align_free(mach->Outputs);
+      align_free(mach->WideInputs);
+      align_free(mach->WideOutputs);
 
       align_free(mach);
    }
@@ -4438,6 +4465,983 @@ exec_instruction(
 }
 
 
+/*
+ * Pre-decoded execution.
+ *
+ * exec_instruction() decodes the operands of every instruction each time
+ * it runs: register files, indirection, swizzles and modifiers.  When a
+ * shader is bound, the instructions which don't need any of that at run
+ * time (plain ALU instructions reading direct registers) are lowered to
+ * micro ops holding pointers to the source channels, already swizzled,
+ * and to the destination channels.  The other instructions (flow control,
+ * texturing, indirect addressing, predication...) are left to
+ * exec_instruction().  There is one micro op per instruction, so that
+ * the program counter means the same for both.
+ *
+ * The micro ops call the same micro_x() functions as exec_instruction(),
+ * so the results are identical.
+ *
+ * Vertex shaders made only of micro ops (no flow control, texturing,
+ * derivatives or system values) are also lowered a second time, to run
+ * on up to TGSI_EXEC_MAX_WIDTH lanes at once: each channel is then a
+ * tgsi_exec_wide_channel, i.e. several consecutive quads, and the micro
+ * ops loop over the quads.  See tgsi_exec_machine_run_wide().
+ */
+
+#define TGSI_EXEC_MAX_QUADS (TGSI_EXEC_MAX_WIDTH / TGSI_QUAD_SIZE)
+
+enum tgsi_exec_uop_kind {
+   TGSI_EXEC_UOP_INSTRUCTION,   /**< use exec_instruction() */
+   TGSI_EXEC_UOP_MOV,
+   TGSI_EXEC_UOP_ADD,
+   TGSI_EXEC_UOP_MUL,
+   TGSI_EXEC_UOP_MAD,
+   TGSI_EXEC_UOP_DP3,
+   TGSI_EXEC_UOP_DP4,
+   TGSI_EXEC_UOP_VECTOR_UNARY,
+   TGSI_EXEC_UOP_VECTOR_BINARY,
+   TGSI_EXEC_UOP_VECTOR_TRINARY,
+   TGSI_EXEC_UOP_SCALAR_UNARY,
+   TGSI_EXEC_UOP_SCALAR_BINARY,
+   TGSI_EXEC_UOP_COUNT
+};
+
+#define TGSI_EXEC_UOP_ABS     0x1
+#define TGSI_EXEC_UOP_NEGATE  0x2
+#define TGSI_EXEC_UOP_INT     0x4   /**< modifiers are integer ones */
+
+struct tgsi_exec_uop_src
+{
+   /** first quad of each channel, the others follow in wide mode */
+   const union tgsi_exec_channel *chan[TGSI_NUM_CHANNELS];
+   unsigned mod;
+};
+
+struct tgsi_exec_uop
+{
+   enum tgsi_exec_uop_kind kind;
+   unsigned writemask;
+   unsigned saturate;
+   union tgsi_exec_channel *dst[TGSI_NUM_CHANNELS];
+   struct tgsi_exec_uop_src src[3];
+   union {
+      micro_unary_op unary;
+      micro_binary_op binary;
+      micro_trinary_op trinary;
+   } func;
+   const struct tgsi_full_instruction *inst;
+};
+
+/** A constant buffer vector read by the micro ops */
+struct tgsi_exec_uop_const
+{
+   unsigned buf;
+   int index;
+};
+
+struct tgsi_exec_uops
+{
+   struct tgsi_exec_uop *uops;
+
+   /** Immediates, each channel replicated across all the lanes */
+   union tgsi_exec_wide_channel (*imms)[TGSI_NUM_CHANNELS];
+
+   /** Constants, replicated like the immediates at the start of each run */
+   struct tgsi_exec_uop_const *const_regs;
+   union tgsi_exec_wide_channel (*consts)[TGSI_NUM_CHANNELS];
+   unsigned num_consts;
+
+   /** Wide mode program and temporaries, or NULL */
+   struct tgsi_exec_uop *wide_uops;
+   union tgsi_exec_wide_channel (*wide_temps)[TGSI_NUM_CHANNELS];
+};
+
+
+static boolean
+uop_set_opcode(struct tgsi_exec_uop *uop, unsigned opcode)
+{
+   unsigned src_type = TGSI_EXEC_DATA_FLOAT;
+
+#define UOP(OPCODE, KIND) \
+   case TGSI_OPCODE_##OPCODE: \
+      uop->kind = TGSI_EXEC_UOP_##KIND; \
+      break;
+#define UOP_FUNC(OPCODE, KIND, FIELD, FUNC, SRC_TYPE) \
+   case TGSI_OPCODE_##OPCODE: \
+      uop->kind = TGSI_EXEC_UOP_##KIND; \
+      uop->func.FIELD = FUNC; \
+      src_type = TGSI_EXEC_DATA_##SRC_TYPE; \
+      break;
+#define UNARY(OPCODE, FUNC, SRC_TYPE) \
+   UOP_FUNC(OPCODE, VECTOR_UNARY, unary, FUNC, SRC_TYPE)
+#define BINARY(OPCODE, FUNC, SRC_TYPE) \
+   UOP_FUNC(OPCODE, VECTOR_BINARY, binary, FUNC, SRC_TYPE)
+#define TRINARY(OPCODE, FUNC, SRC_TYPE) \
+   UOP_FUNC(OPCODE, VECTOR_TRINARY, trinary, FUNC, SRC_TYPE)
+#define SCALAR_UNARY(OPCODE, FUNC) \
+   UOP_FUNC(OPCODE, SCALAR_UNARY, unary, FUNC, FLOAT)
+#define SCALAR_BINARY(OPCODE, FUNC) \
+   UOP_FUNC(OPCODE, SCALAR_BINARY, binary, FUNC, FLOAT)
+
+   switch (opcode) {
+   UOP(MOV, MOV)
+   UOP(ADD, ADD)
+   UOP(MUL, MUL)
+   UOP(MAD, MAD)
+   UOP(DP3, DP3)
+   UOP(DP4, DP4)
+
+   SCALAR_UNARY(RCP, micro_rcp)
+   SCALAR_UNARY(RSQ, micro_rsq)
+   SCALAR_UNARY(SQRT, micro_sqrt)
+   SCALAR_UNARY(EX2, micro_exp2)
+   SCALAR_UNARY(LG2, micro_lg2)
+   SCALAR_UNARY(COS, micro_cos)
+   SCALAR_UNARY(SIN, micro_sin)
+   SCALAR_BINARY(POW, micro_pow)
+
+   UNARY(ABS, micro_abs, FLOAT)
+   UNARY(FRC, micro_frc, FLOAT)
+   UNARY(FLR, micro_flr, FLOAT)
+   UNARY(CEIL, micro_ceil, FLOAT)
+   UNARY(TRUNC, micro_trunc, FLOAT)
+   UNARY(ROUND, micro_rnd, FLOAT)
+   UNARY(SSG, micro_sgn, FLOAT)
+   UNARY(DDX, micro_ddx, FLOAT)
+   UNARY(DDY, micro_ddy, FLOAT)
+   UNARY(F2I, micro_f2i, FLOAT)
+   UNARY(F2U, micro_f2u, FLOAT)
+   UNARY(I2F, micro_i2f, INT)
+   UNARY(U2F, micro_u2f, UINT)
+   UNARY(NOT, micro_not, UINT)
+   UNARY(INEG, micro_ineg, INT)
+   UNARY(IABS, micro_iabs, INT)
+   UNARY(ISSG, micro_isgn, INT)
+
+   BINARY(SUB, micro_sub, FLOAT)
+   BINARY(DIV, micro_div, FLOAT)
+   BINARY(MIN, micro_min, FLOAT)
+   BINARY(MAX, micro_max, FLOAT)
+   BINARY(SLT, micro_slt, FLOAT)
+   BINARY(SGE, micro_sge, FLOAT)
+   BINARY(SEQ, micro_seq, FLOAT)
+   BINARY(SGT, micro_sgt, FLOAT)
+   BINARY(SLE, micro_sle, FLOAT)
+   BINARY(SNE, micro_sne, FLOAT)
+   BINARY(FSEQ, micro_fseq, FLOAT)
+   BINARY(FSGE, micro_fsge, FLOAT)
+   BINARY(FSLT, micro_fslt, FLOAT)
+   BINARY(FSNE, micro_fsne, FLOAT)
+   BINARY(AND, micro_and, UINT)
+   BINARY(OR, micro_or, UINT)
+   BINARY(XOR, micro_xor, UINT)
+   BINARY(SHL, micro_shl, UINT)
+   BINARY(ISHR, micro_ishr, INT)
+   BINARY(USHR, micro_ushr, UINT)
+   BINARY(UADD, micro_uadd, INT)
+   BINARY(UMUL, micro_umul, UINT)
+   BINARY(IMAX, micro_imax, INT)
+   BINARY(IMIN, micro_imin, INT)
+   BINARY(UMAX, micro_umax, UINT)
+   BINARY(UMIN, micro_umin, UINT)
+   BINARY(ISGE, micro_isge, INT)
+   BINARY(ISLT, micro_islt, INT)
+   BINARY(USEQ, micro_useq, UINT)
+   BINARY(USNE, micro_usne, UINT)
+   BINARY(USGE, micro_usge, UINT)
+   BINARY(USLT, micro_uslt, UINT)
+
+   TRINARY(LRP, micro_lrp, FLOAT)
+   TRINARY(CMP, micro_cmp, FLOAT)
+   TRINARY(CND, micro_cnd, FLOAT)
+   TRINARY(CLAMP, micro_clamp, FLOAT)
+   TRINARY(UMAD, micro_umad, UINT)
+   TRINARY(UCMP, micro_ucmp, UINT)
+
+   default:
+      return FALSE;
+   }
+
+#undef UOP
+#undef UOP_FUNC
+#undef UNARY
+#undef BINARY
+#undef TRINARY
+#undef SCALAR_UNARY
+#undef SCALAR_BINARY
+
+   if (src_type != TGSI_EXEC_DATA_FLOAT) {
+      uop->src[0].mod = TGSI_EXEC_UOP_INT;
+      uop->src[1].mod = TGSI_EXEC_UOP_INT;
+      uop->src[2].mod = TGSI_EXEC_UOP_INT;
+   }
+   return TRUE;
+}
+
+
+static INLINE void
+uop_quad_vector(const union tgsi_exec_channel *vec[TGSI_NUM_CHANNELS],
+                const union tgsi_exec_channel *xyzw)
+{
+   unsigned chan;
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      vec[chan] = &xyzw[chan];
+   }
+}
+
+
+/**
+ * Resolve a source register to pointers to its channels.
+ * \return FALSE if the register can't be read without decoding it
+ */
+static boolean
+uop_resolve_src(struct tgsi_exec_machine *mach,
+                struct tgsi_exec_uops *uops,
+                boolean wide,
+                struct tgsi_exec_uop_src *src,
+                const struct tgsi_full_src_register *reg)
+{
+   const union tgsi_exec_channel *vec[TGSI_NUM_CHANNELS];
+   const union tgsi_exec_wide_channel *wide_vec = NULL;
+   unsigned index = reg->Register.Index;
+   unsigned chan;
+
+   if (reg->Register.Indirect)
+      return FALSE;
+
+   switch (reg->Register.File) {
+   case TGSI_FILE_TEMPORARY:
+      if (reg->Register.Dimension || index >= TGSI_EXEC_NUM_TEMPS)
+         return FALSE;
+      if (wide)
+         wide_vec = uops->wide_temps[index];
+      else
+         uop_quad_vector(vec, mach->Temps[index].xyzw);
+      break;
+
+   case TGSI_FILE_INPUT:
+      if (reg->Register.Dimension)
+         return FALSE;
+      if (wide)
+         wide_vec = mach->WideInputs[index].xyzw;
+      else
+         uop_quad_vector(vec, mach->Inputs[index].xyzw);
+      break;
+
+   case TGSI_FILE_OUTPUT:
+      if (reg->Register.Dimension ||
+          mach->Processor == TGSI_PROCESSOR_GEOMETRY)
+         return FALSE;
+      if (wide)
+         wide_vec = mach->WideOutputs[index].xyzw;
+      else
+         uop_quad_vector(vec, mach->Outputs[index].xyzw);
+      break;
+
+   case TGSI_FILE_IMMEDIATE:
+      if (reg->Register.Dimension || index >= mach->ImmLimit)
+         return FALSE;
+      wide_vec = uops->imms[index];
+      break;
+
+   case TGSI_FILE_CONSTANT:
+      {
+         unsigned buf = 0;
+         unsigned i;
+
+         if (reg->Register.Dimension) {
+            if (reg->Dimension.Indirect)
+               return FALSE;
+            buf = reg->Dimension.Index;
+         }
+         if (buf >= PIPE_MAX_CONSTANT_BUFFERS)
+            return FALSE;
+
+         for (i = 0; i < uops->num_consts; i++) {
+            if (uops->const_regs[i].buf == buf &&
+                uops->const_regs[i].index == (int) index)
+               break;
+         }
+         if (i == uops->num_consts) {
+            uops->const_regs[i].buf = buf;
+            uops->const_regs[i].index = index;
+            uops->num_consts++;
+         }
+         wide_vec = uops->consts[i];
+      }
+      break;
+
+   default:
+      return FALSE;
+   }
+
+   if (wide_vec) {
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         vec[chan] = &wide_vec[chan].quad[0];
+      }
+   }
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      src->chan[chan] = vec[tgsi_util_get_full_src_register_swizzle(reg, chan)];
+   }
+   if (reg->Register.Absolute)
+      src->mod |= TGSI_EXEC_UOP_ABS;
+   if (reg->Register.Negate)
+      src->mod |= TGSI_EXEC_UOP_NEGATE;
+   return TRUE;
+}
+
+
+static boolean
+uop_resolve_dst(struct tgsi_exec_machine *mach,
+                struct tgsi_exec_uops *uops,
+                boolean wide,
+                struct tgsi_exec_uop *uop,
+                const struct tgsi_full_dst_register *reg)
+{
+   union tgsi_exec_channel *vec = NULL;
+   union tgsi_exec_wide_channel *wide_vec = NULL;
+   unsigned index = reg->Register.Index;
+   unsigned chan;
+
+   if (reg->Register.Indirect || reg->Register.Dimension)
+      return FALSE;
+
+   switch (reg->Register.File) {
+   case TGSI_FILE_TEMPORARY:
+      if (index >= TGSI_EXEC_NUM_TEMPS)
+         return FALSE;
+      if (wide)
+         wide_vec = uops->wide_temps[index];
+      else
+         vec = mach->Temps[index].xyzw;
+      break;
+
+   case TGSI_FILE_OUTPUT:
+      /* geometry shaders move the outputs on each EMIT */
+      if (mach->Processor == TGSI_PROCESSOR_GEOMETRY)
+         return FALSE;
+      if (wide)
+         wide_vec = mach->WideOutputs[index].xyzw;
+      else
+         vec = mach->Outputs[index].xyzw;
+      break;
+
+   default:
+      return FALSE;
+   }
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      uop->dst[chan] = wide ? &wide_vec[chan].quad[0] : &vec[chan];
+   }
+   uop->writemask = reg->Register.WriteMask;
+   return TRUE;
+}
+
+
+static void
+uop_lower_instruction(struct tgsi_exec_machine *mach,
+                      struct tgsi_exec_uops *uops,
+                      boolean wide,
+                      struct tgsi_exec_uop *uop,
+                      const struct tgsi_full_instruction *inst)
+{
+   unsigned num_consts = uops->num_consts;
+   unsigned i;
+
+   memset(uop, 0, sizeof *uop);
+   uop->inst = inst;
+
+   if (inst->Instruction.NumDstRegs != 1 ||
+       inst->Instruction.NumSrcRegs > Elements(uop->src) ||
+       inst->Instruction.Predicate ||
+       !uop_set_opcode(uop, inst->Instruction.Opcode) ||
+       !uop_resolve_dst(mach, uops, wide, uop, &inst->Dst[0]))
+      goto fallback;
+
+   for (i = 0; i < inst->Instruction.NumSrcRegs; i++) {
+      if (!uop_resolve_src(mach, uops, wide, &uop->src[i], &inst->Src[i]))
+         goto fallback;
+   }
+
+   uop->saturate = inst->Instruction.Saturate;
+   return;
+
+fallback:
+   memset(uop, 0, sizeof *uop);
+   uop->kind = TGSI_EXEC_UOP_INSTRUCTION;
+   uop->inst = inst;
+   uops->num_consts = num_consts;
+}
+
+
+static void
+free_uops(struct tgsi_exec_machine *mach)
+{
+   if (mach->Uops) {
+      FREE(mach->Uops->uops);
+      align_free(mach->Uops->imms);
+      FREE(mach->Uops->const_regs);
+      align_free(mach->Uops->consts);
+      FREE(mach->Uops->wide_uops);
+      align_free(mach->Uops->wide_temps);
+      FREE(mach->Uops);
+      mach->Uops = NULL;
+   }
+}
+
+
+/**
+ * Whether the lanes of an instruction's micro op are independent of each
+ * other and safe to compute for lanes holding garbage.
+ */
+static boolean
+uop_is_lane_independent(const struct tgsi_exec_uop *uop)
+{
+   switch (uop->inst->Instruction.Opcode) {
+   case TGSI_OPCODE_DDX:
+   case TGSI_OPCODE_DDY:
+   case TGSI_OPCODE_IDIV:
+   case TGSI_OPCODE_UDIV:
+   case TGSI_OPCODE_MOD:
+   case TGSI_OPCODE_UMOD:
+      return FALSE;
+   default:
+      return uop->kind != TGSI_EXEC_UOP_INSTRUCTION;
+   }
+}
+
+
+/**
+ * Lower the shader a second time for wide mode, if it is a vertex shader
+ * made only of lane independent micro ops followed by END.
+ */
+static void
+compile_wide_uops(struct tgsi_exec_machine *mach)
+{
+   struct tgsi_exec_uops *uops = mach->Uops;
+   unsigned num_temps = 0;
+   unsigned i, j;
+
+   if (mach->Processor != TGSI_PROCESSOR_VERTEX ||
+       mach->MaxWidth <= TGSI_QUAD_SIZE ||
+       !mach->WideInputs || !mach->WideOutputs)
+      return;
+
+   for (i = 0; i < mach->NumInstructions; i++) {
+      const struct tgsi_full_instruction *inst = &mach->Instructions[i];
+
+      if (i == mach->NumInstructions - 1) {
+         if (inst->Instruction.Opcode != TGSI_OPCODE_END)
+            return;
+         break;
+      }
+      if (!uop_is_lane_independent(&uops->uops[i]))
+         return;
+
+      if (inst->Dst[0].Register.File == TGSI_FILE_TEMPORARY)
+         num_temps = MAX2(num_temps, inst->Dst[0].Register.Index + 1);
+      for (j = 0; j < inst->Instruction.NumSrcRegs; j++) {
+         if (inst->Src[j].Register.File == TGSI_FILE_TEMPORARY)
+            num_temps = MAX2(num_temps, inst->Src[j].Register.Index + 1);
+      }
+   }
+
+   uops->wide_uops = MALLOC(mach->NumInstructions * sizeof *uops->wide_uops);
+   uops->wide_temps = align_malloc(MAX2(num_temps, 1) * sizeof *uops->wide_temps,
+                                   16);
+   if (!uops->wide_uops || !uops->wide_temps) {
+      FREE(uops->wide_uops);
+      align_free(uops->wide_temps);
+      uops->wide_uops = NULL;
+      uops->wide_temps = NULL;
+      return;
+   }
+   for (i = 0; i < mach->NumInstructions; i++) {
+      uop_lower_instruction(mach, uops, TRUE, &uops->wide_uops[i],
+                            &mach->Instructions[i]);
+      assert(i == mach->NumInstructions - 1 ||
+             uops->wide_uops[i].kind != TGSI_EXEC_UOP_INSTRUCTION);
+   }
+}
+
+
+/**
+ * Lower the bound shader's instructions to micro ops.  Leaves
+ * mach->Uops NULL on failure, in which case everything goes through
+ * exec_instruction().
+ */
+static void
+compile_uops(struct tgsi_exec_machine *mach)
+{
+   struct tgsi_exec_uops *uops;
+   unsigned max_consts = mach->NumInstructions * 3;
+   unsigned i, chan, lane;
+
+   free_uops(mach);
+
+   if (mach->NoUops || !mach->NumInstructions)
+      return;
+
+   uops = CALLOC_STRUCT(tgsi_exec_uops);
+   if (!uops)
+      return;
+   mach->Uops = uops;
+
+   uops->uops = MALLOC(mach->NumInstructions * sizeof *uops->uops);
+   uops->imms = align_malloc(MAX2(mach->ImmLimit, 1) * sizeof *uops->imms, 16);
+   uops->const_regs = MALLOC(max_consts * sizeof *uops->const_regs);
+   uops->consts = align_malloc(max_consts * sizeof *uops->consts, 16);
+   if (!uops->uops || !uops->imms || !uops->const_regs || !uops->consts) {
+      free_uops(mach);
+      return;
+   }
+
+   for (i = 0; i < mach->ImmLimit; i++) {
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         for (lane = 0; lane < TGSI_EXEC_MAX_WIDTH; lane++) {
+            uops->imms[i][chan].f[lane] = mach->Imms[i][chan];
+         }
+      }
+   }
+
+   for (i = 0; i < mach->NumInstructions; i++) {
+      uop_lower_instruction(mach, uops, FALSE, &uops->uops[i],
+                            &mach->Instructions[i]);
+   }
+
+   compile_wide_uops(mach);
+}
+
+
+/**
+ * Replicate the constants read by the micro ops, with the same bounds
+ * checks as fetch_src_file_channel().
+ */
+static void
+uop_fetch_consts(struct tgsi_exec_machine *mach, unsigned num_quads)
+{
+   struct tgsi_exec_uops *uops = mach->Uops;
+   unsigned i, chan, q;
+
+   for (i = 0; i < uops->num_consts; i++) {
+      const unsigned constbuf = uops->const_regs[i].buf;
+      const uint *buf = (const uint *) mach->Consts[constbuf];
+
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         const int pos = uops->const_regs[i].index * 4 + chan;
+         uint value = 0;
+
+         assert(buf);
+         if (buf && pos >= 0 && pos < (int) mach->ConstsSize[constbuf])
+            value = buf[pos];
+
+         for (q = 0; q < num_quads; q++) {
+            uops->consts[i][chan].quad[q].u[0] =
+            uops->consts[i][chan].quad[q].u[1] =
+            uops->consts[i][chan].quad[q].u[2] =
+            uops->consts[i][chan].quad[q].u[3] = value;
+         }
+      }
+   }
+}
+
+
+/**
+ * Source channel of a micro op, for the given quad, with the modifiers
+ * applied as in fetch_source().
+ */
+static INLINE const union tgsi_exec_channel *
+uop_fetch(const struct tgsi_exec_uop_src *src,
+          unsigned chan,
+          unsigned q,
+          union tgsi_exec_channel *tmp)
+{
+   if (!(src->mod & (TGSI_EXEC_UOP_ABS | TGSI_EXEC_UOP_NEGATE)))
+      return src->chan[chan] + q;
+
+   *tmp = src->chan[chan][q];
+   if (src->mod & TGSI_EXEC_UOP_ABS) {
+      if (src->mod & TGSI_EXEC_UOP_INT)
+         micro_iabs(tmp, tmp);
+      else
+         micro_abs(tmp, tmp);
+   }
+   if (src->mod & TGSI_EXEC_UOP_NEGATE) {
+      if (src->mod & TGSI_EXEC_UOP_INT)
+         micro_ineg(tmp, tmp);
+      else
+         micro_neg(tmp, tmp);
+   }
+   return tmp;
+}
+
+
+/**
+ * Store a result for the given quad like store_dest() does.
+ */
+static INLINE void
+uop_store(const struct tgsi_exec_uop *uop,
+          uint execmask,
+          unsigned chan,
+          unsigned q,
+          const union tgsi_exec_channel *val)
+{
+   union tgsi_exec_channel *dst = uop->dst[chan] + q;
+   uint i;
+
+   switch (uop->saturate) {
+   case TGSI_SAT_NONE:
+      if (execmask == 0xf) {
+         *dst = *val;
+      }
+      else {
+         for (i = 0; i < TGSI_QUAD_SIZE; i++)
+            if (execmask & (1 << i))
+               dst->i[i] = val->i[i];
+      }
+      break;
+
+   case TGSI_SAT_ZERO_ONE:
+      for (i = 0; i < TGSI_QUAD_SIZE; i++)
+         if (execmask & (1 << i)) {
+            if (val->f[i] < 0.0f)
+               dst->f[i] = 0.0f;
+            else if (val->f[i] > 1.0f)
+               dst->f[i] = 1.0f;
+            else
+               dst->i[i] = val->i[i];
+         }
+      break;
+
+   case TGSI_SAT_MINUS_PLUS_ONE:
+      for (i = 0; i < TGSI_QUAD_SIZE; i++)
+         if (execmask & (1 << i)) {
+            if (val->f[i] < -1.0f)
+               dst->f[i] = -1.0f;
+            else if (val->f[i] > 1.0f)
+               dst->f[i] = 1.0f;
+            else
+               dst->i[i] = val->i[i];
+         }
+      break;
+
+   default:
+      assert(0);
+   }
+}
+
+
+/** Store the enabled channels of a vector result */
+static INLINE void
+uop_store_vector(const struct tgsi_exec_uop *uop,
+                 uint execmask,
+                 unsigned q,
+                 const struct tgsi_exec_vector *val)
+{
+   unsigned chan;
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (uop->writemask & (1 << chan))
+         uop_store(uop, execmask, chan, q, &val->xyzw[chan]);
+   }
+}
+
+
+/** Store a scalar result into all the enabled channels */
+static INLINE void
+uop_store_scalar(const struct tgsi_exec_uop *uop,
+                 uint execmask,
+                 unsigned q,
+                 const union tgsi_exec_channel *val)
+{
+   unsigned chan;
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (uop->writemask & (1 << chan))
+         uop_store(uop, execmask, chan, q, val);
+   }
+}
+
+
+static INLINE void
+uop_dot(const struct tgsi_exec_uop *uop,
+        unsigned num_chans,
+        unsigned q,
+        union tgsi_exec_channel *dst)
+{
+   union tgsi_exec_channel tmp[2];
+   unsigned chan;
+
+   micro_mul(dst,
+             uop_fetch(&uop->src[0], TGSI_CHAN_X, q, &tmp[0]),
+             uop_fetch(&uop->src[1], TGSI_CHAN_X, q, &tmp[1]));
+   for (chan = TGSI_CHAN_Y; chan < num_chans; chan++) {
+      micro_mad(dst,
+                uop_fetch(&uop->src[0], chan, q, &tmp[0]),
+                uop_fetch(&uop->src[1], chan, q, &tmp[1]),
+                dst);
+   }
+}
+
+
+/*
+ * Dispatch to the next micro op: with GCC's labels as values, each
+ * handler jumps directly to the next one instead of going back to a
+ * central switch.
+ */
+#if defined(PIPE_CC_GCC)
+#define UOP_THREADED_DISPATCH 1
+#endif
+
+#if UOP_THREADED_DISPATCH
+#define UOP_CASE(KIND)  uop_##KIND:
+#define UOP_NEXT() \
+   do { \
+      if (pc == -1) \
+         return; \
+      assert(pc < (int) mach->NumInstructions); \
+      uop = &uops[pc]; \
+      goto *dispatch[uop->kind]; \
+   } while (0)
+#else
+#define UOP_CASE(KIND)  case TGSI_EXEC_UOP_##KIND:
+#define UOP_NEXT()  continue
+#endif
+
+/** Loop over the quads of the run, each quad is computed then stored */
+#define UOP_FOREACH_QUAD(q)  for (q = 0; q < num_quads; q++)
+
+
+/**
+ * Execute the micro ops, until the program counter is set to -1.
+ *
+ * In wide mode every micro op is applied to num_quads consecutive quads,
+ * with all the lanes enabled; the final END only stops the run.
+ */
+static void
+exec_uops(struct tgsi_exec_machine *mach,
+          const struct tgsi_exec_uop *uops,
+          unsigned num_quads,
+          boolean wide)
+{
+   const struct tgsi_exec_uop *uop;
+   uint execmask = wide ? 0xf : mach->ExecMask;
+   struct tgsi_exec_vector r;
+   union tgsi_exec_channel tmp[3];
+   unsigned chan, q;
+   int pc = 0;
+
+#if UOP_THREADED_DISPATCH
+   static const void *dispatch[TGSI_EXEC_UOP_COUNT] = {
+      [TGSI_EXEC_UOP_INSTRUCTION] = &&uop_INSTRUCTION,
+      [TGSI_EXEC_UOP_MOV] = &&uop_MOV,
+      [TGSI_EXEC_UOP_ADD] = &&uop_ADD,
+      [TGSI_EXEC_UOP_MUL] = &&uop_MUL,
+      [TGSI_EXEC_UOP_MAD] = &&uop_MAD,
+      [TGSI_EXEC_UOP_DP3] = &&uop_DP3,
+      [TGSI_EXEC_UOP_DP4] = &&uop_DP4,
+      [TGSI_EXEC_UOP_VECTOR_UNARY] = &&uop_VECTOR_UNARY,
+      [TGSI_EXEC_UOP_VECTOR_BINARY] = &&uop_VECTOR_BINARY,
+      [TGSI_EXEC_UOP_VECTOR_TRINARY] = &&uop_VECTOR_TRINARY,
+      [TGSI_EXEC_UOP_SCALAR_UNARY] = &&uop_SCALAR_UNARY,
+      [TGSI_EXEC_UOP_SCALAR_BINARY] = &&uop_SCALAR_BINARY
+   };
+
+   UOP_NEXT();
+#else
+   while (pc != -1) {
+      assert(pc < (int) mach->NumInstructions);
+      uop = &uops[pc];
+
+      switch (uop->kind) {
+#endif
+
+      UOP_CASE(INSTRUCTION)
+         if (wide) {
+            assert(uop->inst->Instruction.Opcode == TGSI_OPCODE_END);
+            pc = -1;
+         }
+         else {
+            /* flow control changes the execution mask */
+            exec_instruction(mach, uop->inst, &pc);
+            execmask = mach->ExecMask;
+         }
+         UOP_NEXT();
+
+      UOP_CASE(MOV)
+         UOP_FOREACH_QUAD(q) {
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+               if (uop->writemask & (1 << chan))
+                  r.xyzw[chan] = *uop_fetch(&uop->src[0], chan, q, &tmp[0]);
+            }
+            uop_store_vector(uop, execmask, q, &r);
+         }
+         pc++;
+         UOP_NEXT();
+
+      UOP_CASE(ADD)
+         UOP_FOREACH_QUAD(q) {
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+               if (uop->writemask & (1 << chan))
+                  micro_add(&r.xyzw[chan],
+                            uop_fetch(&uop->src[0], chan, q, &tmp[0]),
+                            uop_fetch(&uop->src[1], chan, q, &tmp[1]));
+            }
+            uop_store_vector(uop, execmask, q, &r);
+         }
+         pc++;
+         UOP_NEXT();
+
+      UOP_CASE(MUL)
+         UOP_FOREACH_QUAD(q) {
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+               if (uop->writemask & (1 << chan))
+                  micro_mul(&r.xyzw[chan],
+                            uop_fetch(&uop->src[0], chan, q, &tmp[0]),
+                            uop_fetch(&uop->src[1], chan, q, &tmp[1]));
+            }
+            uop_store_vector(uop, execmask, q, &r);
+         }
+         pc++;
+         UOP_NEXT();
+
+      UOP_CASE(MAD)
+         UOP_FOREACH_QUAD(q) {
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+               if (uop->writemask & (1 << chan))
+                  micro_mad(&r.xyzw[chan],
+                            uop_fetch(&uop->src[0], chan, q, &tmp[0]),
+                            uop_fetch(&uop->src[1], chan, q, &tmp[1]),
+                            uop_fetch(&uop->src[2], chan, q, &tmp[2]));
+            }
+            uop_store_vector(uop, execmask, q, &r);
+         }
+         pc++;
+         UOP_NEXT();
+
+      UOP_CASE(DP3)
+         UOP_FOREACH_QUAD(q) {
+            uop_dot(uop, 3, q, &r.xyzw[0]);
+            uop_store_scalar(uop, execmask, q, &r.xyzw[0]);
+         }
+         pc++;
+         UOP_NEXT();
+
+      UOP_CASE(DP4)
+         UOP_FOREACH_QUAD(q) {
+            uop_dot(uop, 4, q, &r.xyzw[0]);
+            uop_store_scalar(uop, execmask, q, &r.xyzw[0]);
+         }
+         pc++;
+         UOP_NEXT();
+
+      UOP_CASE(VECTOR_UNARY)
+         UOP_FOREACH_QUAD(q) {
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+               if (uop->writemask & (1 << chan))
+                  uop->func.unary(&r.xyzw[chan],
+                                  uop_fetch(&uop->src[0], chan, q, &tmp[0]));
+            }
+            uop_store_vector(uop, execmask, q, &r);
+         }
+         pc++;
+         UOP_NEXT();
+
+      UOP_CASE(VECTOR_BINARY)
+         UOP_FOREACH_QUAD(q) {
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+               if (uop->writemask & (1 << chan))
+                  uop->func.binary(&r.xyzw[chan],
+                                   uop_fetch(&uop->src[0], chan, q, &tmp[0]),
+                                   uop_fetch(&uop->src[1], chan, q, &tmp[1]));
+            }
+            uop_store_vector(uop, execmask, q, &r);
+         }
+         pc++;
+         UOP_NEXT();
+
+      UOP_CASE(VECTOR_TRINARY)
+         UOP_FOREACH_QUAD(q) {
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+               if (uop->writemask & (1 << chan))
+                  uop->func.trinary(&r.xyzw[chan],
+                                    uop_fetch(&uop->src[0], chan, q, &tmp[0]),
+                                    uop_fetch(&uop->src[1], chan, q, &tmp[1]),
+                                    uop_fetch(&uop->src[2], chan, q, &tmp[2]));
+            }
+            uop_store_vector(uop, execmask, q, &r);
+         }
+         pc++;
+         UOP_NEXT();
+
+      UOP_CASE(SCALAR_UNARY)
+         UOP_FOREACH_QUAD(q) {
+            uop->func.unary(&r.xyzw[0],
+                            uop_fetch(&uop->src[0], TGSI_CHAN_X, q, &tmp[0]));
+            uop_store_scalar(uop, execmask, q, &r.xyzw[0]);
+         }
+         pc++;
+         UOP_NEXT();
+
+      UOP_CASE(SCALAR_BINARY)
+         UOP_FOREACH_QUAD(q) {
+            uop->func.binary(&r.xyzw[0],
+                             uop_fetch(&uop->src[0], TGSI_CHAN_X, q, &tmp[0]),
+                             uop_fetch(&uop->src[1], TGSI_CHAN_X, q, &tmp[1]));
+            uop_store_scalar(uop, execmask, q, &r.xyzw[0]);
+         }
+         pc++;
+         UOP_NEXT();
+
+#if !UOP_THREADED_DISPATCH
+      default:
+         assert(0);
+         return;
+      }
+   }
+#endif
+}
+
+#undef UOP_CASE
+#undef UOP_NEXT
+#undef UOP_FOREACH_QUAD
+
+
+/**
+ * Number of lanes tgsi_exec_machine_run_wide() can process at once for
+ * the bound shader, or TGSI_QUAD_SIZE if it can only be run a quad at a
+ * time with tgsi_exec_machine_run().
+ */
+unsigned
+tgsi_exec_machine_width(const struct tgsi_exec_machine *mach)
+{
+   if (!mach->Uops || !mach->Uops->wide_uops)
+      return TGSI_QUAD_SIZE;
+   return mach->MaxWidth;
+}
+
+
+/**
+ * Run the bound shader on the first \p width lanes of WideInputs, writing
+ * WideOutputs.  \p width must be a multiple of TGSI_QUAD_SIZE, no larger
+ * than tgsi_exec_machine_width().  All the lanes are executed; the lanes
+ * beyond the valid vertices merely compute garbage.
+ */
+void
+tgsi_exec_machine_run_wide(struct tgsi_exec_machine *mach, unsigned width)
+{
+   unsigned num_quads = width / TGSI_QUAD_SIZE;
+
+   assert(width % TGSI_QUAD_SIZE == 0);
+   assert(width <= tgsi_exec_machine_width(mach));
+   assert(mach->Uops && mach->Uops->wide_uops);
+
+   uop_fetch_consts(mach, num_quads);
+   exec_uops(mach, mach->Uops->wide_uops, num_quads, TRUE);
+}
+
+
 /**
  * Run TGSI interpreter.
  * \return bitmask of "alive" quad components
@@ -4490,6 +5494,12 @@ tgsi_exec_machine_run( struct tgsi_exec_machine *mach )
       memset(mach->Outputs, 0, sizeof(outputs));
       memset(temps, 0, sizeof(temps));
       memset(outputs, 0, sizeof(outputs));
+#else
+      if (mach->Uops) {
+         uop_fetch_consts(mach, 1);
+         exec_uops(mach, mach->Uops->uops, 1, FALSE);
+         pc = -1;
+      }
 #endif
 
       /* execute instructions, until pc is set to -1 */
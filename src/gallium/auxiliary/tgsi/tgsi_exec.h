@@ -45,6 +45,8 @@ extern "C" {
 #define TGSI_NUM_CHANNELS 4  /* R,G,B,A */
 #define TGSI_QUAD_SIZE    4  /* 4 pixel/quad */
 
+#define TGSI_EXEC_MAX_WIDTH 16  /* lanes of tgsi_exec_machine_run_wide() */
+
 #define TGSI_FOR_EACH_CHANNEL( CHAN )\
    for (CHAN = 0; CHAN < TGSI_NUM_CHANNELS; CHAN++)
 
@@ -77,6 +79,23 @@ struct tgsi_exec_vector
    union tgsi_exec_channel xyzw[TGSI_NUM_CHANNELS];
 };
 
+/**
+  * A channel of up to TGSI_EXEC_MAX_WIDTH lanes, for wide execution.
+  * Lane n is in quad[n / 4], element n % 4.
+  */
+union tgsi_exec_wide_channel
+{
+   float    f[TGSI_EXEC_MAX_WIDTH];
+   int      i[TGSI_EXEC_MAX_WIDTH];
+   unsigned u[TGSI_EXEC_MAX_WIDTH];
+   union tgsi_exec_channel quad[TGSI_EXEC_MAX_WIDTH / TGSI_QUAD_SIZE];
+};
+
+struct tgsi_exec_wide_vector
+{
+   union tgsi_exec_wide_channel xyzw[TGSI_NUM_CHANNELS];
+};
+
 /**
  * For fragment programs, information for computing fragment input
  * values from plane equation of the triangle/line.
@@ -259,6 +278,9 @@ enum tgsi_break_type {
 #define TGSI_EXEC_MAX_BREAK_STACK (TGSI_EXEC_MAX_LOOP_NESTING + TGSI_EXEC_MAX_SWITCH_NESTING)
 
 
+struct tgsi_exec_uops;
+
+
 /**
  * Run-time virtual machine state for executing TGSI shader.
  */
@@ -357,6 +379,20 @@ struct tgsi_exec_machine
       SamplerViews[PIPE_MAX_SHADER_SAMPLER_VIEWS];
 
    boolean UsedGeometryShader;
+
+   /** Instructions lowered to pre-decoded micro ops, or NULL */
+   struct tgsi_exec_uops *Uops;
+
+   /** Don't lower the next shader bound, see TGSI_EXEC_NO_UOPS */
+   boolean NoUops;
+
+   /**
+    * Vertex shader registers for tgsi_exec_machine_run_wide(), or NULL.
+    * MaxWidth is the maximum number of lanes, see TGSI_EXEC_WIDTH.
+    */
+   struct tgsi_exec_wide_vector *WideInputs;
+   struct tgsi_exec_wide_vector *WideOutputs;
+   unsigned MaxWidth;
 };
 
 struct tgsi_exec_machine *
@@ -376,6 +412,15 @@ uint
 tgsi_exec_machine_run(
    struct tgsi_exec_machine *mach );
 
+unsigned
+tgsi_exec_machine_width(
+   const struct tgsi_exec_machine *mach );
+
+void
+tgsi_exec_machine_run_wide(
+   struct tgsi_exec_machine *mach,
+   unsigned width );
+
 
 void
 tgsi_exec_machine_free_data(struct tgsi_exec_machine *mach);
@@ -62,7 +62,8 @@ struct translate_buffer_variant {
 
 #define ELEMENT_BUFFER_INSTANCE_ID  1001
 
-#define NUM_CONSTS 7
+#define NUM_FLOAT_CONSTS 11
+#define NUM_CONSTS 16
 
 enum
 {
@@ -72,20 +73,45 @@ enum
    CONST_INV_32767,
    CONST_INV_65535,
    CONST_INV_2147483647,
-   CONST_255
+   CONST_255,
+   /* per channel factors of the 10_10_10_2 formats, see emit_load_10_10_10_2() */
+   CONST_UNORM_10_10_10_2,
+   CONST_SNORM_10_10_10_2,
+   CONST_USCALED_10_10_10_2,
+   CONST_SSCALED_10_10_10_2,
+   /* integer constants */
+   CONST_MASK_10_10_10,
+   CONST_MASK_2,
+   CONST_SHL_10_10_10_2,
+   CONST_MUL_10_10_10_2,
+   CONST_MASK_SIGNED_10_10_10_2
 };
 
 #define C(v) {(float)(v), (float)(v), (float)(v), (float)(v)}
-static float consts[NUM_CONSTS][4] = {
+#define C4(x, y, z, w) {(float)(x), (float)(y), (float)(z), (float)(w)}
+static float consts[NUM_FLOAT_CONSTS][4] = {
       {0, 0, 0, 1},
       C(1.0 / 127.0),
       C(1.0 / 255.0),
       C(1.0 / 32767.0),
       C(1.0 / 65535.0),
       C(1.0 / 2147483647.0),
-      C(255.0)
+      C(255.0),
+      C4(1.0f / 0x3ff, 1.0f / 0x3ff / (1 << 10), 1.0f / 0x3ff / (1 << 20), 1.0f / 0x3 / (1 << 28)),
+      C4(1.0f / 0x1ff, 1.0f / 0x1ff, 1.0f / 0x1ff, 1.0f / (1 << 8)),
+      C4(1.0f, 1.0f / (1 << 10), 1.0f / (1 << 20), 1.0f / (1 << 28)),
+      C4(1.0f, 1.0f, 1.0f, 1.0f / (1 << 8))
 };
 #undef C
+#undef C4
+
+static const uint32_t int_consts[NUM_CONSTS - NUM_FLOAT_CONSTS][4] = {
+      {0x3ff, 0x3ff << 10, 0x3ff << 20, 0},
+      {0, 0, 0, 0x3 << 28},
+      {22, 12, 2, 0},
+      {1 << 22, 1 << 12, 1 << 2, 1},
+      {~0u, ~0u, ~0u, 0x3u << 30}
+};
 
 struct translate_sse {
    struct translate translate;
@@ -441,6 +467,90 @@ static void emit_memcpy(struct translate_sse *p, struct x86_reg dst, struct x86_
    }
 }
 
+/**
+ * Whether the format packs three 10 bit and a 2 bit channel, from the
+ * least significant bits, in 32 bits.
+ */
+static boolean is_10_10_10_2( const struct util_format_description *desc )
+{
+   unsigned i;
+
+   if(desc->layout != UTIL_FORMAT_LAYOUT_PLAIN || desc->nr_channels != 4)
+      return FALSE;
+
+   for(i = 0; i < 4; ++i)
+   {
+      if(desc->channel[i].size != (i == 3 ? 2 : 10)
+            || desc->channel[i].shift != i * 10
+            || desc->channel[i].type != desc->channel[0].type
+            || desc->channel[i].normalized != desc->channel[0].normalized
+            || desc->channel[i].pure_integer)
+         return FALSE;
+   }
+
+   return desc->channel[0].type == UTIL_FORMAT_TYPE_UNSIGNED ||
+          desc->channel[0].type == UTIL_FORMAT_TYPE_SIGNED;
+}
+
+/* load a 10_10_10_2 value as 4 floats, converted like util_format does.
+ *
+ * The dword is broadcast, and each lane keeps its channel without shifting
+ * it all the way down: the channels end up scaled by a power of two, which
+ * is folded into the normalization factor, and the results are exact.
+ */
+static boolean emit_load_10_10_10_2( struct translate_sse *p,
+                                     struct x86_reg data,
+                                     struct x86_reg src,
+                                     const struct util_format_description *desc )
+{
+   struct x86_reg tmpXMM = x86_make_reg(file_XMM, 1);
+   unsigned factor;
+
+   sse2_movd(p->func, data, src);
+   sse2_pshufd(p->func, data, data, SHUF(0, 0, 0, 0));
+
+   if(desc->channel[0].type == UTIL_FORMAT_TYPE_UNSIGNED)
+   {
+      /* x, y << 10, z << 20 in place, w << 28 */
+      sse2_movdqa(p->func, tmpXMM, data);
+      sse2_psrld_imm(p->func, tmpXMM, 2);
+      sse2_pand(p->func, data, get_const(p, CONST_MASK_10_10_10));
+      sse2_pand(p->func, tmpXMM, get_const(p, CONST_MASK_2));
+      sse2_por(p->func, data, tmpXMM);
+      factor = desc->channel[0].normalized ? CONST_UNORM_10_10_10_2 : CONST_USCALED_10_10_10_2;
+   }
+   else
+   {
+      /* move each channel to the top and sign extend x, y, z, w << 8 */
+      if(x86_target_caps(p->func) & X86_AVX2)
+         avx2_vpsllvd(p->func, data, data, get_const(p, CONST_SHL_10_10_10_2));
+      else if(x86_target_caps(p->func) & X86_SSE4_1)
+         sse41_pmulld(p->func, data, get_const(p, CONST_MUL_10_10_10_2));
+      else
+         return FALSE;
+      /* drop z from below w */
+      sse2_pand(p->func, data, get_const(p, CONST_MASK_SIGNED_10_10_10_2));
+      sse2_psrad_imm(p->func, data, 22);
+      factor = desc->channel[0].normalized ? CONST_SNORM_10_10_10_2 : CONST_SSCALED_10_10_10_2;
+   }
+
+   sse2_cvtdq2ps(p->func, data, data);
+   sse_mulps(p->func, data, get_const(p, factor));
+   return TRUE;
+}
+
+/* Compares channel descriptions without their shift, which differs
+ * between the channels of any multi-channel format.
+ */
+static boolean same_channel_type( const struct util_format_channel_description *a,
+                                  const struct util_format_channel_description *b )
+{
+   return a->type == b->type &&
+          a->normalized == b->normalized &&
+          a->pure_integer == b->pure_integer &&
+          a->size == b->size;
+}
+
 static boolean translate_attr_convert( struct translate_sse *p,
                                const struct translate_element *a,
                                struct x86_reg src,
@@ -454,26 +564,34 @@ static boolean translate_attr_convert( struct translate_sse *p,
    unsigned swizzle[4] = {UTIL_FORMAT_SWIZZLE_NONE, UTIL_FORMAT_SWIZZLE_NONE, UTIL_FORMAT_SWIZZLE_NONE, UTIL_FORMAT_SWIZZLE_NONE};
    unsigned needed_chans = 0;
    unsigned imms[2] = {0, 0x3f800000};
+   boolean packed_10_10_10_2;
+   boolean same_chans = TRUE;
 
    if(a->output_format == PIPE_FORMAT_NONE || a->input_format == PIPE_FORMAT_NONE)
       return FALSE;
 
-   if(input_desc->channel[0].size & 7)
+   packed_10_10_10_2 = is_10_10_10_2(input_desc);
+
+   if((input_desc->channel[0].size & 7) && !packed_10_10_10_2)
       return FALSE;
 
    if(input_desc->colorspace != output_desc->colorspace)
       return FALSE;
 
-   for(i = 1; i < input_desc->nr_channels; ++i)
+   for(i = 1; i < input_desc->nr_channels && !packed_10_10_10_2; ++i)
    {
-      if(memcmp(&input_desc->channel[i], &input_desc->channel[0], sizeof(input_desc->channel[0])))
+      if(!same_channel_type(&input_desc->channel[i], &input_desc->channel[0]))
          return FALSE;
+      if(memcmp(&input_desc->channel[i], &input_desc->channel[0], sizeof(input_desc->channel[0])))
+         same_chans = FALSE;
    }
 
    for(i = 1; i < output_desc->nr_channels; ++i)
    {
-      if(memcmp(&output_desc->channel[i], &output_desc->channel[0], sizeof(output_desc->channel[0])))
+      if(!same_channel_type(&output_desc->channel[i], &output_desc->channel[0]))
          return FALSE;
+      if(memcmp(&output_desc->channel[i], &output_desc->channel[0], sizeof(output_desc->channel[0])))
+         same_chans = FALSE;
    }
 
    for(i = 0; i < output_desc->nr_channels; ++i)
@@ -511,18 +629,31 @@ static boolean translate_attr_convert( struct translate_sse *p,
          case UTIL_FORMAT_TYPE_UNSIGNED:
             if(!(x86_target_caps(p->func) & X86_SSE2))
                return FALSE;
+            if(packed_10_10_10_2)
+            {
+               if(!emit_load_10_10_10_2(p, dataXMM, src, input_desc))
+                  return FALSE;
+               break;
+            }
             emit_load_sse2(p, dataXMM, src, input_desc->channel[0].size * input_desc->nr_channels >> 3);
 
-            /* TODO: add support for SSE4.1 pmovzx */
             switch(input_desc->channel[0].size)
             {
             case 8:
-               /* TODO: this may be inefficient due to get_identity() being used both as a float and integer register */
-               sse2_punpcklbw(p->func, dataXMM, get_const(p, CONST_IDENTITY));
-               sse2_punpcklbw(p->func, dataXMM, get_const(p, CONST_IDENTITY));
+               if(x86_target_caps(p->func) & X86_SSE4_1)
+                  sse41_pmovzxbd(p->func, dataXMM, dataXMM);
+               else
+               {
+                  /* TODO: this may be inefficient due to get_identity() being used both as a float and integer register */
+                  sse2_punpcklbw(p->func, dataXMM, get_const(p, CONST_IDENTITY));
+                  sse2_punpcklbw(p->func, dataXMM, get_const(p, CONST_IDENTITY));
+               }
                break;
             case 16:
-               sse2_punpcklwd(p->func, dataXMM, get_const(p, CONST_IDENTITY));
+               if(x86_target_caps(p->func) & X86_SSE4_1)
+                  sse41_pmovzxwd(p->func, dataXMM, dataXMM);
+               else
+                  sse2_punpcklwd(p->func, dataXMM, get_const(p, CONST_IDENTITY));
                break;
             case 32: /* we lose precision here */
                sse2_psrld_imm(p->func, dataXMM, 1);
@@ -561,19 +692,34 @@ static boolean translate_attr_convert( struct translate_sse *p,
          case UTIL_FORMAT_TYPE_SIGNED:
             if(!(x86_target_caps(p->func) & X86_SSE2))
                return FALSE;
+            if(packed_10_10_10_2)
+            {
+               if(!emit_load_10_10_10_2(p, dataXMM, src, input_desc))
+                  return FALSE;
+               break;
+            }
             emit_load_sse2(p, dataXMM, src, input_desc->channel[0].size * input_desc->nr_channels >> 3);
 
-            /* TODO: add support for SSE4.1 pmovsx */
             switch(input_desc->channel[0].size)
             {
             case 8:
-               sse2_punpcklbw(p->func, dataXMM, dataXMM);
-               sse2_punpcklbw(p->func, dataXMM, dataXMM);
-               sse2_psrad_imm(p->func, dataXMM, 24);
+               if(x86_target_caps(p->func) & X86_SSE4_1)
+                  sse41_pmovsxbd(p->func, dataXMM, dataXMM);
+               else
+               {
+                  sse2_punpcklbw(p->func, dataXMM, dataXMM);
+                  sse2_punpcklbw(p->func, dataXMM, dataXMM);
+                  sse2_psrad_imm(p->func, dataXMM, 24);
+               }
                break;
             case 16:
-               sse2_punpcklwd(p->func, dataXMM, dataXMM);
-               sse2_psrad_imm(p->func, dataXMM, 16);
+               if(x86_target_caps(p->func) & X86_SSE4_1)
+                  sse41_pmovsxwd(p->func, dataXMM, dataXMM);
+               else
+               {
+                  sse2_punpcklwd(p->func, dataXMM, dataXMM);
+                  sse2_psrad_imm(p->func, dataXMM, 16);
+               }
                break;
             case 32: /* we lose precision here */
                break;
@@ -609,6 +755,17 @@ static boolean translate_attr_convert( struct translate_sse *p,
 
             break;
          case UTIL_FORMAT_TYPE_FLOAT:
+            if(input_desc->channel[0].size == 16)
+            {
+               /* zero padding converts to 0.0, constant channels are
+                * stored as immediates below */
+               if(!(x86_target_caps(p->func) & X86_SSE2) ||
+                  !(x86_target_caps(p->func) & X86_F16C))
+                  return FALSE;
+               emit_load_sse2(p, dataXMM, src, input_desc->nr_channels * 2);
+               avx_vcvtph2ps(p->func, dataXMM, dataXMM);
+               break;
+            }
             if(input_desc->channel[0].size != 32 && input_desc->channel[0].size != 64)
                return FALSE;
             if(swizzle[3] == UTIL_FORMAT_SWIZZLE_1 && input_desc->nr_channels <= 3)
@@ -701,6 +858,11 @@ static boolean translate_attr_convert( struct translate_sse *p,
       }
       return TRUE;
    }
+   /* The integer output paths below still only take single channel
+    * formats.
+    */
+   else if(!same_chans)
+      return FALSE;
    else if((x86_target_caps(p->func) & X86_SSE2) && input_desc->channel[0].size == 8 && output_desc->channel[0].size == 16
          && output_desc->channel[0].normalized == input_desc->channel[0].normalized
          && (0
@@ -1260,6 +1422,195 @@ static boolean incr_inputs( struct translate_sse *p,
 }
 
 
+/* Number of channels of the float32 formats the AVX2 gather loop reads,
+ * 0 for the others.
+ */
+static unsigned gather_nr_channels( enum pipe_format format )
+{
+   switch (format) {
+   case PIPE_FORMAT_R32_FLOAT:
+      return 1;
+   case PIPE_FORMAT_R32G32_FLOAT:
+      return 2;
+   case PIPE_FORMAT_R32G32B32_FLOAT:
+      return 3;
+   case PIPE_FORMAT_R32G32B32A32_FLOAT:
+      return 4;
+   default:
+      return 0;
+   }
+}
+
+/* Indexed fetch of float32 attributes into R32G32B32A32_FLOAT, the layout
+ * the draw module fetches into, can gather eight vertices at a time.
+ */
+static boolean can_gather_elts( struct translate_sse *p )
+{
+   const struct translate_key *key = &p->translate.key;
+   unsigned i;
+
+   if (!(x86_target_caps(p->func) & X86_AVX2) || !key->nr_elements)
+      return FALSE;
+
+   /* the displacements below must fit struct x86_reg */
+   if (key->output_stride >= (1 << 19))
+      return FALSE;
+
+   for (i = 0; i < key->nr_elements; i++) {
+      const struct translate_element *a = &key->element[i];
+
+      if (a->type != TRANSLATE_ELEMENT_NORMAL ||
+          a->instance_divisor ||
+          a->output_format != PIPE_FORMAT_R32G32B32A32_FLOAT ||
+          !gather_nr_channels(a->input_format) ||
+          a->input_offset >= (1 << 19) ||
+          a->output_offset >= (1 << 19))
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+/* Emit a loop fetching eight vertices per iteration while at least eight
+ * are left, ahead of the per-vertex loop which handles the rest.  Returns
+ * the forward jump to take when no vertices are left.
+ */
+static int emit_elts_gather_loop( struct translate_sse *p,
+                                  unsigned index_size )
+{
+   const struct translate_key *key = &p->translate.key;
+   struct x86_reg xmm[8], elts, offset, mask, sign;
+   struct x86_reg bias = p->tmp2_EDX;
+   struct x86_reg ptr = p->src_ECX;
+   int skip, done, label;
+   unsigned i, j;
+
+   for (i = 0; i < 8; i++)
+      xmm[i] = x86_make_reg(file_XMM, i);
+   elts = xmm[0];
+   offset = xmm[1];
+   mask = xmm[2];
+   sign = xmm[7];
+
+   x86_cmp_imm(p->func, p->count_EBP, 8);
+   skip = x86_jcc_forward(p->func, cc_NAE);
+
+   /* vgatherdps takes signed offsets, the per-vertex loop computes
+    * unsigned ones: flip the offsets' sign bit and start 2^31 bytes
+    * further up instead.
+    */
+   avx2_vpcmpeqd256(p->func, sign, sign, sign);
+   avx2_vpslld256_imm(p->func, sign, sign, 31);
+   x86_mov_reg_imm(p->func, bias, (int) 0x80000000);
+
+   label = x86_get_label(p->func);
+
+   switch (index_size) {
+   case 1:
+      avx2_vpmovzxbd256(p->func, elts, x86_deref(p->idx_ESI));
+      break;
+   case 2:
+      avx2_vpmovzxwd256(p->func, elts, x86_deref(p->idx_ESI));
+      break;
+   case 4:
+      avx_vmovdqu256(p->func, elts, x86_deref(p->idx_ESI));
+      break;
+   }
+
+   for (j = 0; j < key->nr_elements; j++) {
+      const struct translate_element *a = &key->element[j];
+      unsigned variant = p->element_to_buffer_variant[j];
+      struct translate_buffer *buffer = &p->buffer[p->buffer_variant[variant].buffer_index];
+      unsigned nr_channels = gather_nr_channels(a->input_format);
+
+      /* offset = min(elt, max_index) * stride, as in get_buffer_ptr()
+       */
+      avx2_vpbroadcastd256(p->func, offset,
+                           x86_make_disp(p->machine_EDI,
+                                         get_offset(p, &buffer->max_index)));
+      avx2_vpminud256(p->func, offset, offset, elts);
+      avx2_vpbroadcastd256(p->func, mask,
+                           x86_make_disp(p->machine_EDI,
+                                         get_offset(p, &buffer->stride)));
+      avx2_vpmulld256(p->func, offset, offset, mask);
+      avx2_vpxor256(p->func, offset, offset, sign);
+
+      x64_rexw(p->func);
+      x86_mov(p->func, ptr, x86_make_disp(p->machine_EDI,
+                                          get_offset(p, &buffer->base_ptr)));
+      x64_rexw(p->func);
+      x86_add(p->func, ptr, bias);
+
+      /* One channel of eight vertices in each of xmm3-6.
+       */
+      for (i = 0; i < 4; i++) {
+         if (i < nr_channels) {
+            avx2_vpcmpeqd256(p->func, mask, mask, mask);
+            avx2_vgatherdps256(p->func, xmm[3 + i],
+                               x86_make_disp(ptr, a->input_offset + i * 4),
+                               offset, mask);
+         }
+         else if (i == W) {
+            avx_vbroadcastss256(p->func, xmm[3 + i],
+                                x86_make_disp(p->machine_EDI,
+                                              get_offset(p, &p->consts[CONST_IDENTITY][W])));
+         }
+         else {
+            avx_vxorps256(p->func, xmm[3 + i], xmm[3 + i], xmm[3 + i]);
+         }
+      }
+
+      /* Transpose, each 128 bit lane on its own: vertices 0-3 end up in
+       * the low halves of xmm4, xmm6, xmm1 and xmm2, vertices 4-7 in the
+       * high halves.
+       */
+      avx_vunpcklps256(p->func, xmm[1], xmm[3], xmm[4]);
+      avx_vunpckhps256(p->func, xmm[3], xmm[3], xmm[4]);
+      avx_vunpcklps256(p->func, xmm[2], xmm[5], xmm[6]);
+      avx_vunpckhps256(p->func, xmm[5], xmm[5], xmm[6]);
+      avx_vshufps256(p->func, xmm[4], xmm[1], xmm[2], 0x44);
+      avx_vshufps256(p->func, xmm[6], xmm[1], xmm[2], 0xee);
+      avx_vshufps256(p->func, xmm[1], xmm[3], xmm[5], 0x44);
+      avx_vshufps256(p->func, xmm[2], xmm[3], xmm[5], 0xee);
+
+      for (i = 0; i < 4; i++) {
+         static const unsigned vert[4] = { 4, 6, 1, 2 };
+
+         avx_vextractf128(p->func,
+                          x86_make_disp(p->outbuf_EBX,
+                                        a->output_offset + i * key->output_stride),
+                          xmm[vert[i]], 0);
+         avx_vextractf128(p->func,
+                          x86_make_disp(p->outbuf_EBX,
+                                        a->output_offset + (i + 4) * key->output_stride),
+                          xmm[vert[i]], 1);
+      }
+   }
+
+   x64_rexw(p->func);
+   x86_lea(p->func, p->outbuf_EBX,
+           x86_make_disp(p->outbuf_EBX, 8 * key->output_stride));
+   x64_rexw(p->func);
+   x86_lea(p->func, p->idx_ESI,
+           x86_make_disp(p->idx_ESI, 8 * index_size));
+
+   x86_sub_imm(p->func, p->count_EBP, 8);
+   x86_cmp_imm(p->func, p->count_EBP, 8);
+   x86_jcc(p->func, cc_AE, label);
+
+   /* The per-vertex loop uses legacy SSE encodings.
+    */
+   avx_vzeroupper(p->func);
+
+   x86_cmp_imm(p->func, p->count_EBP, 0);
+   done = x86_jcc_forward(p->func, cc_E);
+
+   x86_fixup_fwd_jump(p->func, skip);
+
+   return done;
+}
+
+
 /* Build run( struct translate *machine,
  *            unsigned start,
  *            unsigned count,
@@ -1280,7 +1631,7 @@ static boolean build_vertex_emit( struct translate_sse *p,
 				  struct x86_function *func,
 				  unsigned index_size )
 {
-   int fixup, label;
+   int fixup, gather_fixup = -1, label;
    unsigned j;
 
    memset(p->reg_to_const, 0xff, sizeof(p->reg_to_const));
@@ -1361,6 +1712,9 @@ static boolean build_vertex_emit( struct translate_sse *p,
     */
    init_inputs(p, index_size);
 
+   if (index_size && can_gather_elts(p))
+      gather_fixup = emit_elts_gather_loop(p, index_size);
+
    /* Note address for loop jump
     */
    label = x86_get_label(p->func);
@@ -1412,6 +1766,8 @@ static boolean build_vertex_emit( struct translate_sse *p,
    /* Land forward jump here:
     */
    x86_fixup_fwd_jump(p->func, fixup);
+   if (gather_fixup >= 0)
+      x86_fixup_fwd_jump(p->func, gather_fixup);
 
    /* Pop regs and return
     */
@@ -1489,6 +1845,7 @@ struct translate *translate_sse2_create( const struct translate_key *key )
       goto fail;
    memset(p, 0, sizeof(*p));
    memcpy(p->consts, consts, sizeof(consts));
+   memcpy(p->consts[NUM_FLOAT_CONSTS], int_consts, sizeof(int_consts));
 
    p->translate.key = *key;
    p->translate.release = translate_sse_release;
@@ -47,6 +47,9 @@ extern "C" {
 uint32_t
 util_hash_crc32(const void *data, size_t size);
 
+uint32_t
+util_hash_fast(const void *data, size_t size);
+
 
 #ifdef __cplusplus
 }
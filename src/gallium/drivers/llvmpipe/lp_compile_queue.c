@@ -0,0 +1,222 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Background compilation queue.
+ *
+ * LLVM contexts are not thread safe, so the worker thread builds all its
+ * code in a private context.  Like the main gallivm context it is never
+ * freed (see lp_bld_init.c).
+ */
+
+#include "os/os_thread.h"
+#include "os/os_time.h"
+#include "util/u_memory.h"
+#include "lp_compile_queue.h"
+
+
+struct lp_compile_queue
+{
+   pipe_mutex mutex;
+   pipe_condvar work_ready;   /**< signalled when a job is added */
+   pipe_condvar work_done;    /**< signalled when a job is finished */
+
+   /** Pending jobs, oldest first */
+   struct lp_compile_job *head;
+   struct lp_compile_job *tail;
+
+   unsigned last_seqno;       /**< last submitted job */
+   unsigned done_seqno;       /**< last finished job */
+
+   boolean exit_flag;
+   pipe_thread thread;
+
+   LLVMContextRef context;
+};
+
+
+/** Has job seqno finished?  Called with the mutex held. */
+static INLINE boolean
+is_done_locked(const struct lp_compile_queue *queue, unsigned seqno)
+{
+   return (int)(queue->done_seqno - seqno) >= 0;
+}
+
+
+static PIPE_THREAD_ROUTINE( compile_thread, init_data )
+{
+   struct lp_compile_queue *queue = (struct lp_compile_queue *) init_data;
+
+   pipe_mutex_lock(queue->mutex);
+
+   while (1) {
+      struct lp_compile_job *job;
+      unsigned seqno;
+
+      while (!queue->head && !queue->exit_flag)
+         pipe_condvar_wait(queue->work_ready, queue->mutex);
+
+      /* Pending jobs are always drained before exiting */
+      job = queue->head;
+      if (!job)
+         break;
+
+      queue->head = job->next;
+      if (!queue->head)
+         queue->tail = NULL;
+
+      seqno = job->seqno;
+
+      pipe_mutex_unlock(queue->mutex);
+
+      job->func(job, queue->context);
+
+      /* The job may be freed by func, so don't touch it from here on */
+      pipe_mutex_lock(queue->mutex);
+      queue->done_seqno = seqno;
+      pipe_condvar_broadcast(queue->work_done);
+   }
+
+   pipe_mutex_unlock(queue->mutex);
+
+   return NULL;
+}
+
+
+struct lp_compile_queue *
+lp_compile_queue_create(void)
+{
+   struct lp_compile_queue *queue = CALLOC_STRUCT(lp_compile_queue);
+   if (!queue)
+      return NULL;
+
+   queue->context = LLVMContextCreate();
+   if (!queue->context) {
+      FREE(queue);
+      return NULL;
+   }
+
+   pipe_mutex_init(queue->mutex);
+   pipe_condvar_init(queue->work_ready);
+   pipe_condvar_init(queue->work_done);
+
+   queue->thread = pipe_thread_create(compile_thread, queue);
+
+   return queue;
+}
+
+
+/**
+ * Finish all pending jobs and stop the worker thread.
+ */
+void
+lp_compile_queue_destroy(struct lp_compile_queue *queue)
+{
+   pipe_mutex_lock(queue->mutex);
+   queue->exit_flag = TRUE;
+   pipe_condvar_signal(queue->work_ready);
+   pipe_mutex_unlock(queue->mutex);
+
+   pipe_thread_wait(queue->thread);
+
+   pipe_condvar_destroy(queue->work_ready);
+   pipe_condvar_destroy(queue->work_done);
+   pipe_mutex_destroy(queue->mutex);
+
+   FREE(queue);
+}
+
+
+/**
+ * Submit a job.
+ * \return the job's sequence number, never zero.
+ */
+unsigned
+lp_compile_queue_add(struct lp_compile_queue *queue,
+                     struct lp_compile_job *job,
+                     lp_compile_func func,
+                     void *data)
+{
+   unsigned seqno;
+
+   job->func = func;
+   job->data = data;
+   job->next = NULL;
+
+   pipe_mutex_lock(queue->mutex);
+
+   seqno = ++queue->last_seqno;
+   if (!seqno)
+      seqno = ++queue->last_seqno;
+   job->seqno = seqno;
+
+   if (queue->tail)
+      queue->tail->next = job;
+   else
+      queue->head = job;
+   queue->tail = job;
+
+   pipe_condvar_signal(queue->work_ready);
+   pipe_mutex_unlock(queue->mutex);
+
+   return seqno;
+}
+
+
+boolean
+lp_compile_queue_is_done(struct lp_compile_queue *queue, unsigned seqno)
+{
+   boolean done;
+
+   pipe_mutex_lock(queue->mutex);
+   done = is_done_locked(queue, seqno);
+   pipe_mutex_unlock(queue->mutex);
+
+   return done;
+}
+
+
+/**
+ * Block until the job with the given sequence number, and hence all the
+ * jobs submitted before it, are finished.
+ * \return the time spent waiting, in usecs.
+ */
+int64_t
+lp_compile_queue_wait(struct lp_compile_queue *queue, unsigned seqno)
+{
+   int64_t t0 = 0;
+
+   pipe_mutex_lock(queue->mutex);
+   if (!is_done_locked(queue, seqno)) {
+      t0 = os_time_get();
+      while (!is_done_locked(queue, seqno))
+         pipe_condvar_wait(queue->work_done, queue->mutex);
+   }
+   pipe_mutex_unlock(queue->mutex);
+
+   return t0 ? os_time_get() - t0 : 0;
+}
@@ -0,0 +1,104 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Background compilation queue.
+ *
+ * A single worker thread, owned by the screen, runs compile jobs in
+ * submission order.  Each job is identified by a sequence number so that
+ * consumers can cheaply check or wait for completion of everything
+ * submitted up to a given job.
+ */
+
+#ifndef LP_COMPILE_QUEUE_H
+#define LP_COMPILE_QUEUE_H
+
+#include "pipe/p_compiler.h"
+#include "gallivm/lp_bld.h"
+
+
+struct lp_compile_queue;
+struct lp_compile_job;
+
+
+/**
+ * Job callback.  Runs in the worker thread; all LLVM objects must be
+ * created and destroyed in the given context.  The callback may free
+ * the job.
+ */
+typedef void (*lp_compile_func)(struct lp_compile_job *job,
+                                LLVMContextRef context);
+
+
+/**
+ * A compile job.  Meant to be embedded in the object being compiled.
+ */
+struct lp_compile_job
+{
+   lp_compile_func func;
+   void *data;
+   struct lp_compile_job *next;
+
+   /** Sequence number, non-zero once submitted */
+   unsigned seqno;
+};
+
+
+struct lp_compile_queue *
+lp_compile_queue_create(void);
+
+void
+lp_compile_queue_destroy(struct lp_compile_queue *queue);
+
+unsigned
+lp_compile_queue_add(struct lp_compile_queue *queue,
+                     struct lp_compile_job *job,
+                     lp_compile_func func,
+                     void *data);
+
+boolean
+lp_compile_queue_is_done(struct lp_compile_queue *queue, unsigned seqno);
+
+int64_t
+lp_compile_queue_wait(struct lp_compile_queue *queue, unsigned seqno);
+
+
+/**
+ * Return the later of two sequence numbers, either of which may be zero.
+ */
+static INLINE unsigned
+lp_compile_seqno_max(unsigned a, unsigned b)
+{
+   if (!a)
+      return b;
+   if (!b)
+      return a;
+   return (int)(a - b) > 0 ? a : b;
+}
+
+
+#endif /* LP_COMPILE_QUEUE_H */
@@ -37,13 +37,16 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_simple_list.h"
+#include "cso_cache/cso_hash.h"
 #include "lp_clear.h"
 #include "lp_context.h"
 #include "lp_flush.h"
 #include "lp_perf.h"
 #include "lp_state.h"
+#include "lp_state_cs.h"
 #include "lp_surface.h"
 #include "lp_query.h"
+#include "lp_screen.h"
 #include "lp_setup.h"
 
 
@@ -56,6 +59,8 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    uint i, j;
 
+   llvmpipe_retire_fs_compiles(llvmpipe, TRUE);
+
    lp_print_counters();
 
    if (llvmpipe->blitter) {
@@ -95,8 +100,15 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
       pipe_resource_reference(&llvmpipe->vertex_buffer[i].buffer, NULL);
    }
 
+   llvmpipe_cleanup_compute(llvmpipe);
+
    lp_delete_setup_variants(llvmpipe);
 
+   if (llvmpipe->fs_variants_hash)
+      cso_hash_delete(llvmpipe->fs_variants_hash);
+   if (llvmpipe->setup_variants_hash)
+      cso_hash_delete(llvmpipe->setup_variants_hash);
+
    align_free( llvmpipe );
 }
 
@@ -136,6 +148,7 @@ llvmpipe_create_context( struct pipe_screen *screen, void *priv )
    memset(llvmpipe, 0, sizeof *llvmpipe);
 
    make_empty_list(&llvmpipe->fs_variants_list);
+   make_empty_list(&llvmpipe->fs_variants_compiling);
 
    make_empty_list(&llvmpipe->setup_variants_list);
 
@@ -161,10 +174,16 @@ llvmpipe_create_context( struct pipe_screen *screen, void *priv )
    llvmpipe_init_fs_funcs(llvmpipe);
    llvmpipe_init_vs_funcs(llvmpipe);
    llvmpipe_init_gs_funcs(llvmpipe);
+   llvmpipe_init_compute_funcs(llvmpipe);
    llvmpipe_init_rasterizer_funcs(llvmpipe);
    llvmpipe_init_context_resource_funcs( &llvmpipe->pipe );
    llvmpipe_init_surface_functions(llvmpipe);
 
+   llvmpipe->fs_variants_hash = cso_hash_create();
+   llvmpipe->setup_variants_hash = cso_hash_create();
+   if (!llvmpipe->fs_variants_hash || !llvmpipe->setup_variants_hash)
+      goto fail;
+
    /*
     * Create drawing context and plug our rendering stage into it.
     */
@@ -172,6 +191,8 @@ llvmpipe_create_context( struct pipe_screen *screen, void *priv )
    if (!llvmpipe->draw)
       goto fail;
 
+   draw_set_code_cache(llvmpipe->draw, llvmpipe_screen(screen)->code_cache);
+
    /* FIXME: devise alternative to draw_texture_samplers */
 
    llvmpipe->setup = lp_setup_create( &llvmpipe->pipe,
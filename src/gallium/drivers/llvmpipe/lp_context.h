@@ -47,11 +47,13 @@ struct llvmpipe_vbuf_render;
 struct draw_context;
 struct draw_stage;
 struct lp_fragment_shader;
+struct lp_compute_shader;
 struct lp_vertex_shader;
 struct lp_blend_state;
 struct lp_setup_context;
 struct lp_setup_variant;
 struct lp_velems_state;
+struct cso_hash;
 
 struct llvmpipe_context {
    struct pipe_context pipe;  /**< base class */
@@ -67,6 +69,7 @@ struct llvmpipe_context {
    const struct lp_geometry_shader *gs;
    const struct lp_velems_state *velems;
    const struct lp_so_state *so;
+   struct lp_compute_shader *cs;
 
    /** Other rendering state */
    struct pipe_blend_color blend_color;
@@ -84,6 +87,10 @@ struct llvmpipe_context {
    struct pipe_resource *mapped_vs_tex[PIPE_MAX_SHADER_SAMPLER_VIEWS];
    struct pipe_resource *mapped_gs_tex[PIPE_MAX_SHADER_SAMPLER_VIEWS];
 
+   /** Compute shader memory resources */
+   struct pipe_surface *cs_resources[PIPE_MAX_SHADER_RESOURCES];
+   struct pipe_resource *cs_globals[LP_MAX_CS_GLOBALS];
+
    unsigned num_samplers[PIPE_SHADER_TYPES];
    unsigned num_sampler_views[PIPE_SHADER_TYPES];
 
@@ -140,12 +147,25 @@ struct llvmpipe_context {
    unsigned tex_timestamp;
    boolean no_rast;
 
-   /** List of all fragment shader variants */
+   /** List of all fragment shader variants, most recently used first */
    struct lp_fs_variant_list_item fs_variants_list;
+   struct cso_hash *fs_variants_hash;  /**< indexed by lp_fs_variant_hash() */
    unsigned nr_fs_variants;
    unsigned nr_fs_instrs;
 
+   /** Fragment shader variants compiling in the background, newest first */
+   struct lp_fs_variant_list_item fs_variants_compiling;
+
+   /** The bound fragment shader variant */
+   struct lp_fragment_shader_variant *fs_variant;
+
+   /** Fragment shader compilation statistics, for the HUD (in usecs) */
+   unsigned nr_fs_compiles;
+   uint64_t fs_compile_time;
+   uint64_t fs_compile_wait_time;  /**< blocked on background compiles */
+
    struct lp_setup_variant_list_item setup_variants_list;
+   struct cso_hash *setup_variants_hash;
    unsigned nr_setup_variants;
 
    /** Conditional query object and mode */
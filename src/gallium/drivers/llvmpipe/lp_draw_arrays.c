@@ -63,6 +63,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
    if (lp->dirty)
       llvmpipe_update_derived( lp );
 
+   llvmpipe_count_fs_draw(lp);
+
    /*
     * Map vertex buffers
     */
@@ -78,12 +78,16 @@ void
 llvmpipe_finish( struct pipe_context *pipe,
                  const char *reason )
 {
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct pipe_fence_handle *fence = NULL;
    llvmpipe_flush(pipe, &fence, reason);
    if (fence) {
       pipe->screen->fence_finish(pipe->screen, fence, PIPE_TIMEOUT_INFINITE);
       pipe->screen->fence_reference(pipe->screen, &fence, NULL);
    }
+
+   /* Release what the scenes held, now that they're all done */
+   lp_setup_retire_scenes(llvmpipe->setup);
 }
 
 /**
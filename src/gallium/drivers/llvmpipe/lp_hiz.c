@@ -0,0 +1,195 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "pipe/p_state.h"
+#include "util/u_format.h"
+#include "util/u_memory.h"
+#include "lp_hiz.h"
+#include "lp_texture.h"
+
+
+/**
+ * Create the hierarchical Z of a depth texture.  Returns NULL for textures
+ * which aren't handled: anything but single layer 2D depth textures.
+ */
+struct lp_hiz *
+lp_hiz_create(const struct pipe_resource *pt)
+{
+   const struct util_format_description *desc;
+   const struct util_format_channel_description *chan;
+   struct lp_hiz *hiz;
+   unsigned num_blocks;
+
+   if (pt->array_size != 1 ||
+       (pt->target != PIPE_TEXTURE_2D &&
+        pt->target != PIPE_TEXTURE_RECT))
+      return NULL;
+
+   desc = util_format_description(pt->format);
+   if (!desc || !util_format_has_depth(desc))
+      return NULL;
+
+   chan = &desc->channel[desc->swizzle[0]];
+   if (chan->type == UTIL_FORMAT_TYPE_FLOAT) {
+      if (chan->size != 32)
+         return NULL;
+   }
+   else if (chan->type != UTIL_FORMAT_TYPE_UNSIGNED ||
+            chan->size > 32) {
+      return NULL;
+   }
+
+   hiz = CALLOC_STRUCT(lp_hiz);
+   if (!hiz)
+      return NULL;
+
+   hiz->width = pt->width0;
+   hiz->height = pt->height0;
+   hiz->blocks_x = align(pt->width0, LP_HIZ_BLOCK_SIZE) >> LP_HIZ_BLOCK_ORDER;
+   hiz->blocks_y = align(pt->height0, LP_HIZ_BLOCK_SIZE) >> LP_HIZ_BLOCK_ORDER;
+   hiz->bits = chan->type == UTIL_FORMAT_TYPE_FLOAT ? 0 : chan->size;
+   hiz->shift = chan->shift;
+
+   num_blocks = hiz->blocks_x * hiz->blocks_y;
+   hiz->zmax = MALLOC(num_blocks * sizeof *hiz->zmax);
+   if (!hiz->zmax) {
+      FREE(hiz);
+      return NULL;
+   }
+
+   lp_hiz_invalidate(hiz);
+
+   return hiz;
+}
+
+
+/**
+ * Get the hierarchical Z of a depth surface.  Returns NULL for surfaces
+ * which aren't handled: anything but the base level of a texture with a
+ * hierarchical Z, viewed in its own format.
+ */
+struct lp_hiz *
+lp_hiz_for_surface(struct pipe_surface *zsbuf)
+{
+   if (!zsbuf || !zsbuf->texture ||
+       zsbuf->u.tex.level != 0 ||
+       zsbuf->u.tex.first_layer != 0 ||
+       zsbuf->u.tex.last_layer != 0 ||
+       zsbuf->format != zsbuf->texture->format)
+      return NULL;
+
+   return llvmpipe_resource(zsbuf->texture)->hiz;
+}
+
+
+void
+lp_hiz_destroy(struct lp_hiz *hiz)
+{
+   if (hiz) {
+      FREE(hiz->zmax);
+      FREE(hiz);
+   }
+}
+
+
+/**
+ * Forget everything, for when the depth buffer is written behind the
+ * rasterizer's back.
+ */
+void
+lp_hiz_invalidate(struct lp_hiz *hiz)
+{
+   if (hiz) {
+      memset(hiz->zmax, 0xff,
+             hiz->blocks_x * hiz->blocks_y * sizeof *hiz->zmax);
+   }
+}
+
+
+/**
+ * Account for all depth values in the rectangle having been set to the
+ * given key.  Blocks only partly inside it keep a bound covering both.
+ */
+void
+lp_hiz_set(struct lp_hiz *hiz,
+           unsigned x, unsigned y, unsigned w, unsigned h,
+           uint32_t key)
+{
+   unsigned x1 = x + w >= hiz->width ? hiz->blocks_x << LP_HIZ_BLOCK_ORDER : x + w;
+   unsigned y1 = y + h >= hiz->height ? hiz->blocks_y << LP_HIZ_BLOCK_ORDER : y + h;
+   unsigned bx0, by0, bx1, by1, bx, by;
+
+   if (!w || !h || x >= hiz->width || y >= hiz->height)
+      return;
+
+   bx0 = x >> LP_HIZ_BLOCK_ORDER;
+   by0 = y >> LP_HIZ_BLOCK_ORDER;
+   bx1 = (x1 - 1) >> LP_HIZ_BLOCK_ORDER;
+   by1 = (y1 - 1) >> LP_HIZ_BLOCK_ORDER;
+
+   for (by = by0; by <= by1; by++) {
+      boolean partial_y = (by << LP_HIZ_BLOCK_ORDER) < y ||
+                          ((by + 1) << LP_HIZ_BLOCK_ORDER) > y1;
+      uint32_t *row = hiz->zmax + by * hiz->blocks_x;
+      for (bx = bx0; bx <= bx1; bx++) {
+         boolean partial = partial_y ||
+                           (bx << LP_HIZ_BLOCK_ORDER) < x ||
+                           ((bx + 1) << LP_HIZ_BLOCK_ORDER) > x1;
+         row[bx] = partial ? MAX2(row[bx], key) : key;
+      }
+   }
+}
+
+
+/**
+ * Track a depth/stencil clear of the rectangle.  Clears which only touch
+ * some of the depth bits make the bound unknown.
+ */
+void
+lp_hiz_clear(struct lp_hiz *hiz,
+             unsigned x, unsigned y, unsigned w, unsigned h,
+             uint64_t zsvalue, uint64_t zsmask)
+{
+   uint64_t zmask = (hiz->bits ? (1ULL << hiz->bits) - 1 : 0xffffffff) <<
+                    hiz->shift;
+   uint32_t key;
+
+   if (!(zsmask & zmask))
+      return;
+
+   if ((zsmask & zmask) != zmask) {
+      key = LP_HIZ_UNKNOWN;
+   }
+   else {
+      key = (uint32_t) ((zsvalue & zmask) >> hiz->shift);
+      if (!hiz->bits) {
+         key = (key & 0x80000000) ? ~key : key | 0x80000000;
+      }
+   }
+
+   lp_hiz_set(hiz, x, y, w, h, key);
+}
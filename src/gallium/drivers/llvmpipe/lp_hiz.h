@@ -0,0 +1,263 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Hierarchical Z.
+ *
+ * An upper bound of the depth values in each 16x16 block of a depth
+ * buffer, kept with the resource and maintained by the rasterizer.  When
+ * a primitive's depth within a block is known to be greater than that
+ * bound, a LESS, LEQUAL or EQUAL depth test fails for all its fragments
+ * there, and the block (or the whole tile, or the whole primitive at
+ * binning time) can be skipped.
+ *
+ * Depth values are compared as unsigned keys: the stored value for unorm
+ * formats, and the float bits mapped to unsigned order for float formats.
+ */
+
+#ifndef LP_HIZ_H
+#define LP_HIZ_H
+
+#include "pipe/p_compiler.h"
+#include "util/u_math.h"
+#include "lp_rast.h"
+
+
+struct pipe_resource;
+struct pipe_surface;
+
+
+#define LP_HIZ_BLOCK_ORDER 4
+#define LP_HIZ_BLOCK_SIZE (1 << LP_HIZ_BLOCK_ORDER)
+
+/** No bound: nothing can be rejected */
+#define LP_HIZ_UNKNOWN 0xffffffff
+
+
+/**
+ * lp_fragment_shader_variant::hiz flags, derived from the depth/stencil
+ * state.
+ */
+#define LP_HIZ_TEST        0x1  /**< failing fragments have no side effects */
+#define LP_HIZ_UPDATE      0x2  /**< covered blocks end up below the prim */
+#define LP_HIZ_INVALIDATE  0x4  /**< depth values may increase */
+
+
+struct lp_hiz
+{
+   unsigned width, height;        /**< size, in pixels */
+   unsigned blocks_x, blocks_y;   /**< size, in 16x16 blocks */
+   unsigned bits;                 /**< unorm depth bits, 0 for float */
+   unsigned shift;                /**< depth position in a packed zs value */
+   uint32_t *zmax;                /**< per block bound, in raster order */
+};
+
+
+struct lp_hiz *
+lp_hiz_create(const struct pipe_resource *pt);
+
+struct lp_hiz *
+lp_hiz_for_surface(struct pipe_surface *zsbuf);
+
+void
+lp_hiz_destroy(struct lp_hiz *hiz);
+
+void
+lp_hiz_invalidate(struct lp_hiz *hiz);
+
+void
+lp_hiz_set(struct lp_hiz *hiz,
+           unsigned x, unsigned y, unsigned w, unsigned h,
+           uint32_t key);
+
+void
+lp_hiz_clear(struct lp_hiz *hiz,
+             unsigned x, unsigned y, unsigned w, unsigned h,
+             uint64_t zsvalue, uint64_t zsmask);
+
+
+/**
+ * Convert a depth value to a key.  Rounds down for lower bounds and up
+ * for upper bounds, so that the key brackets whatever the depth test
+ * stores for that value.
+ */
+static INLINE uint32_t
+lp_hiz_key(const struct lp_hiz *hiz, float z, boolean round_up)
+{
+   union fi fi;
+
+   if (z != z) {
+      return round_up ? LP_HIZ_UNKNOWN : 0;
+   }
+
+   if (hiz->bits) {
+      double scale = (double) (~0u >> (32 - hiz->bits));
+      double v = CLAMP(z, 0.0f, 1.0f) * scale;
+      return (uint32_t) (round_up ? ceil(v) : floor(v));
+   }
+
+   fi.f = z;
+   return (fi.ui & 0x80000000) ? ~fi.ui : fi.ui | 0x80000000;
+}
+
+
+/**
+ * Allowance for the rounding of the fragment shader's depth
+ * interpolation at pixels up to (x1, y1).
+ */
+static INLINE float
+lp_hiz_margin(const float (*a0)[4],
+              const float (*dadx)[4],
+              const float (*dady)[4],
+              int x1, int y1)
+{
+   return (fabsf(a0[0][2]) +
+           fabsf(dadx[0][2]) * x1 +
+           fabsf(dady[0][2]) * y1) * (1.0f / (1 << 20));
+}
+
+
+/**
+ * Lower bound key of the primitive's depth at the pixels in the
+ * [x, x+w) x [y, y+h) rectangle.
+ */
+static INLINE uint32_t
+lp_hiz_prim_zmin(const struct lp_hiz *hiz,
+                 const struct lp_rast_shader_inputs *inputs,
+                 int x, int y, int w, int h)
+{
+   const float (*a0)[4] = (const float (*)[4]) GET_A0(inputs);
+   const float (*dadx)[4] = (const float (*)[4]) GET_DADX(inputs);
+   const float (*dady)[4] = (const float (*)[4]) GET_DADY(inputs);
+   float z = a0[0][2] +
+             dadx[0][2] * (dadx[0][2] > 0.0f ? x : x + w - 1) +
+             dady[0][2] * (dady[0][2] > 0.0f ? y : y + h - 1);
+
+   z -= lp_hiz_margin(a0, dadx, dady, x + w, y + h);
+
+   return MAX2(lp_hiz_key(hiz, z, FALSE), inputs->hiz_zmin);
+}
+
+
+/**
+ * Upper bound key of the primitive's depth in the rectangle.
+ */
+static INLINE uint32_t
+lp_hiz_prim_zmax(const struct lp_hiz *hiz,
+                 const struct lp_rast_shader_inputs *inputs,
+                 int x, int y, int w, int h)
+{
+   const float (*a0)[4] = (const float (*)[4]) GET_A0(inputs);
+   const float (*dadx)[4] = (const float (*)[4]) GET_DADX(inputs);
+   const float (*dady)[4] = (const float (*)[4]) GET_DADY(inputs);
+   float z = a0[0][2] +
+             dadx[0][2] * (dadx[0][2] > 0.0f ? x + w - 1 : x) +
+             dady[0][2] * (dady[0][2] > 0.0f ? y + h - 1 : y);
+
+   z += lp_hiz_margin(a0, dadx, dady, x + w, y + h);
+
+   return lp_hiz_key(hiz, z, TRUE);
+}
+
+
+/**
+ * Bound of the depth values in the rectangle.
+ */
+static INLINE uint32_t
+lp_hiz_zmax(const struct lp_hiz *hiz,
+            unsigned x, unsigned y, unsigned w, unsigned h)
+{
+   unsigned bx0 = x >> LP_HIZ_BLOCK_ORDER;
+   unsigned by0 = y >> LP_HIZ_BLOCK_ORDER;
+   unsigned bx1 = MIN2((x + w - 1) >> LP_HIZ_BLOCK_ORDER, hiz->blocks_x - 1);
+   unsigned by1 = MIN2((y + h - 1) >> LP_HIZ_BLOCK_ORDER, hiz->blocks_y - 1);
+   uint32_t zmax = 0;
+   unsigned bx, by;
+
+   if (bx0 >= hiz->blocks_x || by0 >= hiz->blocks_y)
+      return LP_HIZ_UNKNOWN;
+
+   for (by = by0; by <= by1; by++) {
+      const uint32_t *row = hiz->zmax + by * hiz->blocks_x;
+      for (bx = bx0; bx <= bx1; bx++) {
+         zmax = MAX2(zmax, row[bx]);
+      }
+   }
+
+   return zmax;
+}
+
+
+/**
+ * Whether the primitive is known to fail the depth test everywhere in
+ * the rectangle.
+ */
+static INLINE boolean
+lp_hiz_reject(const struct lp_hiz *hiz,
+              const struct lp_rast_shader_inputs *inputs,
+              int x, int y, int w, int h)
+{
+   return lp_hiz_prim_zmin(hiz, inputs, x, y, w, h) >
+          lp_hiz_zmax(hiz, x, y, w, h);
+}
+
+
+/**
+ * Lower the bound of the 16x16 blocks in the rectangle after it was
+ * completely covered by the primitive, see LP_HIZ_UPDATE.  Blocks only
+ * partly inside the rectangle (other than at the edges of the depth
+ * buffer) are left alone.
+ */
+static INLINE void
+lp_hiz_update(struct lp_hiz *hiz,
+              const struct lp_rast_shader_inputs *inputs,
+              unsigned x, unsigned y, unsigned w, unsigned h)
+{
+   unsigned x1 = x + w >= hiz->width ? hiz->blocks_x << LP_HIZ_BLOCK_ORDER : x + w;
+   unsigned y1 = y + h >= hiz->height ? hiz->blocks_y << LP_HIZ_BLOCK_ORDER : y + h;
+   unsigned bx0 = (x + LP_HIZ_BLOCK_SIZE - 1) >> LP_HIZ_BLOCK_ORDER;
+   unsigned by0 = (y + LP_HIZ_BLOCK_SIZE - 1) >> LP_HIZ_BLOCK_ORDER;
+   unsigned bx1 = x1 >> LP_HIZ_BLOCK_ORDER;
+   unsigned by1 = y1 >> LP_HIZ_BLOCK_ORDER;
+   uint32_t key;
+   unsigned bx, by;
+
+   if (bx0 >= bx1 || by0 >= by1)
+      return;
+
+   key = lp_hiz_prim_zmax(hiz, inputs, x, y, w, h);
+
+   for (by = by0; by < by1; by++) {
+      uint32_t *row = hiz->zmax + by * hiz->blocks_x;
+      for (bx = bx0; bx < bx1; bx++) {
+         row[bx] = MIN2(row[bx], key);
+      }
+   }
+}
+
+
+#endif /* LP_HIZ_H */
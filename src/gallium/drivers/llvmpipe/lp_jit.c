@@ -38,6 +38,7 @@
 #include "gallivm/lp_bld_debug.h"
 #include "lp_context.h"
 #include "lp_jit.h"
+#include "lp_state_cs.h"
 
 
 static void
@@ -235,3 +236,104 @@ lp_jit_init_types(struct lp_fragment_shader_variant *lp)
    if (!lp->jit_context_ptr_type)
       lp_jit_create_types(lp);
 }
+
+
+static void
+lp_jit_create_cs_types(struct lp_compute_shader_variant *lp)
+{
+   struct gallivm_state *gallivm = lp->gallivm;
+   LLVMContextRef lc = gallivm->context;
+   LLVMTypeRef buffer_type;
+
+   /* struct lp_jit_cs_buffer */
+   {
+      LLVMTypeRef elem_types[LP_JIT_CS_BUFFER_NUM_FIELDS];
+
+      elem_types[LP_JIT_CS_BUFFER_BASE] =
+         LLVMPointerType(LLVMInt8TypeInContext(lc), 0);
+      elem_types[LP_JIT_CS_BUFFER_SIZE] =
+      elem_types[LP_JIT_CS_BUFFER_ROW_STRIDE] =
+      elem_types[LP_JIT_CS_BUFFER_IMG_STRIDE] = LLVMInt32TypeInContext(lc);
+
+      buffer_type = LLVMStructTypeInContext(lc, elem_types,
+                                            Elements(elem_types), 0);
+
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_buffer, base,
+                             gallivm->target, buffer_type,
+                             LP_JIT_CS_BUFFER_BASE);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_buffer, size,
+                             gallivm->target, buffer_type,
+                             LP_JIT_CS_BUFFER_SIZE);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_buffer, row_stride,
+                             gallivm->target, buffer_type,
+                             LP_JIT_CS_BUFFER_ROW_STRIDE);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_buffer, img_stride,
+                             gallivm->target, buffer_type,
+                             LP_JIT_CS_BUFFER_IMG_STRIDE);
+      LP_CHECK_STRUCT_SIZE(struct lp_jit_cs_buffer,
+                           gallivm->target, buffer_type);
+   }
+
+   /* struct lp_jit_cs_context */
+   {
+      LLVMTypeRef elem_types[LP_JIT_CS_CTX_COUNT];
+      LLVMTypeRef context_type;
+
+      elem_types[LP_JIT_CS_CTX_CONSTANTS] =
+            LLVMArrayType(LLVMPointerType(LLVMFloatTypeInContext(lc), 0), LP_MAX_TGSI_CONST_BUFFERS);
+      elem_types[LP_JIT_CS_CTX_GRID_SIZE] =
+      elem_types[LP_JIT_CS_CTX_BLOCK_SIZE] =
+            LLVMArrayType(LLVMInt32TypeInContext(lc), 3);
+      elem_types[LP_JIT_CS_CTX_LOCAL_SIZE] =
+      elem_types[LP_JIT_CS_CTX_PRIVATE_SIZE] = LLVMInt32TypeInContext(lc);
+      elem_types[LP_JIT_CS_CTX_INPUT] = buffer_type;
+      elem_types[LP_JIT_CS_CTX_RESOURCES] = LLVMArrayType(buffer_type,
+                                                          PIPE_MAX_SHADER_RESOURCES);
+      elem_types[LP_JIT_CS_CTX_GLOBALS] = LLVMArrayType(buffer_type,
+                                                        LP_MAX_CS_GLOBALS);
+
+      context_type = LLVMStructTypeInContext(lc, elem_types,
+                                             Elements(elem_types), 0);
+
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, constants,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_CONSTANTS);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, grid_size,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_GRID_SIZE);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, block_size,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_BLOCK_SIZE);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, local_size,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_LOCAL_SIZE);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, private_size,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_PRIVATE_SIZE);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, input,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_INPUT);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, resources,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_RESOURCES);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, globals,
+                             gallivm->target, context_type,
+                             LP_JIT_CS_CTX_GLOBALS);
+      LP_CHECK_STRUCT_SIZE(struct lp_jit_cs_context,
+                           gallivm->target, context_type);
+
+      lp->jit_context_ptr_type = LLVMPointerType(context_type, 0);
+   }
+
+   if (gallivm_debug & GALLIVM_DEBUG_IR) {
+      LLVMDumpModule(gallivm->module);
+   }
+}
+
+
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp)
+{
+   if (!lp->jit_context_ptr_type)
+      lp_jit_create_cs_types(lp);
+}
@@ -44,6 +44,7 @@
 
 
 struct lp_fragment_shader_variant;
+struct lp_compute_shader_variant;
 struct llvmpipe_screen;
 
 
@@ -211,6 +212,130 @@ typedef void
                     unsigned depth_stride);
 
 
+/** Number of buffers mapped into the GLOBAL resource */
+#define LP_MAX_CS_GLOBALS 32
+
+/**
+ * GLOBAL resource handles are the buffer index in the top bits and the
+ * byte offset in the buffer in the others.
+ */
+#define LP_CS_GLOBAL_SHIFT 27
+
+
+/**
+ * A memory resource of a compute shader, addressed in bytes.
+ */
+struct lp_jit_cs_buffer
+{
+   uint8_t *base;
+   uint32_t size;         /**< in bytes, accesses beyond are ignored */
+   uint32_t row_stride;   /**< for addressing with y */
+   uint32_t img_stride;   /**< for addressing with z */
+};
+
+
+enum {
+   LP_JIT_CS_BUFFER_BASE = 0,
+   LP_JIT_CS_BUFFER_SIZE,
+   LP_JIT_CS_BUFFER_ROW_STRIDE,
+   LP_JIT_CS_BUFFER_IMG_STRIDE,
+   LP_JIT_CS_BUFFER_NUM_FIELDS  /* number of fields above */
+};
+
+
+/**
+ * This structure is passed directly to the generated compute shader.
+ *
+ * Changes here must be reflected in the lp_jit_cs_context_* macros and
+ * lp_jit_init_cs_types function.
+ */
+struct lp_jit_cs_context
+{
+   const float *constants[LP_MAX_TGSI_CONST_BUFFERS];
+
+   uint32_t grid_size[3];
+   uint32_t block_size[3];
+
+   uint32_t local_size;     /**< LOCAL resource size, per block */
+   uint32_t private_size;   /**< PRIVATE resource size, per thread */
+
+   struct lp_jit_cs_buffer input;
+   struct lp_jit_cs_buffer resources[PIPE_MAX_SHADER_RESOURCES];
+   struct lp_jit_cs_buffer globals[LP_MAX_CS_GLOBALS];
+};
+
+
+/**
+ * These enum values must match the position of the fields in the
+ * lp_jit_cs_context struct above.
+ */
+enum {
+   LP_JIT_CS_CTX_CONSTANTS = 0,
+   LP_JIT_CS_CTX_GRID_SIZE,
+   LP_JIT_CS_CTX_BLOCK_SIZE,
+   LP_JIT_CS_CTX_LOCAL_SIZE,
+   LP_JIT_CS_CTX_PRIVATE_SIZE,
+   LP_JIT_CS_CTX_INPUT,
+   LP_JIT_CS_CTX_RESOURCES,
+   LP_JIT_CS_CTX_GLOBALS,
+   LP_JIT_CS_CTX_COUNT
+};
+
+
+#define lp_jit_cs_context_constants(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_CONSTANTS, "constants")
+
+#define lp_jit_cs_context_grid_size(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_GRID_SIZE, "grid_size")
+
+#define lp_jit_cs_context_block_size(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_BLOCK_SIZE, "block_size")
+
+#define lp_jit_cs_context_local_size(_gallivm, _ptr) \
+   lp_build_struct_get(_gallivm, _ptr, LP_JIT_CS_CTX_LOCAL_SIZE, "local_size")
+
+#define lp_jit_cs_context_private_size(_gallivm, _ptr) \
+   lp_build_struct_get(_gallivm, _ptr, LP_JIT_CS_CTX_PRIVATE_SIZE, "private_size")
+
+#define lp_jit_cs_context_input(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_INPUT, "input")
+
+#define lp_jit_cs_context_resources(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_RESOURCES, "resources")
+
+#define lp_jit_cs_context_globals(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_GLOBALS, "globals")
+
+
+/**
+ * typedef for compute shader function
+ *
+ * Runs one group of threads of a block, as many as the SoA vector length,
+ * up to the next barrier.
+ *
+ * @param context       jit context
+ * @param block_x       block position in the grid
+ * @param block_y
+ * @param block_z
+ * @param thread_index  index of the first thread of the group in the block
+ * @param local_mem     LOCAL resource of the block
+ * @param private_mem   PRIVATE resource of the threads of the block
+ * @param temps         temporaries of the group, kept across barriers
+ * @param phase         0, or the value returned by the previous call
+ * @return the phase to resume at after the barrier, or 0 when done
+ */
+typedef uint32_t
+(*lp_jit_cs_func)(const struct lp_jit_cs_context *context,
+                  uint32_t block_x,
+                  uint32_t block_y,
+                  uint32_t block_z,
+                  uint32_t thread_index,
+                  uint8_t *local_mem,
+                  uint8_t *private_mem,
+                  void *temps,
+                  uint32_t phase);
+
+
 void
 lp_jit_screen_cleanup(struct llvmpipe_screen *screen);
 
@@ -223,4 +348,8 @@ void
 lp_jit_init_types(struct lp_fragment_shader_variant *lp);
 
 
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp);
+
+
 #endif /* LP_JIT_H */
@@ -44,7 +44,7 @@
  * Max texture sizes
  */
 #define LP_MAX_TEXTURE_SIZE (1 * 1024 * 1024 * 1024ULL)  /* 1GB for now */
-#define LP_MAX_TEXTURE_2D_LEVELS 14  /* 8K x 8K for now */
+#define LP_MAX_TEXTURE_2D_LEVELS 15  /* 16K x 16K for now */
 #define LP_MAX_TEXTURE_3D_LEVELS 12  /* 2K x 2K x 2K for now */
 #define LP_MAX_TEXTURE_CUBE_LEVELS 14  /* 8K x 8K for now */
 #define LP_MAX_TEXTURE_ARRAY_LAYERS 512 /* 8K x 512 / 8K x 8K x 512 */
@@ -61,7 +61,28 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 16
+/**
+ * Sanity limit on the number of rasterizer threads.  The per-thread data
+ * is sized at runtime, and LP_NUM_THREADS defaults to the number of CPUs.
+ */
+#define LP_MAX_THREADS 256
+
+
+/**
+ * Max number of scenes per context (see LP_NUM_SCENES).  Scenes beyond
+ * the first two are only allocated when binning gets ahead of
+ * rasterization, and only while the scenes in flight take less than
+ * LP_MAX_SCENE_MEMORY bytes.
+ */
+#define LP_MAX_SCENES 16
+#define LP_MAX_SCENE_MEMORY (64 * 1024 * 1024)
+
+
+/**
+ * Max number of threads binning a draw, including the calling thread
+ * (see LP_NUM_BIN_THREADS).
+ */
+#define LP_MAX_BIN_THREADS 16
 
 
 /**
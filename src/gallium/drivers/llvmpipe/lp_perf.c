@@ -26,6 +26,8 @@
  **************************************************************************/
 
 #include "util/u_debug.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_disk_cache.h"
 #include "lp_debug.h"
 #include "lp_perf.h"
 
@@ -50,6 +52,7 @@ lp_print_counters(void)
 
       debug_printf("llvmpipe: nr_triangles:                 %9u\n", lp_count.nr_tris);
       debug_printf("llvmpipe: nr_culled_triangles:          %9u\n", lp_count.nr_culled_tris);
+      debug_printf("llvmpipe: nr_fixed64_triangles:         %9u\n", lp_count.nr_fixed64_tris);
 
       total_64 = (lp_count.nr_empty_64 + 
                   lp_count.nr_fully_covered_64 +
@@ -98,13 +101,55 @@ lp_print_counters(void)
       debug_printf("llvmpipe:   nr_empty_4x4:               %9u (%3.0f%% of %u)\n", lp_count.nr_empty_4, p1, total_4);
       debug_printf("llvmpipe:   nr_non_empty_4x4:           %9u (%3.0f%% of %u)\n", lp_count.nr_non_empty_4, p4, total_4);
 
+      debug_printf("llvmpipe: nr_hiz_culled_tris:           %9u\n", lp_count.nr_hiz_culled_tris);
+      debug_printf("llvmpipe: nr_hiz_rejected_64x64:        %9u\n", lp_count.nr_hiz_rejected_64);
+      debug_printf("llvmpipe: nr_hiz_rejected_16x16:        %9u\n", lp_count.nr_hiz_rejected_16);
+
       debug_printf("llvmpipe: nr_color_tile_clear:          %9u\n", lp_count.nr_color_tile_clear);
       debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
       debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
 
+      debug_printf("llvmpipe: nr_mt_binned_draws:           %9u\n", lp_count.nr_mt_draws);
+      debug_printf("llvmpipe: nr_mt_binned_prims:           %9u\n", lp_count.nr_mt_prims);
+
+      debug_printf("llvmpipe: nr_scene_grows:               %9u\n", lp_count.nr_scene_grows);
+      debug_printf("llvmpipe: scene wait time:              %.2f sec\n", lp_count.scene_wait_time / 1000000.0);
+
       debug_printf("llvmpipe: nr_llvm_compiles:             %u\n", lp_count.nr_llvm_compiles);
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
+      debug_printf("llvmpipe: background LLVM compile time: %.2f sec\n", lp_count.llvm_async_compile_time / 1000000.0);
+      debug_printf("llvmpipe: LLVM compile wait time:       %.2f sec\n", lp_count.llvm_compile_wait_time / 1000000.0);
+
+   }
+
+   if (gallivm_debug & GALLIVM_DEBUG_PERF) {
+      static const char *tier_names[GALLIVM_NUM_TIERS] = { "fast", "opt" };
+      unsigned tier;
+
+      for (tier = 0; tier < GALLIVM_NUM_TIERS; tier++) {
+         debug_printf("llvmpipe: %-4s tier fs compiles:        %9u, %.2f sec\n",
+                      tier_names[tier],
+                      lp_count.nr_tier_compiles[tier],
+                      lp_count.tier_compile_time[tier] / 1000000.0);
+         debug_printf("llvmpipe: %-4s tier fs execution time:  %.2f sec\n",
+                      tier_names[tier],
+                      lp_count.tier_exec_time[tier] / 1000000000.0);
+      }
+      debug_printf("llvmpipe: nr_fs_tier_ups:               %9u\n", lp_count.nr_tier_ups);
+   }
+
+   if (LP_DEBUG & DEBUG_CACHE) {
+      struct gallivm_disk_cache_stats stats;
+
+      gallivm_disk_cache_get_stats(&stats);
 
+      debug_printf("llvmpipe: shader cache hits:            %9u\n", stats.hits);
+      debug_printf("llvmpipe: shader cache misses:          %9u\n", stats.misses);
+      debug_printf("llvmpipe: shader cache stores:          %9u\n", stats.stores);
+      debug_printf("llvmpipe: shader cache evictions:       %9u\n", stats.evictions);
+      debug_printf("llvmpipe: shader cache size:            %9u KB (max %u KB)\n",
+                   (unsigned) (stats.size >> 10),
+                   (unsigned) (stats.max_size >> 10));
    }
 }
@@ -34,6 +34,7 @@
 #define LP_PERF_H
 
 #include "pipe/p_compiler.h"
+#include "gallivm/lp_bld_init.h"
 
 /**
  * Various counters
@@ -42,6 +43,7 @@ struct lp_counters
 {
    unsigned nr_tris;
    unsigned nr_culled_tris;
+   unsigned nr_fixed64_tris;  /**< set up with 64-bit arithmetic */
    unsigned nr_empty_64;
    unsigned nr_fully_covered_64;
    unsigned nr_partially_covered_64;
@@ -56,12 +58,29 @@ struct lp_counters
    unsigned nr_fully_covered_4;
    unsigned nr_partially_covered_4;
    unsigned nr_non_empty_4;
+   unsigned nr_hiz_culled_tris;  /**< rejected by hierarchical Z at binning */
+   unsigned nr_hiz_rejected_64;  /**< tiles rejected by hierarchical Z */
+   unsigned nr_hiz_rejected_16;  /**< 16x16 blocks rejected by hierarchical Z */
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
+   int64_t llvm_async_compile_time;  /**< in the background, in microseconds */
+   int64_t llvm_compile_wait_time;  /**< blocked on background compiles */
+
+   /* Fragment shaders per GALLIVM_TIER_x, the times with GALLIVM_DEBUG=perf */
+   unsigned nr_tier_compiles[GALLIVM_NUM_TIERS];
+   int64_t tier_compile_time[GALLIVM_NUM_TIERS];  /**< in microseconds */
+   int64_t tier_exec_time[GALLIVM_NUM_TIERS];  /**< in nanoseconds */
+   unsigned nr_tier_ups;
 
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   unsigned nr_mt_draws;  /**< draws binned by several threads */
+   unsigned nr_mt_prims;  /**< primitives binned by several threads */
+
+   unsigned nr_scene_grows;
+   int64_t scene_wait_time;  /**< binning blocked on rasterization */
 };
 
 
@@ -34,6 +34,7 @@
 #include "pipe/p_defines.h"
 #include "util/u_memory.h"
 #include "os/os_time.h"
+#include "gallivm/lp_bld_code_cache.h"
 #include "lp_context.h"
 #include "lp_flush.h"
 #include "lp_fence.h"
@@ -48,24 +49,114 @@ static struct llvmpipe_query *llvmpipe_query( struct pipe_query *p )
    return (struct llvmpipe_query *)p;
 }
 
+/**
+ * Current value of a driver specific query counter.
+ */
+static int64_t
+driver_query_value(const struct llvmpipe_context *llvmpipe, unsigned type)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(llvmpipe->pipe.screen);
+   struct gallivm_code_cache_stats stats;
+
+   if (type >= LP_QUERY_CODE_CACHE_ENTRIES) {
+      if (!screen->code_cache)
+         return 0;
+      gallivm_code_cache_get_stats(screen->code_cache, &stats);
+   }
+
+   switch (type) {
+   case LP_QUERY_FS_COMPILES:
+      return llvmpipe->nr_fs_compiles;
+   case LP_QUERY_FS_COMPILE_TIME:
+      return llvmpipe->fs_compile_time;
+   case LP_QUERY_FS_COMPILE_WAIT_TIME:
+      return llvmpipe->fs_compile_wait_time;
+   case LP_QUERY_CODE_CACHE_ENTRIES:
+      return stats.entries;
+   case LP_QUERY_CODE_CACHE_INSTRS:
+      return stats.nr_instrs;
+   case LP_QUERY_CODE_CACHE_HITS:
+      return stats.hits;
+   case LP_QUERY_CODE_CACHE_MISSES:
+      return stats.misses;
+   default:
+      assert(0);
+      return 0;
+   }
+}
+
+
+/**
+ * Whether a driver specific query reports the current level of the
+ * counter rather than how much it changed during the query.
+ */
+static INLINE boolean
+driver_query_is_level(unsigned type)
+{
+   return type == LP_QUERY_CODE_CACHE_ENTRIES ||
+          type == LP_QUERY_CODE_CACHE_INSTRS;
+}
+
+
 static struct pipe_query *
 llvmpipe_create_query(struct pipe_context *pipe, 
                       unsigned type)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq;
 
-   assert(type < PIPE_QUERY_TYPES);
+   assert(type < PIPE_QUERY_TYPES ||
+          (type >= LP_QUERY_FS_COMPILES &&
+           type <= LP_QUERY_CODE_CACHE_MISSES));
 
-   pq = CALLOC_STRUCT( llvmpipe_query );
+   /* Allocate the per-thread counters along with the query */
+   pq = CALLOC(1, sizeof *pq + 2 * num_threads * sizeof(uint64_t));
 
    if (pq) {
       pq->type = type;
+      pq->num_threads = num_threads;
+      pq->start = (uint64_t *)(pq + 1);
+      pq->end = pq->start + num_threads;
    }
 
    return (struct pipe_query *) pq;
 }
 
 
+/**
+ * Wait for the scene with the end of the query, unless !wait.  Once it's
+ * done, the rasterizer doesn't touch the query anymore.
+ * \return FALSE if the scene isn't done yet
+ */
+static boolean
+wait_query(struct pipe_context *pipe, struct llvmpipe_query *pq,
+           boolean wait)
+{
+   if (!pq->fence)
+      return TRUE;
+
+   /* The scene with the end of the query still has to be rasterized */
+   if (!lp_fence_issued(pq->fence))
+      llvmpipe_flush(pipe, NULL, __FUNCTION__);
+
+   if (!lp_fence_signalled(pq->fence)) {
+      if (!wait)
+         return FALSE;
+
+      lp_fence_wait(pq->fence);
+   }
+
+   /* Picks up the counts left if the query couldn't be added to the
+    * scene's list.
+    */
+   llvmpipe_query_resolve(pq);
+   lp_fence_reference(&pq->fence, NULL);
+
+   return TRUE;
+}
+
+
 static void
 llvmpipe_destroy_query(struct pipe_context *pipe, struct pipe_query *q)
 {
@@ -74,17 +165,28 @@ llvmpipe_destroy_query(struct pipe_context *pipe, struct pipe_query *q)
    /* Ideally we would refcount queries & not get destroyed until the
     * last scene had finished with us.
     */
-   if (pq->fence) {
-      if (!lp_fence_issued(pq->fence))
-         llvmpipe_flush(pipe, NULL, __FUNCTION__);
+   wait_query(pipe, pq, TRUE);
 
-      if (!lp_fence_signalled(pq->fence))
-         lp_fence_wait(pq->fence);
+   FREE(pq);
+}
 
-      lp_fence_reference(&pq->fence, NULL);
-   }
 
-   FREE(pq);
+/**
+ * Fold the per-thread counts of a scene which is done into the query
+ * result.  If the scene had the end of the query, the result is final.
+ */
+void
+llvmpipe_query_resolve(struct llvmpipe_query *pq)
+{
+   unsigned i;
+
+   for (i = 0; i < pq->num_threads; i++) {
+      if (pq->type == PIPE_QUERY_TIMESTAMP)
+         pq->result = MAX2(pq->result, pq->end[i]);
+      else
+         pq->result += pq->end[i];
+      pq->end[i] = 0;
+   }
 }
 
 
@@ -94,47 +196,21 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
                           boolean wait,
                           union pipe_query_result *vresult)
 {
-   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
-   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq = llvmpipe_query(q);
    uint64_t *result = (uint64_t *)vresult;
-   int i;
 
-   if (pq->fence) {
-      /* only have a fence if there was a scene */
-      if (!lp_fence_signalled(pq->fence)) {
-         if (!lp_fence_issued(pq->fence))
-            llvmpipe_flush(pipe, NULL, __FUNCTION__);
-
-         if (!wait)
-            return FALSE;
-
-         lp_fence_wait(pq->fence);
-      }
-   }
+   if (!wait_query(pipe, pq, wait))
+      return FALSE;
 
-   /* Sum the results from each of the threads:
-    */
    *result = 0;
 
    switch (pq->type) {
    case PIPE_QUERY_OCCLUSION_COUNTER:
-      for (i = 0; i < num_threads; i++) {
-         *result += pq->end[i];
-      }
+   case PIPE_QUERY_TIMESTAMP:
+      *result = pq->result;
       break;
    case PIPE_QUERY_OCCLUSION_PREDICATE:
-      for (i = 0; i < num_threads; i++) {
-         /* safer (still not guaranteed) when there's an overflow */
-         vresult->b = vresult->b || pq->end[i];
-      }
-      break;
-   case PIPE_QUERY_TIMESTAMP:
-      for (i = 0; i < num_threads; i++) {
-         if (pq->end[i] > *result) {
-            *result = pq->end[i];
-         }
-      }
+      vresult->b = pq->result != 0;
       break;
    case PIPE_QUERY_TIMESTAMP_DISJOINT: {
       struct pipe_query_data_timestamp_disjoint *td =
@@ -163,15 +239,22 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
       stats->primitives_storage_needed = pq->num_primitives_generated;
    }
       break;
+   case LP_QUERY_FS_COMPILES:
+   case LP_QUERY_FS_COMPILE_TIME:
+   case LP_QUERY_FS_COMPILE_WAIT_TIME:
+   case LP_QUERY_CODE_CACHE_ENTRIES:
+   case LP_QUERY_CODE_CACHE_INSTRS:
+   case LP_QUERY_CODE_CACHE_HITS:
+   case LP_QUERY_CODE_CACHE_MISSES:
+      *result = pq->driver_value;
+      break;
    case PIPE_QUERY_PIPELINE_STATISTICS: {
       struct pipe_query_data_pipeline_statistics *stats =
          (struct pipe_query_data_pipeline_statistics *)vresult;
       /* only ps_invocations come from binned query */
-      for (i = 0; i < num_threads; i++) {
-         pq->stats.ps_invocations += pq->end[i];
-      }
-      pq->stats.ps_invocations *= LP_RASTER_BLOCK_SIZE * LP_RASTER_BLOCK_SIZE;
       *stats = pq->stats;
+      stats->ps_invocations = (pq->stats.ps_invocations + pq->result) *
+                              LP_RASTER_BLOCK_SIZE * LP_RASTER_BLOCK_SIZE;
    }
       break;
    default:
@@ -189,17 +272,22 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
-   /* Check if the query is already in the scene.  If so, we need to
-    * flush the scene now.  Real apps shouldn't re-use a query in a
-    * frame of rendering.
-    */
-   if (pq->fence && !lp_fence_issued(pq->fence)) {
-      llvmpipe_finish(pipe, __FUNCTION__);
+   if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+      llvmpipe_retire_fs_compiles(llvmpipe, FALSE);
+      pq->driver_value = driver_query_value(llvmpipe, pq->type);
+      return;
    }
 
+   /* Check if the query is still in a scene.  If so, we need to flush
+    * the scene and wait for it now.  Real apps shouldn't re-use a query
+    * in a frame of rendering.
+    */
+   wait_query(pipe, pq, TRUE);
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+
+   memset(pq->start, 0, pq->num_threads * sizeof(pq->start[0]));
+   memset(pq->end, 0, pq->num_threads * sizeof(pq->end[0]));
+   pq->result = 0;
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -243,6 +331,16 @@ llvmpipe_end_query(struct pipe_context *pipe, struct pipe_query *q)
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+      llvmpipe_retire_fs_compiles(llvmpipe, FALSE);
+      if (driver_query_is_level(pq->type))
+         pq->driver_value = driver_query_value(llvmpipe, pq->type);
+      else
+         pq->driver_value = driver_query_value(llvmpipe, pq->type) -
+                            pq->driver_value;
+      return;
+   }
+
    lp_setup_end_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
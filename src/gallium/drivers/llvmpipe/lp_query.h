@@ -39,15 +39,36 @@
 
 
 struct llvmpipe_context;
+struct lp_fence;
 
 
+/** Non-GPU queries for gallium HUD */
+#define LP_QUERY_FS_COMPILES           (PIPE_QUERY_DRIVER_SPECIFIC + 0)
+#define LP_QUERY_FS_COMPILE_TIME       (PIPE_QUERY_DRIVER_SPECIFIC + 1)
+#define LP_QUERY_FS_COMPILE_WAIT_TIME  (PIPE_QUERY_DRIVER_SPECIFIC + 2)
+#define LP_QUERY_CODE_CACHE_ENTRIES    (PIPE_QUERY_DRIVER_SPECIFIC + 3)
+#define LP_QUERY_CODE_CACHE_INSTRS     (PIPE_QUERY_DRIVER_SPECIFIC + 4)
+#define LP_QUERY_CODE_CACHE_HITS       (PIPE_QUERY_DRIVER_SPECIFIC + 5)
+#define LP_QUERY_CODE_CACHE_MISSES     (PIPE_QUERY_DRIVER_SPECIFIC + 6)
+
+
+/**
+ * The rasterizer threads count into the per-thread start/end arrays while
+ * a scene is rasterized.  When the scene is done, the rasterizer folds the
+ * counts into the result, see llvmpipe_query_resolve(), before signalling
+ * the scene's fence: the result is final as soon as the fence of the scene
+ * with the end of the query is signalled.
+ */
 struct llvmpipe_query {
-   uint64_t start[LP_MAX_THREADS];  /* start count value for each thread */
-   uint64_t end[LP_MAX_THREADS];    /* end count value for each thread */
-   struct lp_fence *fence;          /* fence from last scene this was binned in */
+   uint64_t *start;                 /* start count value for each thread */
+   uint64_t *end;                   /* end count value for each thread */
+   unsigned num_threads;            /* size of the start/end arrays */
+   uint64_t result;                 /* counts of the scenes done so far */
+   struct lp_fence *fence;          /* fence of the scene ending the query */
    unsigned type;                   /* PIPE_QUERY_* */
    unsigned num_primitives_generated;
    unsigned num_primitives_written;
+   int64_t driver_value;            /* LP_QUERY_x counter delta or level */
 
    struct pipe_query_data_pipeline_statistics stats;
 };
@@ -57,4 +78,6 @@ extern void llvmpipe_init_query_funcs(struct llvmpipe_context * );
 
 extern boolean llvmpipe_check_render_cond(struct llvmpipe_context *);
 
+extern void llvmpipe_query_resolve(struct llvmpipe_query *pq);
+
 #endif /* LP_QUERY_H */
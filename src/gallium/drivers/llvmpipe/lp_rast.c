@@ -26,11 +26,15 @@
  **************************************************************************/
 
 #include <limits.h>
+#include <stdio.h>
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_rect.h"
 #include "util/u_surface.h"
 #include "util/u_pack_color.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_atomic.h"
+#include "util/u_string.h"
 
 #include "os/os_time.h"
 
@@ -38,6 +42,7 @@
 #include "lp_context.h"
 #include "lp_debug.h"
 #include "lp_fence.h"
+#include "lp_hiz.h"
 #include "lp_perf.h"
 #include "lp_query.h"
 #include "lp_rast.h"
@@ -46,6 +51,10 @@
 #include "lp_scene.h"
 #include "lp_tex_sample.h"
 
+#if defined(PIPE_OS_LINUX)
+#include <dirent.h>
+#endif
+
 
 #ifdef DEBUG
 int jit_line = 0;
@@ -54,6 +63,160 @@ const struct lp_rasterizer_task *jit_task = NULL;
 #endif
 
 
+/* An empty bin is one that just loads the contents of the tile and
+ * stores them again unchanged.  This typically happens when bins have
+ * been flushed for some reason in the middle of a frame, or when
+ * incremental updates are being made to a render target.
+ * 
+ * Try to avoid doing pointless work in this case.
+ */
+static boolean
+is_empty_bin( const struct cmd_bin *bin )
+{
+   return bin->head == NULL;
+}
+
+
+static int
+compare_work_cost(const void *a, const void *b)
+{
+   const struct lp_rast_work *wa = (const struct lp_rast_work *) a;
+   const struct lp_rast_work *wb = (const struct lp_rast_work *) b;
+
+   if (wa->cost != wb->cost)
+      return wa->cost > wb->cost ? -1 : 1;
+   /* keep raster order among bins of equal cost */
+   if (wa->y != wb->y)
+      return wa->y < wb->y ? -1 : 1;
+   return wa->x < wb->x ? -1 : (wa->x > wb->x);
+}
+
+
+/**
+ * Gather the non-empty bins of the scene and hand each task a contiguous
+ * range of them of roughly equal estimated cost.  Bins are gathered in
+ * raster order, so each range covers a band of neighbouring tiles.
+ */
+static void
+schedule_bins( struct lp_rasterizer *rast,
+               struct lp_scene *scene )
+{
+   struct lp_rast_work *work = rast->work;
+   unsigned num_work = 0;
+   uint64_t total_cost = 0;
+   uint64_t cost = 0;
+   unsigned x, y, i, t;
+
+   if (!rast->no_rast && !scene->discard) {
+      for (y = 0; y < scene->tiles_y; y++) {
+         for (x = 0; x < scene->tiles_x; x++) {
+            const struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
+
+            if (is_empty_bin( bin ))
+               continue;
+
+            work[num_work].x = x;
+            work[num_work].y = y;
+            /* count the tile load/store too */
+            work[num_work].cost = 1 + bin->count;
+            total_cost += work[num_work].cost;
+            num_work++;
+         }
+      }
+   }
+
+   if (rast->sort_bins) {
+      qsort(work, num_work, sizeof *work, compare_work_cost);
+   }
+
+   rast->num_work = num_work;
+
+   i = 0;
+   for (t = 0; t < rast->num_tasks; t++) {
+      uint64_t limit = total_cost * (t + 1) / rast->num_tasks;
+      unsigned begin = i;
+
+      if (t == rast->num_tasks - 1) {
+         i = num_work;
+      }
+      else {
+         while (i < num_work && cost < limit) {
+            cost += work[i].cost;
+            i++;
+         }
+      }
+
+      rast->tasks[t]->queue = LP_RAST_QUEUE(begin, i);
+   }
+}
+
+
+/**
+ * Take the next bin from the front of the task's own range.
+ */
+static const struct lp_rast_work *
+pop_work( struct lp_rasterizer_task *task )
+{
+   while (1) {
+      int32_t queue = p_atomic_read(&task->queue);
+      unsigned begin = LP_RAST_QUEUE_BEGIN(queue);
+      unsigned end = LP_RAST_QUEUE_END(queue);
+
+      if (begin >= end)
+         return NULL;
+
+      if (p_atomic_cmpxchg(&task->queue, queue,
+                           LP_RAST_QUEUE(begin + 1, end)) == queue)
+         return &task->rast->work[begin];
+   }
+}
+
+
+/**
+ * Move the back half of the largest range left in any task to this
+ * (idle) task.  Returns FALSE once there is no work left anywhere.
+ */
+static boolean
+steal_work( struct lp_rasterizer_task *task )
+{
+   struct lp_rasterizer *rast = task->rast;
+
+   while (1) {
+      struct lp_rasterizer_task *victim = NULL;
+      int32_t victim_queue = 0;
+      unsigned max_size = 0;
+      unsigned begin, end, n, i;
+
+      for (i = 0; i < rast->num_tasks; i++) {
+         int32_t queue = p_atomic_read(&rast->tasks[i]->queue);
+         begin = LP_RAST_QUEUE_BEGIN(queue);
+         end = LP_RAST_QUEUE_END(queue);
+
+         if (end > begin && end - begin > max_size) {
+            victim = rast->tasks[i];
+            victim_queue = queue;
+            max_size = end - begin;
+         }
+      }
+
+      if (!victim)
+         return FALSE;
+
+      begin = LP_RAST_QUEUE_BEGIN(victim_queue);
+      end = LP_RAST_QUEUE_END(victim_queue);
+      n = (max_size + 1) / 2;
+
+      if (p_atomic_cmpxchg(&victim->queue, victim_queue,
+                           LP_RAST_QUEUE(begin, end - n)) == victim_queue) {
+         /* Nobody else modifies our queue while it is empty */
+         p_atomic_set(&task->queue, LP_RAST_QUEUE(end - n, end));
+         task->nr_steals++;
+         return TRUE;
+      }
+   }
+}
+
+
 /**
  * Begin rasterizing a scene.
  * Called once per scene by one thread.
@@ -67,16 +230,29 @@ lp_rast_begin( struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
    lp_scene_begin_rasterization( scene );
-   lp_scene_bin_iter_begin( scene );
+   schedule_bins( rast, scene );
 }
 
 
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
+   struct lp_fence *fence = NULL;
+
+   /* Setup may reuse the scene, and drop its fence, as soon as it sees
+    * the fence signalled.  So signalling must be the last thing touching
+    * either.
+    */
+   lp_fence_reference(&fence, rast->curr_scene->fence);
+
    lp_scene_end_rasterization( rast->curr_scene );
 
    rast->curr_scene = NULL;
+
+   if (fence) {
+      lp_fence_signal(fence);
+      lp_fence_reference(&fence, NULL);
+   }
 }
 
 
@@ -310,6 +486,11 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
          dst_layer += scene->zsbuf.layer_stride;
       }
    }
+
+   if (scene->hiz) {
+      lp_hiz_clear(scene->hiz, task->x, task->y, task->width, task->height,
+                   arg.clear_zstencil.value, arg.clear_zstencil.mask);
+   }
 }
 
 
@@ -328,6 +509,7 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    const struct lp_rast_state *state;
    struct lp_fragment_shader_variant *variant;
    const unsigned tile_x = task->x, tile_y = task->y;
+   unsigned hiz_skip = 0;
    unsigned x, y;
 
    if (inputs->disable) {
@@ -344,6 +526,26 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    }
    variant = state->variant;
 
+   if (scene->hiz && (variant->hiz & LP_HIZ_TEST)) {
+      if (lp_hiz_reject(scene->hiz, inputs, tile_x, tile_y,
+                        task->width, task->height)) {
+         LP_COUNT(nr_hiz_rejected_64);
+         return;
+      }
+
+      /* find the 16x16 blocks the triangle is behind */
+      for (y = 0; y < task->height; y += 16) {
+         for (x = 0; x < task->width; x += 16) {
+            if (lp_hiz_reject(scene->hiz, inputs, tile_x + x, tile_y + y,
+                              MIN2(16, task->width - x),
+                              MIN2(16, task->height - y))) {
+               hiz_skip |= 1 << ((y / 16) * 4 + x / 16);
+               LP_COUNT(nr_hiz_rejected_16);
+            }
+         }
+      }
+   }
+
    /* render the whole 64x64 tile in 4x4 chunks */
    for (y = 0; y < task->height; y += 4){
       for (x = 0; x < task->width; x += 4) {
@@ -352,6 +554,10 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
          uint8_t *depth = NULL;
          unsigned depth_stride = 0;
          unsigned i;
+         int64_t start;
+
+         if (hiz_skip & (1 << ((y / 16) * 4 + x / 16)))
+            continue;
 
          /* color buffer */
          for (i = 0; i < scene->fb.nr_cbufs; i++){
@@ -368,6 +574,7 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
          }
 
          /* run shader on 4x4 block */
+         start = lp_rast_shader_time_begin();
          BEGIN_JIT_CALL(state, task);
          variant->jit_function[RAST_WHOLE]( &state->jit_context,
                                             tile_x + x, tile_y + y,
@@ -382,8 +589,14 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
                                             stride,
                                             depth_stride);
          END_JIT_CALL();
+         lp_rast_shader_time_end(variant, start);
       }
    }
+
+   if (scene->hiz && (variant->hiz & LP_HIZ_UPDATE)) {
+      lp_hiz_update(scene->hiz, inputs, tile_x, tile_y,
+                    task->width, task->height);
+   }
 }
 
 
@@ -427,6 +640,7 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
    uint8_t *depth = NULL;
    unsigned depth_stride = 0;
    unsigned i;
+   int64_t start;
 
    assert(state);
 
@@ -463,6 +677,7 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
       task->ps_invocations += 1 * variant->ps_inv_multiplier;
 
       /* run shader on 4x4 block */
+      start = lp_rast_shader_time_begin();
       BEGIN_JIT_CALL(state, task);
       variant->jit_function[RAST_EDGE_TEST](&state->jit_context,
                                             x, y,
@@ -477,6 +692,7 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                                             stride,
                                             depth_stride);
       END_JIT_CALL();
+      lp_rast_shader_time_end(variant, start);
    }
 }
 
@@ -546,6 +762,12 @@ lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg)
 {
    task->state = arg.state;
+
+   /* The depth values of the tile may increase from here on */
+   if (task->scene->hiz && (arg.state->variant->hiz & LP_HIZ_INVALIDATE)) {
+      lp_hiz_set(task->scene->hiz, task->x, task->y,
+                 task->width, task->height, LP_HIZ_UNKNOWN);
+   }
 }
 
 
@@ -597,16 +819,16 @@ do_rasterize_bin(struct lp_rasterizer_task *task,
                  const struct cmd_bin *bin,
                  int x, int y)
 {
-   const struct cmd_block *block;
-   unsigned k;
+   struct lp_cmd_reader reader;
+   union lp_rast_cmd_arg arg;
+   unsigned cmd;
 
    if (0)
       lp_debug_bin(bin, x, y);
 
-   for (block = bin->head; block; block = block->next) {
-      for (k = 0; k < block->count; k++) {
-         dispatch[block->cmd[k]]( task, block->arg[k] );
-      }
+   lp_cmd_reader_init(&reader, bin);
+   while (lp_cmd_read(&reader, &cmd, &arg)) {
+      dispatch[cmd]( task, arg );
    }
 }
 
@@ -631,29 +853,15 @@ rasterize_bin(struct lp_rasterizer_task *task,
 
    /* Debug/Perf flags:
     */
-   if (bin->head->count == 1) {
-      if (bin->head->cmd[0] == LP_RAST_OP_SHADE_TILE_OPAQUE)
+   if (bin->count == 1) {
+      if (bin->head->data[0] == LP_RAST_OP_SHADE_TILE_OPAQUE)
          LP_COUNT(nr_pure_shade_opaque_64);
-      else if (bin->head->cmd[0] == LP_RAST_OP_SHADE_TILE)
+      else if (bin->head->data[0] == LP_RAST_OP_SHADE_TILE)
          LP_COUNT(nr_pure_shade_64);
    }
 }
 
 
-/* An empty bin is one that just loads the contents of the tile and
- * stores them again unchanged.  This typically happens when bins have
- * been flushed for some reason in the middle of a frame, or when
- * incremental updates are being made to a render target.
- * 
- * Try to avoid doing pointless work in this case.
- */
-static boolean
-is_empty_bin( const struct cmd_bin *bin )
-{
-   return bin->head == NULL;
-}
-
-
 /**
  * Rasterize/execute all bins within a scene.
  * Called per thread.
@@ -662,26 +870,23 @@ static void
 rasterize_scene(struct lp_rasterizer_task *task,
                 struct lp_scene *scene)
 {
-   task->scene = scene;
+   const struct lp_rast_work *work;
+   int64_t start = os_time_get();
 
-   if (!task->rast->no_rast && !scene->discard) {
-      /* loop over scene bins, rasterize each */
-      {
-         struct cmd_bin *bin;
-         int i, j;
+   task->scene = scene;
 
-         assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
-            if (!is_empty_bin( bin ))
-               rasterize_bin(task, bin, i, j);
-         }
+   /* Rasterize our own bins, then help the other tasks finish theirs.
+    * Empty bins were already skipped by schedule_bins().
+    */
+   do {
+      while ((work = pop_work(task))) {
+         rasterize_bin(task, lp_scene_get_bin(scene, work->x, work->y),
+                       work->x, work->y);
+         task->nr_bins++;
       }
-   }
-
+   } while (steal_work(task));
 
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
+   task->busy_time += os_time_get() - start;
 
    task->scene = NULL;
 }
@@ -707,7 +912,7 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 
       lp_rast_begin( rast, scene );
 
-      rasterize_scene( &rast->tasks[0], scene );
+      rasterize_scene( rast->tasks[0], scene );
 
       lp_rast_end( rast );
 
@@ -719,11 +924,13 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
       /* threaded rendering! */
       unsigned i;
 
+      lp_fence_reference(&rast->last_fence, scene->fence);
+
       lp_scene_enqueue( rast->full_scenes, scene );
 
       /* signal the threads that there's work to do */
       for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_signal(&rast->tasks[i].work_ready);
+         pipe_semaphore_signal(&rast->tasks[i]->work_ready);
       }
    }
 
@@ -731,19 +938,58 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
+/**
+ * Wait until all the scenes queued so far are rasterized.  Scenes are
+ * rasterized in order, so that's when the last one's fence is signalled.
+ * The caller must hold the screen's rast_mutex.
+ */
 void
 lp_rast_finish( struct lp_rasterizer *rast )
+{
+   if (rast->last_fence) {
+      lp_fence_wait(rast->last_fence);
+      lp_fence_reference(&rast->last_fence, NULL);
+   }
+}
+
+
+/**
+ * Run func(data, thread_index) once on each rasterizer thread, or once in
+ * the calling thread when rasterizing synchronously, and wait for all to
+ * return.  Used for the work that isn't organized in scenes, like compute
+ * grids.  The caller must hold the screen's rast_mutex.
+ */
+void
+lp_rast_run_jobs( struct lp_rasterizer *rast,
+                  lp_rast_job_func func,
+                  void *data )
 {
    if (rast->num_threads == 0) {
-      /* nothing to do */
+      unsigned fpstate = util_fpstate_get();
+
+      util_fpstate_set_denorms_to_zero(fpstate);
+      func(data, 0);
+      util_fpstate_set(fpstate);
    }
    else {
-      int i;
+      unsigned i;
+
+      /* The threads would run the job instead of the scenes still queued */
+      lp_rast_finish(rast);
+
+      rast->job_func = func;
+      rast->job_data = data;
 
-      /* wait for work to complete */
       for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
+         pipe_semaphore_signal(&rast->tasks[i]->work_ready);
       }
+
+      for (i = 0; i < rast->num_threads; i++) {
+         pipe_semaphore_wait(&rast->tasks[i]->work_done);
+      }
+
+      rast->job_func = NULL;
+      rast->job_data = NULL;
    }
 }
 
@@ -753,7 +999,8 @@ lp_rast_finish( struct lp_rasterizer *rast )
  * It's a simple loop:
  *   1. wait for work
  *   2. do work
- *   3. signal that we're done
+ *   3. signal that we're done: through the scene's fence, or the
+ *      work_done semaphore for jobs
  */
 static PIPE_THREAD_ROUTINE( thread_function, init_data )
 {
@@ -761,6 +1008,7 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
    struct lp_rasterizer *rast = task->rast;
    boolean debug = false;
    unsigned fpstate = util_fpstate_get();
+   int64_t start;
 
    /* Make sure that denorms are treated like zeros. This is 
     * the behavior required by D3D10. OpenGL doesn't care.
@@ -776,6 +1024,12 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
       if (rast->exit_flag)
          break;
 
+      if (rast->job_func) {
+         rast->job_func(rast->job_data, task->thread_index);
+         pipe_semaphore_signal(&task->work_done);
+         continue;
+      }
+
       if (task->thread_index == 0) {
          /* thread[0]:
           *  - get next scene to rasterize
@@ -798,7 +1052,9 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
                       rast->curr_scene);
       
       /* wait for all threads to finish with this scene */
+      start = os_time_get();
       pipe_barrier_wait( &rast->barrier );
+      task->idle_time += os_time_get() - start;
 
       /* XXX: shouldn't be necessary:
        */
@@ -806,17 +1062,123 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
    return NULL;
 }
 
 
+#if defined(PIPE_OS_LINUX)
+
+/**
+ * Return the NUMA node of a CPU, or zero if unknown.
+ */
+static unsigned
+cpu_node(unsigned cpu)
+{
+   char path[64];
+   DIR *dir;
+   struct dirent *entry;
+   unsigned node = 0;
+
+   util_snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%u", cpu);
+   dir = opendir(path);
+   if (!dir)
+      return 0;
+
+   while ((entry = readdir(dir)) != NULL) {
+      if (sscanf(entry->d_name, "node%u", &node) == 1)
+         break;
+   }
+
+   closedir(dir);
+   return node;
+}
+
+#endif
+
+
+/**
+ * Get the CPUs the rasterizer threads may be pinned to, grouped by NUMA
+ * node, so that consecutive threads, which rasterize neighbouring bands of
+ * tiles, share a node.
+ * \return the number of CPUs, or zero if the allowed set is unknown
+ */
+static unsigned
+get_thread_cpus(unsigned *cpus, unsigned max_cpus)
+{
+   unsigned num_cpus = pipe_thread_get_cpus(cpus, max_cpus);
+
+#if defined(PIPE_OS_LINUX)
+   if (num_cpus > 1) {
+      unsigned *nodes = MALLOC(num_cpus * sizeof *nodes);
+      unsigned i, j;
+
+      if (nodes) {
+         /* stable insertion sort by node */
+         for (i = 0; i < num_cpus; i++) {
+            unsigned cpu = cpus[i];
+            unsigned node = cpu_node(cpu);
+
+            for (j = i; j > 0 && nodes[j - 1] > node; j--) {
+               cpus[j] = cpus[j - 1];
+               nodes[j] = nodes[j - 1];
+            }
+            cpus[j] = cpu;
+            nodes[j] = node;
+         }
+         FREE(nodes);
+      }
+   }
+#endif
+
+   return num_cpus;
+}
+
+
+/**
+ * Pin each thread to one of the CPUs the process may run on, so that the
+ * tiles and the per-task data stay in the caches (and on the NUMA node)
+ * of the CPU that touched them.  Either all threads get pinned, or none.
+ */
+static void
+pin_rast_threads(struct lp_rasterizer *rast)
+{
+   unsigned max_cpus = MAX2(1, util_cpu_caps.nr_cpus);
+   unsigned *cpus;
+   unsigned num_cpus;
+   unsigned i, j;
+
+   cpus = MALLOC(max_cpus * sizeof *cpus);
+   if (!cpus)
+      return;
+
+   num_cpus = get_thread_cpus(cpus, max_cpus);
+   if (!num_cpus) {
+      debug_printf("llvmpipe: thread affinity not supported\n");
+      FREE(cpus);
+      return;
+   }
+
+   for (i = 0; i < rast->num_threads; i++) {
+      if (!pipe_thread_set_affinity(rast->threads[i],
+                                    &cpus[i % num_cpus], 1)) {
+         debug_printf("llvmpipe: failed to set rasterizer thread affinity\n");
+
+         /* let the threads pinned so far run anywhere again */
+         for (j = 0; j < i; j++) {
+            pipe_thread_set_affinity(rast->threads[j], cpus, num_cpus);
+         }
+         break;
+      }
+   }
+
+   FREE(cpus);
+}
+
+
 /**
  * Initialize semaphores and spawn the threads.
  */
@@ -827,10 +1189,15 @@ create_rast_threads(struct lp_rasterizer *rast)
 
    /* NOTE: if num_threads is zero, we won't use any threads */
    for (i = 0; i < rast->num_threads; i++) {
-      pipe_semaphore_init(&rast->tasks[i].work_ready, 0);
-      pipe_semaphore_init(&rast->tasks[i].work_done, 0);
+      pipe_semaphore_init(&rast->tasks[i]->work_ready, 0);
+      pipe_semaphore_init(&rast->tasks[i]->work_done, 0);
       rast->threads[i] = pipe_thread_create(thread_function,
-                                            (void *) &rast->tasks[i]);
+                                            (void *) rast->tasks[i]);
+   }
+
+   if (rast->num_threads &&
+       debug_get_bool_option("LP_THREAD_AFFINITY", FALSE)) {
+      pin_rast_threads(rast);
    }
 }
 
@@ -857,15 +1224,43 @@ lp_rast_create( unsigned num_threads )
       goto no_full_scenes;
    }
 
-   for (i = 0; i < Elements(rast->tasks); i++) {
-      struct lp_rasterizer_task *task = &rast->tasks[i];
+   rast->num_threads = num_threads;
+   rast->num_tasks = MAX2(1, num_threads);
+
+   rast->tasks = CALLOC(rast->num_tasks, sizeof *rast->tasks);
+   if (!rast->tasks) {
+      goto no_tasks;
+   }
+
+   for (i = 0; i < rast->num_tasks; i++) {
+      struct lp_rasterizer_task *task;
+
+      task = align_malloc(sizeof *task, LP_CACHELINE_SIZE);
+      if (!task) {
+         goto no_task;
+      }
+      memset(task, 0, sizeof *task);
       task->rast = rast;
       task->thread_index = i;
+      rast->tasks[i] = task;
    }
 
-   rast->num_threads = num_threads;
+   if (num_threads) {
+      rast->threads = CALLOC(num_threads, sizeof *rast->threads);
+      if (!rast->threads) {
+         goto no_task;
+      }
+   }
+
+   /* bin positions are packed in 16 bits, see LP_RAST_QUEUE() */
+   assert(TILES_X * TILES_Y <= 0x10000);
+   rast->work = MALLOC(TILES_X * TILES_Y * sizeof *rast->work);
+   if (!rast->work) {
+      goto no_task;
+   }
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", FALSE);
+   rast->sort_bins = debug_get_bool_option("LP_SORT_BINS", FALSE);
 
    create_rast_threads(rast);
 
@@ -876,6 +1271,15 @@ lp_rast_create( unsigned num_threads )
 
    return rast;
 
+no_task:
+   FREE(rast->threads);
+   for (i = 0; i < rast->num_tasks; i++) {
+      if (rast->tasks[i])
+         align_free(rast->tasks[i]);
+   }
+   FREE(rast->tasks);
+no_tasks:
+   lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
    FREE(rast);
 no_rast:
@@ -895,7 +1299,7 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
     */
    rast->exit_flag = TRUE;
    for (i = 0; i < rast->num_threads; i++) {
-      pipe_semaphore_signal(&rast->tasks[i].work_ready);
+      pipe_semaphore_signal(&rast->tasks[i]->work_ready);
    }
 
    /* Wait for threads to terminate before cleaning up per-thread data */
@@ -905,8 +1309,8 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    /* Clean up per-thread data */
    for (i = 0; i < rast->num_threads; i++) {
-      pipe_semaphore_destroy(&rast->tasks[i].work_ready);
-      pipe_semaphore_destroy(&rast->tasks[i].work_done);
+      pipe_semaphore_destroy(&rast->tasks[i]->work_ready);
+      pipe_semaphore_destroy(&rast->tasks[i]->work_done);
    }
 
    /* for synchronizing rasterization threads */
@@ -914,6 +1318,27 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   lp_fence_reference(&rast->last_fence, NULL);
+
+   if (LP_DEBUG & DEBUG_COUNTERS) {
+      debug_printf("llvmpipe: rasterizer load balance:\n");
+      for (i = 0; i < rast->num_tasks; i++) {
+         struct lp_rasterizer_task *task = rast->tasks[i];
+         debug_printf("llvmpipe:   thread %3u: %9u bins %7u steals "
+                      "%9.3f sec busy %9.3f sec idle\n",
+                      i, task->nr_bins, task->nr_steals,
+                      task->busy_time / 1000000.0,
+                      task->idle_time / 1000000.0);
+      }
+   }
+
+   for (i = 0; i < rast->num_tasks; i++) {
+      align_free(rast->tasks[i]);
+   }
+   FREE(rast->tasks);
+   FREE(rast->threads);
+   FREE(rast->work);
+
    FREE(rast);
 }
 
@@ -39,6 +39,7 @@
 
 #include "pipe/p_compiler.h"
 #include "lp_jit.h"
+#include "lp_limits.h"
 
 
 struct lp_rasterizer;
@@ -59,6 +60,14 @@ struct cmd_bin;
  */
 #define MAX_FIXED_LENGTH (1 << (((FIXED_TYPE_WIDTH/2) - 1) - FIXED_ORDER))
 
+/** Maximum length of an edge in a primitive in pixels, for primitives
+ *  which don't fit in MAX_FIXED_LENGTH and are set up with 64-bit
+ *  arithmetic.  The rasterizer still evaluates the edge functions in
+ *  32 bits within a tile, so (|dcdx| + |dcdy|) * TILE_SIZE, plus some
+ *  headroom, must fit in 31 bits.
+ */
+#define MAX_FIXED_LENGTH64 (1 << (31 - 2 * FIXED_ORDER - TILE_ORDER - 3))
+
 /* Rasterizer output size going to jit fs, width/height */
 #define LP_RASTER_BLOCK_SIZE 4
 
@@ -98,7 +107,7 @@ struct lp_rast_shader_inputs {
    unsigned pad0:29;            /* wasted space */
    unsigned stride;             /* how much to advance data between a0, dadx, dady */
    unsigned layer;              /* the layer to render to (from gs, already clamped) */
-   unsigned pad2;               /* wasted space */
+   unsigned hiz_zmin;           /**< lower bound hierarchical Z key */
    /* followed by a0, dadx, dady and planes[] */
 };
 
@@ -106,7 +115,10 @@ struct lp_rast_shader_inputs {
  * sse code in rasterization:
  */
 struct lp_rast_plane {
-   /* edge function values at minx,miny ?? */
+   /* edge function values at minx,miny ??
+    * For primitives set up with 64-bit arithmetic this is only correct
+    * modulo 2^32, see lp_rast_plane_eval().
+    */
    int c;
 
    int dcdx;
@@ -116,6 +128,21 @@ struct lp_rast_plane {
    int eo;
 };
 
+
+/**
+ * Evaluate the edge function at pixel (x, y).
+ * Uses wrapping arithmetic, which gives the right result for any pixel
+ * close enough to the edge for the value to fit in 32 bits, even when
+ * plane->c itself was truncated.
+ */
+static INLINE int
+lp_rast_plane_eval(const struct lp_rast_plane *plane, int x, int y)
+{
+   return (int)((unsigned)plane->c +
+                (unsigned)plane->dcdy * (unsigned)y -
+                (unsigned)plane->dcdx * (unsigned)x);
+}
+
 /**
  * Rasterization information for a triangle known to be in this bin,
  * plus inputs to run the shader:
@@ -156,6 +183,17 @@ void
 lp_rast_finish( struct lp_rasterizer *rast );
 
 
+/**
+ * A job run on each rasterizer thread, see lp_rast_run_jobs().
+ */
+typedef void (*lp_rast_job_func)(void *data, unsigned thread_index);
+
+void
+lp_rast_run_jobs( struct lp_rasterizer *rast,
+                  lp_rast_job_func func,
+                  void *data );
+
+
 union lp_rast_cmd_arg {
    const struct lp_rast_shader_inputs *shade_tile;
    struct {
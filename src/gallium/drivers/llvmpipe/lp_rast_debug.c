@@ -53,21 +53,20 @@ static const char *cmd_name(unsigned cmd)
 
 static const struct lp_fragment_shader_variant *
 get_variant( const struct lp_rast_state *state,
-             const struct cmd_block *block,
-             int k )
+             unsigned cmd )
 {
    if (!state)
       return NULL;
 
-   if (block->cmd[k] == LP_RAST_OP_SHADE_TILE ||
-       block->cmd[k] == LP_RAST_OP_SHADE_TILE_OPAQUE ||
-       block->cmd[k] == LP_RAST_OP_TRIANGLE_1 ||
-       block->cmd[k] == LP_RAST_OP_TRIANGLE_2 ||
-       block->cmd[k] == LP_RAST_OP_TRIANGLE_3 ||
-       block->cmd[k] == LP_RAST_OP_TRIANGLE_4 ||
-       block->cmd[k] == LP_RAST_OP_TRIANGLE_5 ||
-       block->cmd[k] == LP_RAST_OP_TRIANGLE_6 ||
-       block->cmd[k] == LP_RAST_OP_TRIANGLE_7)
+   if (cmd == LP_RAST_OP_SHADE_TILE ||
+       cmd == LP_RAST_OP_SHADE_TILE_OPAQUE ||
+       cmd == LP_RAST_OP_TRIANGLE_1 ||
+       cmd == LP_RAST_OP_TRIANGLE_2 ||
+       cmd == LP_RAST_OP_TRIANGLE_3 ||
+       cmd == LP_RAST_OP_TRIANGLE_4 ||
+       cmd == LP_RAST_OP_TRIANGLE_5 ||
+       cmd == LP_RAST_OP_TRIANGLE_6 ||
+       cmd == LP_RAST_OP_TRIANGLE_7)
       return state->variant;
 
    return NULL;
@@ -76,10 +75,9 @@ get_variant( const struct lp_rast_state *state,
 
 static boolean
 is_blend( const struct lp_rast_state *state,
-          const struct cmd_block *block,
-          int k )
+          unsigned cmd )
 {
-   const struct lp_fragment_shader_variant *variant = get_variant(state, block, k);
+   const struct lp_fragment_shader_variant *variant = get_variant(state, cmd);
 
    if (variant)
       return  variant->key.blend.rt[0].blend_enable;
@@ -93,21 +91,21 @@ static void
 debug_bin( const struct cmd_bin *bin, int x, int y )
 {
    const struct lp_rast_state *state = NULL;
-   const struct cmd_block *head = bin->head;
-   int i, j = 0;
+   struct lp_cmd_reader reader;
+   union lp_rast_cmd_arg arg;
+   unsigned cmd;
+   int j = 0;
 
    debug_printf("bin %d,%d:\n", x, y);
-                
-   while (head) {
-      for (i = 0; i < head->count; i++, j++) {
-         if (head->cmd[i] == LP_RAST_OP_SET_STATE)
-            state = head->arg[i].state;
-
-         debug_printf("%d: %s %s\n", j,
-                      cmd_name(head->cmd[i]),
-                      is_blend(state, head, i) ? "blended" : "");
-      }
-      head = head->next;
+
+   lp_cmd_reader_init(&reader, bin);
+   while (lp_cmd_read(&reader, &cmd, &arg)) {
+      if (cmd == LP_RAST_OP_SET_STATE)
+         state = arg.state;
+
+      debug_printf("%d: %s %s\n", j++,
+                   cmd_name(cmd),
+                   is_blend(state, cmd) ? "blended" : "");
    }
 }
 
@@ -234,8 +232,9 @@ do_debug_bin( struct tile *tile,
               int x, int y,
               boolean print_cmds)
 {
-   unsigned k, j = 0;
-   const struct cmd_block *block;
+   struct lp_cmd_reader reader;
+   union lp_rast_cmd_arg arg;
+   unsigned cmd, j = 0;
 
    int tx = x * TILE_SIZE;
    int ty = y * TILE_SIZE;
@@ -245,43 +244,42 @@ do_debug_bin( struct tile *tile,
    tile->overdraw = 0;
    tile->state = NULL;
 
-   for (block = bin->head; block; block = block->next) {
-      for (k = 0; k < block->count; k++, j++) {
-         boolean blend = is_blend(tile->state, block, k);
-         char val = get_label(j);
-         int count = 0;
-            
-         if (print_cmds)
-            debug_printf("%c: %15s", val, cmd_name(block->cmd[k]));
-
-         if (block->cmd[k] == LP_RAST_OP_SET_STATE)
-            tile->state = block->arg[k].state;
-         
-         if (block->cmd[k] == LP_RAST_OP_CLEAR_COLOR ||
-             block->cmd[k] == LP_RAST_OP_CLEAR_ZSTENCIL)
-            count = debug_clear_tile(tx, ty, block->arg[k], tile, val);
-
-         if (block->cmd[k] == LP_RAST_OP_SHADE_TILE ||
-             block->cmd[k] == LP_RAST_OP_SHADE_TILE_OPAQUE)
-            count = debug_shade_tile(tx, ty, block->arg[k], tile, val);
-
-         if (block->cmd[k] == LP_RAST_OP_TRIANGLE_1 ||
-             block->cmd[k] == LP_RAST_OP_TRIANGLE_2 ||
-             block->cmd[k] == LP_RAST_OP_TRIANGLE_3 ||
-             block->cmd[k] == LP_RAST_OP_TRIANGLE_4 ||
-             block->cmd[k] == LP_RAST_OP_TRIANGLE_5 ||
-             block->cmd[k] == LP_RAST_OP_TRIANGLE_6 ||
-             block->cmd[k] == LP_RAST_OP_TRIANGLE_7)
-            count = debug_triangle(tx, ty, block->arg[k], tile, val);
-
-         if (print_cmds) {
-            debug_printf(" % 5d", count);
-
-            if (blend)
-               debug_printf(" blended");
-            
-            debug_printf("\n");
-         }
+   lp_cmd_reader_init(&reader, bin);
+   while (lp_cmd_read(&reader, &cmd, &arg)) {
+      boolean blend = is_blend(tile->state, cmd);
+      char val = get_label(j++);
+      int count = 0;
+
+      if (print_cmds)
+         debug_printf("%c: %15s", val, cmd_name(cmd));
+
+      if (cmd == LP_RAST_OP_SET_STATE)
+         tile->state = arg.state;
+
+      if (cmd == LP_RAST_OP_CLEAR_COLOR ||
+          cmd == LP_RAST_OP_CLEAR_ZSTENCIL)
+         count = debug_clear_tile(tx, ty, arg, tile, val);
+
+      if (cmd == LP_RAST_OP_SHADE_TILE ||
+          cmd == LP_RAST_OP_SHADE_TILE_OPAQUE)
+         count = debug_shade_tile(tx, ty, arg, tile, val);
+
+      if (cmd == LP_RAST_OP_TRIANGLE_1 ||
+          cmd == LP_RAST_OP_TRIANGLE_2 ||
+          cmd == LP_RAST_OP_TRIANGLE_3 ||
+          cmd == LP_RAST_OP_TRIANGLE_4 ||
+          cmd == LP_RAST_OP_TRIANGLE_5 ||
+          cmd == LP_RAST_OP_TRIANGLE_6 ||
+          cmd == LP_RAST_OP_TRIANGLE_7)
+         count = debug_triangle(tx, ty, arg, tile, val);
+
+      if (print_cmds) {
+         debug_printf(" % 5d", count);
+
+         if (blend)
+            debug_printf(" blended");
+
+         debug_printf("\n");
       }
    }
 }
@@ -322,8 +320,7 @@ lp_scene_bin_size( const struct lp_scene *scene, unsigned x, unsigned y )
    const struct cmd_block *cmd;
    unsigned size = 0;
    for (cmd = bin->head; cmd; cmd = cmd->next) {
-      size += (cmd->count *
-               (sizeof(uint8_t) + sizeof(union lp_rast_cmd_arg)));
+      size += cmd->used;
    }
    return size;
 }
@@ -29,6 +29,7 @@
 #define LP_RAST_PRIV_H
 
 #include "os/os_thread.h"
+#include "os/os_time.h"
 #include "util/u_format.h"
 #include "gallivm/lp_bld_debug.h"
 #include "lp_memory.h"
@@ -37,6 +38,7 @@
 #include "lp_state.h"
 #include "lp_texture.h"
 #include "lp_limits.h"
+#include "lp_perf.h"
 
 
 #define TILE_VECTOR_HEIGHT 4
@@ -76,11 +78,45 @@ extern const struct lp_rasterizer_task *jit_task;
 struct lp_rasterizer;
 struct cmd_bin;
 
+/** Assumed cache line size, for keeping per-thread data apart */
+#define LP_CACHELINE_SIZE 64
+
+
+/**
+ * A non-empty bin of the current scene, waiting to be rasterized.
+ */
+struct lp_rast_work
+{
+   uint16_t x, y;   /**< position of the bin, in tiles */
+   unsigned cost;   /**< estimated cost, in commands */
+};
+
+
+/**
+ * Pack/unpack the [begin, end) range of lp_rasterizer::work owned by a
+ * task into a single word, so that it can be updated atomically.
+ * The last element rather than the end is stored, so that all of the
+ * TILES_X * TILES_Y bins can be addressed with 16 bits.
+ */
+#define LP_RAST_QUEUE_EMPTY 1
+#define LP_RAST_QUEUE(begin, end) \
+   ((begin) < (end) ? (int32_t)((begin) | (((end) - 1) << 16)) : \
+                      LP_RAST_QUEUE_EMPTY)
+#define LP_RAST_QUEUE_BEGIN(queue) ((unsigned)(queue) & 0xffff)
+#define LP_RAST_QUEUE_END(queue) (((unsigned)(queue) >> 16) + 1)
+
+
 /**
  * Per-thread rasterization state
  */
 struct lp_rasterizer_task
 {
+   /**
+    * Bins left for this task, see LP_RAST_QUEUE().  The task takes bins
+    * from the front, idle tasks steal them from the back.
+    */
+   int32_t queue;
+
    const struct cmd_bin *bin;
    const struct lp_rast_state *state;
 
@@ -102,6 +138,12 @@ struct lp_rasterizer_task
    uint64_t ps_invocations;
    uint8_t ps_inv_multiplier;
 
+   /* load balancing statistics */
+   unsigned nr_bins;
+   unsigned nr_steals;
+   int64_t busy_time;  /**< rasterizing, in microseconds */
+   int64_t idle_time;  /**< waiting for the other threads, in microseconds */
+
    pipe_semaphore work_ready;
    pipe_semaphore work_done;
 };
@@ -123,14 +165,34 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
-   /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   /** Fence of the last scene queued, see lp_rast_finish() */
+   struct lp_fence *last_fence;
+
+   /**
+    * A task object for each rasterization thread, or a single one when
+    * rasterizing synchronously.  Each is allocated separately, cache line
+    * aligned, so that threads don't write to shared cache lines.
+    */
+   struct lp_rasterizer_task **tasks;
+   unsigned num_tasks;
+
+   /**
+    * Non-empty bins of the current scene.  Split into one contiguous
+    * range per task by lp_rast_begin().
+    */
+   struct lp_rast_work *work;
+   unsigned num_work;
+   boolean sort_bins;  /**< hand out the most expensive bins first */
 
    unsigned num_threads;
-   pipe_thread threads[LP_MAX_THREADS];
+   pipe_thread *threads;
 
    /** For synchronizing the rasterization threads */
    pipe_barrier barrier;
+
+   /** Job run by the threads instead of a scene, see lp_rast_run_jobs() */
+   lp_rast_job_func job_func;
+   void *job_data;
 };
 
 
@@ -272,6 +334,25 @@ lp_rast_get_unswizzled_depth_block_pointer(struct lp_rasterizer_task *task,
 
 
 
+/**
+ * Time fragment shader calls per optimization tier, with
+ * GALLIVM_DEBUG=perf.  Returns zero when not timing.
+ */
+static INLINE int64_t
+lp_rast_shader_time_begin(void)
+{
+   return (gallivm_debug & GALLIVM_DEBUG_PERF) ? os_time_get_nano() : 0;
+}
+
+static INLINE void
+lp_rast_shader_time_end(const struct lp_fragment_shader_variant *variant,
+                        int64_t start)
+{
+   if (start)
+      LP_COUNT_ADD(tier_exec_time[variant->tier], os_time_get_nano() - start);
+}
+
+
 /**
  * Shade all pixels in a 4x4 block.  The fragment code omits the
  * triangle in/out tests.
@@ -290,6 +371,7 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
    uint8_t *depth = NULL;
    unsigned depth_stride = 0;
    unsigned i;
+   int64_t start;
 
    /* color buffer */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
@@ -312,6 +394,7 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
       task->ps_invocations += 1 * variant->ps_inv_multiplier;
 
       /* run shader on 4x4 block */
+      start = lp_rast_shader_time_begin();
       BEGIN_JIT_CALL(state, task);
       variant->jit_function[RAST_WHOLE]( &state->jit_context,
                                          x, y,
@@ -326,6 +409,7 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
                                          stride,
                                          depth_stride);
       END_JIT_CALL();
+      lp_rast_shader_time_end(variant, start);
    }
 }
 
@@ -32,6 +32,7 @@
 #include <limits.h>
 #include "util/u_math.h"
 #include "lp_debug.h"
+#include "lp_hiz.h"
 #include "lp_perf.h"
 #include "lp_rast_priv.h"
 
@@ -66,6 +67,38 @@ block_full_16(struct lp_rasterizer_task *task,
 	 block_full_4(task, tri, x + ix, y + iy);
 }
 
+
+/**
+ * The scene's hierarchical Z, if the current state allows the given
+ * LP_HIZ_x use of it.
+ */
+static INLINE struct lp_hiz *
+lp_rast_hiz(const struct lp_rasterizer_task *task, unsigned flags)
+{
+   if (task->scene->hiz && (task->state->variant->hiz & flags))
+      return task->scene->hiz;
+   return NULL;
+}
+
+
+/**
+ * Whether the triangle is behind the depth buffer in a 16x16 block.
+ */
+static INLINE boolean
+lp_rast_hiz_reject_16(const struct lp_rasterizer_task *task,
+                      const struct lp_hiz *hiz,
+                      const struct lp_rast_triangle *tri,
+                      int x, int y)
+{
+   if (lp_hiz_reject(hiz, &tri->inputs, x, y,
+                     MIN2(16, task->x + task->width - x),
+                     MIN2(16, task->y + task->height - y))) {
+      LP_COUNT(nr_hiz_rejected_16);
+      return TRUE;
+   }
+   return FALSE;
+}
+
 #if !defined(PIPE_ARCH_SSE)
 
 static INLINE unsigned
@@ -159,6 +159,7 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
    unsigned plane_mask = arg.triangle.plane_mask;
    const struct lp_rast_plane *tri_plane = GET_PLANES(tri);
    const int x = task->x, y = task->y;
+   struct lp_hiz *hiz = lp_rast_hiz(task, LP_HIZ_TEST);
    struct lp_rast_plane plane[NR_PLANES];
    int c[NR_PLANES];
    unsigned outmask, inmask, partmask, partial_mask;
@@ -169,6 +170,12 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       return;
    }
 
+   if (hiz && lp_hiz_reject(hiz, &tri->inputs, x, y,
+                            task->width, task->height)) {
+      LP_COUNT(nr_hiz_rejected_64);
+      return;
+   }
+
    outmask = 0;                 /* outside one or more trivial reject planes */
    partmask = 0;                /* outside one or more trivial accept planes */
 
@@ -176,7 +183,7 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       int i = ffs(plane_mask) - 1;
       plane[j] = tri_plane[i];
       plane_mask &= ~(1 << i);
-      c[j] = plane[j].c + plane[j].dcdy * y - plane[j].dcdx * x;
+      c[j] = lp_rast_plane_eval(&plane[j], x, y);
 
       {
 	 const int dcdx = -plane[j].dcdx * 16;
@@ -228,6 +235,9 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       partial_mask &= ~(1 << i);
 
+      if (hiz && lp_rast_hiz_reject_16(task, hiz, tri, px, py))
+         continue;
+
       LP_COUNT(nr_partially_covered_16);
       TAG(do_block_16)(task, tri, plane, px, py, cx);
    }
@@ -243,8 +253,16 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       inmask &= ~(1 << i);
 
+      if (hiz && lp_rast_hiz_reject_16(task, hiz, tri, px, py))
+         continue;
+
       LP_COUNT(nr_fully_covered_16);
       block_full_16(task, tri, px, py);
+
+      if (hiz && (task->state->variant->hiz & LP_HIZ_UPDATE))
+         lp_hiz_update(hiz, &tri->inputs, px, py,
+                       MIN2(16, x + task->width - px),
+                       MIN2(16, y + task->height - py));
    }
 }
 
@@ -283,7 +301,7 @@ TRI_16(struct lp_rasterizer_task *task,
       cstep4[j][3] = _mm_add_epi32(cstep4[j][2], xdcdy);
 
       {
-	 const int c = plane[j].c + plane[j].dcdy * y - plane[j].dcdx * x;
+	 const int c = lp_rast_plane_eval(&plane[j], x, y);
 	 const int cox = plane[j].eo * 4;
 
 	 outmask |= sign_bits4(cstep4[j], c + cox);
@@ -312,9 +330,7 @@ TRI_16(struct lp_rasterizer_task *task,
       partial_mask &= ~(1 << i);
 
       for (j = 0; j < NR_PLANES; j++) {
-         const int cx = (plane[j].c - 1
-			 - plane[j].dcdx * px
-			 + plane[j].dcdy * py) * 4;
+         const int cx = (lp_rast_plane_eval(&plane[j], px, py) - 1) * 4;
 
 	 mask &= ~sign_bits4(cstep4[j], cx);
       }
@@ -343,9 +359,7 @@ TRI_4(struct lp_rasterizer_task *task,
       unsigned mask = 0xffff;
 
       for (j = 0; j < NR_PLANES; j++) {
-	 const int cx = (plane[j].c 
-			 - plane[j].dcdx * x
-			 + plane[j].dcdy * y);
+	 const int cx = lp_rast_plane_eval(&plane[j], x, y);
 
 	 const int dcdx = -plane[j].dcdx;
 	 const int dcdy = plane[j].dcdy;
@@ -34,6 +34,8 @@
 #include "lp_scene.h"
 #include "lp_fence.h"
 #include "lp_debug.h"
+#include "lp_hiz.h"
+#include "lp_query.h"
 
 
 #define RESOURCE_REF_SZ 32
@@ -46,6 +48,13 @@ struct resource_ref {
 };
 
 
+/** List of queries binned in a scene */
+struct query_ref {
+   struct llvmpipe_query *pq;
+   struct query_ref *next;
+};
+
+
 /**
  * Create a new scene object.
  * \param queue  the queue to put newly rendered/emptied scenes into
@@ -62,22 +71,24 @@ lp_scene_create( struct pipe_context *pipe )
    scene->data.head =
       CALLOC_STRUCT(data_block);
 
-   pipe_mutex_init(scene->mutex);
+   scene->max_size = LP_SCENE_MAX_SIZE;
 
-#ifdef DEBUG
-   /* Do some scene limit sanity checks here */
-   {
-      size_t maxBins = TILES_X * TILES_Y;
-      size_t maxCommandBytes = sizeof(struct cmd_block) * maxBins;
-      size_t maxCommandPlusData = maxCommandBytes + DATA_BLOCK_SIZE;
-      /* We'll need at least one command block per bin.  Make sure that's
-       * less than the max allowed scene size.
-       */
-      assert(maxCommandBytes < LP_SCENE_MAX_SIZE);
-      /* We'll also need space for at least one other data block */
-      assert(maxCommandPlusData <= LP_SCENE_MAX_SIZE);
-   }
-#endif
+   return scene;
+}
+
+
+/**
+ * Create a child scene, see lp_scene_begin_child().  Children get their
+ * data blocks when binning starts.
+ */
+struct lp_scene *
+lp_scene_create_child( struct pipe_context *pipe )
+{
+   struct lp_scene *scene = CALLOC_STRUCT(lp_scene);
+   if (!scene)
+      return NULL;
+
+   scene->pipe = pipe;
 
    return scene;
 }
@@ -90,9 +101,12 @@ void
 lp_scene_destroy(struct lp_scene *scene)
 {
    lp_fence_reference(&scene->fence, NULL);
-   pipe_mutex_destroy(scene->mutex);
-   assert(scene->data.head->next == NULL);
-   FREE(scene->data.head);
+   if (scene->data.head) {
+      /* child scenes may have given their block away */
+      assert(scene->data.head->next == NULL);
+      FREE(scene->data.head);
+   }
+   FREE(scene->tile);
    FREE(scene);
 }
 
@@ -106,8 +120,8 @@ lp_scene_is_empty(struct lp_scene *scene )
 {
    unsigned x, y;
 
-   for (y = 0; y < TILES_Y; y++) {
-      for (x = 0; x < TILES_X; x++) {
+   for (y = 0; y < scene->tiles_y; y++) {
+      for (x = 0; x < scene->tiles_x; x++) {
          const struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
          if (bin->head) {
             return FALSE;
@@ -139,9 +153,12 @@ lp_scene_bin_reset(struct lp_scene *scene, unsigned x, unsigned y)
 
    bin->last_state = NULL;
    bin->head = bin->tail;
+   bin->count = 0;
+   bin->data_base = NULL;
+   bin->state_base = NULL;
    if (bin->tail) {
       bin->tail->next = NULL;
-      bin->tail->count = 0;
+      bin->tail->used = 0;
    }
 }
 
@@ -193,7 +210,8 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
 
 /**
- * Free all the temporary data in a scene.
+ * Unmap the framebuffer and empty the bins.  Called by the rasterizer
+ * when it's done with the scene, see lp_scene_reset() for the rest.
  */
 void
 lp_scene_end_rasterization(struct lp_scene *scene )
@@ -230,6 +248,9 @@ lp_scene_end_rasterization(struct lp_scene *scene )
          bin->head = NULL;
          bin->tail = NULL;
          bin->last_state = NULL;
+         bin->count = 0;
+         bin->data_base = NULL;
+         bin->state_base = NULL;
       }
    }
 
@@ -238,6 +259,28 @@ lp_scene_end_rasterization(struct lp_scene *scene )
     */
    assert(lp_scene_is_empty(scene));
 
+   /* The counters of the queries binned in the scene are final now, fold
+    * them into the query results before the next scene adds to them.
+    */
+   {
+      struct query_ref *ref;
+
+      for (ref = scene->queries; ref; ref = ref->next) {
+         llvmpipe_query_resolve(ref->pq);
+      }
+      scene->queries = NULL;
+   }
+}
+
+
+/**
+ * Free all the temporary data in a scene, once the rasterizer is done
+ * with it.  Called by setup, in the application's thread, so that the
+ * resources and queries are only released there.
+ */
+void
+lp_scene_reset(struct lp_scene *scene)
+{
    /* Decrement texture ref counts
     */
    {
@@ -283,6 +326,7 @@ lp_scene_end_rasterization(struct lp_scene *scene )
    scene->resources = NULL;
    scene->scene_size = 0;
    scene->resource_reference_size = 0;
+   scene->num_tris = 0;
 
    scene->has_depthstencil_clear = FALSE;
    scene->alloc_failed = FALSE;
@@ -311,7 +355,11 @@ lp_scene_new_cmd_block( struct lp_scene *scene,
       }
       //memset(block, 0, sizeof *block);
       block->next = NULL;
-      block->count = 0;
+      block->used = 0;
+
+      /* Each block's pointer deltas start from scratch */
+      bin->data_base = NULL;
+      bin->state_base = NULL;
    }
    return block;
 }
@@ -320,7 +368,7 @@ lp_scene_new_cmd_block( struct lp_scene *scene,
 struct data_block *
 lp_scene_new_data_block( struct lp_scene *scene )
 {
-   if (scene->scene_size + DATA_BLOCK_SIZE > LP_SCENE_MAX_SIZE) {
+   if (scene->scene_size + DATA_BLOCK_SIZE > scene->max_size) {
       if (0) debug_printf("%s: failed\n", __FUNCTION__);
       scene->alloc_failed = TRUE;
       return NULL;
@@ -358,6 +406,27 @@ lp_scene_data_size( const struct lp_scene *scene )
 
 
 
+/**
+ * Note that the scene has commands for a query, so that its result is
+ * resolved when the scene is done.
+ */
+boolean
+lp_scene_add_query(struct lp_scene *scene,
+                   struct llvmpipe_query *pq)
+{
+   struct query_ref *ref = lp_scene_alloc(scene, sizeof *ref);
+
+   if (!ref)
+      return FALSE;
+
+   ref->pq = pq;
+   ref->next = scene->queries;
+   scene->queries = ref;
+
+   return TRUE;
+}
+
+
 /**
  * Add a reference to a resource by the scene.
  */
@@ -439,69 +508,16 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
-{
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
-   }
-   return TRUE;
-}
-
-
-void
-lp_scene_bin_iter_begin( struct lp_scene *scene )
-{
-   scene->curr_x = scene->curr_y = -1;
-}
-
-
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
- * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * Returns FALSE if the bins for the framebuffer couldn't be allocated.
  */
-struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
-{
-   struct cmd_bin *bin = NULL;
-
-   pipe_mutex_lock(scene->mutex);
-
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
-   }
-
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
-
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   pipe_mutex_unlock(scene->mutex);
-   return bin;
-}
-
-
-void lp_scene_begin_binning( struct lp_scene *scene,
-                             struct pipe_framebuffer_state *fb, boolean discard )
+boolean lp_scene_begin_binning( struct lp_scene *scene,
+                                struct pipe_framebuffer_state *fb,
+                                boolean discard )
 {
    int i;
    unsigned max_layer = ~0;
+   unsigned num_bins;
 
    assert(lp_scene_is_empty(scene));
 
@@ -513,6 +529,28 @@ void lp_scene_begin_binning( struct lp_scene *scene,
    assert(scene->tiles_x <= TILES_X);
    assert(scene->tiles_y <= TILES_Y);
 
+   /* Only grow the bins, so that small framebuffers don't pay for large
+    * ones, and switching between sizes doesn't reallocate.  All bins past
+    * the ones in use are empty.
+    */
+   num_bins = scene->tiles_x * scene->tiles_y;
+   if (num_bins > scene->num_alloced_bins) {
+      FREE(scene->tile);
+      scene->tile = CALLOC(num_bins, sizeof *scene->tile);
+      if (!scene->tile) {
+         scene->num_alloced_bins = 0;
+         scene->tiles_x = scene->tiles_y = 0;
+         return FALSE;
+      }
+      scene->num_alloced_bins = num_bins;
+   }
+
+   /* We'll need at least one command block per bin, and room for more
+    * than that to be worth binning.
+    */
+   scene->max_size = MAX2(LP_SCENE_MAX_SIZE,
+                          2 * num_bins * sizeof(struct cmd_block));
+
    /*
     * Determine how many layers the fb has (used for clamping layer value).
     * OpenGL (but not d3d10) permits different amount of layers per rt, however
@@ -533,6 +571,13 @@ void lp_scene_begin_binning( struct lp_scene *scene,
       max_layer = MIN2(max_layer, zsbuf->u.tex.last_layer - zsbuf->u.tex.first_layer);
    }
    scene->fb_max_layer = max_layer;
+
+   scene->hiz = NULL;
+   if (!(LP_PERF & PERF_NO_HIZ))
+      scene->hiz = lp_hiz_for_surface(fb->zsbuf);
+   scene->hiz_binning = scene->hiz != NULL;
+
+   return TRUE;
 }
 
 
@@ -545,7 +590,205 @@ void lp_scene_end_binning( struct lp_scene *scene )
       debug_printf("  data size: %u\n",
                    lp_scene_data_size(scene));
 
+      {
+         unsigned num_bins = lp_scene_get_num_bins(scene);
+         unsigned num_cmds = 0, cmd_size = 0, old_size;
+         unsigned i;
+
+         for (i = 0; i < num_bins; i++) {
+            const struct cmd_bin *bin = &scene->tile[i];
+            const struct cmd_block *block;
+
+            num_cmds += bin->count;
+            for (block = bin->head; block; block = block->next)
+               cmd_size += block->used;
+         }
+
+         /* What the same commands took as an opcode and a full
+          * union lp_rast_cmd_arg each.
+          */
+         old_size = num_cmds * (1 + sizeof(union lp_rast_cmd_arg));
+
+         debug_printf("  commands: %u, %u bytes (%u unencoded)\n",
+                      num_cmds, cmd_size, old_size);
+         if (scene->num_tris) {
+            debug_printf("  triangles: %u, %.1f command bytes/tri "
+                         "(%.1f unencoded)\n",
+                         scene->num_tris,
+                         (double) cmd_size / scene->num_tris,
+                         (double) old_size / scene->num_tris);
+         }
+      }
+
       if (0)
          lp_debug_bins( scene );
    }
 }
+
+
+/**
+ * Prepare a child scene for binning part of a draw in another thread.
+ *
+ * The child bins into the parent's framebuffer layout, starting from the
+ * parent's bin state, and gets an equal share of the parent's remaining
+ * memory.  Only the primitive setup/binning paths may use a child scene;
+ * its commands reach the parent through lp_scene_merge_child().
+ *
+ * Returns FALSE if there's not enough memory left to be worth it.
+ */
+boolean
+lp_scene_begin_child(struct lp_scene *child,
+                     const struct lp_scene *scene,
+                     unsigned num_children)
+{
+   unsigned num_bins = lp_scene_get_num_bins(scene);
+   unsigned i;
+
+   if (num_bins > child->num_alloced_bins) {
+      FREE(child->tile);
+      child->tile = MALLOC(num_bins * sizeof *child->tile);
+      if (!child->tile) {
+         child->num_alloced_bins = 0;
+         return FALSE;
+      }
+      child->num_alloced_bins = num_bins;
+   }
+
+   child->scene_size = 0;
+   child->max_size = (scene->max_size - MIN2(scene->max_size,
+                                             scene->scene_size)) /
+                     num_children;
+   child->alloc_failed = FALSE;
+   child->num_tris = 0;
+
+   /* The data block is kept across draws until the parent is done with
+    * binning, see lp_scene_end_child().
+    */
+   if (!child->data.head) {
+      if (child->max_size < 2 * DATA_BLOCK_SIZE)
+         return FALSE;
+
+      child->data.head = MALLOC_STRUCT(data_block);
+      if (!child->data.head)
+         return FALSE;
+
+      child->data.head->used = 0;
+      child->data.head->next = NULL;
+      child->scene_size += sizeof *child->data.head;
+   }
+
+   /* Not referenced, the parent holds the references */
+   child->fb = scene->fb;
+   child->fb_max_layer = scene->fb_max_layer;
+   child->hiz = scene->hiz;
+   child->hiz_binning = scene->hiz_binning;
+   child->had_queries = scene->had_queries;
+   child->tiles_x = scene->tiles_x;
+   child->tiles_y = scene->tiles_y;
+
+   for (i = 0; i < num_bins; i++) {
+      child->tile[i].last_state = scene->tile[i].last_state;
+      child->tile[i].head = NULL;
+      child->tile[i].tail = NULL;
+      child->tile[i].count = 0;
+      child->tile[i].data_base = NULL;
+      child->tile[i].state_base = NULL;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Hand the child's full data blocks over to the parent, keeping only the
+ * current one for the next draw.
+ */
+static void
+merge_child_data(struct lp_scene *scene, struct lp_scene *child)
+{
+   struct data_block *first = child->data.head->next;
+
+   if (first) {
+      struct data_block *last = first;
+
+      while (last->next)
+         last = last->next;
+
+      last->next = scene->data.head->next;
+      scene->data.head->next = first;
+      child->data.head->next = NULL;
+   }
+
+   scene->scene_size += child->scene_size;
+   child->scene_size = 0;
+
+   scene->num_tris += child->num_tris;
+   child->num_tris = 0;
+}
+
+
+/**
+ * Append the commands binned in the child to the parent's bins, so that
+ * they're rasterized after everything binned in the parent so far.
+ */
+void
+lp_scene_merge_child(struct lp_scene *scene, struct lp_scene *child)
+{
+   unsigned num_bins = lp_scene_get_num_bins(scene);
+   unsigned i;
+
+   assert(child->tiles_x == scene->tiles_x);
+   assert(child->tiles_y == scene->tiles_y);
+
+   for (i = 0; i < num_bins; i++) {
+      struct cmd_bin *src = &child->tile[i];
+      struct cmd_bin *dst = &scene->tile[i];
+
+      if (src->head) {
+         if (dst->tail)
+            dst->tail->next = src->head;
+         else
+            dst->head = src->head;
+         dst->tail = src->tail;
+         dst->last_state = src->last_state;
+         dst->count += src->count;
+         /* The parent carries on encoding into the child's last block */
+         dst->data_base = src->data_base;
+         dst->state_base = src->state_base;
+      }
+   }
+
+   merge_child_data(scene, child);
+}
+
+
+/**
+ * Throw away the commands binned in the child.  The memory is still
+ * handed to the parent, it's freed when the parent is.
+ */
+void
+lp_scene_discard_child(struct lp_scene *scene, struct lp_scene *child)
+{
+   child->num_tris = 0;
+   merge_child_data(scene, child);
+}
+
+
+/**
+ * Give the child's last data block to the parent, before the parent is
+ * rasterized.
+ */
+void
+lp_scene_end_child(struct lp_scene *scene, struct lp_scene *child)
+{
+   struct data_block *block = child->data.head;
+
+   if (block) {
+      assert(block->next == NULL);
+      block->next = scene->data.head->next;
+      scene->data.head->next = block;
+      child->data.head = NULL;
+   }
+
+   memset(&child->fb, 0, sizeof child->fb);
+}
@@ -41,18 +41,29 @@
 
 struct lp_scene_queue;
 struct lp_rast_state;
+struct lp_hiz;
 
-/* We're limited to 2K by 2K for 32bit fixed point rasterization.
- * Will need a 64-bit version for larger framebuffers.
+/* Max number of bins in each dimension.  The bins themselves are
+ * allocated to fit the framebuffer, see lp_scene_begin_binning().
  */
 #define TILES_X (LP_MAX_WIDTH / TILE_SIZE)
 #define TILES_Y (LP_MAX_HEIGHT / TILE_SIZE)
 
 
-/* Commands per command block (ideally so sizeof(cmd_block) is a power of
- * two in size.)
+/* Bytes of encoded commands per command block (so that sizeof(cmd_block)
+ * is 256 bytes).
  */
-#define CMD_BLOCK_MAX 29
+#define CMD_BLOCK_SIZE (256 - sizeof(void *) - sizeof(unsigned))
+
+/* Upper bound of the size of one encoded command, see lp_scene_bin_command().
+ */
+#define CMD_MAX_SIZE (1 + 2 * 10)
+
+/* Flag ORed into the encoded opcode of a command whose argument is stored
+ * once in the scene data and referenced by every bin, see
+ * lp_scene_bin_everywhere().
+ */
+#define CMD_SHARED 0x80
 
 /* Bytes per data block.
  */
@@ -74,11 +85,20 @@ typedef void (*lp_rast_cmd_func)( struct lp_rasterizer_task *,
                                   const union lp_rast_cmd_arg );
 
    
+/**
+ * A chunk of a bin's command stream.
+ *
+ * Each command is an opcode byte followed by its argument, encoded
+ * according to the opcode.  Pointers to scene data are stored as
+ * variable length deltas against the previous pointer of the same kind
+ * in the block, so the triangles and states of a bin, which are mostly
+ * allocated in order, take two or three bytes each instead of a whole
+ * union lp_rast_cmd_arg.  The deltas restart at each block.
+ */
 struct cmd_block {
-   uint8_t cmd[CMD_BLOCK_MAX];
-   union lp_rast_cmd_arg arg[CMD_BLOCK_MAX];
-   unsigned count;
    struct cmd_block *next;
+   unsigned used;
+   uint8_t data[CMD_BLOCK_SIZE];
 };
 
 
@@ -97,6 +117,11 @@ struct cmd_bin {
    const struct lp_rast_state *last_state;       /* most recent state set in bin */
    struct cmd_block *head;
    struct cmd_block *tail;
+   unsigned count;                               /* number of commands */
+
+   /* Previous pointers encoded in the tail block */
+   const void *data_base;
+   const void *state_base;
 };
    
 
@@ -116,6 +141,7 @@ struct data_block_list {
 };
 
 struct resource_ref;
+struct query_ref;
 
 /**
  * All bins and bin data are contained here.
@@ -147,18 +173,35 @@ struct lp_scene {
    /* The amount of layers in the fb (minimum of all attachments) */
    unsigned fb_max_layer;
 
+   /** Hierarchical Z of the depth buffer, or NULL */
+   struct lp_hiz *hiz;
+
+   /**
+    * Whether the hierarchical Z bounds are still valid for binning, i.e.
+    * nothing binned so far may have increased the depth values.
+    */
+   boolean hiz_binning;
+
    /** the framebuffer to render the scene into */
    struct pipe_framebuffer_state fb;
 
    /** list of resources referenced by the scene commands */
    struct resource_ref *resources;
 
+   /** list of queries to resolve when the scene is done */
+   struct query_ref *queries;
+
    /** Total memory used by the scene (in bytes).  This sums all the
     * data blocks and counts all bins, state, resource references and
     * other random allocations within the scene.
     */
    unsigned scene_size;
 
+   /** Limit for scene_size.  LP_SCENE_MAX_SIZE, unless the framebuffer
+    * has so many bins that this wouldn't leave room for binning much.
+    */
+   unsigned max_size;
+
    /** Sum of sizes of all resources referenced by the scene.  Sums
     * all the textures read by the scene:
     */
@@ -173,17 +216,21 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   pipe_mutex mutex;
-
-   struct cmd_bin tile[TILES_X][TILES_Y];
+   /** tiles_x * tiles_y bins, in raster order */
+   struct cmd_bin *tile;
+   unsigned num_alloced_bins;
    struct data_block_list data;
+
+   /** Number of triangles binned, for the DEBUG_SCENE statistics */
+   unsigned num_tris;
 };
 
 
 
 struct lp_scene *lp_scene_create(struct pipe_context *pipe);
 
+struct lp_scene *lp_scene_create_child(struct pipe_context *pipe);
+
 void lp_scene_destroy(struct lp_scene *scene);
 
 boolean lp_scene_is_empty(struct lp_scene *scene );
@@ -202,6 +249,9 @@ boolean lp_scene_add_resource_reference(struct lp_scene *scene,
 boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
                                         const struct pipe_resource *resource );
 
+boolean lp_scene_add_query(struct lp_scene *scene,
+                           struct llvmpipe_query *pq);
+
 
 /**
  * Allocate space for a command/data in the bin's data buffer.
@@ -219,7 +269,7 @@ lp_scene_alloc( struct lp_scene *scene, unsigned size)
    if (LP_DEBUG & DEBUG_MEM)
       debug_printf("alloc %u block %u/%u tot %u/%u\n",
 		   size, block->used, DATA_BLOCK_SIZE,
-		   scene->scene_size, LP_SCENE_MAX_SIZE);
+		   scene->scene_size, scene->max_size);
 
    if (block->used + size > DATA_BLOCK_SIZE) {
       block = lp_scene_new_data_block( scene );
@@ -253,7 +303,7 @@ lp_scene_alloc_aligned( struct lp_scene *scene, unsigned size,
       debug_printf("alloc %u block %u/%u tot %u/%u\n",
 		   size + alignment - 1,
 		   block->used, DATA_BLOCK_SIZE,
-		   scene->scene_size, LP_SCENE_MAX_SIZE);
+		   scene->scene_size, scene->max_size);
        
    if (block->used + size + alignment - 1 > DATA_BLOCK_SIZE) {
       block = lp_scene_new_data_block( scene );
@@ -285,7 +335,9 @@ lp_scene_putback_data( struct lp_scene *scene, unsigned size)
 static INLINE struct cmd_bin *
 lp_scene_get_bin(struct lp_scene *scene, unsigned x, unsigned y)
 {
-   return &scene->tile[x][y];
+   assert(x < scene->tiles_x);
+   assert(y < scene->tiles_y);
+   return &scene->tile[y * scene->tiles_x + x];
 }
 
 
@@ -294,40 +346,247 @@ void
 lp_scene_bin_reset(struct lp_scene *scene, unsigned x, unsigned y);
 
 
-/* Add a command to bin[x][y].
+/**
+ * Command stream encoding helpers.
+ */
+static INLINE uint8_t *
+lp_cmd_put_uint(uint8_t *p, uint64_t value)
+{
+   while (value >= 0x80) {
+      *p++ = (uint8_t) (value | 0x80);
+      value >>= 7;
+   }
+   *p++ = (uint8_t) value;
+   return p;
+}
+
+
+static INLINE const uint8_t *
+lp_cmd_get_uint(const uint8_t *p, uint64_t *value)
+{
+   uint64_t v = 0;
+   unsigned shift = 0;
+
+   while (*p & 0x80) {
+      v |= (uint64_t) (*p++ & 0x7f) << shift;
+      shift += 7;
+   }
+   v |= (uint64_t) *p++ << shift;
+
+   *value = v;
+   return p;
+}
+
+
+/**
+ * Encode ptr as a zigzag delta against *base, and make it the new base.
+ */
+static INLINE uint8_t *
+lp_cmd_put_ptr(uint8_t *p, const void **base, const void *ptr)
+{
+   int64_t delta = (int64_t) ((intptr_t) ptr - (intptr_t) *base);
+
+   *base = ptr;
+   return lp_cmd_put_uint(p, ((uint64_t) delta << 1) ^
+                             (uint64_t) (delta >> 63));
+}
+
+
+static INLINE const uint8_t *
+lp_cmd_get_ptr(const uint8_t *p, const void **base)
+{
+   uint64_t value;
+   int64_t delta;
+
+   p = lp_cmd_get_uint(p, &value);
+   delta = (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+
+   *base = (const void *) ((intptr_t) *base + (intptr_t) delta);
+   return p;
+}
+
+
+/**
+ * Walks the commands of a bin.
+ */
+struct lp_cmd_reader {
+   const struct cmd_block *block;
+   const uint8_t *pos;
+   const uint8_t *end;
+   const void *data_base;
+   const void *state_base;
+};
+
+
+static INLINE void
+lp_cmd_reader_init(struct lp_cmd_reader *reader,
+                   const struct cmd_bin *bin)
+{
+   reader->block = bin->head;
+   reader->pos = bin->head ? bin->head->data : NULL;
+   reader->end = bin->head ? bin->head->data + bin->head->used : NULL;
+   reader->data_base = NULL;
+   reader->state_base = NULL;
+}
+
+
+/**
+ * Decode the next command.  Returns FALSE at the end of the bin.
  */
 static INLINE boolean
-lp_scene_bin_command( struct lp_scene *scene,
-                      unsigned x, unsigned y,
-                      unsigned cmd,
-                      union lp_rast_cmd_arg arg )
+lp_cmd_read(struct lp_cmd_reader *reader,
+            unsigned *cmd,
+            union lp_rast_cmd_arg *arg)
+{
+   const uint8_t *p;
+   unsigned op;
+
+   while (reader->pos == reader->end) {
+      if (!reader->block || !reader->block->next)
+         return FALSE;
+      reader->block = reader->block->next;
+      reader->pos = reader->block->data;
+      reader->end = reader->block->data + reader->block->used;
+      reader->data_base = NULL;
+      reader->state_base = NULL;
+   }
+
+   p = reader->pos;
+   op = *p++;
+
+   if (op & CMD_SHARED) {
+      p = lp_cmd_get_ptr(p, &reader->data_base);
+      memcpy(arg, reader->data_base, sizeof *arg);
+      op &= ~CMD_SHARED;
+   }
+   else {
+      switch (op) {
+      case LP_RAST_OP_SET_STATE:
+         p = lp_cmd_get_ptr(p, &reader->state_base);
+         arg->set_state = reader->state_base;
+         break;
+      case LP_RAST_OP_SHADE_TILE:
+      case LP_RAST_OP_SHADE_TILE_OPAQUE:
+         p = lp_cmd_get_ptr(p, &reader->data_base);
+         arg->shade_tile = reader->data_base;
+         break;
+      case LP_RAST_OP_TRIANGLE_1:
+      case LP_RAST_OP_TRIANGLE_2:
+      case LP_RAST_OP_TRIANGLE_3:
+      case LP_RAST_OP_TRIANGLE_4:
+      case LP_RAST_OP_TRIANGLE_5:
+      case LP_RAST_OP_TRIANGLE_6:
+      case LP_RAST_OP_TRIANGLE_7:
+      case LP_RAST_OP_TRIANGLE_8:
+      case LP_RAST_OP_TRIANGLE_3_4:
+      case LP_RAST_OP_TRIANGLE_3_16:
+      case LP_RAST_OP_TRIANGLE_4_16:
+         {
+            uint64_t plane_mask;
+            p = lp_cmd_get_ptr(p, &reader->data_base);
+            p = lp_cmd_get_uint(p, &plane_mask);
+            arg->triangle.tri = reader->data_base;
+            arg->triangle.plane_mask = (unsigned) plane_mask;
+         }
+         break;
+      default:
+         memcpy(arg, p, sizeof *arg);
+         p += sizeof *arg;
+         break;
+      }
+   }
+
+   reader->pos = p;
+   *cmd = op;
+   return TRUE;
+}
+
+
+/**
+ * Append an encoded command to a bin.
+ */
+static INLINE boolean
+lp_scene_bin_encode( struct lp_scene *scene,
+                     struct cmd_bin *bin,
+                     unsigned cmd,
+                     const union lp_rast_cmd_arg *arg,
+                     const union lp_rast_cmd_arg *shared )
 {
-   struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
    struct cmd_block *tail = bin->tail;
+   uint8_t *p;
 
-   assert(x < scene->tiles_x);
-   assert(y < scene->tiles_y);
    assert(cmd < LP_RAST_OP_MAX);
 
-   if (tail == NULL || tail->count == CMD_BLOCK_MAX) {
+   if (tail == NULL || tail->used + CMD_MAX_SIZE > CMD_BLOCK_SIZE) {
       tail = lp_scene_new_cmd_block( scene, bin );
       if (!tail) {
          return FALSE;
       }
-      assert(tail->count == 0);
+      assert(tail->used == 0);
    }
 
-   {
-      unsigned i = tail->count;
-      tail->cmd[i] = cmd & LP_RAST_OP_MASK;
-      tail->arg[i] = arg;
-      tail->count++;
+   p = tail->data + tail->used;
+
+   if (shared) {
+      *p++ = (uint8_t) (cmd | CMD_SHARED);
+      p = lp_cmd_put_ptr(p, &bin->data_base, shared);
    }
-   
+   else {
+      *p++ = (uint8_t) cmd;
+
+      switch (cmd) {
+      case LP_RAST_OP_SET_STATE:
+         p = lp_cmd_put_ptr(p, &bin->state_base, arg->set_state);
+         break;
+      case LP_RAST_OP_SHADE_TILE:
+      case LP_RAST_OP_SHADE_TILE_OPAQUE:
+         p = lp_cmd_put_ptr(p, &bin->data_base, arg->shade_tile);
+         break;
+      case LP_RAST_OP_TRIANGLE_1:
+      case LP_RAST_OP_TRIANGLE_2:
+      case LP_RAST_OP_TRIANGLE_3:
+      case LP_RAST_OP_TRIANGLE_4:
+      case LP_RAST_OP_TRIANGLE_5:
+      case LP_RAST_OP_TRIANGLE_6:
+      case LP_RAST_OP_TRIANGLE_7:
+      case LP_RAST_OP_TRIANGLE_8:
+      case LP_RAST_OP_TRIANGLE_3_4:
+      case LP_RAST_OP_TRIANGLE_3_16:
+      case LP_RAST_OP_TRIANGLE_4_16:
+         p = lp_cmd_put_ptr(p, &bin->data_base, arg->triangle.tri);
+         p = lp_cmd_put_uint(p, arg->triangle.plane_mask);
+         break;
+      default:
+         memcpy(p, arg, sizeof *arg);
+         p += sizeof *arg;
+         break;
+      }
+   }
+
+   assert(p <= tail->data + tail->used + CMD_MAX_SIZE);
+   tail->used = p - tail->data;
+   bin->count++;
+
    return TRUE;
 }
 
 
+/* Add a command to bin[x][y].
+ */
+static INLINE boolean
+lp_scene_bin_command( struct lp_scene *scene,
+                      unsigned x, unsigned y,
+                      unsigned cmd,
+                      union lp_rast_cmd_arg arg )
+{
+   assert(x < scene->tiles_x);
+   assert(y < scene->tiles_y);
+
+   return lp_scene_bin_encode(scene, lp_scene_get_bin(scene, x, y),
+                              cmd & LP_RAST_OP_MASK, &arg, NULL);
+}
+
+
 static INLINE boolean
 lp_scene_bin_cmd_with_state( struct lp_scene *scene,
                              unsigned x, unsigned y,
@@ -352,17 +611,27 @@ lp_scene_bin_cmd_with_state( struct lp_scene *scene,
 }
 
 
-/* Add a command to all active bins.
+/* Add a command to all active bins.  The argument is stored once in the
+ * scene data, and the bins only reference it.
  */
 static INLINE boolean
 lp_scene_bin_everywhere( struct lp_scene *scene,
 			 unsigned cmd,
 			 const union lp_rast_cmd_arg arg )
 {
+   union lp_rast_cmd_arg *shared;
    unsigned i, j;
+
+   shared = lp_scene_alloc_aligned(scene, sizeof *shared, 16);
+   if (!shared)
+      return FALSE;
+
+   *shared = arg;
+
    for (i = 0; i < scene->tiles_x; i++) {
       for (j = 0; j < scene->tiles_y; j++) {
-         if (!lp_scene_bin_command( scene, i, j, cmd, arg ))
+         if (!lp_scene_bin_encode( scene, lp_scene_get_bin(scene, i, j),
+                                   cmd & LP_RAST_OP_MASK, &arg, shared ))
             return FALSE;
       }
    }
@@ -378,17 +647,9 @@ lp_scene_get_num_bins( const struct lp_scene *scene )
 }
 
 
-void
-lp_scene_bin_iter_begin( struct lp_scene *scene );
-
-struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
-
-
-
 /* Begin/end binning of a scene
  */
-void
+boolean
 lp_scene_begin_binning( struct lp_scene *scene,
                         struct pipe_framebuffer_state *fb,
                         boolean discard );
@@ -397,6 +658,23 @@ void
 lp_scene_end_binning( struct lp_scene *scene );
 
 
+/* Child scenes, for binning parts of a draw in parallel
+ */
+boolean
+lp_scene_begin_child(struct lp_scene *child,
+                     const struct lp_scene *scene,
+                     unsigned num_children);
+
+void
+lp_scene_merge_child(struct lp_scene *scene, struct lp_scene *child);
+
+void
+lp_scene_discard_child(struct lp_scene *scene, struct lp_scene *child);
+
+void
+lp_scene_end_child(struct lp_scene *scene, struct lp_scene *child);
+
+
 /* Begin/end rasterization of a scene
  */
 void
@@ -405,6 +683,9 @@ lp_scene_begin_rasterization(struct lp_scene *scene);
 void
 lp_scene_end_rasterization(struct lp_scene *scene );
 
+void
+lp_scene_reset(struct lp_scene *scene);
+
 
 
 
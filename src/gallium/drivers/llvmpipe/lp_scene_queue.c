@@ -34,11 +34,12 @@
 
 #include "util/u_ringbuffer.h"
 #include "util/u_memory.h"
+#include "lp_limits.h"
 #include "lp_scene_queue.h"
 
 
 
-#define MAX_SCENE_QUEUE 4
+#define MAX_SCENE_QUEUE LP_MAX_SCENES
 
 struct scene_packet {
    struct util_packet header;
@@ -47,6 +47,9 @@
 #include "lp_public.h"
 #include "lp_limits.h"
 #include "lp_rast.h"
+#include "lp_query.h"
+#include "lp_compile_queue.h"
+#include "gallivm/lp_bld_code_cache.h"
 
 #include "state_tracker/sw_winsys.h"
 
@@ -66,6 +69,7 @@ static const struct debug_named_value lp_debug_flags[] = {
    { "fence", DEBUG_FENCE, NULL },
    { "mem", DEBUG_MEM, NULL },
    { "fs", DEBUG_FS, NULL },
+   { "cache", DEBUG_CACHE, NULL },
    DEBUG_NAMED_VALUE_END
 };
 #endif
@@ -80,6 +84,8 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_blend",       PERF_NO_BLEND, NULL },
    { "no_depth",       PERF_NO_DEPTH, NULL },
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
+   { "no_tex_tiling",  PERF_NO_TEX_TILING, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -203,6 +209,9 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_QUADS_FOLLOW_PROVOKING_VERTEX_CONVENTION:
       return 0;
    case PIPE_CAP_COMPUTE:
+      /* The launch_grid path has not been validated with
+       * tests/trivial/compute yet, and lacks sampling and atomics.
+       */
       return 0;
    case PIPE_CAP_USER_VERTEX_BUFFERS:
    case PIPE_CAP_USER_INDEX_BUFFERS:
@@ -265,6 +274,60 @@ llvmpipe_get_shader_param(struct pipe_screen *screen, unsigned shader, enum pipe
       default:
          return draw_get_shader_param(shader, param);
       }
+   case PIPE_SHADER_COMPUTE:
+      switch (param) {
+      case PIPE_SHADER_CAP_PREFERRED_IR:
+         return PIPE_SHADER_IR_TGSI;
+      case PIPE_SHADER_CAP_MAX_TEXTURE_SAMPLERS:
+         /* no sampling in compute shaders */
+         return 0;
+      default:
+         return gallivm_get_shader_param(param);
+      }
+   default:
+      return 0;
+   }
+}
+
+static int
+llvmpipe_get_compute_param(struct pipe_screen *screen,
+                           enum pipe_compute_cap param, void *data)
+{
+   uint64_t *data64 = (uint64_t *)data;
+
+   switch (param) {
+   case PIPE_COMPUTE_CAP_GRID_DIMENSION:
+      data64[0] = 3;
+      return 8;
+   case PIPE_COMPUTE_CAP_MAX_GRID_SIZE:
+      data64[0] = 65535;
+      data64[1] = 65535;
+      data64[2] = 65535;
+      return 24;
+   case PIPE_COMPUTE_CAP_MAX_BLOCK_SIZE:
+      data64[0] = 1024;
+      data64[1] = 1024;
+      data64[2] = 64;
+      return 24;
+   case PIPE_COMPUTE_CAP_MAX_THREADS_PER_BLOCK:
+      data64[0] = 1024;
+      return 8;
+   case PIPE_COMPUTE_CAP_MAX_GLOBAL_SIZE:
+      data64[0] = (uint64_t)LP_MAX_CS_GLOBALS << LP_CS_GLOBAL_SHIFT;
+      return 8;
+   case PIPE_COMPUTE_CAP_MAX_MEM_ALLOC_SIZE:
+      /* a buffer must be addressable by a single GLOBAL handle */
+      data64[0] = 1 << LP_CS_GLOBAL_SHIFT;
+      return 8;
+   case PIPE_COMPUTE_CAP_MAX_LOCAL_SIZE:
+      data64[0] = 32 << 10;
+      return 8;
+   case PIPE_COMPUTE_CAP_MAX_PRIVATE_SIZE:
+      data64[0] = 16 << 10;
+      return 8;
+   case PIPE_COMPUTE_CAP_MAX_INPUT_SIZE:
+      data64[0] = 4096;
+      return 8;
    default:
       return 0;
    }
@@ -411,8 +474,39 @@ llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
    struct llvmpipe_resource *texture = llvmpipe_resource(resource);
 
    assert(texture->dt);
-   if (texture->dt)
+   if (texture->dt) {
+      /* The scenes rendering to it are queued asynchronously */
+      if (texture->fence)
+         lp_fence_wait(texture->fence);
+
       winsys->displaytarget_display(winsys, texture->dt, context_private);
+   }
+}
+
+
+static int
+llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+   static const struct pipe_driver_query_info queries[] = {
+      {"fs-compiles", LP_QUERY_FS_COMPILES, 0, FALSE},
+      {"fs-compile-time", LP_QUERY_FS_COMPILE_TIME, 0, FALSE},
+      {"fs-compile-wait-time", LP_QUERY_FS_COMPILE_WAIT_TIME, 0, FALSE},
+      {"code-cache-entries", LP_QUERY_CODE_CACHE_ENTRIES, 0, FALSE},
+      {"code-cache-instrs", LP_QUERY_CODE_CACHE_INSTRS, 0, FALSE},
+      {"code-cache-hits", LP_QUERY_CODE_CACHE_HITS, 0, FALSE},
+      {"code-cache-misses", LP_QUERY_CODE_CACHE_MISSES, 0, FALSE}
+   };
+
+   if (!info)
+      return Elements(queries);
+
+   if (index >= Elements(queries))
+      return 0;
+
+   *info = queries[index];
+   return 1;
 }
 
 
@@ -422,6 +516,15 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
    struct sw_winsys *winsys = screen->winsys;
 
+   /* Cached code compiled in the background is destroyed by the compile
+    * queue, so the cache must go first.
+    */
+   if (screen->code_cache)
+      gallivm_code_cache_destroy(screen->code_cache);
+
+   if (screen->compile_queue)
+      lp_compile_queue_destroy(screen->compile_queue);
+
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
@@ -493,6 +596,7 @@ struct pipe_screen *
 llvmpipe_create_screen(struct sw_winsys *winsys)
 {
    struct llvmpipe_screen *screen;
+   unsigned max_cached_code;
 
    util_cpu_detect();
 
@@ -520,6 +624,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.get_vendor = llvmpipe_get_vendor;
    screen->base.get_param = llvmpipe_get_param;
    screen->base.get_shader_param = llvmpipe_get_shader_param;
+   screen->base.get_compute_param = llvmpipe_get_compute_param;
    screen->base.get_paramf = llvmpipe_get_paramf;
    screen->base.is_format_supported = llvmpipe_is_format_supported;
 
@@ -530,6 +635,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.fence_finish = llvmpipe_fence_finish;
 
    screen->base.get_timestamp = llvmpipe_get_timestamp;
+   screen->base.get_driver_query_info = llvmpipe_get_driver_query_info;
 
    llvmpipe_init_screen_resource_funcs(&screen->base);
 
@@ -542,6 +648,16 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS", screen->num_threads);
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
 
+   screen->num_scenes = debug_get_num_option("LP_NUM_SCENES", 4);
+   screen->num_scenes = CLAMP(screen->num_scenes, 2, LP_MAX_SCENES);
+
+   /* The binning threads share the CPUs with the rasterizer threads, which
+    * may still be rasterizing the previous scenes meanwhile.
+    */
+   screen->num_bin_threads = debug_get_num_option("LP_NUM_BIN_THREADS",
+                                                  MIN2(screen->num_threads, 8));
+   screen->num_bin_threads = MIN2(screen->num_bin_threads, LP_MAX_BIN_THREADS);
+
    screen->rast = lp_rast_create(screen->num_threads);
    if (!screen->rast) {
       lp_jit_screen_cleanup(screen);
@@ -550,6 +666,23 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    }
    pipe_mutex_init(screen->rast_mutex);
 
+   if (debug_get_bool_option("LP_ASYNC_COMPILE", FALSE)) {
+      /* Falls back to synchronous compilation on failure */
+      screen->compile_queue = lp_compile_queue_create();
+   }
+
+   /* Tiered compilation pays off when the optimized code is built in the
+    * background.
+    */
+   screen->fs_tier_up_draws = debug_get_num_option("LP_TIER_UP_DRAWS",
+                                                   screen->compile_queue ? 64 : 0);
+
+   /* Number of variants kept around when no context uses them anymore */
+   max_cached_code = debug_get_num_option("LP_CODE_CACHE_SIZE", 1024);
+   if (max_cached_code) {
+      screen->code_cache = gallivm_code_cache_create(max_cached_code);
+   }
+
    util_format_s3tc_init();
 
    return &screen->base;
@@ -41,6 +41,8 @@
 
 
 struct sw_winsys;
+struct lp_compile_queue;
+struct gallivm_code_cache;
 
 
 struct llvmpipe_screen
@@ -50,6 +52,8 @@ struct llvmpipe_screen
    struct sw_winsys *winsys;
 
    unsigned num_threads;
+   unsigned num_scenes;  /**< max scenes in flight per context */
+   unsigned num_bin_threads;  /**< threads binning large draws, per context */
 
    /* Increments whenever textures are modified.  Contexts can track this.
     */
@@ -57,6 +61,15 @@ struct llvmpipe_screen
 
    struct lp_rasterizer *rast;
    pipe_mutex rast_mutex;
+
+   /** Background shader compilation, NULL unless LP_ASYNC_COMPILE is set */
+   struct lp_compile_queue *compile_queue;
+
+   /** JIT'd code shared by all the contexts, NULL if disabled */
+   struct gallivm_code_cache *code_cache;
+
+   /** Draws before fast fs code is optimized, 0 disables tiering */
+   unsigned fs_tier_up_draws;
 };
 
 
@@ -47,9 +47,12 @@
 #include "lp_texture.h"
 #include "lp_debug.h"
 #include "lp_fence.h"
+#include "lp_hiz.h"
+#include "lp_perf.h"
 #include "lp_query.h"
 #include "lp_rast.h"
 #include "lp_setup_context.h"
+#include "lp_setup_mt.h"
 #include "lp_screen.h"
 #include "lp_state.h"
 #include "state_tracker/sw_winsys.h"
@@ -63,7 +66,54 @@ static boolean set_scene_state( struct lp_setup_context *, enum setup_state,
 static boolean try_update_scene_state( struct lp_setup_context *setup );
 
 
+/**
+ * If the next scene in the ring is still being rasterized, add a new
+ * scene in front of it instead of waiting, as long as the limits allow.
+ * This lets binning run further ahead of rasterization, e.g. for many
+ * small flushes, without paying for the memory when it doesn't.
+ */
 static void
+lp_setup_grow_scenes(struct lp_setup_context *setup)
+{
+   unsigned next = (setup->scene_idx + 1) % setup->num_scenes;
+   struct lp_scene *scene = setup->scenes[next];
+   unsigned scene_memory = 0;
+   unsigned i;
+
+   if (setup->num_scenes >= setup->max_scenes ||
+       !scene->fence ||
+       lp_fence_signalled(scene->fence))
+      return;
+
+   for (i = 0; i < setup->num_scenes; i++) {
+      scene_memory += setup->scenes[i]->scene_size;
+   }
+   if (scene_memory >= LP_MAX_SCENE_MEMORY)
+      return;
+
+   scene = lp_scene_create(setup->pipe);
+   if (!scene)
+      return;
+
+   /* Insert before the oldest scene, so that scenes keep being reused in
+    * the order they were queued.
+    */
+   for (i = setup->num_scenes; i > next; i--) {
+      setup->scenes[i] = setup->scenes[i - 1];
+   }
+   setup->scenes[next] = scene;
+   if (next <= setup->scene_idx)
+      setup->scene_idx++;
+   setup->num_scenes++;
+
+   LP_COUNT(nr_scene_grows);
+
+   if (LP_DEBUG & DEBUG_SETUP)
+      debug_printf("%s: %u scenes\n", __FUNCTION__, setup->num_scenes);
+}
+
+
+static boolean
 lp_setup_get_empty_scene(struct lp_setup_context *setup)
 {
    struct llvmpipe_context *lp = llvmpipe_context(setup->pipe);
@@ -71,21 +121,53 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
 
    assert(setup->scene == NULL);
 
+   lp_setup_grow_scenes(setup);
+
    setup->scene_idx++;
-   setup->scene_idx %= Elements(setup->scenes);
+   setup->scene_idx %= setup->num_scenes;
 
    setup->scene = setup->scenes[setup->scene_idx];
 
    if (setup->scene->fence) {
-      if (LP_DEBUG & DEBUG_SETUP)
-         debug_printf("%s: wait for scene %d\n",
-                      __FUNCTION__, setup->scene->fence->id);
+      if (!lp_fence_signalled(setup->scene->fence)) {
+         int64_t start = os_time_get();
+
+         if (LP_DEBUG & DEBUG_SETUP)
+            debug_printf("%s: wait for scene %d\n",
+                         __FUNCTION__, setup->scene->fence->id);
+
+         lp_fence_wait(setup->scene->fence);
 
-      lp_fence_wait(setup->scene->fence);
+         LP_COUNT_ADD(scene_wait_time, os_time_get() - start);
+      }
+
+      lp_scene_reset(setup->scene);
    }
 
-   lp_scene_begin_binning(setup->scene, &setup->fb, discard);
-   
+   return lp_scene_begin_binning(setup->scene, &setup->fb, discard);
+}
+
+
+/**
+ * Release the resources and resolve the queries of the scenes the
+ * rasterizer is done with, oldest first.  Scenes are otherwise only reset
+ * when they get reused.
+ */
+void
+lp_setup_retire_scenes(struct lp_setup_context *setup)
+{
+   unsigned i;
+
+   for (i = 1; i <= setup->num_scenes; i++) {
+      struct lp_scene *scene =
+         setup->scenes[(setup->scene_idx + i) % setup->num_scenes];
+
+      if (scene != setup->scene &&
+          scene->fence &&
+          lp_fence_signalled(scene->fence)) {
+         lp_scene_reset(scene);
+      }
+   }
 }
 
 
@@ -155,11 +237,22 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
 {
    struct lp_scene *scene = setup->scene;
    struct llvmpipe_screen *screen = llvmpipe_screen(scene->pipe->screen);
+   unsigned i;
 
    scene->num_active_queries = setup->active_binned_queries;
    memcpy(scene->active_queries, setup->active_queries,
           scene->num_active_queries * sizeof(scene->active_queries[0]));
 
+   /* The queries still active count in this scene too.  If they can't be
+    * added, their counts are picked up with a later scene.
+    */
+   for (i = 0; i < scene->num_active_queries; i++) {
+      lp_scene_add_query(scene, scene->active_queries[i]);
+   }
+
+   if (setup->mt)
+      lp_setup_mt_end_scene(setup->mt, scene);
+
    lp_scene_end_binning(scene);
 
    lp_fence_reference(&setup->last_fence, scene->fence);
@@ -167,12 +260,38 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
+   if (setup->fs.compile_seqno) {
+      /* The scene may use fragment shaders still compiling in the
+       * background.
+       */
+      struct llvmpipe_context *lp = llvmpipe_context(setup->pipe);
+      int64_t dt = lp_compile_queue_wait(screen->compile_queue,
+                                         setup->fs.compile_seqno);
+      lp->fs_compile_wait_time += dt;
+      LP_COUNT_ADD(llvm_compile_wait_time, dt);
+      setup->fs.compile_seqno = 0;
+
+      /* Install their code, or a replacement if the compilation failed */
+      llvmpipe_retire_fs_compiles(lp, FALSE);
+   }
+
+   /* Display targets may be presented without another flush, see
+    * llvmpipe_flush_frontbuffer().
+    */
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      struct llvmpipe_resource *lpr =
+         llvmpipe_resource(scene->fb.cbufs[i]->texture);
+      if (lpr->dt)
+         lp_fence_reference(&lpr->fence, scene->fence);
+   }
+
+   /* Don't wait for the scene: it stays in the ring until it's reused or
+    * retired, see lp_setup_retire_scenes().
+    */
    pipe_mutex_lock(screen->rast_mutex);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    pipe_mutex_unlock(screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -180,6 +299,29 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
 
 
 
+/**
+ * Is a scene which is still being rasterized using the given bounds?
+ */
+static boolean
+hiz_in_flight(const struct lp_setup_context *setup,
+              const struct lp_hiz *hiz)
+{
+   unsigned i;
+
+   for (i = 0; i < setup->num_scenes; i++) {
+      const struct lp_scene *scene = setup->scenes[i];
+
+      if (scene != setup->scene &&
+          scene->hiz == hiz &&
+          scene->fence &&
+          !lp_fence_signalled(scene->fence))
+         return TRUE;
+   }
+
+   return FALSE;
+}
+
+
 static boolean
 begin_binning( struct lp_setup_context *setup )
 {
@@ -190,12 +332,20 @@ begin_binning( struct lp_setup_context *setup )
    assert(scene);
    assert(scene->fence == NULL);
 
-   /* Always create a fence:
+   /* Always create a fence.  The rasterizer signals it once it's done with
+    * the whole scene.
     */
-   scene->fence = lp_fence_create(MAX2(1, setup->num_threads));
+   scene->fence = lp_fence_create(1);
    if (!scene->fence)
       return FALSE;
 
+   /* The rasterizer may still be updating the bounds for an earlier scene
+    * with the same depth buffer.  Leave them to it, and don't reject
+    * anything at binning time in this scene.
+    */
+   if (scene->hiz && hiz_in_flight(setup, scene->hiz))
+      scene->hiz_binning = FALSE;
+
    ok = try_update_scene_state(setup);
    if (!ok)
       return FALSE;
@@ -224,6 +374,14 @@ begin_binning( struct lp_setup_context *setup )
          if (!need_zsload)
             scene->has_depthstencil_clear = TRUE;
 
+         /* Nothing was binned yet, so the bounds can be set right away,
+          * keeping them usable for binning.
+          */
+         if (scene->hiz_binning)
+            lp_hiz_clear(scene->hiz, 0, 0,
+                         setup->fb.width, setup->fb.height,
+                         setup->clear.zsvalue, setup->clear.zsmask);
+
          ok = lp_scene_bin_everywhere( scene,
                                        LP_RAST_OP_CLEAR_ZSTENCIL,
                                        lp_rast_arg_clearzs(
@@ -289,8 +447,9 @@ set_scene_state( struct lp_setup_context *setup,
 
    /* wait for a free/empty scene
     */
-   if (old_state == SETUP_FLUSHED) 
-      lp_setup_get_empty_scene(setup);
+   if (old_state == SETUP_FLUSHED &&
+       !lp_setup_get_empty_scene(setup))
+      goto fail;
 
    switch (new_state) {
    case SETUP_CLEARED:
@@ -320,7 +479,10 @@ set_scene_state( struct lp_setup_context *setup,
 
 fail:
    if (setup->scene) {
+      if (setup->mt)
+         lp_setup_mt_end_scene(setup->mt, setup->scene);
       lp_scene_end_rasterization(setup->scene);
+      lp_scene_reset(setup->scene);
       setup->scene = NULL;
    }
 
@@ -337,6 +499,8 @@ lp_setup_flush( struct lp_setup_context *setup,
 {
    set_scene_state( setup, SETUP_FLUSHED, reason );
 
+   lp_setup_retire_scenes(setup);
+
    if (fence) {
       lp_fence_reference((struct lp_fence **)fence, setup->last_fence);
    }
@@ -426,6 +590,9 @@ lp_setup_try_clear( struct lp_setup_context *setup,
                                        LP_RAST_OP_CLEAR_ZSTENCIL,
                                        lp_rast_arg_clearzs(zsvalue, zsmask) ))
             return FALSE;
+
+         /* The clear may increase depth values */
+         scene->hiz_binning = FALSE;
       }
    }
    else {
@@ -537,6 +704,9 @@ lp_setup_set_fs_variant( struct lp_setup_context *setup,
    /* FIXME: reference count */
 
    setup->fs.current.variant = variant;
+   if (variant)
+      setup->fs.compile_seqno = lp_compile_seqno_max(setup->fs.compile_seqno,
+                                                     variant->compile_seqno);
    setup->dirty |= LP_SETUP_NEW_FS;
 }
 
@@ -830,6 +1000,21 @@ lp_setup_set_fragment_sampler_state(struct lp_setup_context *setup,
 }
 
 
+static boolean
+fb_references(const struct pipe_framebuffer_state *fb,
+              const struct pipe_resource *texture)
+{
+   unsigned i;
+
+   for (i = 0; i < fb->nr_cbufs; i++) {
+      if (fb->cbufs[i]->texture == texture)
+         return TRUE;
+   }
+
+   return fb->zsbuf && fb->zsbuf->texture == texture;
+}
+
+
 /**
  * Is the given texture referenced by any scene?
  * Note: we have to check all scenes including any scenes currently
@@ -842,16 +1027,21 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
    unsigned i;
 
    /* check the render targets */
-   for (i = 0; i < setup->fb.nr_cbufs; i++) {
-      if (setup->fb.cbufs[i]->texture == texture)
-         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
-   }
-   if (setup->fb.zsbuf && setup->fb.zsbuf->texture == texture) {
+   if (fb_references(&setup->fb, texture))
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+
+   /* and those of the scenes still being rasterized */
+   for (i = 0; i < setup->num_scenes; i++) {
+      const struct lp_scene *scene = setup->scenes[i];
+
+      if (scene->fence &&
+          !lp_fence_signalled(scene->fence) &&
+          fb_references(&scene->fb, texture))
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
    /* check textures referenced by the scene */
-   for (i = 0; i < Elements(setup->scenes); i++) {
+   for (i = 0; i < setup->num_scenes; i++) {
       if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
          return LP_REFERENCED_FOR_READ;
       }
@@ -981,6 +1171,13 @@ try_update_scene_state( struct lp_setup_context *setup )
                 &setup->fs.current,
                 sizeof setup->fs.current);
          setup->fs.stored = stored;
+
+         /* Depth values may now increase, so the hierarchical Z bounds
+          * no longer hold for what gets binned after this.
+          */
+         if (stored->variant &&
+             (stored->variant->hiz & LP_HIZ_INVALIDATE))
+            scene->hiz_binning = FALSE;
          
          /* The scene now references the textures in the rasterization
           * state record.  Note that now.
@@ -1008,8 +1205,9 @@ try_update_scene_state( struct lp_setup_context *setup )
          }
       }
       /*
-       * Subdivide triangles if the framebuffer is larger than the
-       * MAX_FIXED_LENGTH.
+       * Triangles in framebuffers larger than MAX_FIXED_LENGTH are set up
+       * with 64-bit arithmetic, which still needs very long edges to be
+       * subdivided (see MAX_FIXED_LENGTH64).
        */
       setup->subdivide_large_triangles = (setup->fb.width > MAX_FIXED_LENGTH ||
                                           setup->fb.height > MAX_FIXED_LENGTH);
@@ -1106,6 +1304,9 @@ lp_setup_destroy( struct lp_setup_context *setup )
 
    lp_setup_reset( setup );
 
+   if (setup->mt)
+      lp_setup_mt_destroy(setup->mt);
+
    util_unreference_framebuffer_state(&setup->fb);
 
    for (i = 0; i < Elements(setup->fs.current_tex); i++) {
@@ -1117,11 +1318,15 @@ lp_setup_destroy( struct lp_setup_context *setup )
    }
 
    /* free the scenes in the 'empty' queue */
-   for (i = 0; i < Elements(setup->scenes); i++) {
+   for (i = 0; i < setup->num_scenes; i++) {
       struct lp_scene *scene = setup->scenes[i];
 
-      if (scene->fence)
-         lp_fence_wait(scene->fence);
+      if (scene->fence) {
+         if (lp_fence_issued(scene->fence))
+            lp_fence_wait(scene->fence);
+
+         lp_scene_reset(scene);
+      }
 
       lp_scene_destroy(scene);
    }
@@ -1150,12 +1355,15 @@ lp_setup_create( struct pipe_context *pipe,
       goto no_setup;
    }
 
-   lp_setup_init_vbuf(setup);
-   
-   /* Used only in update_state():
+   /* Used in update_state() and for the binning threads' scenes:
     */
    setup->pipe = pipe;
 
+   /* Optional, large draws are binned serially without it */
+   setup->mt = lp_setup_mt_create(setup, screen->num_bin_threads);
+
+   lp_setup_init_vbuf(setup);
+
 
    setup->num_threads = screen->num_threads;
    setup->vbuf = draw_vbuf_stage(draw, &setup->base);
@@ -1166,8 +1374,10 @@ lp_setup_create( struct pipe_context *pipe,
    draw_set_rasterize_stage(draw, setup->vbuf);
    draw_set_render(draw, &setup->base);
 
-   /* create some empty scenes */
-   for (i = 0; i < MAX_SCENES; i++) {
+   /* create some empty scenes, more are added on demand */
+   setup->max_scenes = screen->num_scenes;
+   setup->num_scenes = 2;
+   for (i = 0; i < setup->num_scenes; i++) {
       setup->scenes[i] = lp_scene_create( pipe );
       if (!setup->scenes[i]) {
          goto no_scenes;
@@ -1183,7 +1393,7 @@ lp_setup_create( struct pipe_context *pipe,
    return setup;
 
 no_scenes:
-   for (i = 0; i < MAX_SCENES; i++) {
+   for (i = 0; i < setup->num_scenes; i++) {
       if (setup->scenes[i]) {
          lp_scene_destroy(setup->scenes[i]);
       }
@@ -1191,6 +1401,8 @@ no_scenes:
 
    setup->vbuf->destroy(setup->vbuf);
 no_vbuf:
+   if (setup->mt)
+      lp_setup_mt_destroy(setup->mt);
    FREE(setup);
 no_setup:
    return NULL;
@@ -1281,8 +1493,13 @@ lp_setup_end_query(struct lp_setup_context *setup, struct llvmpipe_query *pq)
                                          lp_rast_arg_query(pq))) {
                goto fail;
             }
+
+            lp_fence_reference(&pq->fence, setup->scene->fence);
          }
          setup->scene->had_queries |= TRUE;
+
+         /* Have the result resolved when the scene is done */
+         lp_scene_add_query(setup->scene, pq);
       }
    }
    else {
@@ -1318,6 +1535,12 @@ lp_setup_flush_and_restart(struct lp_setup_context *setup)
 {
    if (0) debug_printf("%s\n", __FUNCTION__);
 
+   /* Binning threads leave flushing to the calling thread */
+   if (setup->bin_job) {
+      lp_setup_mt_fail(setup);
+      return FALSE;
+   }
+
    assert(setup->state == SETUP_ACTIVE);
 
    if (!set_scene_state(setup, SETUP_FLUSHED, __FUNCTION__))
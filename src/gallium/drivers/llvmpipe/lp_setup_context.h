@@ -35,6 +35,7 @@
 #ifndef LP_SETUP_CONTEXT_H
 #define LP_SETUP_CONTEXT_H
 
+#include "lp_limits.h"
 #include "lp_setup.h"
 #include "lp_rast.h"
 #include "lp_scene.h"
@@ -50,11 +51,8 @@
 
 
 struct lp_setup_variant;
-
-
-/** Max number of scenes */
-#define MAX_SCENES 2
-
+struct lp_setup_mt;
+struct lp_setup_bin_job;
 
 
 /**
@@ -85,9 +83,14 @@ struct lp_setup_context
    struct draw_stage *vbuf;
    unsigned num_threads;
    unsigned scene_idx;
-   struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
+   unsigned num_scenes;                  /**< scenes allocated so far */
+   unsigned max_scenes;                  /**< LP_NUM_SCENES */
+   struct lp_scene *scenes[LP_MAX_SCENES];  /**< ring of scenes */
    struct lp_scene *scene;               /**< current scene being built */
 
+   struct lp_setup_mt *mt;               /**< binning threads, or NULL */
+   struct lp_setup_bin_job *bin_job;     /**< set in binning threads' copies */
+
    struct lp_fence *last_fence;
    struct llvmpipe_query *active_queries[LP_MAX_ACTIVE_BINNED_QUERIES];
    unsigned active_binned_queries;
@@ -130,6 +133,7 @@ struct lp_setup_context
       const struct lp_rast_state *stored; /**< what's in the scene */
       struct lp_rast_state current;  /**< currently set state */
       struct pipe_resource *current_tex[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+      unsigned compile_seqno;  /**< background compiles to wait for */
    } fs;
 
    /** fragment shader constants */
@@ -200,6 +204,7 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                        struct lp_rast_triangle *tri,
                        const struct u_rect *bbox,
                        int nr_planes,
-                       unsigned scissor_index );
+                       unsigned scissor_index,
+                       const int64_t *exact_c );
 
 #endif
@@ -292,6 +292,7 @@ try_setup_line( struct lp_setup_context *setup,
    unsigned tri_bytes;
    int x[4]; 
    int y[4];
+   int64_t c[8];
    int i;
    int nr_planes = 4;
    unsigned scissor_index = 0;
@@ -635,34 +636,38 @@ try_setup_line( struct lp_setup_context *setup,
    line->inputs.disable = FALSE;
    line->inputs.opaque = FALSE;
    line->inputs.layer = layer;
+   line->inputs.hiz_zmin = 0;
 
    for (i = 0; i < 4; i++) {
 
       /* half-edge constants, will be interated over the whole render
-       * target.
+       * target.  These don't fit in 32 bits for long lines, so the planes
+       * only get them modulo 2^32; binning uses the exact values.
        */
-      plane[i].c = plane[i].dcdx * x[i] - plane[i].dcdy * y[i];
+      c[i] = (int64_t)plane[i].dcdx * x[i] - (int64_t)plane[i].dcdy * y[i];
 
       
       /* correct for top-left vs. bottom-left fill convention.  
        */         
       if (plane[i].dcdx < 0) {
          /* both fill conventions want this - adjust for left edges */
-         plane[i].c++;            
+         c[i]++;
       }
       else if (plane[i].dcdx == 0) {
          if (setup->pixel_offset == 0) {
             /* correct for top-left fill convention:
              */
-            if (plane[i].dcdy > 0) plane[i].c++;
+            if (plane[i].dcdy > 0) c[i]++;
          }
          else {
             /* correct for bottom-left fill convention:
              */
-            if (plane[i].dcdy < 0) plane[i].c++;
+            if (plane[i].dcdy < 0) c[i]++;
          }
       }
 
+      plane[i].c = (int)c[i];
+
       plane[i].dcdx *= FIXED_ONE;
       plane[i].dcdy *= FIXED_ONE;
 
@@ -718,9 +723,13 @@ try_setup_line( struct lp_setup_context *setup,
       plane[7].dcdy = -1;
       plane[7].c = scissor->y1+1;
       plane[7].eo = 0;
+
+      for (i = 4; i < 8; i++)
+         c[i] = plane[i].c;
    }
 
-   return lp_setup_bin_triangle(setup, line, &bbox, nr_planes, scissor_index);
+   return lp_setup_bin_triangle(setup, line, &bbox, nr_planes, scissor_index,
+                                c);
 }
 
 
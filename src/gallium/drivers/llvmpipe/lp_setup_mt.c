@@ -0,0 +1,462 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Multi-threaded binning of large draws.
+ *
+ * While the draw module emits the primitives of a draw, the setup
+ * functions are replaced by ones which just collect the vertex pointers.
+ * The primitives are then split into equal contiguous ranges, one per
+ * binning thread.  Each thread sets up and bins its range with a private
+ * copy of the setup context, into a private child scene.  Finally the
+ * children's bins are appended to the scene's bins in range order.
+ *
+ * Scene state (fs.stored etc.) is set up by the calling thread before
+ * the draw, and the child scenes don't change it, so the threads only
+ * ever read shared data.
+ *
+ * When a child runs out of memory, the ranges after it are discarded,
+ * the scene is flushed and the rest of the draw is binned serially from
+ * the primitive that failed, just like lp_setup_flush_and_restart() in
+ * the serial case.
+ */
+
+#include "os/os_thread.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "lp_perf.h"
+#include "lp_scene.h"
+#include "lp_setup_context.h"
+#include "lp_setup_mt.h"
+
+
+/** Draws with fewer primitives are binned by the calling thread alone */
+#define LP_MT_MIN_PRIMS 256
+
+/** Don't split draws into smaller ranges than this */
+#define LP_MT_MIN_JOB_PRIMS 64
+
+
+struct lp_setup_prim
+{
+   const float (*v[3])[4];
+};
+
+
+struct lp_setup_bin_job
+{
+   struct lp_setup_mt *mt;
+
+   /** Private copy of the context, binning into 'scene' */
+   struct lp_setup_context setup;
+   struct lp_scene *scene;
+
+   unsigned begin, end;   /**< range of mt->prims */
+   boolean failed;        /**< the child scene ran out of memory */
+   unsigned failed_prim;  /**< first primitive not completely binned */
+
+   /* Not used by jobs[0], which runs in the calling thread */
+   pipe_semaphore work_ready;
+   pipe_semaphore work_done;
+   pipe_thread thread;
+};
+
+
+struct lp_setup_mt
+{
+   unsigned num_jobs;  /**< binning threads, including the calling one */
+   struct lp_setup_bin_job *jobs[LP_MAX_BIN_THREADS];
+
+   /** The scene the children's data blocks belong to, or NULL */
+   struct lp_scene *scene;
+
+   /** Primitives collected for the current draw */
+   struct lp_setup_prim *prims;
+   unsigned num_prims;
+   unsigned max_prims;
+   unsigned nr_verts;  /**< 1 for points, 2 for lines, 3 for triangles */
+
+   /** The real setup functions, while collecting */
+   void (*point)( struct lp_setup_context *,
+                  const float (*v0)[4]);
+
+   void (*line)( struct lp_setup_context *,
+                 const float (*v0)[4],
+                 const float (*v1)[4]);
+
+   void (*triangle)( struct lp_setup_context *,
+                     const float (*v0)[4],
+                     const float (*v1)[4],
+                     const float (*v2)[4]);
+
+   boolean exit_flag;
+};
+
+
+static void
+collect_point(struct lp_setup_context *setup,
+              const float (*v0)[4])
+{
+   struct lp_setup_mt *mt = setup->mt;
+   struct lp_setup_prim *prim = &mt->prims[mt->num_prims++];
+
+   assert(mt->num_prims <= mt->max_prims);
+
+   prim->v[0] = v0;
+   mt->nr_verts = 1;
+}
+
+
+static void
+collect_line(struct lp_setup_context *setup,
+             const float (*v0)[4],
+             const float (*v1)[4])
+{
+   struct lp_setup_mt *mt = setup->mt;
+   struct lp_setup_prim *prim = &mt->prims[mt->num_prims++];
+
+   assert(mt->num_prims <= mt->max_prims);
+
+   prim->v[0] = v0;
+   prim->v[1] = v1;
+   mt->nr_verts = 2;
+}
+
+
+static void
+collect_triangle(struct lp_setup_context *setup,
+                 const float (*v0)[4],
+                 const float (*v1)[4],
+                 const float (*v2)[4])
+{
+   struct lp_setup_mt *mt = setup->mt;
+   struct lp_setup_prim *prim = &mt->prims[mt->num_prims++];
+
+   assert(mt->num_prims <= mt->max_prims);
+
+   prim->v[0] = v0;
+   prim->v[1] = v1;
+   prim->v[2] = v2;
+   mt->nr_verts = 3;
+}
+
+
+/**
+ * Set up and bin collected primitive i.
+ */
+static INLINE void
+bin_prim(struct lp_setup_context *setup,
+         const struct lp_setup_mt *mt,
+         unsigned i)
+{
+   const struct lp_setup_prim *prim = &mt->prims[i];
+
+   switch (mt->nr_verts) {
+   case 1:
+      setup->point(setup, prim->v[0]);
+      break;
+   case 2:
+      setup->line(setup, prim->v[0], prim->v[1]);
+      break;
+   default:
+      setup->triangle(setup, prim->v[0], prim->v[1], prim->v[2]);
+      break;
+   }
+}
+
+
+static void
+run_job(struct lp_setup_bin_job *job)
+{
+   unsigned i;
+
+   for (i = job->begin; i < job->end; i++) {
+      bin_prim(&job->setup, job->mt, i);
+      if (job->failed) {
+         job->failed_prim = i;
+         break;
+      }
+   }
+}
+
+
+static PIPE_THREAD_ROUTINE( bin_thread, init_data )
+{
+   struct lp_setup_bin_job *job = (struct lp_setup_bin_job *) init_data;
+
+   while (1) {
+      pipe_semaphore_wait(&job->work_ready);
+
+      if (job->mt->exit_flag)
+         break;
+
+      run_job(job);
+
+      pipe_semaphore_signal(&job->work_done);
+   }
+
+   return NULL;
+}
+
+
+/**
+ * Create the binning threads.
+ * \param num_threads  number of threads binning each large draw,
+ *                     including the calling thread
+ * Returns NULL if there's no point in threading.
+ */
+struct lp_setup_mt *
+lp_setup_mt_create(struct lp_setup_context *setup, unsigned num_threads)
+{
+   struct lp_setup_mt *mt;
+   unsigned i;
+
+   num_threads = MIN2(num_threads, LP_MAX_BIN_THREADS);
+   if (num_threads < 2)
+      return NULL;
+
+   mt = CALLOC_STRUCT(lp_setup_mt);
+   if (!mt)
+      return NULL;
+
+   for (i = 0; i < num_threads; i++) {
+      struct lp_setup_bin_job *job = CALLOC_STRUCT(lp_setup_bin_job);
+      if (!job)
+         break;
+
+      job->mt = mt;
+      job->scene = lp_scene_create_child(setup->pipe);
+      if (!job->scene) {
+         FREE(job);
+         break;
+      }
+
+      if (i > 0) {
+         pipe_semaphore_init(&job->work_ready, 0);
+         pipe_semaphore_init(&job->work_done, 0);
+         job->thread = pipe_thread_create(bin_thread, job);
+      }
+
+      mt->jobs[i] = job;
+      mt->num_jobs++;
+   }
+
+   if (mt->num_jobs < 2) {
+      lp_setup_mt_destroy(mt);
+      return NULL;
+   }
+
+   return mt;
+}
+
+
+void
+lp_setup_mt_destroy(struct lp_setup_mt *mt)
+{
+   unsigned i;
+
+   mt->exit_flag = TRUE;
+
+   for (i = 1; i < mt->num_jobs; i++) {
+      pipe_semaphore_signal(&mt->jobs[i]->work_ready);
+   }
+
+   for (i = 0; i < mt->num_jobs; i++) {
+      struct lp_setup_bin_job *job = mt->jobs[i];
+
+      if (i > 0) {
+         pipe_thread_wait(job->thread);
+         pipe_semaphore_destroy(&job->work_ready);
+         pipe_semaphore_destroy(&job->work_done);
+      }
+
+      lp_scene_destroy(job->scene);
+      FREE(job);
+   }
+
+   FREE(mt->prims);
+   FREE(mt);
+}
+
+
+/**
+ * Start collecting the primitives of a draw with up to nr vertices, if
+ * it's large enough to be binned in parallel.  No draw emits more
+ * primitives than vertices.
+ */
+boolean
+lp_setup_mt_begin(struct lp_setup_context *setup, unsigned nr)
+{
+   struct lp_setup_mt *mt = setup->mt;
+
+   if (!mt || nr < LP_MT_MIN_PRIMS)
+      return FALSE;
+
+   if (nr > mt->max_prims) {
+      FREE(mt->prims);
+      mt->prims = MALLOC(nr * sizeof *mt->prims);
+      if (!mt->prims) {
+         mt->max_prims = 0;
+         return FALSE;
+      }
+      mt->max_prims = nr;
+   }
+
+   mt->num_prims = 0;
+   mt->nr_verts = 0;
+
+   mt->point = setup->point;
+   mt->line = setup->line;
+   mt->triangle = setup->triangle;
+
+   setup->point = collect_point;
+   setup->line = collect_line;
+   setup->triangle = collect_triangle;
+
+   return TRUE;
+}
+
+
+/**
+ * Bin the primitives collected since lp_setup_mt_begin().
+ */
+void
+lp_setup_mt_end(struct lp_setup_context *setup)
+{
+   struct lp_setup_mt *mt = setup->mt;
+   struct lp_scene *scene = setup->scene;
+   unsigned num_jobs;
+   unsigned resume = mt->num_prims;
+   boolean failed = FALSE;
+   unsigned i;
+
+   setup->point = mt->point;
+   setup->line = mt->line;
+   setup->triangle = mt->triangle;
+
+   assert(!mt->scene || mt->scene == scene);
+   mt->scene = scene;
+
+   num_jobs = MIN2(mt->num_jobs, mt->num_prims / LP_MT_MIN_JOB_PRIMS);
+
+   for (i = 0; i < num_jobs; i++) {
+      if (!lp_scene_begin_child(mt->jobs[i]->scene, scene, num_jobs))
+         break;
+   }
+
+   if (num_jobs < 2 || i < num_jobs) {
+      /* Not worth it, or the scene is nearly full */
+      while (i--) {
+         lp_scene_discard_child(scene, mt->jobs[i]->scene);
+      }
+
+      for (i = 0; i < mt->num_prims; i++) {
+         bin_prim(setup, mt, i);
+      }
+      return;
+   }
+
+   for (i = 0; i < num_jobs; i++) {
+      struct lp_setup_bin_job *job = mt->jobs[i];
+
+      memcpy(&job->setup, setup, sizeof *setup);
+      job->setup.scene = job->scene;
+      job->setup.bin_job = job;
+
+      job->begin = mt->num_prims * i / num_jobs;
+      job->end = mt->num_prims * (i + 1) / num_jobs;
+      job->failed = FALSE;
+
+      if (i > 0)
+         pipe_semaphore_signal(&job->work_ready);
+   }
+
+   run_job(mt->jobs[0]);
+
+   for (i = 1; i < num_jobs; i++) {
+      pipe_semaphore_wait(&mt->jobs[i]->work_done);
+   }
+
+   /* Append the ranges in order, up to the first one which failed */
+   for (i = 0; i < num_jobs; i++) {
+      struct lp_setup_bin_job *job = mt->jobs[i];
+
+      if (failed) {
+         lp_scene_discard_child(scene, job->scene);
+      }
+      else {
+         lp_scene_merge_child(scene, job->scene);
+         if (job->failed) {
+            failed = TRUE;
+            resume = job->failed_prim;
+         }
+      }
+   }
+
+   LP_COUNT(nr_mt_draws);
+   LP_COUNT_ADD(nr_mt_prims, resume);
+
+   if (failed) {
+      if (!lp_setup_flush_and_restart(setup))
+         return;
+
+      for (i = resume; i < mt->num_prims; i++) {
+         bin_prim(setup, mt, i);
+      }
+   }
+}
+
+
+/**
+ * Called before the scene is rasterized or discarded, to hand it the
+ * children's last data blocks.
+ */
+void
+lp_setup_mt_end_scene(struct lp_setup_mt *mt, struct lp_scene *scene)
+{
+   unsigned i;
+
+   if (mt->scene != scene)
+      return;
+
+   for (i = 0; i < mt->num_jobs; i++) {
+      lp_scene_end_child(scene, mt->jobs[i]->scene);
+   }
+
+   mt->scene = NULL;
+}
+
+
+/**
+ * Called instead of flushing the scene when a binning thread runs out
+ * of memory.
+ */
+void
+lp_setup_mt_fail(struct lp_setup_context *setup)
+{
+   setup->bin_job->failed = TRUE;
+}
@@ -0,0 +1,67 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Multi-threaded binning of large draws.
+ *
+ * The primitives of a draw are first collected, then split into
+ * contiguous ranges which are set up and binned in parallel, each into
+ * its own child scene.  The children are appended to the scene in range
+ * order, so every bin still sees the primitives in API order.
+ */
+
+#ifndef LP_SETUP_MT_H
+#define LP_SETUP_MT_H
+
+#include "pipe/p_compiler.h"
+
+
+struct lp_setup_context;
+struct lp_setup_mt;
+struct lp_scene;
+
+
+struct lp_setup_mt *
+lp_setup_mt_create(struct lp_setup_context *setup, unsigned num_threads);
+
+void
+lp_setup_mt_destroy(struct lp_setup_mt *mt);
+
+boolean
+lp_setup_mt_begin(struct lp_setup_context *setup, unsigned nr);
+
+void
+lp_setup_mt_end(struct lp_setup_context *setup);
+
+void
+lp_setup_mt_end_scene(struct lp_setup_mt *mt, struct lp_scene *scene);
+
+void
+lp_setup_mt_fail(struct lp_setup_context *setup);
+
+
+#endif /* LP_SETUP_MT_H */
@@ -413,6 +413,7 @@ try_setup_point( struct lp_setup_context *setup,
    point->inputs.disable = FALSE;
    point->inputs.opaque = FALSE;
    point->inputs.layer = layer;
+   point->inputs.hiz_zmin = 0;
 
    {
       struct lp_rast_plane *plane = GET_PLANES(point);
@@ -438,7 +439,8 @@ try_setup_point( struct lp_setup_context *setup,
       plane[3].eo = 0;
    }
 
-   return lp_setup_bin_triangle(setup, point, &bbox, nr_planes, scissor_index);
+   return lp_setup_bin_triangle(setup, point, &bbox, nr_planes, scissor_index,
+                                NULL);
 }
 
 
@@ -33,6 +33,7 @@
 #include "util/u_memory.h"
 #include "util/u_rect.h"
 #include "util/u_sse.h"
+#include "lp_hiz.h"
 #include "lp_perf.h"
 #include "lp_setup_context.h"
 #include "lp_rast.h"
@@ -63,7 +64,7 @@ fixed_to_float(int a)
 struct fixed_position {
    int x[4];
    int y[4];
-   int area;
+   int64_t area;
    int dx01;
    int dy01;
    int dx20;
@@ -239,6 +240,102 @@ lp_setup_whole_tile(struct lp_setup_context *setup,
 }
 
 
+/**
+ * Compute the edge planes of a triangle, with the half-edge constants in
+ * 64 bits.  The constants are only stored modulo 2^32 in the planes, the
+ * exact values are returned in c64 for binning.
+ */
+static void
+setup_planes_64(const struct lp_setup_context *setup,
+                const struct fixed_position *position,
+                struct lp_rast_plane *plane,
+                int64_t *c64)
+{
+   int i;
+
+   plane[0].dcdy = position->dx01;
+   plane[1].dcdy = position->x[1] - position->x[2];
+   plane[2].dcdy = position->dx20;
+   plane[0].dcdx = position->dy01;
+   plane[1].dcdx = position->y[1] - position->y[2];
+   plane[2].dcdx = position->dy20;
+
+   for (i = 0; i < 3; i++) {
+      /* half-edge constants, will be interated over the whole render
+       * target.
+       */
+      c64[i] = (int64_t)plane[i].dcdx * position->x[i] -
+               (int64_t)plane[i].dcdy * position->y[i];
+
+      /* correct for top-left vs. bottom-left fill convention.
+       */
+      if (plane[i].dcdx < 0) {
+         /* both fill conventions want this - adjust for left edges */
+         c64[i]++;
+      }
+      else if (plane[i].dcdx == 0) {
+         if (setup->bottom_edge_rule == 0){
+            /* correct for top-left fill convention:
+             */
+            if (plane[i].dcdy > 0) c64[i]++;
+         }
+         else {
+            /* correct for bottom-left fill convention:
+             */
+            if (plane[i].dcdy < 0) c64[i]++;
+         }
+      }
+
+      plane[i].c = (int)c64[i];
+
+      plane[i].dcdx *= FIXED_ONE;
+      plane[i].dcdy *= FIXED_ONE;
+
+      /* find trivial reject offsets for each edge for a single-pixel
+       * sized block.  These will be scaled up at each recursive level to
+       * match the active blocksize.  Scaling in this way works best if
+       * the blocks are square.
+       */
+      plane[i].eo = 0;
+      if (plane[i].dcdx < 0) plane[i].eo -= plane[i].dcdx;
+      if (plane[i].dcdy > 0) plane[i].eo += plane[i].dcdy;
+   }
+}
+
+
+/**
+ * Lower bound hierarchical Z key of the triangle: the smallest depth
+ * plane value at the vertices, less the interpolation rounding margin.
+ */
+static uint32_t
+hiz_tri_zmin(const struct lp_setup_context *setup,
+             const struct lp_hiz *hiz,
+             const struct lp_rast_triangle *tri,
+             const float (*v0)[4],
+             const float (*v1)[4],
+             const float (*v2)[4],
+             const struct u_rect *bbox)
+{
+   const float (*a0)[4] = (const float (*)[4]) GET_A0(&tri->inputs);
+   const float (*dadx)[4] = (const float (*)[4]) GET_DADX(&tri->inputs);
+   const float (*dady)[4] = (const float (*)[4]) GET_DADY(&tri->inputs);
+   const float (*v[3])[4] = { v0, v1, v2 };
+   float zmin = 0.0f;
+   int i;
+
+   for (i = 0; i < 3; i++) {
+      float z = a0[0][2] +
+                dadx[0][2] * (v[i][0][0] - setup->pixel_offset) +
+                dady[0][2] * (v[i][0][1] - setup->pixel_offset);
+      zmin = i ? MIN2(zmin, z) : z;
+   }
+
+   zmin -= lp_hiz_margin(a0, dadx, dady, bbox->x1 + 1, bbox->y1 + 1);
+
+   return lp_hiz_key(hiz, zmin, FALSE);
+}
+
+
 /**
  * Do basic setup for triangle rasterization and determine which
  * framebuffer tiles are touched.  Put the triangle in the scene's
@@ -261,6 +358,9 @@ do_triangle_ccw(struct lp_setup_context *setup,
    int nr_planes = 3;
    unsigned scissor_index = 0;
    unsigned layer = 0;
+   boolean fixed64;
+   int64_t c64[MAX_PLANES];
+   const int64_t *exact_c = NULL;
 
    /* Area should always be positive here */
    assert(position->area > 0);
@@ -308,6 +408,16 @@ do_triangle_ccw(struct lp_setup_context *setup,
       return TRUE;
    }
 
+   /* The half-edge constants are cross products of the vertex positions,
+    * which only fit in 32 bits while the vertices stay within
+    * MAX_FIXED_LENGTH of the origin.  Beyond that (large render targets
+    * or large triangles) compute them with 64-bit arithmetic.
+    */
+   fixed64 = (bbox.x0 < -MAX_FIXED_LENGTH / 2 ||
+              bbox.y0 < -MAX_FIXED_LENGTH / 2 ||
+              bbox.x1 >= MAX_FIXED_LENGTH ||
+              bbox.y1 >= MAX_FIXED_LENGTH);
+
    if (!u_rect_test_intersection(&setup->draw_regions[scissor_index], &bbox)) {
       if (0) debug_printf("offscreen\n");
       LP_COUNT(nr_culled_tris);
@@ -338,6 +448,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
 #endif
 
    LP_COUNT(nr_tris);
+   scene->num_tris++;
 
    /* Setup parameter interpolants:
     */
@@ -353,6 +464,8 @@ do_triangle_ccw(struct lp_setup_context *setup,
    tri->inputs.disable = FALSE;
    tri->inputs.opaque = setup->fs.current.variant->opaque;
    tri->inputs.layer = layer;
+   tri->inputs.hiz_zmin = scene->hiz ?
+      hiz_tri_zmin(setup, scene->hiz, tri, v0, v1, v2, &bbox) : 0;
 
    if (0)
       lp_dump_setup_coef(&setup->setup.variant->key,
@@ -363,7 +476,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
    plane = GET_PLANES(tri);
 
 #if defined(PIPE_ARCH_SSE)
-   {
+   if (!fixed64) {
       __m128i vertx, verty;
       __m128i shufx, shufy;
       __m128i dcdx, dcdy, c;
@@ -425,55 +538,12 @@ do_triangle_ccw(struct lp_setup_context *setup,
       _mm_store_si128((__m128i *)&plane[1], p1);
       _mm_store_si128((__m128i *)&plane[2], p2);
    }
-#else
+   else
+#endif
    {
-      int i;
-      plane[0].dcdy = position->dx01;
-      plane[1].dcdy = position->x[1] - position->x[2];
-      plane[2].dcdy = position->dx20;
-      plane[0].dcdx = position->dy01;
-      plane[1].dcdx = position->y[1] - position->y[2];
-      plane[2].dcdx = position->dy20;
-  
-      for (i = 0; i < 3; i++) {
-         /* half-edge constants, will be interated over the whole render
-          * target.
-          */
-         plane[i].c = plane[i].dcdx * position->x[i] - plane[i].dcdy * position->y[i];
-
-         /* correct for top-left vs. bottom-left fill convention.
-          */         
-         if (plane[i].dcdx < 0) {
-            /* both fill conventions want this - adjust for left edges */
-            plane[i].c++;            
-         }
-         else if (plane[i].dcdx == 0) {
-            if (setup->bottom_edge_rule == 0){
-               /* correct for top-left fill convention:
-                */
-               if (plane[i].dcdy > 0) plane[i].c++;
-            }
-            else {
-               /* correct for bottom-left fill convention:
-                */
-               if (plane[i].dcdy < 0) plane[i].c++;
-            }
-         }
-
-         plane[i].dcdx *= FIXED_ONE;
-         plane[i].dcdy *= FIXED_ONE;
-
-         /* find trivial reject offsets for each edge for a single-pixel
-          * sized block.  These will be scaled up at each recursive level to
-          * match the active blocksize.  Scaling in this way works best if
-          * the blocks are square.
-          */
-         plane[i].eo = 0;
-         if (plane[i].dcdx < 0) plane[i].eo -= plane[i].dcdx;
-         if (plane[i].dcdy > 0) plane[i].eo += plane[i].dcdy;
-      }
+      setup_planes_64(setup, position, plane, c64);
+      exact_c = c64;
    }
-#endif
 
    if (0) {
       debug_printf("p0: %08x/%08x/%08x/%08x\n",
@@ -536,9 +606,19 @@ do_triangle_ccw(struct lp_setup_context *setup,
       plane[6].dcdy = -1;
       plane[6].c = scissor->y1+1;
       plane[6].eo = 0;
+
+      if (exact_c) {
+         int i;
+         for (i = 3; i < 7; i++)
+            c64[i] = plane[i].c;
+      }
    }
 
-   return lp_setup_bin_triangle(setup, tri, &bbox, nr_planes, scissor_index);
+   if (fixed64)
+      LP_COUNT(nr_fixed64_tris);
+
+   return lp_setup_bin_triangle(setup, tri, &bbox, nr_planes, scissor_index,
+                                exact_c);
 }
 
 /*
@@ -568,17 +648,48 @@ floor_pot(uint32_t n)
 }
 
 
+/**
+ * Whether hierarchical Z says the triangle fails the depth test in the
+ * part of tile (x, y) within the box.
+ */
+static INLINE boolean
+hiz_reject_tile(const struct lp_hiz *hiz,
+                const struct lp_rast_triangle *tri,
+                const struct u_rect *box,
+                int x, int y)
+{
+   int x0 = MAX2(x * TILE_SIZE, box->x0);
+   int y0 = MAX2(y * TILE_SIZE, box->y0);
+   int x1 = MIN2((x + 1) * TILE_SIZE - 1, box->x1);
+   int y1 = MIN2((y + 1) * TILE_SIZE - 1, box->y1);
+
+   return lp_hiz_reject(hiz, &tri->inputs,
+                        x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+}
+
+
+/**
+ * Put the triangle in the bins of the tiles it overlaps.
+ * \param exact_c  the exact half-edge constants, if the ones in the
+ *                 planes were truncated to 32 bits, or NULL
+ */
 boolean
 lp_setup_bin_triangle( struct lp_setup_context *setup,
                        struct lp_rast_triangle *tri,
                        const struct u_rect *bbox,
                        int nr_planes,
-                       unsigned scissor_index )
+                       unsigned scissor_index,
+                       const int64_t *exact_c )
 {
    struct lp_scene *scene = setup->scene;
    struct u_rect trimmed_box = *bbox;   
+   const struct lp_hiz *hiz = NULL;
    int i;
 
+   if (scene->hiz_binning &&
+       (setup->fs.current.variant->hiz & LP_HIZ_TEST))
+      hiz = scene->hiz;
+
    /* What is the largest power-of-two boundary this triangle crosses:
     */
    int dx = floor_pot((bbox->x0 ^ bbox->x1) |
@@ -610,6 +721,17 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
       assert(iy0 == bbox->y1 / TILE_SIZE &&
 	     ix0 == bbox->x1 / TILE_SIZE);
 
+      if (hiz &&
+          lp_hiz_reject(hiz, &tri->inputs,
+                        bbox->x0, bbox->y0,
+                        bbox->x1 - bbox->x0 + 1,
+                        bbox->y1 - bbox->y0 + 1)) {
+         /* Triangle is behind everything already drawn there:
+          */
+         LP_COUNT(nr_hiz_culled_tris);
+         return TRUE;
+      }
+
       if (nr_planes == 3) {
          if (sz < 4)
          {
@@ -669,7 +791,8 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
    else
    {
       struct lp_rast_plane *plane = GET_PLANES(tri);
-      int c[MAX_PLANES];
+      /* The edge functions can exceed 32 bits across large triangles */
+      int64_t c[MAX_PLANES];
       int ei[MAX_PLANES];
 
       int eo[MAX_PLANES];
@@ -683,9 +806,9 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
       int iy1 = trimmed_box.y1 / TILE_SIZE;
       
       for (i = 0; i < nr_planes; i++) {
-         c[i] = (plane[i].c + 
-                 plane[i].dcdy * iy0 * TILE_SIZE - 
-                 plane[i].dcdx * ix0 * TILE_SIZE);
+         c[i] = ((exact_c ? exact_c[i] : plane[i].c) +
+                 (int64_t)plane[i].dcdy * iy0 * TILE_SIZE -
+                 (int64_t)plane[i].dcdx * ix0 * TILE_SIZE);
 
          ei[i] = (plane[i].dcdy - 
                   plane[i].dcdx - 
@@ -706,7 +829,7 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
       for (y = iy0; y <= iy1; y++)
       {
 	 boolean in = FALSE;  /* are we inside the triangle? */
-	 int cx[MAX_PLANES];
+	 int64_t cx[MAX_PLANES];
 
          for (i = 0; i < nr_planes; i++)
             cx[i] = c[i];
@@ -717,10 +840,10 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
             int partial = 0;
 
             for (i = 0; i < nr_planes; i++) {
-               int planeout = cx[i] + eo[i];
-               int planepartial = cx[i] + ei[i] - 1;
-               out |= (planeout >> 31);
-               partial |= (planepartial >> 31) & (1<<i);
+               int64_t planeout = cx[i] + eo[i];
+               int64_t planepartial = cx[i] + ei[i] - 1;
+               out |= (int) (planeout >> 63);
+               partial |= ((int) (planepartial >> 63)) & (1<<i);
             }
 
             if (out) {
@@ -729,6 +852,11 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                   break;  /* exiting triangle, all done with this row */
                LP_COUNT(nr_empty_64);
             }
+            else if (hiz && hiz_reject_tile(hiz, tri, &trimmed_box, x, y)) {
+               /* triangle is behind the depth buffer in this tile */
+               LP_COUNT(nr_hiz_rejected_64);
+               in = TRUE;
+            }
             else if (partial) {
                /* Not trivially accepted by at least one plane - 
                 * rasterize/shade partial tile
@@ -823,7 +951,8 @@ calc_fixed_position( struct lp_setup_context *setup,
    position->dx20 = position->x[2] - position->x[0];
    position->dy20 = position->y[2] - position->y[0];
 
-   position->area = position->dx01 * position->dy20 - position->dx20 * position->dy01;
+   position->area = (int64_t)position->dx01 * position->dy20 -
+                    (int64_t)position->dx20 * position->dy01;
 }
 
 
@@ -988,7 +1117,7 @@ check_subdivide_triangle(struct lp_setup_context *setup,
                          const float (*v2)[4],
                          triangle_func_t tri)
 {
-   const float maxLen = (float) MAX_FIXED_LENGTH;  /* longest permissible edge, in pixels */
+   const float maxLen = (float) MAX_FIXED_LENGTH64;  /* longest permissible edge, in pixels */
    float dx10, dy10, len10;
    float dx21, dy21, len21;
    float dx02, dy02, len02;
@@ -37,6 +37,7 @@
 
 
 #include "lp_setup_context.h"
+#include "lp_setup_mt.h"
 #include "lp_context.h"
 #include "draw/draw_vbuf.h"
 #include "draw/draw_vertex.h"
@@ -46,6 +47,12 @@
 #define LP_MAX_VBUF_INDEXES 1024
 #define LP_MAX_VBUF_SIZE    4096
 
+/* Larger batches, so that there's enough to split between the binning
+ * threads.
+ */
+#define LP_MAX_VBUF_INDEXES_MT 16384
+#define LP_MAX_VBUF_SIZE_MT    (256 * 1024)
+
   
 
 /** cast wrapper */
@@ -139,6 +146,7 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
    const unsigned stride = setup->vertex_info->size * sizeof(float);
    const void *vertex_buffer = setup->vertex_buffer;
    const boolean flatshade_first = setup->flatshade_first;
+   boolean mt;
    unsigned i;
 
    assert(setup->setup.variant);
@@ -146,6 +154,9 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
    if (!lp_setup_update_state(setup, TRUE))
       return;
 
+   /* Large draws are collected, and then binned by several threads */
+   mt = lp_setup_mt_begin(setup, nr);
+
    switch (setup->prim) {
    case PIPE_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
@@ -324,6 +335,9 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
    default:
       assert(0);
    }
+
+   if (mt)
+      lp_setup_mt_end(setup);
 }
 
 
@@ -339,11 +353,15 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    const void *vertex_buffer =
       (void *) get_vert(setup->vertex_buffer, start, stride);
    const boolean flatshade_first = setup->flatshade_first;
+   boolean mt;
    unsigned i;
 
    if (!lp_setup_update_state(setup, TRUE))
       return;
 
+   /* Large draws are collected, and then binned by several threads */
+   mt = lp_setup_mt_begin(setup, nr);
+
    switch (setup->prim) {
    case PIPE_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
@@ -519,6 +537,9 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    default:
       assert(0);
    }
+
+   if (mt)
+      lp_setup_mt_end(setup);
 }
 
 
@@ -585,8 +606,14 @@ lp_setup_pipeline_statistics(
 void
 lp_setup_init_vbuf(struct lp_setup_context *setup)
 {
-   setup->base.max_indices = LP_MAX_VBUF_INDEXES;
-   setup->base.max_vertex_buffer_bytes = LP_MAX_VBUF_SIZE;
+   if (setup->mt) {
+      setup->base.max_indices = LP_MAX_VBUF_INDEXES_MT;
+      setup->base.max_vertex_buffer_bytes = LP_MAX_VBUF_SIZE_MT;
+   }
+   else {
+      setup->base.max_indices = LP_MAX_VBUF_INDEXES;
+      setup->base.max_vertex_buffer_bytes = LP_MAX_VBUF_SIZE;
+   }
 
    setup->base.get_vertex_info = lp_setup_get_vertex_info;
    setup->base.allocate_vertices = lp_setup_allocate_vertices;
@@ -0,0 +1,983 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Compute shaders.
+ *
+ * Memory resources are accessed a 32 bit word at a time, with byte
+ * addresses.  Accesses outside of a resource, or to unbound resources,
+ * are ignored and load zero.
+ *
+ * The GLOBAL resource spans LP_MAX_CS_GLOBALS buffers, see
+ * LP_CS_GLOBAL_SHIFT for the handles set_global_binding() returns.
+ */
+
+#include "pipe/p_defines.h"
+#include "pipe/p_shader_tokens.h"
+#include "util/u_format.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_string.h"
+#include "os/os_thread.h"
+#include "os/os_time.h"
+#include "tgsi/tgsi_dump.h"
+#include "tgsi/tgsi_parse.h"
+#include "tgsi/tgsi_scan.h"
+#include "gallivm/lp_bld_type.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_logic.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_swizzle.h"
+#include "gallivm/lp_bld_struct.h"
+#include "gallivm/lp_bld_tgsi.h"
+#include "lp_context.h"
+#include "lp_debug.h"
+#include "lp_flush.h"
+#include "lp_perf.h"
+#include "lp_rast.h"
+#include "lp_screen.h"
+#include "lp_state_cs.h"
+#include "lp_texture.h"
+
+
+/** Alignment of the memory handed to the compute shader functions */
+#define LP_CS_MEM_ALIGN 64
+
+/** Most blocks a single lp_rast_run_jobs() call hands out */
+#define LP_CS_MAX_JOB_BLOCKS (1 << 30)
+
+
+static unsigned cs_no = 0;
+
+
+/**
+ * Values the memory access callbacks need, all from the function
+ * parameters or the jit context.
+ */
+struct lp_cs_iface
+{
+   struct lp_build_tgsi_cs_iface base;
+
+   LLVMValueRef context_ptr;
+   LLVMValueRef thread_index;
+   LLVMValueRef local_mem;
+   LLVMValueRef local_size;
+   LLVMValueRef private_mem;
+   LLVMValueRef private_size;
+
+   /** Target of the inactive lanes' and out of bounds accesses */
+   LLVMValueRef dummy;
+};
+
+
+static INLINE const struct lp_cs_iface *
+lp_cs_iface(const struct lp_build_tgsi_cs_iface *iface)
+{
+   return (const struct lp_cs_iface *) iface;
+}
+
+
+/**
+ * Pointer to the word one lane accesses.  Points to a dummy word, and
+ * sets *valid to false, when the lane is inactive or the access is out of
+ * bounds, so the access itself can always be done.
+ */
+static LLVMValueRef
+cs_word_ptr(const struct lp_cs_iface *iface,
+            struct gallivm_state *gallivm,
+            unsigned resource,
+            const LLVMValueRef *address,
+            unsigned offset,
+            LLVMValueRef exec_mask,
+            unsigned lane,
+            LLVMValueRef *valid)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int32_ptr_type =
+      LLVMPointerType(LLVMInt32TypeInContext(gallivm->context), 0);
+   LLVMValueRef index = lp_build_const_int32(gallivm, lane);
+   LLVMValueRef active;
+   LLVMValueRef buffer;
+   LLVMValueRef base;
+   LLVMValueRef size;
+   LLVMValueRef off;
+   LLVMValueRef ptr;
+
+   active = LLVMBuildExtractElement(builder, exec_mask, index, "");
+   active = LLVMBuildICmp(builder, LLVMIntNE, active,
+                          lp_build_const_int32(gallivm, 0), "");
+
+   off = LLVMBuildExtractElement(builder, address[0], index, "");
+   off = LLVMBuildAdd(builder, off, lp_build_const_int32(gallivm, offset), "");
+
+   switch (resource) {
+   case TGSI_RESOURCE_GLOBAL:
+      buffer = LLVMBuildLShr(builder, off,
+                             lp_build_const_int32(gallivm, LP_CS_GLOBAL_SHIFT),
+                             "");
+      buffer = lp_build_array_get_ptr(gallivm,
+                                      lp_jit_cs_context_globals(gallivm,
+                                                                iface->context_ptr),
+                                      buffer);
+      base = lp_build_struct_get(gallivm, buffer, LP_JIT_CS_BUFFER_BASE, "base");
+      size = lp_build_struct_get(gallivm, buffer, LP_JIT_CS_BUFFER_SIZE, "size");
+      off = LLVMBuildAnd(builder, off,
+                         lp_build_const_int32(gallivm,
+                                              (1 << LP_CS_GLOBAL_SHIFT) - 1),
+                         "");
+      break;
+
+   case TGSI_RESOURCE_LOCAL:
+      base = iface->local_mem;
+      size = iface->local_size;
+      break;
+
+   case TGSI_RESOURCE_PRIVATE:
+      {
+         LLVMValueRef thread;
+
+         thread = LLVMBuildAdd(builder, iface->thread_index, index, "");
+         thread = LLVMBuildMul(builder, thread, iface->private_size, "");
+         base = LLVMBuildGEP(builder, iface->private_mem, &thread, 1, "");
+         size = iface->private_size;
+      }
+      break;
+
+   case TGSI_RESOURCE_INPUT:
+      buffer = lp_jit_cs_context_input(gallivm, iface->context_ptr);
+      base = lp_build_struct_get(gallivm, buffer, LP_JIT_CS_BUFFER_BASE, "base");
+      size = lp_build_struct_get(gallivm, buffer, LP_JIT_CS_BUFFER_SIZE, "size");
+      break;
+
+   default:
+      if (resource < PIPE_MAX_SHADER_RESOURCES) {
+         LLVMValueRef y, z, stride;
+
+         buffer = lp_build_array_get_ptr(gallivm,
+                                         lp_jit_cs_context_resources(gallivm,
+                                                                     iface->context_ptr),
+                                         lp_build_const_int32(gallivm, resource));
+         base = lp_build_struct_get(gallivm, buffer, LP_JIT_CS_BUFFER_BASE, "base");
+         size = lp_build_struct_get(gallivm, buffer, LP_JIT_CS_BUFFER_SIZE, "size");
+
+         y = LLVMBuildExtractElement(builder, address[1], index, "");
+         stride = lp_build_struct_get(gallivm, buffer,
+                                      LP_JIT_CS_BUFFER_ROW_STRIDE, "row_stride");
+         off = LLVMBuildAdd(builder, off,
+                            LLVMBuildMul(builder, y, stride, ""), "");
+
+         z = LLVMBuildExtractElement(builder, address[2], index, "");
+         stride = lp_build_struct_get(gallivm, buffer,
+                                      LP_JIT_CS_BUFFER_IMG_STRIDE, "img_stride");
+         off = LLVMBuildAdd(builder, off,
+                            LLVMBuildMul(builder, z, stride, ""), "");
+      }
+      else {
+         *valid = LLVMConstInt(LLVMInt1TypeInContext(gallivm->context), 0, 0);
+         return iface->dummy;
+      }
+      break;
+   }
+
+   /* words are aligned */
+   off = LLVMBuildAnd(builder, off, lp_build_const_int32(gallivm, ~3), "");
+
+   /* size >= 4 && off <= size - 4, without wrapping around */
+   *valid = LLVMBuildAnd(builder, active,
+                         LLVMBuildICmp(builder, LLVMIntUGE, size,
+                                       lp_build_const_int32(gallivm, 4), ""),
+                         "");
+   *valid = LLVMBuildAnd(builder, *valid,
+                         LLVMBuildICmp(builder, LLVMIntULE, off,
+                                       LLVMBuildSub(builder, size,
+                                                    lp_build_const_int32(gallivm, 4),
+                                                    ""),
+                                       ""),
+                         "");
+
+   ptr = LLVMBuildGEP(builder, base, &off, 1, "");
+   ptr = LLVMBuildBitCast(builder, ptr, int32_ptr_type, "");
+
+   return LLVMBuildSelect(builder, *valid, ptr, iface->dummy, "");
+}
+
+
+static LLVMValueRef
+cs_load(const struct lp_build_tgsi_cs_iface *cs_iface,
+        struct lp_build_tgsi_context *bld_base,
+        unsigned resource,
+        const LLVMValueRef *address,
+        unsigned offset,
+        LLVMValueRef exec_mask)
+{
+   const struct lp_cs_iface *iface = lp_cs_iface(cs_iface);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   LLVMValueRef res = uint_bld->undef;
+   unsigned i;
+
+   for (i = 0; i < uint_bld->type.length; i++) {
+      LLVMValueRef valid;
+      LLVMValueRef ptr = cs_word_ptr(iface, gallivm, resource, address,
+                                     offset, exec_mask, i, &valid);
+      LLVMValueRef value = LLVMBuildLoad(builder, ptr, "");
+
+      value = LLVMBuildSelect(builder, valid, value,
+                              lp_build_const_int32(gallivm, 0), "");
+      res = LLVMBuildInsertElement(builder, res, value,
+                                   lp_build_const_int32(gallivm, i), "");
+   }
+
+   return res;
+}
+
+
+static void
+cs_store(const struct lp_build_tgsi_cs_iface *cs_iface,
+         struct lp_build_tgsi_context *bld_base,
+         unsigned resource,
+         const LLVMValueRef *address,
+         unsigned offset,
+         LLVMValueRef value,
+         LLVMValueRef exec_mask)
+{
+   const struct lp_cs_iface *iface = lp_cs_iface(cs_iface);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   unsigned i;
+
+   for (i = 0; i < bld_base->uint_bld.type.length; i++) {
+      LLVMValueRef valid;
+      LLVMValueRef ptr = cs_word_ptr(iface, gallivm, resource, address,
+                                     offset, exec_mask, i, &valid);
+      LLVMValueRef elem =
+         LLVMBuildExtractElement(builder, value,
+                                 lp_build_const_int32(gallivm, i), "");
+
+      LLVMBuildStore(builder, elem, ptr);
+   }
+}
+
+
+static void
+cs_barrier(const struct lp_build_tgsi_cs_iface *cs_iface,
+           struct lp_build_tgsi_context *bld_base,
+           unsigned phase)
+{
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+
+   LLVMBuildRet(gallivm->builder, lp_build_const_int32(gallivm, phase));
+}
+
+
+/**
+ * Generate the compute shader function for one entry point.  Any change
+ * to the prototype must be reflected in lp_jit_cs_func.
+ */
+static void
+generate_compute(struct lp_compute_shader *shader,
+                 struct lp_compute_shader_variant *variant)
+{
+   struct gallivm_state *gallivm = variant->gallivm;
+   LLVMContextRef lc = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(lc);
+   LLVMTypeRef int8_ptr_type = LLVMPointerType(LLVMInt8TypeInContext(lc), 0);
+   LLVMTypeRef arg_types[9];
+   LLVMTypeRef func_type;
+   LLVMValueRef function;
+   LLVMValueRef context_ptr;
+   LLVMValueRef block_size_ptr;
+   LLVMValueRef grid_size_ptr;
+   LLVMValueRef consts_ptr;
+   LLVMValueRef thread_vec;
+   LLVMValueRef num_threads;
+   LLVMValueRef lanes[LP_MAX_VECTOR_LENGTH];
+   LLVMValueRef block_size_vec[3];
+   LLVMValueRef value;
+   LLVMBasicBlockRef block;
+   struct lp_build_context uint_bld;
+   struct lp_build_mask_context mask;
+   struct lp_bld_tgsi_system_values system_values;
+   struct lp_cs_iface iface;
+   char func_name[64];
+   unsigned i;
+
+   util_snprintf(func_name, sizeof(func_name), "cs%u_pc%u",
+                 shader->no, variant->pc);
+
+   arg_types[0] = variant->jit_context_ptr_type;   /* context */
+   arg_types[1] = int32_type;                      /* block_x */
+   arg_types[2] = int32_type;                      /* block_y */
+   arg_types[3] = int32_type;                      /* block_z */
+   arg_types[4] = int32_type;                      /* thread_index */
+   arg_types[5] = int8_ptr_type;                   /* local_mem */
+   arg_types[6] = int8_ptr_type;                   /* private_mem */
+   arg_types[7] = int8_ptr_type;                   /* temps */
+   arg_types[8] = int32_type;                      /* phase */
+
+   func_type = LLVMFunctionType(int32_type, arg_types,
+                                Elements(arg_types), 0);
+
+   function = LLVMAddFunction(gallivm->module, func_name, func_type);
+   LLVMSetFunctionCallConv(function, LLVMCCallConv);
+
+   variant->function = function;
+
+   for (i = 0; i < Elements(arg_types); ++i)
+      if (LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind)
+         LLVMAddAttribute(LLVMGetParam(function, i), LLVMNoAliasAttribute);
+
+   memset(&iface, 0, sizeof iface);
+   memset(&system_values, 0, sizeof system_values);
+
+   context_ptr = LLVMGetParam(function, 0);
+   system_values.block_id[0] = LLVMGetParam(function, 1);
+   system_values.block_id[1] = LLVMGetParam(function, 2);
+   system_values.block_id[2] = LLVMGetParam(function, 3);
+   iface.thread_index = LLVMGetParam(function, 4);
+   iface.local_mem = LLVMGetParam(function, 5);
+   iface.private_mem = LLVMGetParam(function, 6);
+   iface.base.temps = LLVMGetParam(function, 7);
+   iface.base.phase = LLVMGetParam(function, 8);
+
+   lp_build_name(context_ptr, "context");
+   lp_build_name(system_values.block_id[0], "block_x");
+   lp_build_name(system_values.block_id[1], "block_y");
+   lp_build_name(system_values.block_id[2], "block_z");
+   lp_build_name(iface.thread_index, "thread_index");
+   lp_build_name(iface.local_mem, "local_mem");
+   lp_build_name(iface.private_mem, "private_mem");
+   lp_build_name(iface.base.temps, "temps");
+   lp_build_name(iface.base.phase, "phase");
+
+   /*
+    * Function body
+    */
+
+   block = LLVMAppendBasicBlockInContext(lc, function, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   lp_build_context_init(&uint_bld, gallivm, lp_uint_type(shader->type));
+
+   iface.base.load = cs_load;
+   iface.base.store = cs_store;
+   iface.base.barrier = cs_barrier;
+   iface.base.pc = variant->pc;
+   iface.context_ptr = context_ptr;
+   iface.local_size = lp_jit_cs_context_local_size(gallivm, context_ptr);
+   iface.private_size = lp_jit_cs_context_private_size(gallivm, context_ptr);
+   iface.dummy = lp_build_alloca(gallivm, int32_type, "dummy");
+
+   block_size_ptr = lp_jit_cs_context_block_size(gallivm, context_ptr);
+   grid_size_ptr = lp_jit_cs_context_grid_size(gallivm, context_ptr);
+   for (i = 0; i < 3; i++) {
+      LLVMValueRef index = lp_build_const_int32(gallivm, i);
+
+      system_values.block_size[i] =
+         lp_build_array_get(gallivm, block_size_ptr, index);
+      system_values.grid_size[i] =
+         lp_build_array_get(gallivm, grid_size_ptr, index);
+      block_size_vec[i] =
+         lp_build_broadcast_scalar(&uint_bld, system_values.block_size[i]);
+   }
+
+   /* The threads of the group, in x, y, z order */
+   for (i = 0; i < shader->type.length; i++) {
+      lanes[i] = lp_build_const_int32(gallivm, i);
+   }
+   thread_vec = lp_build_broadcast_scalar(&uint_bld, iface.thread_index);
+   thread_vec = LLVMBuildAdd(builder, thread_vec,
+                             LLVMConstVector(lanes, shader->type.length), "");
+
+   system_values.thread_id[0] =
+      LLVMBuildURem(builder, thread_vec, block_size_vec[0], "");
+   value = LLVMBuildUDiv(builder, thread_vec, block_size_vec[0], "");
+   system_values.thread_id[1] =
+      LLVMBuildURem(builder, value, block_size_vec[1], "");
+   system_values.thread_id[2] =
+      LLVMBuildUDiv(builder, value, block_size_vec[1], "");
+
+   /* The last group of a block may be partial */
+   num_threads = LLVMBuildMul(builder, block_size_vec[0], block_size_vec[1], "");
+   num_threads = LLVMBuildMul(builder, num_threads, block_size_vec[2], "");
+   lp_build_mask_begin(&mask, gallivm, shader->type,
+                       lp_build_cmp(&uint_bld, PIPE_FUNC_LESS,
+                                    thread_vec, num_threads));
+
+   consts_ptr = lp_jit_cs_context_constants(gallivm, context_ptr);
+
+   lp_build_tgsi_soa(gallivm, shader->tokens, shader->type, &mask,
+                     consts_ptr, &system_values,
+                     NULL, NULL, NULL,
+                     &shader->info, NULL, &iface.base);
+
+   lp_build_mask_end(&mask);
+
+   LLVMBuildRet(builder, lp_build_const_int32(gallivm, 0));
+
+   gallivm_verify_function(gallivm, function);
+}
+
+
+static struct lp_compute_shader_variant *
+generate_variant(struct lp_compute_shader *shader, unsigned pc)
+{
+   struct lp_compute_shader_variant *variant;
+   int64_t t0 = os_time_get();
+
+   variant = CALLOC_STRUCT(lp_compute_shader_variant);
+   if (!variant)
+      return NULL;
+
+   variant->shader = shader;
+   variant->pc = pc;
+
+   variant->gallivm = gallivm_create();
+   if (!variant->gallivm) {
+      FREE(variant);
+      return NULL;
+   }
+
+   lp_jit_init_cs_types(variant);
+
+   generate_compute(shader, variant);
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->jit_function = (lp_jit_cs_func)
+      gallivm_jit_function(variant->gallivm, variant->function);
+
+   LP_COUNT(nr_llvm_compiles);
+   LP_COUNT_ADD(llvm_compile_time, os_time_get() - t0);
+
+   return variant;
+}
+
+
+static void
+destroy_variant(struct lp_compute_shader_variant *variant)
+{
+   if (variant->function) {
+      gallivm_free_function(variant->gallivm,
+                            variant->function,
+                            variant->jit_function);
+   }
+
+   gallivm_destroy(variant->gallivm);
+
+   FREE(variant);
+}
+
+
+static struct lp_compute_shader_variant *
+get_variant(struct lp_compute_shader *shader, unsigned pc)
+{
+   struct lp_compute_shader_variant *variant;
+
+   for (variant = shader->variants; variant; variant = variant->next) {
+      if (variant->pc == pc)
+         return variant;
+   }
+
+   variant = generate_variant(shader, pc);
+   if (variant) {
+      variant->next = shader->variants;
+      shader->variants = variant;
+   }
+
+   return variant;
+}
+
+
+static void *
+llvmpipe_create_compute_state(struct pipe_context *pipe,
+                              const struct pipe_compute_state *templ)
+{
+   struct lp_compute_shader *shader;
+   struct tgsi_parse_context parse;
+   unsigned depth = 0;
+   boolean in_main = TRUE;
+   boolean returned = FALSE;
+   boolean barrier_ok = TRUE;
+
+   shader = CALLOC_STRUCT(lp_compute_shader);
+   if (!shader)
+      return NULL;
+
+   shader->no = cs_no++;
+   shader->base = *templ;
+   shader->tokens = tgsi_dup_tokens(templ->prog);
+   if (!shader->tokens) {
+      FREE(shader);
+      return NULL;
+   }
+
+   tgsi_scan_shader(shader->tokens, &shader->info);
+
+   /*
+    * Launches are validated against the number of instructions.  The code
+    * can only resume after barriers at the top level of the main function,
+    * see barrier_emit().
+    */
+   tgsi_parse_init(&parse, shader->tokens);
+   while (!tgsi_parse_end_of_tokens(&parse)) {
+      tgsi_parse_token(&parse);
+      if (parse.FullToken.Token.Type != TGSI_TOKEN_TYPE_INSTRUCTION)
+         continue;
+
+      shader->num_instructions++;
+
+      switch (parse.FullToken.FullInstruction.Instruction.Opcode) {
+      case TGSI_OPCODE_IF:
+      case TGSI_OPCODE_UIF:
+      case TGSI_OPCODE_BGNLOOP:
+      case TGSI_OPCODE_SWITCH:
+         depth++;
+         break;
+      case TGSI_OPCODE_ENDIF:
+      case TGSI_OPCODE_ENDLOOP:
+      case TGSI_OPCODE_ENDSWITCH:
+         depth--;
+         break;
+      case TGSI_OPCODE_RET:
+         returned |= in_main;
+         break;
+      case TGSI_OPCODE_END:
+      case TGSI_OPCODE_BGNSUB:
+         /* subroutines follow the main function */
+         in_main = FALSE;
+         break;
+      case TGSI_OPCODE_BARRIER:
+         if (!in_main || depth || returned)
+            barrier_ok = FALSE;
+         break;
+      }
+   }
+   tgsi_parse_free(&parse);
+
+   if (!barrier_ok) {
+      debug_printf("llvmpipe: BARRIER in control flow is not supported\n");
+      goto fail;
+   }
+
+   if (shader->info.file_count[TGSI_FILE_SAMPLER] ||
+       shader->info.file_count[TGSI_FILE_SAMPLER_VIEW]) {
+      debug_printf("llvmpipe: texture sampling in compute shaders is not "
+                   "supported\n");
+      goto fail;
+   }
+
+   memset(&shader->type, 0, sizeof shader->type);
+   shader->type.floating = TRUE;
+   shader->type.sign = TRUE;
+   shader->type.width = 32;
+   shader->type.length = MIN2(lp_native_vector_width / 32, 16);
+
+   shader->temps_size = (shader->info.file_max[TGSI_FILE_TEMPORARY] + 1) *
+                        TGSI_NUM_CHANNELS * shader->type.length * 4;
+
+   if (LP_DEBUG & DEBUG_TGSI) {
+      debug_printf("llvmpipe: Create compute shader #%u %p:\n",
+                   shader->no, (void *) shader);
+      tgsi_dump(shader->tokens, 0);
+   }
+
+   return shader;
+
+fail:
+   FREE((void *) shader->tokens);
+   FREE(shader);
+   return NULL;
+}
+
+
+static void
+llvmpipe_bind_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+
+   llvmpipe->cs = (struct lp_compute_shader *) cs;
+}
+
+
+static void
+llvmpipe_delete_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct lp_compute_shader *shader = cs;
+   struct lp_compute_shader_variant *variant, *next;
+
+   assert(llvmpipe_context(pipe)->cs != shader);
+
+   /* grids run synchronously, nothing can be using the variants */
+   for (variant = shader->variants; variant; variant = next) {
+      next = variant->next;
+      destroy_variant(variant);
+   }
+
+   FREE((void *) shader->tokens);
+   FREE(shader);
+}
+
+
+static void
+llvmpipe_set_compute_resources(struct pipe_context *pipe,
+                               unsigned start, unsigned count,
+                               struct pipe_surface **surfaces)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   unsigned i;
+
+   assert(start + count <= PIPE_MAX_SHADER_RESOURCES);
+
+   for (i = 0; i < count; i++) {
+      pipe_surface_reference(&llvmpipe->cs_resources[start + i],
+                             surfaces ? surfaces[i] : NULL);
+   }
+}
+
+
+static void
+llvmpipe_set_global_binding(struct pipe_context *pipe,
+                            unsigned first, unsigned count,
+                            struct pipe_resource **resources,
+                            uint32_t **handles)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   unsigned i;
+
+   assert(first + count <= LP_MAX_CS_GLOBALS);
+
+   for (i = 0; i < count; i++) {
+      pipe_resource_reference(&llvmpipe->cs_globals[first + i],
+                              resources ? resources[i] : NULL);
+
+      if (resources && resources[i]) {
+         /* the handle holds an offset into the buffer */
+         *handles[i] += (first + i) << LP_CS_GLOBAL_SHIFT;
+      }
+   }
+}
+
+
+/**
+ * Describe a resource bound with set_compute_resources() to the shader.
+ */
+static void
+setup_resource(struct lp_jit_cs_buffer *buffer,
+               struct pipe_surface *surface)
+{
+   struct pipe_resource *res;
+   struct llvmpipe_resource *lpr;
+
+   memset(buffer, 0, sizeof *buffer);
+
+   if (!surface)
+      return;
+
+   res = surface->texture;
+   lpr = llvmpipe_resource(res);
+
+   if (!llvmpipe_resource_is_texture(res)) {
+      unsigned size = util_format_get_blocksize(surface->format);
+      unsigned first = surface->u.buf.first_element * size;
+      unsigned last = (surface->u.buf.last_element + 1) * size;
+
+      last = MIN2(last, res->width0);
+      if (first >= last)
+         return;
+
+      buffer->base = (uint8_t *) lpr->data + first;
+      buffer->size = last - first;
+   }
+   else if (!lpr->dt) {
+      unsigned level = surface->u.tex.level;
+      unsigned layers = surface->u.tex.last_layer -
+                        surface->u.tex.first_layer + 1;
+      uint8_t *base;
+
+      /* the surface creation untiled it */
+      assert(!lpr->tiled);
+
+      base = (uint8_t *) llvmpipe_get_texture_image_all(lpr, level,
+                                                        LP_TEX_USAGE_READ_WRITE);
+      if (!base)
+         return;
+
+      buffer->row_stride = lpr->row_stride[level];
+      buffer->img_stride = lpr->img_stride[level];
+      buffer->base = base +
+                     surface->u.tex.first_layer * buffer->img_stride;
+      buffer->size = layers * buffer->img_stride;
+   }
+}
+
+
+/**
+ * State shared by the threads running a grid.
+ */
+struct lp_cs_job
+{
+   const struct lp_compute_shader *shader;
+   lp_jit_cs_func func;
+   struct lp_jit_cs_context context;
+
+   unsigned num_threads;    /**< per block */
+   unsigned num_groups;     /**< per block */
+
+   uint64_t first_block;
+   unsigned num_blocks;
+   unsigned next_block;     /**< next one to hand out, in num_blocks */
+   pipe_mutex mutex;
+};
+
+
+/**
+ * Run the blocks of a grid, lp_rast_job_func for lp_rast_run_jobs().
+ */
+static void
+cs_job(void *data, unsigned thread_index)
+{
+   struct lp_cs_job *job = data;
+   const struct lp_jit_cs_context *context = &job->context;
+   const unsigned length = job->shader->type.length;
+   const unsigned temps_size = job->shader->temps_size;
+   uint8_t *local_mem;
+   uint8_t *private_mem;
+   uint8_t *temps;
+   uint32_t *phases;
+
+   (void) thread_index;
+
+   local_mem = align_malloc(MAX2(context->local_size, 4), LP_CS_MEM_ALIGN);
+   private_mem = align_malloc(MAX2(context->private_size * job->num_threads, 4),
+                              LP_CS_MEM_ALIGN);
+   temps = align_malloc(MAX2(temps_size * job->num_groups, 4),
+                        LP_CS_MEM_ALIGN);
+   phases = MALLOC(job->num_groups * sizeof *phases);
+
+   if (!local_mem || !private_mem || !temps || !phases) {
+      debug_printf("llvmpipe: out of memory running a compute grid\n");
+      goto out;
+   }
+
+   while (1) {
+      uint64_t block;
+      unsigned x, y, z;
+      unsigned group;
+      boolean more;
+
+      pipe_mutex_lock(job->mutex);
+      block = job->next_block;
+      if (block < job->num_blocks)
+         job->next_block++;
+      pipe_mutex_unlock(job->mutex);
+
+      if (block >= job->num_blocks)
+         break;
+
+      block += job->first_block;
+      x = block % context->grid_size[0];
+      block /= context->grid_size[0];
+      y = block % context->grid_size[1];
+      z = block / context->grid_size[1];
+
+      /* Run every group up to the first barrier, then every group up to
+       * the next one, and so on.
+       */
+      for (group = 0; group < job->num_groups; group++) {
+         phases[group] = job->func(context, x, y, z, group * length,
+                                   local_mem, private_mem,
+                                   temps + group * temps_size, 0);
+      }
+
+      do {
+         more = FALSE;
+         for (group = 0; group < job->num_groups; group++) {
+            if (phases[group]) {
+               phases[group] = job->func(context, x, y, z, group * length,
+                                         local_mem, private_mem,
+                                         temps + group * temps_size,
+                                         phases[group]);
+               more |= phases[group] != 0;
+            }
+         }
+      } while (more);
+   }
+
+out:
+   align_free(local_mem);
+   align_free(private_mem);
+   align_free(temps);
+   FREE(phases);
+}
+
+
+static void
+llvmpipe_launch_grid(struct pipe_context *pipe,
+                     const uint *block_layout, const uint *grid_layout,
+                     uint32_t pc, const void *input)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct lp_compute_shader *shader = llvmpipe->cs;
+   struct lp_compute_shader_variant *variant;
+   struct lp_cs_job *job;
+   uint64_t num_blocks;
+   void *input_copy = NULL;
+   unsigned i;
+
+   if (!shader)
+      return;
+
+   if (pc >= shader->num_instructions) {
+      debug_printf("llvmpipe: compute entry point %u out of range\n", pc);
+      return;
+   }
+
+   for (i = 0; i < 3; i++) {
+      if (!block_layout[i] || !grid_layout[i])
+         return;
+   }
+
+   variant = get_variant(shader, pc);
+   if (!variant)
+      return;
+
+   /* Kernels may write to their input, keep the caller's intact */
+   if (input && shader->base.req_input_mem) {
+      input_copy = MALLOC(shader->base.req_input_mem);
+      if (!input_copy)
+         return;
+      memcpy(input_copy, input, shader->base.req_input_mem);
+   }
+
+   job = CALLOC_STRUCT(lp_cs_job);
+   if (!job) {
+      FREE(input_copy);
+      return;
+   }
+
+   /* The grid may access anything rendering produces */
+   llvmpipe_finish(pipe, __FUNCTION__);
+
+   job->shader = shader;
+   job->func = variant->jit_function;
+   job->num_threads = block_layout[0] * block_layout[1] * block_layout[2];
+   job->num_groups = (job->num_threads + shader->type.length - 1) /
+                      shader->type.length;
+   pipe_mutex_init(job->mutex);
+
+   for (i = 0; i < LP_MAX_TGSI_CONST_BUFFERS; i++) {
+      struct pipe_constant_buffer *cb =
+         &llvmpipe->constants[PIPE_SHADER_COMPUTE][i];
+      const ubyte *data = NULL;
+
+      if (cb->buffer)
+         data = (const ubyte *) llvmpipe_resource_data(cb->buffer);
+      else if (cb->user_buffer)
+         data = (const ubyte *) cb->user_buffer;
+
+      job->context.constants[i] =
+         (const float *) (data ? data + cb->buffer_offset : NULL);
+   }
+
+   for (i = 0; i < 3; i++) {
+      job->context.grid_size[i] = grid_layout[i];
+      job->context.block_size[i] = block_layout[i];
+   }
+   job->context.local_size = shader->base.req_local_mem;
+   job->context.private_size = align(shader->base.req_private_mem, 4);
+
+   if (input_copy) {
+      job->context.input.base = input_copy;
+      job->context.input.size = shader->base.req_input_mem;
+   }
+
+   for (i = 0; i < PIPE_MAX_SHADER_RESOURCES; i++) {
+      setup_resource(&job->context.resources[i], llvmpipe->cs_resources[i]);
+   }
+
+   for (i = 0; i < LP_MAX_CS_GLOBALS; i++) {
+      struct pipe_resource *res = llvmpipe->cs_globals[i];
+
+      if (res) {
+         job->context.globals[i].base = llvmpipe_resource_data(res);
+         job->context.globals[i].size =
+            MIN2(res->width0, 1 << LP_CS_GLOBAL_SHIFT);
+      }
+   }
+
+   num_blocks = (uint64_t) grid_layout[0] * grid_layout[1] * grid_layout[2];
+
+   pipe_mutex_lock(screen->rast_mutex);
+   for (job->first_block = 0;
+        job->first_block < num_blocks;
+        job->first_block += job->num_blocks) {
+      job->num_blocks = (unsigned) MIN2(num_blocks - job->first_block,
+                                        LP_CS_MAX_JOB_BLOCKS);
+      job->next_block = 0;
+      lp_rast_run_jobs(screen->rast, cs_job, job);
+   }
+   pipe_mutex_unlock(screen->rast_mutex);
+
+   pipe_mutex_destroy(job->mutex);
+   FREE(input_copy);
+   FREE(job);
+}
+
+
+void
+llvmpipe_cleanup_compute(struct llvmpipe_context *llvmpipe)
+{
+   unsigned i;
+
+   for (i = 0; i < Elements(llvmpipe->cs_resources); i++) {
+      pipe_surface_reference(&llvmpipe->cs_resources[i], NULL);
+   }
+
+   for (i = 0; i < Elements(llvmpipe->cs_globals); i++) {
+      pipe_resource_reference(&llvmpipe->cs_globals[i], NULL);
+   }
+}
+
+
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe)
+{
+   llvmpipe->pipe.create_compute_state = llvmpipe_create_compute_state;
+   llvmpipe->pipe.bind_compute_state = llvmpipe_bind_compute_state;
+   llvmpipe->pipe.delete_compute_state = llvmpipe_delete_compute_state;
+   llvmpipe->pipe.set_compute_resources = llvmpipe_set_compute_resources;
+   llvmpipe->pipe.set_global_binding = llvmpipe_set_global_binding;
+   llvmpipe->pipe.launch_grid = llvmpipe_launch_grid;
+}
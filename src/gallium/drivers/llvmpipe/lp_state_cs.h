@@ -0,0 +1,93 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Compute shaders.
+ *
+ * A grid is run on the rasterizer threads, each taking whole blocks.  The
+ * threads of a block are run in groups as wide as the SoA vectors, one
+ * group after the other, switching groups at each barrier.
+ *
+ * Barriers must be at the top level of the main function, and textures
+ * can't be sampled; shaders doing otherwise are rejected.
+ */
+
+#ifndef LP_STATE_CS_H
+#define LP_STATE_CS_H
+
+#include "pipe/p_state.h"
+#include "tgsi/tgsi_scan.h"
+#include "gallivm/lp_bld.h"
+#include "lp_jit.h"
+
+
+struct llvmpipe_context;
+struct lp_compute_shader;
+
+
+struct lp_compute_shader_variant
+{
+   struct lp_compute_shader *shader;
+   unsigned pc;                      /**< entry point */
+
+   struct gallivm_state *gallivm;
+
+   LLVMTypeRef jit_context_ptr_type;
+
+   LLVMValueRef function;
+   lp_jit_cs_func jit_function;
+
+   struct lp_compute_shader_variant *next;
+};
+
+
+struct lp_compute_shader
+{
+   struct pipe_compute_state base;
+   const struct tgsi_token *tokens;
+   struct tgsi_shader_info info;
+   unsigned num_instructions;
+
+   unsigned no;
+
+   struct lp_type type;   /**< SoA vector type, one lane per thread */
+   unsigned temps_size;   /**< bytes of temporaries per thread group */
+
+   /** One variant per entry point */
+   struct lp_compute_shader_variant *variants;
+};
+
+
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe);
+
+void
+llvmpipe_cleanup_compute(struct llvmpipe_context *llvmpipe);
+
+
+#endif /* LP_STATE_CS_H */
@@ -67,6 +67,8 @@
 #include "util/u_string.h"
 #include "util/u_simple_list.h"
 #include "util/u_dual_blend.h"
+#include "util/u_hash.h"
+#include "cso_cache/cso_hash.h"
 #include "os/os_time.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
@@ -83,6 +85,8 @@
 #include "gallivm/lp_bld_swizzle.h"
 #include "gallivm/lp_bld_flow.h"
 #include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_code_cache.h"
+#include "gallivm/lp_bld_disk_cache.h"
 #include "gallivm/lp_bld_arit.h"
 #include "gallivm/lp_bld_pack.h"
 #include "gallivm/lp_bld_format.h"
@@ -99,8 +103,11 @@
 #include "lp_state.h"
 #include "lp_tex_sample.h"
 #include "lp_flush.h"
+#include "lp_hiz.h"
 #include "lp_state_fs.h"
 #include "lp_rast.h"
+#include "lp_screen.h"
+#include "lp_texture.h"
 
 
 /** Fragment shader number (for debugging) */
@@ -390,7 +397,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
    lp_build_tgsi_soa(gallivm, tokens, type, &mask,
                      consts_ptr, &system_values,
                      interp->inputs,
-                     outputs, sampler, &shader->info.base, NULL);
+                     outputs, sampler, &shader->info.base, NULL, NULL);
 
    /* Alpha test */
    if (key->alpha.enabled) {
@@ -1529,7 +1536,9 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
    lp_mem_type_from_format_desc(out_format_desc, &dst_type);
 
    row_type.length = fs_type.length;
-   vector_width    = dst_type.floating ? lp_native_vector_width : lp_integer_vector_width;
+   /* rows are split into 128 or 256 bit vectors, even with 512 bit shaders */
+   vector_width    = dst_type.floating ? MIN2(lp_native_vector_width, 256)
+                                       : lp_integer_vector_width;
 
    /* Compute correct swizzle and count channels */
    memset(swizzle, LP_BLD_SWIZZLE_DONTCARE, TGSI_NUM_CHANNELS);
@@ -2000,8 +2009,7 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
  * 2x2 pixels.
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
-                  struct lp_fragment_shader *shader,
+generate_fragment(struct lp_fragment_shader *shader,
                   struct lp_fragment_shader_variant *variant,
                   unsigned partial_mask)
 {
@@ -2038,6 +2046,8 @@ generate_fragment(struct llvmpipe_context *lp,
    LLVMValueRef function;
    LLVMValueRef facing;
    unsigned num_fs;
+   unsigned num_blend_fs;
+   struct lp_type blend_fs_type;
    unsigned i;
    unsigned chan;
    unsigned cbuf;
@@ -2077,7 +2087,8 @@ generate_fragment(struct llvmpipe_context *lp,
    fs_type.sign = TRUE;          /* values are signed */
    fs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
    fs_type.width = 32;           /* 32-bit float */
-   fs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
+   /* n*4 elements per vector; 1d resources only cover half a stamp */
+   fs_type.length = MIN2(lp_native_vector_width / 32, key->resource_1d ? 8 : 16);
 
    memset(&blend_type, 0, sizeof blend_type);
    blend_type.floating = FALSE; /* values are integers */
@@ -2247,6 +2258,42 @@ generate_fragment(struct llvmpipe_context *lp,
             }
          }
       }
+
+      /*
+       * Blending works on at most 256 bits per row, so a 16-wide shader
+       * (one vector per 4x4 stamp) hands its results over as two 8-wide
+       * halves, which is exactly the layout an 8-wide shader produces.
+       */
+      blend_fs_type = fs_type;
+      num_blend_fs = num_fs;
+      if (fs_type.length > 8) {
+         const unsigned num_outs = dual_source_blend ? MAX2(key->nr_cbufs, 2)
+                                                     : key->nr_cbufs;
+         LLVMTypeRef half_ptr_type;
+         LLVMValueRef mask = fs_mask[0];
+         unsigned j;
+
+         assert(num_fs == 1);
+         blend_fs_type.length = 8;
+         num_blend_fs = fs_type.length / blend_fs_type.length;
+         half_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, blend_fs_type), 0);
+
+         for (j = 0; j < num_blend_fs; j++) {
+            fs_mask[j] = lp_build_extract_range(gallivm, mask, j * 8, 8);
+         }
+         for (cbuf = 0; cbuf < num_outs; cbuf++) {
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
+               LLVMValueRef ptr = LLVMBuildBitCast(builder,
+                                                   fs_out_color[cbuf][chan][0],
+                                                   half_ptr_type, "");
+               for (j = 0; j < num_blend_fs; j++) {
+                  LLVMValueRef indexj = lp_build_const_int32(gallivm, j);
+                  fs_out_color[cbuf][chan][j] = LLVMBuildGEP(builder, ptr,
+                                                             &indexj, 1, "");
+               }
+            }
+         }
+      }
    }
 
    sampler->destroy(sampler);
@@ -2274,15 +2321,13 @@ generate_fragment(struct llvmpipe_context *lp,
                              "");
 
       generate_unswizzled_blend(gallivm, cbuf, variant, key->cbuf_format[cbuf],
-                                num_fs, fs_type, fs_mask, fs_out_color,
+                                num_blend_fs, blend_fs_type, fs_mask, fs_out_color,
                                 context_ptr, color_ptr, stride, partial_mask, do_branch);
    }
 
    LLVMBuildRetVoid(builder);
 
    gallivm_verify_function(gallivm, function);
-
-   variant->nr_instrs += lp_build_count_instructions(function);
 }
 
 
@@ -2382,19 +2427,311 @@ lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant)
    tgsi_dump(variant->shader->base.tokens, 0);
    dump_fs_variant_key(&variant->key);
    debug_printf("variant->opaque = %u\n", variant->opaque);
+   debug_printf("variant->hiz = 0x%x\n", variant->hiz);
    debug_printf("\n");
 }
 
 
+/**
+ * Hash a fragment shader variant key.  The variants of all the shaders
+ * share one table per context, so the shader is part of the hash too.
+ */
+unsigned
+lp_fs_variant_hash(const struct lp_fragment_shader *shader,
+                   const struct lp_fragment_shader_variant_key *key)
+{
+   return util_hash_fast(key, shader->variant_key_size) ^ shader->no;
+}
+
+
+/**
+ * Find the shader's variant matching the key, or NULL.
+ */
+struct lp_fragment_shader_variant *
+lp_fs_variant_lookup(struct cso_hash *variants_hash,
+                     const struct lp_fragment_shader *shader,
+                     const struct lp_fragment_shader_variant_key *key,
+                     unsigned hash)
+{
+   struct cso_hash_iter iter = cso_hash_find(variants_hash, hash);
+
+   while (!cso_hash_iter_is_null(iter) && cso_hash_iter_key(iter) == hash) {
+      struct lp_fragment_shader_variant *variant = cso_hash_iter_data(iter);
+
+      if (variant->shader == shader &&
+          memcmp(&variant->key, key, shader->variant_key_size) == 0)
+         return variant;
+
+      iter = cso_hash_iter_next(iter);
+   }
+
+   return NULL;
+}
+
+
+/**
+ * Build the disk cache key of a fragment shader variant.
+ */
+static void
+make_cache_key(const struct lp_fragment_shader *shader,
+               const struct lp_fragment_shader_variant_key *key,
+               enum gallivm_tier tier,
+               struct gallivm_cache_key *cache_key)
+{
+   gallivm_cache_key_init(cache_key, "llvmpipe fs");
+   gallivm_cache_key_add(cache_key, shader->base.tokens,
+                         tgsi_num_tokens(shader->base.tokens) *
+                         sizeof(struct tgsi_token));
+   gallivm_cache_key_add(cache_key, key, shader->variant_key_size);
+   gallivm_cache_key_add(cache_key, &tier, sizeof tier);
+   /* PERF_NO_TEX is baked into the sampling code */
+   gallivm_cache_key_add(cache_key, &LP_PERF, sizeof LP_PERF);
+}
+
+
+/**
+ * Generate, optimize and JIT the code of a fragment shader variant at the
+ * given tier into code, and share it through the code cache.
+ *
+ * This may run in the background compile thread, so it must only touch
+ * the variant's LLVM objects and immutable fields, and the shader's
+ * immutable fields.
+ */
+static boolean
+compile_variant(struct lp_fragment_shader_variant *variant,
+                struct gallivm_code *code,
+                enum gallivm_tier tier,
+                LLVMContextRef context)
+{
+   struct lp_fragment_shader *shader = variant->shader;
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   struct gallivm_cache_key cache_key;
+   boolean need_key = variant->code_cache || gallivm_disk_cache_enabled();
+   boolean cached = FALSE;
+   int64_t t0;
+   unsigned i;
+
+   t0 = os_time_get();
+
+   variant->gallivm = gallivm_create_tiered(context, tier);
+   if (!variant->gallivm) {
+      return FALSE;
+   }
+
+   code->gallivm = variant->gallivm;
+   memset(variant->function, 0, sizeof variant->function);
+
+   lp_jit_init_types(variant);
+
+   if (need_key) {
+      make_cache_key(shader, key, tier, &cache_key);
+   }
+
+   if (gallivm_disk_cache_enabled()) {
+      cached = gallivm_disk_cache_load(variant->gallivm, &cache_key,
+                                       variant->function,
+                                       Elements(variant->function));
+   }
+
+   if (!cached) {
+      generate_fragment(shader, variant, RAST_EDGE_TEST);
+
+      if (variant->opaque) {
+         /* Specialized shader, which doesn't need to read the color buffer. */
+         generate_fragment(shader, variant, RAST_WHOLE);
+      }
+
+      if (gallivm_disk_cache_enabled()) {
+         gallivm_disk_cache_store(variant->gallivm, &cache_key,
+                                  variant->function,
+                                  Elements(variant->function));
+      }
+   }
+
+   /*
+    * Compile everything
+    */
+
+   gallivm_compile_module(variant->gallivm);
+
+   /* The code object owns the LLVM objects from now on */
+   code->num_functions = Elements(variant->function);
+   for (i = 0; i < Elements(variant->function); i++) {
+      code->functions[i] = variant->function[i];
+      if (variant->function[i]) {
+         code->jit_functions[i] =
+            gallivm_jit_function(variant->gallivm, variant->function[i]);
+         code->nr_instrs += lp_build_count_instructions(variant->function[i]);
+      }
+   }
+
+   if (!code->jit_functions[RAST_WHOLE]) {
+      code->jit_functions[RAST_WHOLE] = code->jit_functions[RAST_EDGE_TEST];
+   }
+
+   variant->gallivm = NULL;
+
+   if (variant->code_cache) {
+      gallivm_code_cache_add(variant->code_cache, code, &cache_key);
+   }
+
+   if (need_key) {
+      gallivm_cache_key_release(&cache_key);
+   }
+
+   variant->compile_time = os_time_get() - t0;
+
+   return TRUE;
+}
+
+
+/**
+ * Make the variant run the given code.
+ */
+static void
+install_code(struct lp_fragment_shader_variant *variant,
+             struct gallivm_code *code)
+{
+   unsigned i;
+
+   for (i = 0; i < Elements(variant->jit_function); i++) {
+      variant->jit_function[i] = (lp_jit_frag_func) code->jit_functions[i];
+   }
+   variant->nr_instrs = code->nr_instrs;
+}
+
+
+static void
+compile_variant_job(struct lp_compile_job *job, LLVMContextRef context)
+{
+   struct lp_fragment_shader_variant *variant = job->data;
+
+   if (compile_variant(variant, variant->code, variant->tier, context)) {
+      install_code(variant, variant->code);
+   }
+   else {
+      /* The context compiles it again when it retires the job, see
+       * recompile_variant().
+       */
+      variant->failed = TRUE;
+   }
+}
+
+
+/**
+ * Build the optimized code of a hot variant.  The context installs it
+ * once it notices the job is done, see llvmpipe_retire_fs_compiles().
+ */
+static void
+tier_up_variant_job(struct lp_compile_job *job, LLVMContextRef context)
+{
+   struct lp_fragment_shader_variant *variant = job->data;
+
+   if (!compile_variant(variant, variant->tier_code, GALLIVM_TIER_OPT,
+                        context)) {
+      /* Keep running the fast code */
+      gallivm_code_reference(&variant->tier_code, NULL);
+   }
+}
+
+
+static void
+destroy_code_job(struct lp_compile_job *job, LLVMContextRef context)
+{
+   (void) context;
+   gallivm_code_destroy(job->data);
+   FREE(job);
+}
+
+
+/**
+ * Destroy hook of code compiled in the background: its LLVM objects can
+ * only be freed in the compile thread.  Whichever context or cache drops
+ * the last reference, the destruction is queued there.
+ */
+static void
+destroy_code_async(struct gallivm_code *code, void *data)
+{
+   struct lp_compile_queue *queue = data;
+   struct lp_compile_job *job = CALLOC_STRUCT(lp_compile_job);
+
+   /* Leak the code rather than freeing it in the wrong thread */
+   if (job) {
+      lp_compile_queue_add(queue, job, destroy_code_job, code);
+   }
+}
+
+
+/**
+ * Create an empty code object for the variant.
+ */
+static struct gallivm_code *
+create_code(struct llvmpipe_screen *screen)
+{
+   struct gallivm_code *code = gallivm_code_create(NULL);
+
+   if (code && screen->compile_queue) {
+      code->destroy = destroy_code_async;
+      code->destroy_data = screen->compile_queue;
+   }
+
+   return code;
+}
+
+
+/**
+ * Look the code of a variant up in the screen's code cache.
+ */
+static struct gallivm_code *
+lookup_code(struct llvmpipe_screen *screen,
+            const struct lp_fragment_shader_variant *variant,
+            enum gallivm_tier tier)
+{
+   struct gallivm_cache_key cache_key;
+   struct gallivm_code *code;
+
+   if (!screen->code_cache)
+      return NULL;
+
+   make_cache_key(variant->shader, &variant->key, tier, &cache_key);
+   code = gallivm_code_cache_lookup(screen->code_cache, &cache_key);
+   gallivm_cache_key_release(&cache_key);
+
+   return code;
+}
+
+
+/**
+ * Release the variant's code and free the variant.
+ */
+static void
+destroy_variant(struct lp_fragment_shader_variant *variant)
+{
+   gallivm_code_reference(&variant->code, NULL);
+   gallivm_code_reference(&variant->fast_code, NULL);
+   gallivm_code_reference(&variant->tier_code, NULL);
+   FREE(variant);
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
+ *
+ * With tiered compilation the code is first built quickly, and rebuilt
+ * with all optimizations once the variant turns out to be hot.  With a
+ * compile queue the code is built quickly as well, and the optimized code
+ * is built in the background while the draws use the quick code.  Only if
+ * the quick code can't be built either is the whole variant generated in
+ * the background, and then it must not be rasterized before its
+ * compile_seqno is reached.
  */
 static struct lp_fragment_shader_variant *
 generate_variant(struct llvmpipe_context *lp,
                  struct lp_fragment_shader *shader,
                  const struct lp_fragment_shader_variant_key *key)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc;
    boolean fullcolormask;
@@ -2403,15 +2740,10 @@ generate_variant(struct llvmpipe_context *lp,
    if(!variant)
       return NULL;
 
-   variant->gallivm = gallivm_create();
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
-   }
-
    variant->shader = shader;
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
+   variant->list_item_compiling.base = variant;
    variant->no = shader->variants_created++;
 
    memcpy(&variant->key, key, shader->variant_key_size);
@@ -2435,6 +2767,38 @@ generate_variant(struct llvmpipe_context *lp,
          !shader->info.base.uses_kill
       ? TRUE : FALSE;
 
+   /*
+    * Hierarchical Z can skip fragments which would fail a LESS, LEQUAL or
+    * EQUAL depth test, provided they have no other side effects.  When
+    * fragments are also guaranteed to store their depth where the test
+    * passes, covered blocks end up below the primitive.  Any other depth
+    * function may increase the depth values.
+    */
+   variant->hiz = 0;
+   if (key->depth.enabled &&
+       (key->depth.func == PIPE_FUNC_LESS ||
+        key->depth.func == PIPE_FUNC_LEQUAL ||
+        key->depth.func == PIPE_FUNC_EQUAL) &&
+       !key->stencil[0].enabled &&
+       !shader->info.base.writes_z) {
+      variant->hiz |= LP_HIZ_TEST;
+      if (key->depth.func != PIPE_FUNC_EQUAL &&
+          key->depth.writemask &&
+          !key->alpha.enabled &&
+          !key->blend.alpha_to_coverage &&
+          !shader->info.base.uses_kill) {
+         variant->hiz |= LP_HIZ_UPDATE;
+      }
+   }
+   else if (key->depth.enabled &&
+            key->depth.writemask &&
+            key->depth.func != PIPE_FUNC_NEVER &&
+            key->depth.func != PIPE_FUNC_LESS &&
+            key->depth.func != PIPE_FUNC_LEQUAL &&
+            key->depth.func != PIPE_FUNC_EQUAL) {
+      variant->hiz |= LP_HIZ_INVALIDATE;
+   }
+
    if ((shader->info.base.num_tokens <= 1) &&
        !key->depth.enabled && !key->stencil[0].enabled) {
       variant->ps_inv_multiplier = 0;
@@ -2446,42 +2810,306 @@ generate_variant(struct llvmpipe_context *lp,
       lp_debug_fs_variant(variant);
    }
 
-   lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+   variant->code_cache = screen->code_cache;
+   variant->tier = screen->fs_tier_up_draws || screen->compile_queue
+      ? GALLIVM_TIER_FAST : GALLIVM_TIER_OPT;
 
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
-      }
+   /* Another context may have compiled the same code already */
+   variant->code = lookup_code(screen, variant, GALLIVM_TIER_OPT);
+   if (variant->code) {
+      variant->tier = GALLIVM_TIER_OPT;
+   }
+   else if (variant->tier == GALLIVM_TIER_FAST) {
+      variant->code = lookup_code(screen, variant, GALLIVM_TIER_FAST);
    }
 
-   /*
-    * Compile everything
-    */
+   if (variant->code) {
+      install_code(variant, variant->code);
+      variant->shared = TRUE;
+      return variant;
+   }
 
-   gallivm_compile_module(variant->gallivm);
+   if (variant->tier == GALLIVM_TIER_FAST) {
+      /* Built in this thread, so it must be destroyed synchronously */
+      variant->code = gallivm_code_create(NULL);
+      if (variant->code &&
+          compile_variant(variant, variant->code, variant->tier, NULL)) {
+         install_code(variant, variant->code);
+         return variant;
+      }
+      gallivm_code_reference(&variant->code, NULL);
+      variant->tier = GALLIVM_TIER_OPT;
+   }
 
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST]);
+   variant->code = create_code(screen);
+   if (!variant->code) {
+      FREE(variant);
+      return NULL;
    }
 
-   if (variant->function[RAST_WHOLE]) {
-         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-               gallivm_jit_function(variant->gallivm,
-                                    variant->function[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   if (screen->compile_queue) {
+      variant->async = TRUE;
+      variant->compile_seqno =
+         lp_compile_queue_add(screen->compile_queue, &variant->compile_job,
+                              compile_variant_job, variant);
+      insert_at_head(&lp->fs_variants_compiling,
+                     &variant->list_item_compiling);
+   }
+   else if (compile_variant(variant, variant->code, variant->tier, NULL)) {
+      install_code(variant, variant->code);
+   }
+   else {
+      destroy_variant(variant);
+      return NULL;
    }
 
    return variant;
 }
 
 
+/**
+ * Account for a compilation of the variant's code at the given tier.
+ */
+static void
+count_compile(struct llvmpipe_context *lp,
+              struct lp_fragment_shader_variant *variant,
+              enum gallivm_tier tier)
+{
+   lp->nr_fs_compiles++;
+   lp->fs_compile_time += variant->compile_time;
+   if (variant->async) {
+      LP_COUNT_ADD(llvm_async_compile_time, variant->compile_time);
+   }
+   LP_COUNT_ADD(llvm_compile_time, variant->compile_time);
+   LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
+   LP_COUNT(nr_tier_compiles[tier]);
+   LP_COUNT_ADD(tier_compile_time[tier], variant->compile_time);
+}
+
+
+/**
+ * Account for the variant once its code is available.  Only code compiled
+ * for this context counts as a compile.
+ */
+static void
+finish_variant(struct llvmpipe_context *lp,
+               struct lp_fragment_shader_variant *variant)
+{
+   lp->nr_fs_instrs += variant->nr_instrs;
+   if (!variant->shared)
+      count_compile(lp, variant, variant->tier);
+}
+
+
+/**
+ * Switch a variant over to its optimized code.
+ */
+static void
+finish_tier_up(struct llvmpipe_context *lp,
+               struct lp_fragment_shader_variant *variant,
+               struct gallivm_code *code)
+{
+   /* Scenes still being rasterized may be running the fast code */
+   assert(!variant->fast_code);
+   variant->fast_code = variant->code;
+   variant->code = code;
+
+   lp->nr_fs_instrs -= variant->nr_instrs;
+   install_code(variant, code);
+   lp->nr_fs_instrs += variant->nr_instrs;
+
+   variant->tier = GALLIVM_TIER_OPT;
+   LP_COUNT(nr_tier_ups);
+}
+
+
+/**
+ * Rebuild the variant at the optimized tier, in the background if there
+ * is a compile queue.  The variant keeps running its fast code meanwhile.
+ */
+static void
+tier_up_variant(struct llvmpipe_context *lp,
+                struct lp_fragment_shader_variant *variant)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct gallivm_code *code;
+
+   /* Another context may have done it already */
+   code = lookup_code(screen, variant, GALLIVM_TIER_OPT);
+   if (code) {
+      finish_tier_up(lp, variant, code);
+      return;
+   }
+
+   code = create_code(screen);
+   if (!code)
+      return;
+
+   if (screen->compile_queue) {
+      variant->async = TRUE;
+      variant->tier_code = code;
+      variant->tier_seqno =
+         lp_compile_queue_add(screen->compile_queue, &variant->compile_job,
+                              tier_up_variant_job, variant);
+      insert_at_head(&lp->fs_variants_compiling,
+                     &variant->list_item_compiling);
+   }
+   else if (compile_variant(variant, code, GALLIVM_TIER_OPT, NULL)) {
+      count_compile(lp, variant, GALLIVM_TIER_OPT);
+      finish_tier_up(lp, variant, code);
+   }
+   else {
+      gallivm_code_reference(&code, NULL);
+   }
+}
+
+
+/**
+ * Count a draw with the bound fragment shader variant, and have it
+ * rebuilt at the optimized tier when it gets hot.
+ */
+void
+llvmpipe_count_fs_draw(struct llvmpipe_context *lp)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fragment_shader_variant *variant = lp->fs_variant;
+
+   if (!variant ||
+       variant->tier != GALLIVM_TIER_FAST ||
+       variant->compile_seqno ||
+       ++variant->nr_draws != screen->fs_tier_up_draws)
+      return;
+
+   tier_up_variant(lp, variant);
+}
+
+
+/**
+ * Stand-in for the code of a variant which could not be compiled at all.
+ * It leaves the color and depth buffers alone, so the draws already
+ * binned with the variant are dropped.
+ */
+static void
+null_fragment_function(const struct lp_jit_context *context,
+                       uint32_t x,
+                       uint32_t y,
+                       uint32_t facing,
+                       const void *a0,
+                       const void *dadx,
+                       const void *dady,
+                       uint8_t **color,
+                       uint8_t *depth,
+                       uint32_t mask,
+                       struct lp_jit_thread_data *thread_data,
+                       unsigned *stride,
+                       unsigned depth_stride)
+{
+}
+
+
+/**
+ * Compile the code of a variant whose background compilation failed in
+ * this thread, before any scene using it is rasterized.
+ */
+static void
+recompile_variant(struct llvmpipe_context *lp,
+                  struct lp_fragment_shader_variant *variant)
+{
+   struct gallivm_code *code = gallivm_code_create(NULL);
+   unsigned i;
+
+   variant->failed = FALSE;
+   variant->async = FALSE;
+
+   if (code && compile_variant(variant, code, variant->tier, NULL)) {
+      gallivm_code_reference(&variant->code, code);
+      gallivm_code_reference(&code, NULL);
+      install_code(variant, variant->code);
+      return;
+   }
+
+   gallivm_code_reference(&code, NULL);
+
+   debug_printf("llvmpipe: failed to compile fs variant, dropping its draws\n");
+
+   for (i = 0; i < Elements(variant->jit_function); i++) {
+      variant->jit_function[i] = null_fragment_function;
+   }
+   variant->nr_instrs = 0;
+
+   /* Nothing is written, so the depth buffer doesn't get any lower */
+   variant->hiz &= ~LP_HIZ_UPDATE;
+}
+
+
+/**
+ * Sequence number of the variant's pending background job.
+ */
+static INLINE unsigned
+pending_seqno(const struct lp_fragment_shader_variant *variant)
+{
+   return variant->compile_seqno ? variant->compile_seqno
+                                 : variant->tier_seqno;
+}
+
+
+/**
+ * Account for background compilations which have finished, or wait for
+ * all of them to finish when wait is set.  Variants whose compilation
+ * failed are compiled again here, so they never run without code.
+ */
+void
+llvmpipe_retire_fs_compiles(struct llvmpipe_context *lp, boolean wait)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fs_variant_list_item *li;
+
+   if (is_empty_list(&lp->fs_variants_compiling))
+      return;
+
+   if (wait) {
+      /* The list is newest first */
+      int64_t dt;
+
+      li = first_elem(&lp->fs_variants_compiling);
+      dt = lp_compile_queue_wait(screen->compile_queue,
+                                 pending_seqno(li->base));
+      lp->fs_compile_wait_time += dt;
+      LP_COUNT_ADD(llvm_compile_wait_time, dt);
+   }
+
+   /* Jobs finish in order, so stop at the oldest one still pending */
+   li = last_elem(&lp->fs_variants_compiling);
+   while (!at_end(&lp->fs_variants_compiling, li)) {
+      struct lp_fs_variant_list_item *prev = prev_elem(li);
+      struct lp_fragment_shader_variant *variant = li->base;
+
+      if (!lp_compile_queue_is_done(screen->compile_queue,
+                                    pending_seqno(variant)))
+         break;
+
+      remove_from_list(li);
+      if (variant->compile_seqno) {
+         variant->compile_seqno = 0;
+         if (variant->failed)
+            recompile_variant(lp, variant);
+         finish_variant(lp, variant);
+      }
+      else {
+         struct gallivm_code *code = variant->tier_code;
+
+         variant->tier_seqno = 0;
+         variant->tier_code = NULL;
+         if (code) {
+            count_compile(lp, variant, GALLIVM_TIER_OPT);
+            finish_tier_up(lp, variant, code);
+         }
+      }
+      li = prev;
+   }
+}
+
+
 static void *
 llvmpipe_create_fs_state(struct pipe_context *pipe,
                          const struct pipe_shader_state *templ)
@@ -2602,8 +3230,6 @@ void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant)
 {
-   unsigned i;
-
    if (gallivm_debug & GALLIVM_DEBUG_IR) {
       debug_printf("llvmpipe: del fs #%u var #%u v created #%u v cached"
                    " #%u v total cached #%u\n",
@@ -2614,16 +3240,14 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants);
    }
 
-   /* free all the variant's JIT'd functions */
-   for (i = 0; i < Elements(variant->function); i++) {
-      if (variant->function[i]) {
-         gallivm_free_function(variant->gallivm,
-                               variant->function[i],
-                               variant->jit_function[i]);
-      }
-   }
+   /* must have been retired by llvmpipe_retire_fs_compiles() */
+   assert(!variant->compile_seqno);
+   assert(!variant->tier_seqno);
+
+   if (lp->fs_variant == variant)
+      lp->fs_variant = NULL;
 
-   gallivm_destroy(variant->gallivm);
+   cso_hash_erase_data(lp->fs_variants_hash, variant->hash, variant);
 
    /* remove from shader's list */
    remove_from_list(&variant->list_item_local);
@@ -2634,7 +3258,7 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
    lp->nr_fs_variants--;
    lp->nr_fs_instrs -= variant->nr_instrs;
 
-   FREE(variant);
+   destroy_variant(variant);
 }
 
 
@@ -2653,6 +3277,7 @@ llvmpipe_delete_fs_state(struct pipe_context *pipe, void *fs)
     * Flushing alone might not sufficient we need to wait on it too.
     */
    llvmpipe_finish(pipe, __FUNCTION__);
+   llvmpipe_retire_fs_compiles(llvmpipe, TRUE);
 
    /* Delete all the variants */
    li = first_elem(&shader->variants);
@@ -2739,6 +3364,22 @@ force_dst_alpha_one(unsigned factor, boolean clamped_zero)
 }
 
 
+/**
+ * The static texture state of a fragment shader sampler view, including
+ * the layout of the texture.
+ */
+static void
+fs_texture_state(struct lp_static_texture_state *state,
+                 struct pipe_sampler_view *view)
+{
+   lp_sampler_static_texture_state(state, view);
+
+   if (view && llvmpipe_resource_is_texture(view->texture)) {
+      state->tiled = llvmpipe_resource(view->texture)->tiled;
+   }
+}
+
+
 /**
  * We need to generate several variants of the fragment pipeline to match
  * all the combinations of the contributing state atoms.
@@ -2885,8 +3526,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] + 1;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1 << i)) {
-            lp_sampler_static_texture_state(&key->state[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            fs_texture_state(&key->state[i].texture_state,
+                             lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -2894,8 +3535,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = key->nr_samplers;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
-            lp_sampler_static_texture_state(&key->state[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            fs_texture_state(&key->state[i].texture_state,
+                             lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -2913,19 +3554,15 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    struct lp_fragment_shader *shader = lp->fs;
    struct lp_fragment_shader_variant_key key;
    struct lp_fragment_shader_variant *variant = NULL;
-   struct lp_fs_variant_list_item *li;
+   unsigned hash;
+
+   llvmpipe_retire_fs_compiles(lp, FALSE);
 
    make_variant_key(lp, shader, &key);
 
    /* Search the variants for one which matches the key */
-   li = first_elem(&shader->variants);
-   while(!at_end(&shader->variants, li)) {
-      if(memcmp(&li->base->key, &key, shader->variant_key_size) == 0) {
-         variant = li->base;
-         break;
-      }
-      li = next_elem(li);
-   }
+   hash = lp_fs_variant_hash(shader, &key);
+   variant = lp_fs_variant_lookup(lp->fs_variants_hash, shader, &key, hash);
 
    if (variant) {
       /* Move this variant to the head of the list to implement LRU
@@ -2935,7 +3572,6 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    }
    else {
       /* variant not found, create it now */
-      int64_t t0, t1, dt;
       unsigned i;
       unsigned variants_to_cull;
 
@@ -2961,6 +3597,7 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
           * Flushing alone might not be sufficient we need to wait on it too.
           */
          llvmpipe_finish(pipe, __FUNCTION__);
+         llvmpipe_retire_fs_compiles(lp, TRUE);
 
          /*
           * We need to re-check lp->nr_fs_variants because an arbitrarliy large
@@ -2983,26 +3620,33 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       /*
        * Generate the new variant.
        */
-      t0 = os_time_get();
       variant = generate_variant(lp, shader, &key);
-      t1 = os_time_get();
-      dt = t1 - t0;
-      LP_COUNT_ADD(llvm_compile_time, dt);
-      LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
 
       llvmpipe_variant_count++;
 
       /* Put the new variant into the list */
       if (variant) {
+         variant->hash = hash;
+         cso_hash_insert(lp->fs_variants_hash, hash, variant);
          insert_at_head(&shader->variants, &variant->list_item_local);
          insert_at_head(&lp->fs_variants_list, &variant->list_item_global);
          lp->nr_fs_variants++;
-         lp->nr_fs_instrs += variant->nr_instrs;
          shader->variants_cached++;
+         if (!variant->async)
+            finish_variant(lp, variant);
+
+         /* Without a hotness threshold, start building the optimized
+          * code right away, and draw with the fast code until it's done.
+          */
+         if (variant->tier == GALLIVM_TIER_FAST &&
+             !variant->compile_seqno &&
+             !llvmpipe_screen(lp->pipe.screen)->fs_tier_up_draws)
+            tier_up_variant(lp, variant);
       }
    }
 
    /* Bind this variant */
+   lp->fs_variant = variant;
    lp_setup_set_fs_variant(lp->setup, variant);
 }
 
@@ -36,10 +36,14 @@
 #include "gallivm/lp_bld_sample.h" /* for struct lp_sampler_static_state */
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
+#include "lp_compile_queue.h" /* for struct lp_compile_job */
 
 
 struct tgsi_token;
+struct cso_hash;
 struct lp_fragment_shader;
+struct gallivm_code;
+struct gallivm_code_cache;
 
 
 /** Indexes into jit_function[] array */
@@ -96,9 +100,14 @@ struct lp_fragment_shader_variant
 {
    struct lp_fragment_shader_variant_key key;
 
+   /** Index of the variant in llvmpipe_context::fs_variants_hash */
+   unsigned hash;
+
    boolean opaque;
+   unsigned hiz;  /**< LP_HIZ_x flags */
    uint8_t ps_inv_multiplier;
 
+   /* LLVM objects, only valid while the code is generated */
    struct gallivm_state *gallivm;
 
    LLVMTypeRef jit_context_ptr_type;
@@ -107,12 +116,45 @@ struct lp_fragment_shader_variant
 
    LLVMValueRef function[2];
 
+   /** The JIT'd code, possibly shared with other contexts */
+   struct gallivm_code *code;
+   struct gallivm_code_cache *code_cache;
+   boolean shared;  /**< code found in the cache, nothing compiled */
+
+   /*
+    * Tiered compilation.  tier is the GALLIVM_TIER_x of the installed code.
+    * Fast code is rebuilt at the optimized tier after a number of draws,
+    * or right away in the background with a compile queue, and kept alive
+    * until the variant is destroyed as scenes in flight may still run it.
+    */
+   unsigned tier;
+   unsigned nr_draws;
+   struct gallivm_code *tier_code;  /**< optimized code being built */
+   unsigned tier_seqno;             /**< background job building it */
+   struct gallivm_code *fast_code;
+
    lp_jit_frag_func jit_function[2];
 
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
+   /* Time spent generating and compiling the code, in usecs */
+   int64_t compile_time;
+
+   /*
+    * Background compilation.  The LLVM objects of asynchronously compiled
+    * code live in the compile thread's context, so they are destroyed
+    * there too, see destroy_code_async().  compile_seqno is non-zero until
+    * the context has noticed that the compilation finished.  failed is
+    * set by the compile thread when there is no code to install.
+    */
+   boolean async;
+   boolean failed;
+   unsigned compile_seqno;
+   struct lp_compile_job compile_job;
+
    struct lp_fs_variant_list_item list_item_global, list_item_local;
+   struct lp_fs_variant_list_item list_item_compiling;
    struct lp_fragment_shader *shader;
 
    /* For debugging/profiling purposes */
@@ -145,10 +187,26 @@ struct lp_fragment_shader
 void
 lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant);
 
+unsigned
+lp_fs_variant_hash(const struct lp_fragment_shader *shader,
+                   const struct lp_fragment_shader_variant_key *key);
+
+struct lp_fragment_shader_variant *
+lp_fs_variant_lookup(struct cso_hash *variants_hash,
+                     const struct lp_fragment_shader *shader,
+                     const struct lp_fragment_shader_variant_key *key,
+                     unsigned hash);
+
 void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant);
 
+void
+llvmpipe_retire_fs_compiles(struct llvmpipe_context *lp, boolean wait);
+
+void
+llvmpipe_count_fs_draw(struct llvmpipe_context *lp);
+
 boolean
 llvmpipe_rasterization_disabled(struct llvmpipe_context *lp);
 
@@ -37,6 +37,7 @@
 #include "lp_context.h"
 #include "lp_screen.h"
 #include "lp_state.h"
+#include "lp_texture.h"
 #include "lp_debug.h"
 #include "state_tracker/sw_winsys.h"
 
@@ -149,6 +150,12 @@ llvmpipe_set_sampler_views(struct pipe_context *pipe,
    }
 
    if (shader == PIPE_SHADER_VERTEX || shader == PIPE_SHADER_GEOMETRY) {
+      /* The draw module's samplers only know about linear images */
+      for (i = 0; i < num; i++) {
+         if (views[i] && views[i]->texture)
+            llvmpipe_untile_resource(pipe, views[i]->texture);
+      }
+
       draw_set_sampler_views(llvmpipe->draw,
                              shader,
                              llvmpipe->sampler_views[shader],
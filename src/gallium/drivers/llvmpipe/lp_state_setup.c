@@ -29,11 +29,15 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_simple_list.h"
+#include "util/u_hash.h"
+#include "cso_cache/cso_hash.h"
 #include "os/os_time.h"
 #include "gallivm/lp_bld_arit.h"
 #include "gallivm/lp_bld_bitarit.h"
+#include "gallivm/lp_bld_code_cache.h"
 #include "gallivm/lp_bld_const.h"
 #include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_disk_cache.h"
 #include "gallivm/lp_bld_init.h"
 #include "gallivm/lp_bld_logic.h"
 #include "gallivm/lp_bld_intr.h"
@@ -683,44 +687,19 @@ init_args(struct gallivm_state *gallivm,
 }
 
 /**
- * Generate the runtime callable function for the coefficient calculation.
- *
+ * Emit the LLVM IR of the coefficient calculation function.
  */
-static struct lp_setup_variant *
-generate_setup_variant(struct lp_setup_variant_key *key,
-                       struct llvmpipe_context *lp)
+static boolean
+generate_setup_function(struct gallivm_state *gallivm,
+                        struct lp_setup_variant *variant)
 {
-   struct lp_setup_variant *variant = NULL;
-   struct gallivm_state *gallivm;
    struct lp_setup_args args;
    char func_name[256];
    LLVMTypeRef vec4f_type;
    LLVMTypeRef func_type;
    LLVMTypeRef arg_types[7];
    LLVMBasicBlockRef block;
-   LLVMBuilderRef builder;
-   int64_t t0 = 0, t1;
-
-   if (0)
-      goto fail;
-
-   variant = CALLOC_STRUCT(lp_setup_variant);
-   if (variant == NULL)
-      goto fail;
-
-   variant->gallivm = gallivm = gallivm_create();
-   if (!variant->gallivm) {
-      goto fail;
-   }
-
-   builder = gallivm->builder;
-
-   if (LP_DEBUG & DEBUG_COUNTERS) {
-      t0 = os_time_get();
-   }
-
-   memcpy(&variant->key, key, key->size);
-   variant->list_item_global.base = variant;
+   LLVMBuilderRef builder = gallivm->builder;
 
    util_snprintf(func_name, sizeof(func_name), "fs%u_setup%u",
                  0, variant->no);
@@ -744,7 +723,7 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    variant->function = LLVMAddFunction(gallivm->module, func_name, func_type);
    if (!variant->function)
-      goto fail;
+      return FALSE;
 
    LLVMSetFunctionCallConv(variant->function, LLVMCCallConv);
 
@@ -779,6 +758,86 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    gallivm_verify_function(gallivm, variant->function);
 
+   return TRUE;
+}
+
+
+/**
+ * Generate the runtime callable function for the coefficient calculation.
+ *
+ */
+static struct lp_setup_variant *
+generate_setup_variant(struct lp_setup_variant_key *key,
+                       struct llvmpipe_context *lp)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_setup_variant *variant = NULL;
+   struct gallivm_state *gallivm;
+   struct gallivm_cache_key cache_key;
+   boolean need_key = screen->code_cache || gallivm_disk_cache_enabled();
+   boolean cached = FALSE;
+   int64_t t0 = 0, t1;
+
+   variant = CALLOC_STRUCT(lp_setup_variant);
+   if (variant == NULL)
+      goto fail;
+
+   memcpy(&variant->key, key, key->size);
+   variant->list_item_global.base = variant;
+
+   if (need_key) {
+      gallivm_cache_key_init(&cache_key, "llvmpipe setup");
+      gallivm_cache_key_add(&cache_key, &variant->key, key->size);
+   }
+
+   /* Another context may have compiled the same code already */
+   if (screen->code_cache) {
+      variant->code = gallivm_code_cache_lookup(screen->code_cache,
+                                                &cache_key);
+      if (variant->code) {
+         variant->jit_function =
+            (lp_jit_setup_triangle) variant->code->jit_functions[0];
+         gallivm_cache_key_release(&cache_key);
+         return variant;
+      }
+   }
+
+   variant->code = gallivm_code_create(NULL);
+   if (!variant->code)
+      goto fail;
+
+   variant->gallivm = gallivm = gallivm_create();
+   if (!variant->gallivm) {
+      goto fail;
+   }
+
+   variant->code->gallivm = gallivm;
+   variant->code->num_functions = 1;
+
+   if (LP_DEBUG & DEBUG_COUNTERS) {
+      t0 = os_time_get();
+   }
+
+   if (gallivm_disk_cache_enabled()) {
+      cached = gallivm_disk_cache_load(gallivm, &cache_key,
+                                       &variant->function, 1);
+   }
+
+   if (!cached) {
+      if (!generate_setup_function(gallivm, variant)) {
+         variant->code->functions[0] = variant->function;
+         goto fail;
+      }
+
+      if (gallivm_disk_cache_enabled()) {
+         gallivm_disk_cache_store(gallivm, &cache_key,
+                                  &variant->function, 1);
+      }
+   }
+
+   variant->code->functions[0] = variant->function;
+   variant->code->nr_instrs = lp_build_count_instructions(variant->function);
+
    gallivm_compile_module(gallivm);
 
    variant->jit_function = (lp_jit_setup_triangle)
@@ -786,6 +845,18 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    if (!variant->jit_function)
       goto fail;
 
+   /* The code object owns the LLVM objects from now on */
+   variant->code->jit_functions[0] = (func_pointer) variant->jit_function;
+   variant->gallivm = NULL;
+
+   if (screen->code_cache) {
+      gallivm_code_cache_add(screen->code_cache, variant->code, &cache_key);
+   }
+
+   if (need_key) {
+      gallivm_cache_key_release(&cache_key);
+   }
+
    /*
     * Update timing information:
     */
@@ -799,14 +870,10 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
 fail:
    if (variant) {
-      if (variant->function) {
-         gallivm_free_function(gallivm,
-                               variant->function,
-                               variant->jit_function);
-      }
-      if (variant->gallivm) {
-         gallivm_destroy(variant->gallivm);
+      if (need_key) {
+         gallivm_cache_key_release(&cache_key);
       }
+      gallivm_code_reference(&variant->code, NULL);
       FREE(variant);
    }
    
@@ -879,16 +946,9 @@ remove_setup_variant(struct llvmpipe_context *lp,
 		   variant->no, lp->nr_setup_variants);
    }
 
-   if (variant->function) {
-      gallivm_free_function(variant->gallivm,
-                            variant->function,
-                            variant->jit_function);
-   }
-
-   if (variant->gallivm) {
-      gallivm_destroy(variant->gallivm);
-   }
+   gallivm_code_reference(&variant->code, NULL);
 
+   cso_hash_erase_data(lp->setup_variants_hash, variant->hash, variant);
    remove_from_list(&variant->list_item_global);
    lp->nr_setup_variants--;
    FREE(variant);
@@ -935,16 +995,21 @@ llvmpipe_update_setup(struct llvmpipe_context *lp)
 {
    struct lp_setup_variant_key *key = &lp->setup_variant.key;
    struct lp_setup_variant *variant = NULL;
-   struct lp_setup_variant_list_item *li;
+   struct cso_hash_iter iter;
+   unsigned hash;
 
    lp_make_setup_variant_key(lp, key);
 
-   foreach(li, &lp->setup_variants_list) {
-      if(li->base->key.size == key->size &&
-	 memcmp(&li->base->key, key, key->size) == 0) {
-         variant = li->base;
+   hash = util_hash_fast(key, key->size);
+   iter = cso_hash_find(lp->setup_variants_hash, hash);
+   while (!cso_hash_iter_is_null(iter) && cso_hash_iter_key(iter) == hash) {
+      struct lp_setup_variant *item = cso_hash_iter_data(iter);
+      if (item->key.size == key->size &&
+          memcmp(&item->key, key, key->size) == 0) {
+         variant = item;
          break;
       }
+      iter = cso_hash_iter_next(iter);
    }
 
    if (variant) {
@@ -957,6 +1022,8 @@ llvmpipe_update_setup(struct llvmpipe_context *lp)
 
       variant = generate_setup_variant(key, lp);
       if (variant) {
+         variant->hash = hash;
+         cso_hash_insert(lp->setup_variants_hash, hash, variant);
          insert_at_head(&lp->setup_variants_list, &variant->list_item_global);
          lp->nr_setup_variants++;
          llvmpipe_variant_count++;
@@ -6,6 +6,7 @@
 
 struct llvmpipe_context;
 struct lp_setup_variant;
+struct gallivm_code;
 
 struct lp_setup_variant_list_item
 {
@@ -55,18 +56,19 @@ typedef void (*lp_jit_setup_triangle)( const float (*v0)[4],
  */
 struct lp_setup_variant {
    struct lp_setup_variant_key key;
-   
+
+   /** Index of the variant in llvmpipe_context::setup_variants_hash */
+   unsigned hash;
+
    struct lp_setup_variant_list_item list_item_global;
 
+   /* LLVM objects, only valid while the code is generated */
    struct gallivm_state *gallivm;
-
-   /* XXX: this is a pointer to the LLVM IR.  Once jit_function is
-    * generated, we never need to use the IR again - need to find a
-    * way to release this data without destroying the generated
-    * assembly.
-    */
    LLVMValueRef function;
 
+   /** The JIT'd code, possibly shared with other contexts */
+   struct gallivm_code *code;
+
    /* The actual generated setup function:
     */
    lp_jit_setup_triangle jit_function;
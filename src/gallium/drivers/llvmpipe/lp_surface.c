@@ -29,6 +29,7 @@
 #include "util/u_surface.h"
 #include "lp_context.h"
 #include "lp_flush.h"
+#include "lp_hiz.h"
 #include "lp_limits.h"
 #include "lp_surface.h"
 #include "lp_texture.h"
@@ -73,6 +74,8 @@ lp_resource_copy(struct pipe_context *pipe,
                            FALSE, /* do_not_block */
                            "blit dest");
 
+   lp_hiz_invalidate(dst_tex->hiz);
+
    llvmpipe_flush_resource(pipe,
                            src, src_level,
                            TRUE, /* read_only */
@@ -80,8 +83,9 @@ lp_resource_copy(struct pipe_context *pipe,
                            FALSE, /* do_not_block */
                            "blit src");
 
-   /* Fallback for buffers. */
-   if (dst->target == PIPE_BUFFER && src->target == PIPE_BUFFER) {
+   /* Fallback for buffers and tiled textures. */
+   if ((dst->target == PIPE_BUFFER && src->target == PIPE_BUFFER) ||
+       src_tex->tiled || dst_tex->tiled) {
       util_resource_copy_region(pipe, dst, dst_level, dstx, dsty, dstz,
                                 src, src_level, src_box);
       return;
@@ -256,6 +260,9 @@ llvmpipe_create_surface(struct pipe_context *pipe,
       ps->context = pipe;
       ps->format = surf_tmpl->format;
       if (llvmpipe_resource_is_texture(pt)) {
+         /* Rendering only knows about linear images */
+         llvmpipe_untile_resource(pipe, pt);
+
          assert(surf_tmpl->u.tex.level <= pt->last_level);
          assert(surf_tmpl->u.tex.first_layer <= surf_tmpl->u.tex.last_layer);
          ps->width = u_minify(pt->width0, surf_tmpl->u.tex.level);
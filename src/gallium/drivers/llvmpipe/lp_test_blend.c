@@ -621,6 +621,8 @@ blend_funcs[] = {
 const struct lp_type blend_types[] = {
    /* float, fixed,  sign,  norm, width, len */
    {   TRUE, FALSE,  TRUE, FALSE,    32,   4 }, /* f32 x 4 */
+   {   TRUE, FALSE,  TRUE, FALSE,    32,   8 }, /* f32 x 8 */
+   {   TRUE, FALSE,  TRUE, FALSE,    32,  16 }, /* f32 x 16 */
    {  FALSE, FALSE, FALSE,  TRUE,     8,  16 }, /* u8n x 16 */
 };
 
@@ -0,0 +1,254 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+/**
+ * @file
+ * Fragment shader variant lookup micro-benchmark.
+ *
+ * Compares the cost of finding a variant with a linear walk of the
+ * shader's variant list against the hashed index used by
+ * llvmpipe_update_fs(), for an increasing number of variants.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/u_memory.h"
+#include "util/u_simple_list.h"
+#include "cso_cache/cso_hash.h"
+
+#include "lp_limits.h"
+#include "lp_context.h"
+
+#include "lp_test.h"
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "variants\t"
+           "linear_cycles\t"
+           "hashed_cycles\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp,
+              unsigned num_variants,
+              double linear_cycles,
+              double hashed_cycles,
+              boolean success)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+
+   fprintf(fp, "%u\t%.1f\t%.1f\n",
+           num_variants, linear_cycles, hashed_cycles);
+
+   fflush(fp);
+}
+
+
+/**
+ * Make the i-th key.  The keys differ in blend state, past the depth and
+ * stencil state, as with apps which toggle blending per draw.
+ */
+static void
+make_key(struct lp_fragment_shader_variant_key *key, unsigned i)
+{
+   memset(key, 0, sizeof *key);
+
+   key->depth.enabled = 1;
+   key->depth.func = PIPE_FUNC_LESS;
+   key->nr_cbufs = 1;
+   key->cbuf_format[0] = PIPE_FORMAT_B8G8R8A8_UNORM;
+   key->zsbuf_format = PIPE_FORMAT_Z24_UNORM_S8_UINT;
+
+   key->blend.rt[0].blend_enable = 1;
+   key->blend.rt[0].rgb_src_factor = i & 0x1f;
+   key->blend.rt[0].rgb_dst_factor = (i >> 5) & 0x1f;
+   key->blend.rt[0].colormask = ~(i >> 10) & 0xf;
+}
+
+
+/** Find the variant as llvmpipe_update_fs() used to */
+static struct lp_fragment_shader_variant *
+linear_lookup(struct lp_fragment_shader *shader,
+              const struct lp_fragment_shader_variant_key *key)
+{
+   struct lp_fs_variant_list_item *li;
+
+   li = first_elem(&shader->variants);
+   while(!at_end(&shader->variants, li)) {
+      if(memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
+         return li->base;
+      }
+      li = next_elem(li);
+   }
+
+   return NULL;
+}
+
+
+static boolean
+test_lookup(unsigned verbose, FILE *fp, unsigned num_variants)
+{
+   struct lp_fragment_shader shader;
+   struct lp_fragment_shader_variant **variants;
+   struct lp_fragment_shader_variant_key key;
+   struct cso_hash *hash;
+   int64_t linear_cycles[LP_TEST_NUM_SAMPLES];
+   int64_t hashed_cycles[LP_TEST_NUM_SAMPLES];
+   double linear_avg = 0.0, hashed_avg = 0.0;
+   boolean success = TRUE;
+   unsigned i, j;
+
+   memset(&shader, 0, sizeof shader);
+   make_empty_list(&shader.variants);
+   shader.variant_key_size = Offset(struct lp_fragment_shader_variant_key,
+                                    state[1]);
+
+   hash = cso_hash_create();
+   variants = CALLOC(num_variants, sizeof *variants);
+   if (!hash || !variants) {
+      success = FALSE;
+      goto out;
+   }
+
+   for (i = 0; i < num_variants; i++) {
+      struct lp_fragment_shader_variant *variant =
+         CALLOC_STRUCT(lp_fragment_shader_variant);
+      if (!variant) {
+         success = FALSE;
+         goto out;
+      }
+      make_key(&variant->key, i);
+      variant->shader = &shader;
+      variant->list_item_local.base = variant;
+      variant->hash = lp_fs_variant_hash(&shader, &variant->key);
+      insert_at_head(&shader.variants, &variant->list_item_local);
+      cso_hash_insert(hash, variant->hash, variant);
+      variants[i] = variant;
+   }
+
+   for (i = 0; i < LP_TEST_NUM_SAMPLES; i++) {
+      /* Look up every variant, oldest (i.e., at the list tail) first */
+      uint64_t start_counter, end_counter;
+
+      start_counter = rdtsc();
+      for (j = 0; j < num_variants; j++) {
+         make_key(&key, j);
+         if (linear_lookup(&shader, &key) != variants[j])
+            success = FALSE;
+      }
+      end_counter = rdtsc();
+      linear_cycles[i] = end_counter - start_counter;
+
+      start_counter = rdtsc();
+      for (j = 0; j < num_variants; j++) {
+         unsigned h;
+         make_key(&key, j);
+         h = lp_fs_variant_hash(&shader, &key);
+         if (lp_fs_variant_lookup(hash, &shader, &key, h) != variants[j])
+            success = FALSE;
+      }
+      end_counter = rdtsc();
+      hashed_cycles[i] = end_counter - start_counter;
+   }
+
+   /* A key which was never inserted must not be found */
+   make_key(&key, num_variants);
+   if (lp_fs_variant_lookup(hash, &shader, &key,
+                            lp_fs_variant_hash(&shader, &key)) != NULL)
+      success = FALSE;
+
+   for (i = 0; i < LP_TEST_NUM_SAMPLES; i++) {
+      linear_avg += (double)linear_cycles[i] / num_variants;
+      hashed_avg += (double)hashed_cycles[i] / num_variants;
+   }
+   linear_avg /= LP_TEST_NUM_SAMPLES;
+   hashed_avg /= LP_TEST_NUM_SAMPLES;
+
+   if (verbose >= 1 || !success) {
+      printf("%4u variants: linear %9.1f cycles, hashed %7.1f cycles%s\n",
+             num_variants, linear_avg, hashed_avg,
+             success ? "" : " (FAIL)");
+      fflush(stdout);
+   }
+
+   if (fp)
+      write_tsv_row(fp, num_variants, linear_avg, hashed_avg, success);
+
+out:
+   if (variants) {
+      for (i = 0; i < num_variants; i++)
+         FREE(variants[i]);
+      FREE(variants);
+   }
+   if (hash)
+      cso_hash_delete(hash);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   unsigned num_variants;
+   boolean success = TRUE;
+
+   for (num_variants = 1;
+        num_variants <= LP_MAX_SHADER_VARIANTS;
+        num_variants *= 2) {
+      if (!test_lookup(verbose, fp, num_variants))
+         success = FALSE;
+   }
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_lookup(verbose, fp, LP_MAX_SHADER_VARIANTS);
+}
@@ -43,8 +43,13 @@
 #include "util/u_simple_list.h"
 #include "util/u_transfer.h"
 
+#include "gallivm/lp_bld_sample.h"
+
 #include "lp_context.h"
+#include "lp_debug.h"
+#include "lp_fence.h"
 #include "lp_flush.h"
+#include "lp_hiz.h"
 #include "lp_screen.h"
 #include "lp_texture.h"
 #include "lp_setup.h"
@@ -220,6 +225,168 @@ llvmpipe_displaytarget_layout(struct llvmpipe_screen *screen,
 }
 
 
+/**
+ * Whether a texture may be stored tiled.  The sampling code is the only
+ * one which knows about tiled images, so the texture must be for sampling
+ * only, or at least believed to be: textures which turn out to be
+ * rendered to or sampled from other shader stages are untiled then, see
+ * llvmpipe_untile_resource().
+ */
+static boolean
+llvmpipe_can_tile(const struct llvmpipe_resource *lpr)
+{
+   const struct pipe_resource *pt = &lpr->base;
+   const struct util_format_description *desc =
+      util_format_description(pt->format);
+
+   if (LP_PERF & PERF_NO_TEX_TILING)
+      return FALSE;
+
+   if (!(pt->bind & PIPE_BIND_SAMPLER_VIEW) ||
+       (pt->bind & (PIPE_BIND_DEPTH_STENCIL |
+                    PIPE_BIND_DISPLAY_TARGET |
+                    PIPE_BIND_SCANOUT |
+                    PIPE_BIND_SHARED)))
+      return FALSE;
+
+   switch (pt->target) {
+   case PIPE_TEXTURE_2D:
+   case PIPE_TEXTURE_RECT:
+   case PIPE_TEXTURE_CUBE:
+   case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_3D:
+      break;
+   default:
+      return FALSE;
+   }
+
+   /* Images are padded to 4x4 blocks of texels, see llvmpipe_texture_layout */
+   if (desc->block.width != 1 || desc->block.height != 1 ||
+       LP_RASTER_BLOCK_SIZE % LP_TEXEL_TILE_SIZE != 0)
+      return FALSE;
+
+   /* Nothing to gain for images a single tile wide or high */
+   if (pt->width0 <= LP_TEXEL_TILE_SIZE ||
+       pt->height0 <= LP_TEXEL_TILE_SIZE)
+      return FALSE;
+
+   return TRUE;
+}
+
+
+/**
+ * Byte offset of texel (x, y) in a tiled image.
+ */
+static INLINE unsigned
+tiled_texel_offset(unsigned row_stride, unsigned bpp,
+                   unsigned x, unsigned y)
+{
+   const unsigned mask = LP_TEXEL_TILE_SIZE - 1;
+
+   return (y & ~mask) * row_stride +
+          ((x & ~mask) + (y & mask)) * LP_TEXEL_TILE_SIZE * bpp +
+          (x & mask) * bpp;
+}
+
+
+/**
+ * Copy a rectangle of texels between a tiled image and a linear one.
+ */
+static void
+tiled_copy_rect(ubyte *tiled, unsigned row_stride,
+                ubyte *linear, unsigned linear_stride,
+                unsigned bpp,
+                unsigned x0, unsigned y0, unsigned width, unsigned height,
+                boolean to_linear)
+{
+   unsigned x, y;
+
+   for (y = 0; y < height; y++) {
+      ubyte *row = linear + y * linear_stride;
+
+      for (x = 0; x < width; ) {
+         unsigned tx = x0 + x;
+         unsigned run = MIN2(LP_TEXEL_TILE_SIZE - (tx % LP_TEXEL_TILE_SIZE),
+                             width - x);
+         ubyte *texel = tiled + tiled_texel_offset(row_stride, bpp,
+                                                   tx, y0 + y);
+
+         if (to_linear)
+            memcpy(row + x * bpp, texel, run * bpp);
+         else
+            memcpy(texel, row + x * bpp, run * bpp);
+
+         x += run;
+      }
+   }
+}
+
+
+/**
+ * Convert a tiled texture to the linear layout, for good.
+ */
+void
+llvmpipe_untile_resource(struct pipe_context *pipe,
+                         struct pipe_resource *resource)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   unsigned bpp, level, slice;
+   ubyte *tmp;
+
+   if (!llvmpipe_resource_is_texture(resource) || !lpr->tiled)
+      return;
+
+   llvmpipe_flush_resource(pipe, resource, 0, FALSE, TRUE, FALSE,
+                           __FUNCTION__);
+
+   if (lpr->linear_img.data) {
+      bpp = util_format_get_blocksize(resource->format);
+
+      /*
+       * A row of tiles covers the same bytes as the LP_TEXEL_TILE_SIZE
+       * texel rows it contains, so images can be converted one row of
+       * tiles at a time.
+       */
+      tmp = MALLOC(LP_TEXEL_TILE_SIZE * lpr->row_stride[0]);
+      if (!tmp)
+         return;
+
+      for (level = 0; level <= resource->last_level; level++) {
+         unsigned row_stride = lpr->row_stride[level];
+         unsigned tile_row_size = LP_TEXEL_TILE_SIZE * row_stride;
+         unsigned width = align(u_minify(resource->width0, level),
+                                LP_TEXEL_TILE_SIZE);
+         unsigned height = align(u_minify(resource->height0, level),
+                                 LP_TEXEL_TILE_SIZE);
+
+         for (slice = 0; slice < lpr->num_slices_faces[level]; slice++) {
+            ubyte *img = llvmpipe_get_texture_image_address(lpr, slice, level);
+            unsigned y;
+
+            for (y = 0; y < height; y += LP_TEXEL_TILE_SIZE) {
+               ubyte *tile_row = img + y * row_stride;
+
+               memcpy(tmp, tile_row, tile_row_size);
+               tiled_copy_rect(tmp, row_stride, tile_row, row_stride,
+                               bpp, 0, 0, width, LP_TEXEL_TILE_SIZE,
+                               TRUE);
+            }
+         }
+      }
+
+      FREE(tmp);
+   }
+
+   lpr->tiled = FALSE;
+
+   /* Notify all contexts sharing the texture: their fragment shader
+    * variants and sampler state may still assume the tiled layout, and
+    * are rebuilt before their next draw, see llvmpipe_update_derived().
+    */
+   llvmpipe_screen(resource->screen)->timestamp++;
+}
+
+
 static struct pipe_resource *
 llvmpipe_resource_create(struct pipe_screen *_screen,
                          const struct pipe_resource *templat)
@@ -247,7 +414,12 @@ llvmpipe_resource_create(struct pipe_screen *_screen,
          /* texture map */
          if (!llvmpipe_texture_layout(screen, lpr))
             goto fail;
+
+         lpr->tiled = llvmpipe_can_tile(lpr);
       }
+
+      /* Created up front, as contexts sharing the texture all use it */
+      lpr->hiz = lp_hiz_create(&lpr->base);
    }
    else {
       /* other data (vertex buffer, const buffer, etc) */
@@ -298,6 +470,7 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
       /* display target */
       struct sw_winsys *winsys = screen->winsys;
       winsys->displaytarget_destroy(winsys, lpr->dt);
+      lp_fence_reference(&lpr->fence, NULL);
    }
    else if (llvmpipe_resource_is_texture(pt)) {
       /* free linear image data */
@@ -311,6 +484,8 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
       align_free(lpr->data);
    }
 
+   lp_hiz_destroy(lpr->hiz);
+
 #ifdef DEBUG
    if (lpr->next)
       remove_from_list(lpr);
@@ -570,6 +745,48 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
 
    format = lpr->base.format;
 
+   if (lpr->tiled) {
+      /*
+       * Hand out a linear copy of the box, converted back to tiles on
+       * unmap.
+       */
+      unsigned bpp = util_format_get_blocksize(format);
+      unsigned z;
+
+      if (usage & PIPE_TRANSFER_MAP_DIRECTLY) {
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         return NULL;
+      }
+
+      pt->stride = align(box->width * bpp, 16);
+      pt->layer_stride = pt->stride * box->height;
+      lpt->staging = align_malloc(pt->layer_stride * box->depth, 16);
+      if (!lpt->staging) {
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         return NULL;
+      }
+
+      if (!(usage & (PIPE_TRANSFER_DISCARD_RANGE |
+                     PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE))) {
+         for (z = 0; z < box->depth; z++) {
+            ubyte *img = llvmpipe_get_texture_image(lpr, box->z + z, level,
+                                                    LP_TEX_USAGE_READ);
+            tiled_copy_rect(img, lpr->row_stride[level],
+                            lpt->staging + z * pt->layer_stride, pt->stride,
+                            bpp, box->x, box->y, box->width, box->height,
+                            TRUE);
+         }
+      }
+
+      if (usage & PIPE_TRANSFER_WRITE) {
+         screen->timestamp++;
+      }
+
+      return lpt->staging;
+   }
+
    map = llvmpipe_resource_map(resource,
                                level,
                                box->z,
@@ -583,6 +800,9 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
       /* Do something to notify sharing contexts of a texture change.
        */
       screen->timestamp++;
+
+      /* The depth values are about to change behind the rasterizer's back */
+      lp_hiz_invalidate(lpr->hiz);
    }
 
    map +=
@@ -597,15 +817,40 @@ static void
 llvmpipe_transfer_unmap(struct pipe_context *pipe,
                         struct pipe_transfer *transfer)
 {
+   struct llvmpipe_transfer *lpt = llvmpipe_transfer(transfer);
+
    assert(transfer->resource);
 
-   llvmpipe_resource_unmap(transfer->resource,
-                           transfer->level,
-                           transfer->box.z);
+   if (lpt->staging) {
+      struct llvmpipe_resource *lpr = llvmpipe_resource(transfer->resource);
+      const struct pipe_box *box = &transfer->box;
+      unsigned bpp = util_format_get_blocksize(lpr->base.format);
+      unsigned z;
+
+      if (transfer->usage & PIPE_TRANSFER_WRITE) {
+         for (z = 0; z < box->depth; z++) {
+            ubyte *img = llvmpipe_get_texture_image(lpr, box->z + z,
+                                                    transfer->level,
+                                                    LP_TEX_USAGE_READ_WRITE);
+            tiled_copy_rect(img, lpr->row_stride[transfer->level],
+                            lpt->staging + z * transfer->layer_stride,
+                            transfer->stride,
+                            bpp, box->x, box->y, box->width, box->height,
+                            FALSE);
+         }
+      }
+
+      align_free(lpt->staging);
+   }
+   else {
+      llvmpipe_resource_unmap(transfer->resource,
+                              transfer->level,
+                              transfer->box.z);
+   }
 
    /* Effectively do the texture_update work here - if texture images
     * needed post-processing to put them into hardware layout, this is
-    * where it would happen.  For llvmpipe, nothing to do.
+    * where it would happen.  For llvmpipe, only tiled textures need it, above.
     */
    assert (transfer->resource);
    pipe_resource_reference(&transfer->resource, NULL);
@@ -45,6 +45,8 @@ enum lp_texture_usage
 struct pipe_context;
 struct pipe_screen;
 struct llvmpipe_context;
+struct lp_fence;
+struct lp_hiz;
 
 struct sw_displaytarget;
 
@@ -82,6 +84,9 @@ struct llvmpipe_resource
     */
    struct sw_displaytarget *dt;
 
+   /** Fence of the last scene rendering to dt */
+   struct lp_fence *fence;
+
    /**
     * Malloc'ed data for regular textures, or a mapping to dt above.
     */
@@ -97,6 +102,16 @@ struct llvmpipe_resource
 
    unsigned id;  /**< temporary, for debugging */
 
+   /** Hierarchical Z of depth textures, see lp_hiz_create() */
+   struct lp_hiz *hiz;
+
+   /**
+    * Texels are stored in LP_TEXEL_TILE_SIZE square tiles rather than in
+    * rows, see lp_bld_sample.h.  Only done for textures which so far have
+    * only been sampled by fragment shaders.
+    */
+   boolean tiled;
+
 #ifdef DEBUG
    /** for linked list */
    struct llvmpipe_resource *prev, *next;
@@ -109,6 +124,9 @@ struct llvmpipe_transfer
    struct pipe_transfer base;
 
    unsigned long offset;
+
+   /** Linear copy of the box, for tiled resources */
+   ubyte *staging;
 };
 
 
@@ -257,4 +275,8 @@ llvmpipe_is_resource_referenced( struct pipe_context *pipe,
 unsigned
 llvmpipe_get_format_alignment(enum pipe_format format);
 
+void
+llvmpipe_untile_resource(struct pipe_context *pipe,
+                         struct pipe_resource *resource);
+
 #endif /* LP_TEXTURE_H */
@@ -30,6 +30,8 @@
  *    Keith Whitwell <keith@tungstengraphics.com>
  */
 
+#include <inttypes.h>  /* for PRIu64 macro */
+
 #include "draw/draw_context.h"
 #include "draw/draw_vbuf.h"
 #include "pipe/p_defines.h"
@@ -44,6 +46,7 @@
 #include "sp_context.h"
 #include "sp_flush.h"
 #include "sp_prim_vbuf.h"
+#include "sp_setup_mt.h"
 #include "sp_state.h"
 #include "sp_surface.h"
 #include "sp_tile_cache.h"
@@ -72,6 +75,8 @@ softpipe_destroy( struct pipe_context *pipe )
       util_blitter_destroy(softpipe->blitter);
    }
 
+   sp_setup_mt_destroy(softpipe->setup_mt);
+
    if (softpipe->draw)
       draw_destroy( softpipe->draw );
 
@@ -120,6 +125,15 @@ softpipe_destroy( struct pipe_context *pipe )
       FREE(softpipe->tgsi.sampler[i]);
    }
 
+   if (softpipe->tex_cache_stats) {
+      uint64_t lookups = softpipe->tex_cache_hits + softpipe->tex_cache_misses;
+
+      debug_printf("softpipe: texture cache: %" PRIu64 " lookups, "
+                   "%" PRIu64 " misses (%.2f%%)\n",
+                   lookups, softpipe->tex_cache_misses,
+                   lookups ? 100.0 * softpipe->tex_cache_misses / lookups : 0.0);
+   }
+
    FREE( softpipe );
 }
 
@@ -203,6 +217,8 @@ softpipe_create_context( struct pipe_screen *screen,
 
    softpipe->dump_fs = debug_get_bool_option( "SOFTPIPE_DUMP_FS", FALSE );
    softpipe->dump_gs = debug_get_bool_option( "SOFTPIPE_DUMP_GS", FALSE );
+   softpipe->tex_cache_stats =
+      debug_get_bool_option( "SOFTPIPE_TEX_CACHE_STATS", FALSE );
 
    softpipe->pipe.screen = screen;
    softpipe->pipe.destroy = softpipe_destroy;
@@ -291,6 +307,10 @@ softpipe_create_context( struct pipe_screen *screen,
    draw_set_rasterize_stage(softpipe->draw, softpipe->vbuf);
    draw_set_render(softpipe->draw, softpipe->vbuf_backend);
 
+   softpipe->setup_mt =
+      sp_setup_mt_create(softpipe,
+                         debug_get_num_option("SOFTPIPE_NUM_THREADS", 0));
+
    softpipe->blitter = util_blitter_create(&softpipe->pipe);
    if (!softpipe->blitter) {
       goto fail;
@@ -55,6 +55,7 @@ struct sp_fragment_shader;
 struct sp_vertex_shader;
 struct sp_velems_state;
 struct sp_so_state;
+struct sp_setup_mt;
 
 struct softpipe_context {
    struct pipe_context pipe;  /**< base class */
@@ -174,6 +175,9 @@ struct softpipe_context {
    struct vbuf_render *vbuf_backend;
    struct draw_stage *vbuf;
 
+   /** Rasterizer threads, NULL when single threaded */
+   struct sp_setup_mt *setup_mt;
+
    struct blitter_context *blitter;
 
    boolean dirty_render_cache;
@@ -192,8 +196,13 @@ struct softpipe_context {
     */
    struct softpipe_tex_tile_cache *tex_cache[PIPE_SHADER_GEOMETRY+1][PIPE_MAX_SHADER_SAMPLER_VIEWS];
 
+   /** Texture cache statistics, summed up as the caches are destroyed */
+   uint64_t tex_cache_hits;
+   uint64_t tex_cache_misses;
+
    unsigned dump_fs : 1;
    unsigned dump_gs : 1;
+   unsigned tex_cache_stats : 1;
    unsigned no_rast : 1;
 };
 
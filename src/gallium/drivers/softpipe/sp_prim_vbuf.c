@@ -38,6 +38,7 @@
 
 #include "sp_context.h"
 #include "sp_setup.h"
+#include "sp_setup_mt.h"
 #include "sp_state.h"
 #include "sp_prim_vbuf.h"
 #include "draw/draw_context.h"
@@ -165,8 +166,13 @@ sp_vbuf_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
    const void *vertex_buffer = cvbr->vertex_buffer;
    struct setup_context *setup = cvbr->setup;
    const boolean flatshade_first = softpipe->rasterizer->flatshade_first;
+   boolean threaded;
    unsigned i;
 
+   /* collect the primitives for the rasterizer threads */
+   threaded = softpipe->setup_mt &&
+              sp_setup_mt_begin(softpipe->setup_mt, setup, nr);
+
    switch (cvbr->prim) {
    case PIPE_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
@@ -345,6 +351,9 @@ sp_vbuf_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
    default:
       assert(0);
    }
+
+   if (threaded)
+      sp_setup_mt_end(softpipe->setup_mt);
 }
 
 
@@ -362,8 +371,13 @@ sp_vbuf_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    const void *vertex_buffer =
       (void *) get_vert(cvbr->vertex_buffer, start, stride);
    const boolean flatshade_first = softpipe->rasterizer->flatshade_first;
+   boolean threaded;
    unsigned i;
 
+   /* collect the primitives for the rasterizer threads */
+   threaded = softpipe->setup_mt &&
+              sp_setup_mt_begin(softpipe->setup_mt, setup, nr);
+
    switch (cvbr->prim) {
    case PIPE_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
@@ -585,6 +599,9 @@ sp_vbuf_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    default:
       assert(0);
    }
+
+   if (threaded)
+      sp_setup_mt_end(softpipe->setup_mt);
 }
 
 /*
@@ -36,7 +36,9 @@
 #include "sp_quad.h"
 #include "sp_quad_pipe.h"
 #include "sp_setup.h"
+#include "sp_setup_mt.h"
 #include "sp_state.h"
+#include "sp_tile_cache.h"
 #include "draw/draw_context.h"
 #include "draw/draw_vertex.h"
 #include "pipe/p_shader_tokens.h"
@@ -113,6 +115,13 @@ struct setup_context {
 
    unsigned cull_face;		/* which faces cull */
    unsigned nr_vertex_attrs;
+
+   /** Collecting primitives for the rasterizer threads, see sp_setup_mt.c */
+   struct sp_setup_mt *mt;
+
+   /** Only emit quads in the tiles of this thread, when num_threads > 1 */
+   unsigned thread;
+   unsigned num_threads;
 };
 
 
@@ -152,6 +161,20 @@ quad_clip(struct setup_context *setup, struct quad_header *quad)
 }
 
 
+/**
+ * Is the tile containing pixel (x,y) rendered by this setup context?
+ * With several rasterizer threads, each one owns the tiles which map to
+ * a subset of the tile cache entries.
+ */
+static INLINE boolean
+tile_is_ours(const struct setup_context *setup, int x, int y)
+{
+   return setup->num_threads <= 1 ||
+          CACHE_POS(x / TILE_SIZE, y / TILE_SIZE) % setup->num_threads ==
+          setup->thread;
+}
+
+
 /**
  * Emit a quad (pass to next stage) with clipping.
  */
@@ -160,7 +183,8 @@ clip_emit_quad(struct setup_context *setup, struct quad_header *quad)
 {
    quad_clip( setup, quad );
 
-   if (quad->inout.mask) {
+   if (quad->inout.mask &&
+       tile_is_ours(setup, quad->input.x0, quad->input.y0)) {
       struct softpipe_context *sp = setup->softpipe;
 
 #if DEBUG_FRAGS
@@ -228,6 +252,10 @@ flush_spans(struct setup_context *setup)
       unsigned mask0 = ~skipmask_left0 & ~skipmask_right0;
       unsigned mask1 = ~skipmask_left1 & ~skipmask_right1;
 
+      /* chunks never straddle tiles */
+      if (!tile_is_ours(setup, x, setup->span.y))
+         continue;
+
       if (mask0 | mask1) {
          do {
             unsigned quadmask = (mask0 & 3) | ((mask1 & 3) << 2);
@@ -825,6 +853,14 @@ sp_setup_tri(struct setup_context *setup,
    if (!setup_sort_vertices( setup, det, v0, v1, v2 ))
       return;
 
+   if (setup->mt) {
+      if (setup->softpipe->active_statistics_queries) {
+         setup->softpipe->pipeline_statistics.c_primitives++;
+      }
+      sp_setup_mt_tri(setup->mt, v0, v1, v2);
+      return;
+   }
+
    setup_tri_coefficients( setup );
    setup_tri_edges( setup );
 
@@ -852,7 +888,9 @@ sp_setup_tri(struct setup_context *setup,
 
    flush_spans( setup );
 
-   if (setup->softpipe->active_statistics_queries) {
+   /* when rasterizing for a thread, the tri was counted while collecting */
+   if (setup->softpipe->active_statistics_queries &&
+       setup->num_threads <= 1) {
       setup->softpipe->pipeline_statistics.c_primitives++;
    }
 
@@ -1085,6 +1123,11 @@ sp_setup_line(struct setup_context *setup,
    if (dx == 0 && dy == 0)
       return;
 
+   if (setup->mt) {
+      sp_setup_mt_line(setup->mt, v0, v1);
+      return;
+   }
+
    if (!setup_line_coefficients(setup, v0, v1))
       return;
 
@@ -1217,6 +1260,11 @@ sp_setup_point(struct setup_context *setup,
 
    assert(setup->softpipe->reduced_prim == PIPE_PRIM_POINTS);
 
+   if (setup->mt) {
+      sp_setup_mt_point(setup->mt, v0);
+      return;
+   }
+
    /* For points, all interpolants are constant-valued.
     * However, for point sprites, we'll need to setup texcoords appropriately.
     * XXX: which coefficients are the texcoords???
@@ -1424,6 +1472,31 @@ sp_setup_prepare(struct setup_context *setup)
 }
 
 
+/**
+ * Redirect the primitives to the rasterizer threads' collector, or back
+ * to this context when mt is NULL.
+ */
+void
+sp_setup_set_mt(struct setup_context *setup, struct sp_setup_mt *mt)
+{
+   setup->mt = mt;
+}
+
+
+/**
+ * Only emit the quads which fall in the tiles of the given rasterizer
+ * thread (out of num_threads), see sp_setup_mt.c.
+ */
+void
+sp_setup_set_thread(struct setup_context *setup,
+                    unsigned thread, unsigned num_threads)
+{
+   assert(thread < MAX2(num_threads, 1));
+   setup->thread = thread;
+   setup->num_threads = num_threads;
+}
+
+
 void
 sp_setup_destroy_context(struct setup_context *setup)
 {
@@ -1450,5 +1523,7 @@ sp_setup_create_context(struct softpipe_context *softpipe)
    setup->span.left[0] = 1000000;     /* greater than right[0] */
    setup->span.left[1] = 1000000;     /* greater than right[1] */
 
+   setup->num_threads = 1;
+
    return setup;
 }
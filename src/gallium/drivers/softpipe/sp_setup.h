@@ -29,6 +29,7 @@
 
 struct setup_context;
 struct softpipe_context;
+struct sp_setup_mt;
 
 void 
 sp_setup_tri( struct setup_context *setup,
@@ -48,6 +49,9 @@ sp_setup_point( struct setup_context *setup,
 
 struct setup_context *sp_setup_create_context( struct softpipe_context *softpipe );
 void sp_setup_prepare( struct setup_context *setup );
+void sp_setup_set_mt( struct setup_context *setup, struct sp_setup_mt *mt );
+void sp_setup_set_thread( struct setup_context *setup,
+                          unsigned thread, unsigned num_threads );
 void sp_setup_destroy_context( struct setup_context *setup );
 
 #endif
@@ -0,0 +1,659 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Multi-threaded rasterization.
+ *
+ * While the draw module emits the primitives of a draw, setup just
+ * collects their vertex pointers.  The primitives are then binned to the
+ * threads owning the tiles their bounding boxes touch, and every thread
+ * runs setup and the quad pipeline for the primitives of its bin,
+ * emitting only the quads which fall in its own tiles.
+ *
+ * A thread owns the tiles whose color/depth tile cache position is
+ * CACHE_POS(x, y) % num_threads == thread.  So besides touching disjoint
+ * pixels, each thread sees exactly the same sequence of tiles at each of
+ * its cache positions as a single thread would, so tiles are evicted and
+ * reloaded at the same points, and the output is identical to the
+ * single-threaded path, bit for bit.  This matters as the cached tiles
+ * hold more precision than the surfaces.
+ *
+ * The calling thread is thread 0 and uses the context as is.  The other
+ * threads use a private copy of the context, with their own quad
+ * pipeline, fragment shader machine, texture caches, tile cache
+ * bookkeeping and counters, which are merged back after the draw.
+ */
+
+#include "os/os_thread.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "tgsi/tgsi_exec.h"
+#include "sp_context.h"
+#include "sp_limits.h"
+#include "sp_quad_pipe.h"
+#include "sp_setup.h"
+#include "sp_setup_mt.h"
+#include "sp_state.h"
+#include "sp_tex_sample.h"
+#include "sp_tex_tile_cache.h"
+#include "sp_texture.h"
+#include "sp_tile_cache.h"
+
+
+struct sp_setup_prim
+{
+   const float (*v[3])[4];
+};
+
+
+struct sp_setup_bin
+{
+   unsigned *prims;   /**< indices into sp_setup_mt::prims, in order */
+   unsigned num_prims;
+};
+
+
+struct sp_setup_thread
+{
+   struct sp_setup_mt *mt;
+   unsigned index;
+
+   /** Private copy of the context, as seen by the quad stages */
+   struct softpipe_context softpipe;
+   struct setup_context *setup;
+
+   struct {
+      struct quad_stage *shade;
+      struct quad_stage *depth_test;
+      struct quad_stage *blend;
+      struct quad_stage *pstipple;
+   } quad;
+
+   struct tgsi_exec_machine *fs_machine;
+   /** Variant bound to fs_machine, always with sampler */
+   const struct sp_fragment_shader_variant *fs_variant;
+   struct sp_tgsi_sampler sampler;
+   /** Created on demand, they are rather big */
+   struct softpipe_tex_tile_cache *tex_cache[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+
+   /** Private views of the context's color/depth tile caches */
+   struct softpipe_tile_cache cbuf_cache[PIPE_MAX_COLOR_BUFS];
+   struct softpipe_tile_cache zsbuf_cache;
+
+   pipe_semaphore work_ready;
+   pipe_semaphore work_done;
+   pipe_thread thread;
+};
+
+
+struct sp_setup_mt
+{
+   struct softpipe_context *softpipe;
+
+   /** The context's setup, while collecting */
+   struct setup_context *setup;
+
+   unsigned num_threads;  /**< including the calling one */
+   struct sp_setup_thread *threads[SP_MAX_THREADS];  /**< [0] is unused */
+   struct sp_setup_bin bins[SP_MAX_THREADS];
+
+   /** Primitives collected for the current draw */
+   struct sp_setup_prim *prims;
+   unsigned num_prims;
+   unsigned max_prims;
+   unsigned nr_verts;  /**< 1 for points, 2 for lines, 3 for triangles */
+
+   boolean exit_flag;
+};
+
+
+void
+sp_setup_mt_tri(struct sp_setup_mt *mt,
+                const float (*v0)[4],
+                const float (*v1)[4],
+                const float (*v2)[4])
+{
+   struct sp_setup_prim *prim = &mt->prims[mt->num_prims++];
+
+   assert(mt->num_prims <= mt->max_prims);
+
+   prim->v[0] = v0;
+   prim->v[1] = v1;
+   prim->v[2] = v2;
+   mt->nr_verts = 3;
+}
+
+
+void
+sp_setup_mt_line(struct sp_setup_mt *mt,
+                 const float (*v0)[4],
+                 const float (*v1)[4])
+{
+   struct sp_setup_prim *prim = &mt->prims[mt->num_prims++];
+
+   assert(mt->num_prims <= mt->max_prims);
+
+   prim->v[0] = v0;
+   prim->v[1] = v1;
+   mt->nr_verts = 2;
+}
+
+
+void
+sp_setup_mt_point(struct sp_setup_mt *mt,
+                  const float (*v0)[4])
+{
+   struct sp_setup_prim *prim = &mt->prims[mt->num_prims++];
+
+   assert(mt->num_prims <= mt->max_prims);
+
+   prim->v[0] = v0;
+   mt->nr_verts = 1;
+}
+
+
+/**
+ * Mask of the threads owning the tiles a primitive may touch.
+ *
+ * Points and lines are cheap to set up and go to every thread.
+ */
+static unsigned
+prim_threads(const struct sp_setup_mt *mt,
+             const struct sp_setup_prim *prim)
+{
+   const struct pipe_scissor_state *cliprect = &mt->softpipe->cliprect;
+   const unsigned all = (1 << mt->num_threads) - 1;
+   float minx, miny, maxx, maxy;
+   int x0, y0, x1, y1, tx, ty;
+   unsigned mask = 0;
+
+   if (mt->nr_verts < 3)
+      return all;
+
+   minx = MIN3(prim->v[0][0][0], prim->v[1][0][0], prim->v[2][0][0]);
+   miny = MIN3(prim->v[0][0][1], prim->v[1][0][1], prim->v[2][0][1]);
+   maxx = MAX3(prim->v[0][0][0], prim->v[1][0][0], prim->v[2][0][0]);
+   maxy = MAX3(prim->v[0][0][1], prim->v[1][0][1], prim->v[2][0][1]);
+
+   /* a pixel of margin covers the pixel center offset; clamp to the
+    * cliprect before converting to integers */
+   minx = MAX2(minx - 1.0f, (float) cliprect->minx);
+   miny = MAX2(miny - 1.0f, (float) cliprect->miny);
+   maxx = MIN2(maxx + 1.0f, (float) cliprect->maxx);
+   maxy = MIN2(maxy + 1.0f, (float) cliprect->maxy);
+
+   if (!(minx < maxx && miny < maxy))
+      return 0;
+
+   x0 = (int) minx / TILE_SIZE;
+   y0 = (int) miny / TILE_SIZE;
+   x1 = ((int) ceilf(maxx) - 1) / TILE_SIZE;
+   y1 = ((int) ceilf(maxy) - 1) / TILE_SIZE;
+
+   for (ty = y0; ty <= y1; ty++) {
+      for (tx = x0; tx <= x1; tx++) {
+         mask |= 1 << (CACHE_POS(tx, ty) % mt->num_threads);
+         if (mask == all)
+            return mask;
+      }
+   }
+
+   return mask;
+}
+
+
+/**
+ * Run setup and the quad pipeline for the primitives of a bin.
+ */
+static void
+rasterize_bin(struct sp_setup_mt *mt,
+              struct setup_context *setup,
+              unsigned thread)
+{
+   const struct sp_setup_bin *bin = &mt->bins[thread];
+   unsigned i;
+
+   for (i = 0; i < bin->num_prims; i++) {
+      const struct sp_setup_prim *prim = &mt->prims[bin->prims[i]];
+
+      switch (mt->nr_verts) {
+      case 3:
+         sp_setup_tri(setup, prim->v[0], prim->v[1], prim->v[2]);
+         break;
+      case 2:
+         sp_setup_line(setup, prim->v[0], prim->v[1]);
+         break;
+      default:
+         sp_setup_point(setup, prim->v[0]);
+         break;
+      }
+   }
+}
+
+
+/**
+ * Set up a thread's copy of the context from the context's current state.
+ * Called by the calling thread before every parallel draw.
+ */
+static void
+fork_thread(struct sp_setup_mt *mt, struct sp_setup_thread *thr)
+{
+   struct softpipe_context *sp = mt->softpipe;
+   struct softpipe_context *copy = &thr->softpipe;
+   const unsigned num_views = sp->num_sampler_views[PIPE_SHADER_FRAGMENT];
+   unsigned i;
+
+   memcpy(copy, sp, sizeof *copy);
+   copy->dirty = 0;
+   copy->setup_mt = NULL;
+   copy->occlusion_count = 0;
+   memset(&copy->pipeline_statistics, 0, sizeof copy->pipeline_statistics);
+
+   copy->quad.shade = thr->quad.shade;
+   copy->quad.depth_test = thr->quad.depth_test;
+   copy->quad.blend = thr->quad.blend;
+   copy->quad.pstipple = thr->quad.pstipple;
+   sp_build_quad_pipeline(copy);
+
+   for (i = 0; i < sp->framebuffer.nr_cbufs; i++) {
+      if (sp->framebuffer.cbufs[i]) {
+         sp_tile_cache_fork(&thr->cbuf_cache[i], sp->cbuf_cache[i]);
+         copy->cbuf_cache[i] = &thr->cbuf_cache[i];
+      }
+   }
+   if (sp->framebuffer.zsbuf) {
+      sp_tile_cache_fork(&thr->zsbuf_cache, sp->zsbuf_cache);
+      copy->zsbuf_cache = &thr->zsbuf_cache;
+   }
+
+   /* Fragment shader samplers, with the thread's texture caches.  These
+    * map the textures themselves, like the context's ones do.
+    */
+   thr->sampler = *sp->tgsi.sampler[PIPE_SHADER_FRAGMENT];
+   for (i = 0; i < num_views; i++) {
+      struct softpipe_tex_tile_cache *tc = thr->tex_cache[i];
+
+      sp_tex_tile_cache_set_sampler_view(tc,
+                                         sp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+      if (tc->texture) {
+         struct softpipe_resource *spt = softpipe_resource(tc->texture);
+         if (spt->timestamp != tc->timestamp) {
+            sp_tex_tile_cache_validate_texture(tc);
+            tc->timestamp = spt->timestamp;
+         }
+      }
+      thr->sampler.sp_sview[i].cache = tc;
+   }
+   copy->tgsi.sampler[PIPE_SHADER_FRAGMENT] = &thr->sampler;
+
+   copy->fs_machine = thr->fs_machine;
+   if (thr->fs_variant != sp->fs_variant) {
+      sp->fs_variant->prepare(sp->fs_variant, thr->fs_machine,
+                              (struct tgsi_sampler *) &thr->sampler);
+      thr->fs_variant = sp->fs_variant;
+   }
+
+   sp_setup_prepare(thr->setup);
+   sp_setup_set_thread(thr->setup, thr->index, mt->num_threads);
+}
+
+
+/**
+ * Merge a thread's tile cache bookkeeping and counters back into the
+ * context, after it finished.
+ */
+static void
+join_thread(struct sp_setup_mt *mt, struct sp_setup_thread *thr)
+{
+   struct softpipe_context *sp = mt->softpipe;
+   const struct softpipe_context *copy = &thr->softpipe;
+   unsigned i;
+
+   for (i = 0; i < sp->framebuffer.nr_cbufs; i++) {
+      if (sp->framebuffer.cbufs[i]) {
+         sp_tile_cache_join(sp->cbuf_cache[i], &thr->cbuf_cache[i],
+                            thr->index, mt->num_threads);
+      }
+   }
+   if (sp->framebuffer.zsbuf) {
+      sp_tile_cache_join(sp->zsbuf_cache, &thr->zsbuf_cache,
+                         thr->index, mt->num_threads);
+   }
+
+   sp->occlusion_count += copy->occlusion_count;
+   sp->pipeline_statistics.ps_invocations +=
+      copy->pipeline_statistics.ps_invocations;
+}
+
+
+static PIPE_THREAD_ROUTINE( raster_thread, init_data )
+{
+   struct sp_setup_thread *thr = (struct sp_setup_thread *) init_data;
+   struct sp_setup_mt *mt = thr->mt;
+
+   while (1) {
+      pipe_semaphore_wait(&thr->work_ready);
+      if (mt->exit_flag)
+         break;
+
+      rasterize_bin(mt, thr->setup, thr->index);
+
+      pipe_semaphore_signal(&thr->work_done);
+   }
+
+   return 0;
+}
+
+
+static struct sp_setup_thread *
+create_thread(struct sp_setup_mt *mt, unsigned index)
+{
+   struct sp_setup_thread *thr = CALLOC_STRUCT(sp_setup_thread);
+   struct softpipe_context *copy;
+
+   if (!thr)
+      return NULL;
+
+   thr->mt = mt;
+   thr->index = index;
+   copy = &thr->softpipe;
+
+   thr->setup = sp_setup_create_context(copy);
+   thr->quad.shade = sp_quad_shade_stage(copy);
+   thr->quad.depth_test = sp_quad_depth_test_stage(copy);
+   thr->quad.blend = sp_quad_blend_stage(copy);
+   thr->quad.pstipple = sp_quad_polygon_stipple_stage(copy);
+   thr->fs_machine = tgsi_exec_machine_create();
+
+   if (!thr->setup ||
+       !thr->quad.shade ||
+       !thr->quad.depth_test ||
+       !thr->quad.blend ||
+       !thr->quad.pstipple ||
+       !thr->fs_machine)
+      return thr;  /* destroy_thread() cleans up */
+
+   pipe_semaphore_init(&thr->work_ready, 0);
+   pipe_semaphore_init(&thr->work_done, 0);
+   thr->thread = pipe_thread_create(raster_thread, thr);
+
+   return thr;
+}
+
+
+static void
+destroy_thread(struct sp_setup_thread *thr)
+{
+   unsigned i;
+
+   if (thr->thread) {
+      pipe_thread_wait(thr->thread);
+      pipe_semaphore_destroy(&thr->work_ready);
+      pipe_semaphore_destroy(&thr->work_done);
+   }
+
+   for (i = 0; i < Elements(thr->tex_cache); i++) {
+      if (thr->tex_cache[i]) {
+         sp_tex_tile_cache_set_sampler_view(thr->tex_cache[i], NULL);
+         sp_destroy_tex_tile_cache(thr->tex_cache[i]);
+      }
+   }
+
+   if (thr->fs_machine)
+      tgsi_exec_machine_destroy(thr->fs_machine);
+   if (thr->quad.shade)
+      thr->quad.shade->destroy(thr->quad.shade);
+   if (thr->quad.depth_test)
+      thr->quad.depth_test->destroy(thr->quad.depth_test);
+   if (thr->quad.blend)
+      thr->quad.blend->destroy(thr->quad.blend);
+   if (thr->quad.pstipple)
+      thr->quad.pstipple->destroy(thr->quad.pstipple);
+   if (thr->setup)
+      sp_setup_destroy_context(thr->setup);
+
+   FREE(thr);
+}
+
+
+/**
+ * \param num_threads  number of threads rasterizing each draw, including
+ *                     the calling one
+ * \return NULL if rasterization is single threaded
+ */
+struct sp_setup_mt *
+sp_setup_mt_create(struct softpipe_context *softpipe, unsigned num_threads)
+{
+   struct sp_setup_mt *mt;
+   unsigned i;
+
+   num_threads = MIN2(num_threads, SP_MAX_THREADS);
+   if (num_threads < 2)
+      return NULL;
+
+   mt = CALLOC_STRUCT(sp_setup_mt);
+   if (!mt)
+      return NULL;
+
+   mt->softpipe = softpipe;
+   mt->num_threads = num_threads;
+
+   for (i = 1; i < num_threads; i++) {
+      mt->threads[i] = create_thread(mt, i);
+      if (!mt->threads[i] || !mt->threads[i]->thread) {
+         sp_setup_mt_destroy(mt);
+         return NULL;
+      }
+   }
+
+   return mt;
+}
+
+
+void
+sp_setup_mt_destroy(struct sp_setup_mt *mt)
+{
+   unsigned i;
+
+   if (!mt)
+      return;
+
+   mt->exit_flag = TRUE;
+   for (i = 1; i < mt->num_threads; i++) {
+      if (mt->threads[i] && mt->threads[i]->thread)
+         pipe_semaphore_signal(&mt->threads[i]->work_ready);
+   }
+
+   for (i = 0; i < mt->num_threads; i++) {
+      if (mt->threads[i])
+         destroy_thread(mt->threads[i]);
+      FREE(mt->bins[i].prims);
+   }
+
+   FREE(mt->prims);
+   FREE(mt);
+}
+
+
+/**
+ * Start collecting the primitives of a draw of up to nr primitives.
+ * \return FALSE if the draw must be rasterized by the calling thread
+ *         alone, because we're out of memory.
+ */
+boolean
+sp_setup_mt_begin(struct sp_setup_mt *mt, struct setup_context *setup,
+                  unsigned nr)
+{
+   struct softpipe_context *sp = mt->softpipe;
+   unsigned i, t;
+
+   if (sp->no_rast || sp->rasterizer->rasterizer_discard)
+      return FALSE;
+
+   if (nr > mt->max_prims) {
+      FREE(mt->prims);
+      mt->prims = MALLOC(nr * sizeof mt->prims[0]);
+      for (i = 0; i < mt->num_threads; i++) {
+         FREE(mt->bins[i].prims);
+         mt->bins[i].prims = mt->prims ? MALLOC(nr * sizeof(unsigned)) : NULL;
+         if (!mt->bins[i].prims) {
+            mt->max_prims = 0;
+            return FALSE;
+         }
+      }
+      mt->max_prims = nr;
+   }
+
+   for (t = 1; t < mt->num_threads; t++) {
+      struct sp_setup_thread *thr = mt->threads[t];
+
+      for (i = 0; i < sp->num_sampler_views[PIPE_SHADER_FRAGMENT]; i++) {
+         if (!thr->tex_cache[i]) {
+            thr->tex_cache[i] = sp_create_tex_tile_cache(&sp->pipe);
+            if (!thr->tex_cache[i])
+               return FALSE;
+         }
+      }
+   }
+
+   /* The threads share the tiles of the caches, which must never need
+    * to be allocated while rendering.
+    */
+   for (i = 0; i < sp->framebuffer.nr_cbufs; i++) {
+      if (sp->framebuffer.cbufs[i] &&
+          !sp_tile_cache_reserve(sp->cbuf_cache[i]))
+         return FALSE;
+   }
+   if (sp->framebuffer.zsbuf &&
+       !sp_tile_cache_reserve(sp->zsbuf_cache))
+      return FALSE;
+
+   mt->setup = setup;
+   mt->num_prims = 0;
+   sp_setup_set_mt(setup, mt);
+
+   return TRUE;
+}
+
+
+/**
+ * Bin and rasterize the collected primitives.
+ */
+void
+sp_setup_mt_end(struct sp_setup_mt *mt)
+{
+   struct setup_context *setup = mt->setup;
+   unsigned busy = 0, last = 0;
+   unsigned i, t;
+
+   sp_setup_set_mt(setup, NULL);
+
+   for (t = 0; t < mt->num_threads; t++) {
+      mt->bins[t].num_prims = 0;
+   }
+
+   for (i = 0; i < mt->num_prims; i++) {
+      unsigned mask = prim_threads(mt, &mt->prims[i]);
+
+      while (mask) {
+         t = u_bit_scan(&mask);
+         mt->bins[t].prims[mt->bins[t].num_prims++] = i;
+      }
+   }
+
+   for (t = 0; t < mt->num_threads; t++) {
+      if (mt->bins[t].num_prims) {
+         busy++;
+         last = t;
+      }
+   }
+
+   if (busy > 1) {
+      for (t = 1; t < mt->num_threads; t++) {
+         if (mt->bins[t].num_prims) {
+            fork_thread(mt, mt->threads[t]);
+            pipe_semaphore_signal(&mt->threads[t]->work_ready);
+         }
+      }
+
+      sp_setup_set_thread(setup, 0, mt->num_threads);
+      rasterize_bin(mt, setup, 0);
+
+      for (t = 1; t < mt->num_threads; t++) {
+         if (mt->bins[t].num_prims) {
+            pipe_semaphore_wait(&mt->threads[t]->work_done);
+            join_thread(mt, mt->threads[t]);
+         }
+      }
+   }
+   else if (busy) {
+      /* not worth waking up the threads */
+      sp_setup_set_thread(setup, last, mt->num_threads);
+      rasterize_bin(mt, setup, last);
+   }
+
+   sp_setup_set_thread(setup, 0, 1);
+   mt->num_prims = 0;
+}
+
+
+/**
+ * Unbind a fragment shader variant which is about to be deleted from the
+ * threads' machines.
+ */
+void
+sp_setup_mt_delete_fs_variant(struct sp_setup_mt *mt,
+                              const struct sp_fragment_shader_variant *var)
+{
+   unsigned t;
+
+   for (t = 1; t < mt->num_threads; t++) {
+      struct sp_setup_thread *thr = mt->threads[t];
+
+      if (thr->fs_variant == var) {
+         tgsi_exec_machine_bind_shader(thr->fs_machine, NULL, NULL);
+         thr->fs_variant = NULL;
+      }
+   }
+}
+
+
+/**
+ * Drop the threads' cached texture tiles, see SP_FLUSH_TEXTURE_CACHE.
+ */
+void
+sp_setup_mt_flush_textures(struct sp_setup_mt *mt)
+{
+   unsigned i, t;
+
+   for (t = 1; t < mt->num_threads; t++) {
+      for (i = 0; i < Elements(mt->threads[t]->tex_cache); i++) {
+         if (mt->threads[t]->tex_cache[i])
+            sp_flush_tex_tile_cache(mt->threads[t]->tex_cache[i]);
+      }
+   }
+}
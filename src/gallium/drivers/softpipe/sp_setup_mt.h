@@ -0,0 +1,85 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Multi-threaded rasterization.
+ *
+ * The primitives of a draw are collected, binned to the threads owning
+ * the 64x64 tiles they touch, and each thread runs setup and the quad
+ * pipeline for its own tiles only.  The output is the same as with a
+ * single thread, see sp_setup_mt.c.
+ */
+
+#ifndef SP_SETUP_MT_H
+#define SP_SETUP_MT_H
+
+#include "pipe/p_compiler.h"
+
+
+struct softpipe_context;
+struct setup_context;
+struct sp_fragment_shader_variant;
+struct sp_setup_mt;
+
+
+struct sp_setup_mt *
+sp_setup_mt_create(struct softpipe_context *softpipe, unsigned num_threads);
+
+void
+sp_setup_mt_destroy(struct sp_setup_mt *mt);
+
+boolean
+sp_setup_mt_begin(struct sp_setup_mt *mt, struct setup_context *setup,
+                  unsigned nr);
+
+void
+sp_setup_mt_end(struct sp_setup_mt *mt);
+
+void
+sp_setup_mt_delete_fs_variant(struct sp_setup_mt *mt,
+                              const struct sp_fragment_shader_variant *var);
+
+void
+sp_setup_mt_flush_textures(struct sp_setup_mt *mt);
+
+void
+sp_setup_mt_tri(struct sp_setup_mt *mt,
+                const float (*v0)[4],
+                const float (*v1)[4],
+                const float (*v2)[4]);
+
+void
+sp_setup_mt_line(struct sp_setup_mt *mt,
+                 const float (*v0)[4],
+                 const float (*v1)[4]);
+
+void
+sp_setup_mt_point(struct sp_setup_mt *mt,
+                  const float (*v0)[4]);
+
+
+#endif /* SP_SETUP_MT_H */
@@ -28,6 +28,7 @@
 #include "sp_context.h"
 #include "sp_state.h"
 #include "sp_fs.h"
+#include "sp_setup_mt.h"
 #include "sp_texture.h"
 
 #include "pipe/p_defines.h"
@@ -192,6 +193,9 @@ softpipe_delete_fs_state(struct pipe_context *pipe, void *fs)
       draw_delete_fragment_shader(softpipe->draw, var->draw_shader);
 #endif
 
+      if (softpipe->setup_mt)
+         sp_setup_mt_delete_fs_variant(softpipe->setup_mt, var);
+
       var->delete(var, softpipe->fs_machine);
    }
 
@@ -41,13 +41,79 @@
 #include "sp_texture.h"
 #include "sp_tex_tile_cache.h"
 
-   
+
+static INLINE unsigned
+tex_cache_num_entries(const struct softpipe_tex_tile_cache *tc)
+{
+   return tc->num_sets * TEX_TILE_WAYS;
+}
+
+
+static void
+tex_cache_invalidate(struct softpipe_tex_tile_cache *tc)
+{
+   unsigned pos;
+
+   for (pos = 0; pos < tex_cache_num_entries(tc); pos++) {
+      tc->entries[pos].addr.bits.invalid = 1;
+      tc->entries[pos].lru = 0;
+   }
+   tc->lru_clock = 0;
+}
+
+
+/**
+ * (Re)allocate the cache with the given number of sets.  The old
+ * entries are kept if the allocation fails.
+ */
+static boolean
+tex_cache_resize(struct softpipe_tex_tile_cache *tc, unsigned num_sets)
+{
+   struct softpipe_tex_cached_tile *entries;
+
+   if (tc->entries && tc->num_sets == num_sets)
+      return TRUE;
+
+   entries = MALLOC(num_sets * TEX_TILE_WAYS * sizeof *entries);
+   if (!entries)
+      return FALSE;
+
+   FREE(tc->entries);
+   tc->entries = entries;
+   tc->num_sets = num_sets;
+   tc->last_tile = &tc->entries[0]; /* any tile */
+   tex_cache_invalidate(tc);
+   return TRUE;
+}
+
+
+/**
+ * Number of sets to use for a texture: enough to hold all the tiles of
+ * one face/layer of the texture, including the mipmaps, within the
+ * MIN/MAX_TEX_TILE_SETS limits.
+ */
+static unsigned
+tex_cache_num_sets(const struct pipe_resource *texture)
+{
+   unsigned tiles, sets;
+
+   if (!texture)
+      return MIN_TEX_TILE_SETS;
+
+   tiles = ((texture->width0 + TEX_TILE_SIZE - 1) >> TEX_TILE_SIZE_LOG2) *
+           ((texture->height0 + TEX_TILE_SIZE - 1) >> TEX_TILE_SIZE_LOG2);
+   if (texture->last_level > 0)
+      tiles += tiles / 3;
+
+   sets = util_next_power_of_two((tiles + TEX_TILE_WAYS - 1) / TEX_TILE_WAYS);
+   return CLAMP(sets, MIN_TEX_TILE_SETS, MAX_TEX_TILE_SETS);
+}
+
 
 struct softpipe_tex_tile_cache *
 sp_create_tex_tile_cache( struct pipe_context *pipe )
 {
    struct softpipe_tex_tile_cache *tc;
-   uint pos;
 
    /* make sure max texture size works */
    assert((TEX_TILE_SIZE << TEX_ADDR_BITS) >= (1 << (SP_MAX_TEXTURE_2D_LEVELS-1)));
@@ -55,10 +121,10 @@ sp_create_tex_tile_cache( struct pipe_context *pipe )
    tc = CALLOC_STRUCT( softpipe_tex_tile_cache );
    if (tc) {
       tc->pipe = pipe;
-      for (pos = 0; pos < Elements(tc->entries); pos++) {
-         tc->entries[pos].addr.bits.invalid = 1;
+      if (!tex_cache_resize(tc, MIN_TEX_TILE_SETS)) {
+         FREE(tc);
+         return NULL;
       }
-      tc->last_tile = &tc->entries[0]; /* any tile */
    }
    return tc;
 }
@@ -68,11 +134,11 @@ void
 sp_destroy_tex_tile_cache(struct softpipe_tex_tile_cache *tc)
 {
    if (tc) {
-      uint pos;
+      struct softpipe_context *softpipe = softpipe_context(tc->pipe);
+
+      softpipe->tex_cache_hits += tc->hits;
+      softpipe->tex_cache_misses += tc->misses;
 
-      for (pos = 0; pos < Elements(tc->entries); pos++) {
-         /*assert(tc->entries[pos].x < 0);*/
-      }
       if (tc->transfer) {
          tc->pipe->transfer_unmap(tc->pipe, tc->transfer);
       }
@@ -80,6 +146,7 @@ sp_destroy_tex_tile_cache(struct softpipe_tex_tile_cache *tc)
          tc->pipe->transfer_unmap(tc->pipe, tc->tex_trans);
       }
 
+      FREE( tc->entries );
       FREE( tc );
    }
 }
@@ -92,14 +159,10 @@ sp_destroy_tex_tile_cache(struct softpipe_tex_tile_cache *tc)
 void
 sp_tex_tile_cache_validate_texture(struct softpipe_tex_tile_cache *tc)
 {
-   unsigned i;
-
    assert(tc);
    assert(tc->texture);
 
-   for (i = 0; i < Elements(tc->entries); i++) {
-      tc->entries[i].addr.bits.invalid = 1;
-   }
+   tex_cache_invalidate(tc);
 }
 
 static boolean
@@ -124,7 +187,6 @@ sp_tex_tile_cache_set_sampler_view(struct softpipe_tex_tile_cache *tc,
                                    struct pipe_sampler_view *view)
 {
    struct pipe_resource *texture = view ? view->texture : NULL;
-   uint i;
 
    assert(!tc->transfer);
 
@@ -145,11 +207,13 @@ sp_tex_tile_cache_set_sampler_view(struct softpipe_tex_tile_cache *tc,
          tc->format = view->format;
       }
 
-      /* mark as entries as invalid/empty */
+      /* mark as entries as invalid/empty, resizing the cache for the
+       * new texture if needed
+       */
       /* XXX we should try to avoid this when the teximage hasn't changed */
-      for (i = 0; i < Elements(tc->entries); i++) {
-         tc->entries[i].addr.bits.invalid = 1;
-      }
+      if (texture)
+         tex_cache_resize(tc, tex_cache_num_sets(texture));
+      tex_cache_invalidate(tc);
 
       tc->tex_face = -1; /* any invalid value here */
    }
@@ -165,13 +229,9 @@ sp_tex_tile_cache_set_sampler_view(struct softpipe_tex_tile_cache *tc,
 void
 sp_flush_tex_tile_cache(struct softpipe_tex_tile_cache *tc)
 {
-   int pos;
-
    if (tc->texture) {
       /* caching a texture, mark all entries as empty */
-      for (pos = 0; pos < Elements(tc->entries); pos++) {
-         tc->entries[pos].addr.bits.invalid = 1;
-      }
+      tex_cache_invalidate(tc);
       tc->tex_face = -1;
    }
 
@@ -180,13 +240,11 @@ sp_flush_tex_tile_cache(struct softpipe_tex_tile_cache *tc)
 
 /**
  * Given the texture face, level, zslice, x and y values, compute
- * the cache entry position/index where we'd hope to find the
- * cached texture tile.
- * This is basically a direct-map cache.
- * XXX There's probably lots of ways in which we can improve this.
+ * the cache set where we'd hope to find the cached texture tile.
  */
 static INLINE uint
-tex_cache_pos( union tex_tile_address addr )
+tex_cache_set( const struct softpipe_tex_tile_cache *tc,
+               union tex_tile_address addr )
 {
    uint entry = (addr.bits.x + 
                  addr.bits.y * 9 + 
@@ -194,7 +252,7 @@ tex_cache_pos( union tex_tile_address addr )
                  addr.bits.face + 
                  addr.bits.level * 7);
 
-   return entry % NUM_TEX_TILE_ENTRIES;
+   return entry & (tc->num_sets - 1);
 }
 
 /**
@@ -205,12 +263,29 @@ const struct softpipe_tex_cached_tile *
 sp_find_cached_tile_tex(struct softpipe_tex_tile_cache *tc, 
                         union tex_tile_address addr )
 {
-   struct softpipe_tex_cached_tile *tile;
+   struct softpipe_tex_cached_tile *set, *tile;
    boolean zs = util_format_is_depth_or_stencil(tc->format);
+   unsigned way, pos;
+
+   set = tc->entries + tex_cache_set( tc, addr ) * TEX_TILE_WAYS;
+
+   /* look for the tile in the set, remembering the least recently used
+    * entry in case of a miss (invalid entries have lru == 0)
+    */
+   tile = set;
+   for (way = 0; way < TEX_TILE_WAYS; way++) {
+      if (set[way].addr.value == addr.value) {
+         tile = &set[way];
+         break;
+      }
+      if (set[way].lru < tile->lru)
+         tile = &set[way];
+   }
 
-   tile = tc->entries + tex_cache_pos( addr );
-
-   if (addr.value != tile->addr.value) {
+   if (way < TEX_TILE_WAYS) {
+      tc->hits++;
+   }
+   else {
 
       /* cache miss.  Most misses are because we've invalidated the
        * texture cache previously -- most commonly on binding a new
@@ -289,8 +364,17 @@ sp_find_cached_tile_tex(struct softpipe_tex_tile_cache *tc,
                                    (float *) tile->data.color);
       }
       tile->addr = addr;
+      tc->misses++;
    }
 
+   if (++tc->lru_clock == 0) {
+      /* wrapped around: start over, forgetting the usage history */
+      for (pos = 0; pos < tex_cache_num_entries(tc); pos++) {
+         tc->entries[pos].lru = 0;
+      }
+      tc->lru_clock = 1;
+   }
+   tile->lru = tc->lru_clock;
    tc->last_tile = tile;
    return tile;
 }
@@ -66,6 +66,7 @@ union tex_tile_address {
 struct softpipe_tex_cached_tile
 {
    union tex_tile_address addr;
+   unsigned lru;  /**< tc->lru_clock at the last lookup */
    union {
       float color[TEX_TILE_SIZE][TEX_TILE_SIZE][4];
       unsigned int colorui[TEX_TILE_SIZE][TEX_TILE_SIZE][4];
@@ -74,12 +75,14 @@ struct softpipe_tex_cached_tile
 };
 
 /*
- * The number of cache entries.
- * Should not be decreased to lower than 16, and even that
- * seems too low to avoid cache thrashing in some cases (because
- * the cache is direct mapped, see tex_cache_pos() function).
+ * The cache is set associative, with TEX_TILE_WAYS entries per set and
+ * LRU replacement within a set.  The number of sets is a power of two
+ * between MIN_TEX_TILE_SETS and MAX_TEX_TILE_SETS, sized for the texture
+ * (see tex_cache_num_sets()).
  */
-#define NUM_TEX_TILE_ENTRIES 16
+#define TEX_TILE_WAYS 4
+#define MIN_TEX_TILE_SETS 4
+#define MAX_TEX_TILE_SETS 32
 
 struct softpipe_tex_tile_cache
 {
@@ -90,7 +93,9 @@ struct softpipe_tex_tile_cache
    struct pipe_resource *texture;  /**< if caching a texture */
    unsigned timestamp;
 
-   struct softpipe_tex_cached_tile entries[NUM_TEX_TILE_ENTRIES];
+   struct softpipe_tex_cached_tile *entries;  /**< num_sets * TEX_TILE_WAYS */
+   unsigned num_sets;
+   unsigned lru_clock;
 
    struct pipe_transfer *tex_trans;
    void *tex_trans_map;
@@ -103,6 +108,10 @@ struct softpipe_tex_tile_cache
    enum pipe_format format;
 
    struct softpipe_tex_cached_tile *last_tile;  /**< most recently retrieved tile */
+
+   /** Statistics, see SOFTPIPE_TEX_CACHE_STATS */
+   uint64_t hits;
+   uint64_t misses;
 };
 
 
@@ -153,8 +162,10 @@ static INLINE const struct softpipe_tex_cached_tile *
 sp_get_cached_tile_tex(struct softpipe_tex_tile_cache *tc, 
                        union tex_tile_address addr )
 {
-   if (tc->last_tile->addr.value == addr.value)
+   if (tc->last_tile->addr.value == addr.value) {
+      tc->hits++;
       return tc->last_tile;
+   }
 
    return sp_find_cached_tile_tex( tc, addr );
 }
@@ -42,17 +42,6 @@ static struct softpipe_cached_tile *
 sp_alloc_tile(struct softpipe_tile_cache *tc);
 
 
-/**
- * Return the position in the cache for the tile that contains win pos (x,y).
- * We currently use a direct mapped cache so this is like a hack key.
- * At some point we should investige something more sophisticated, like
- * a LRU replacement policy.
- */
-#define CACHE_POS(x, y) \
-   (((x) + (y) * 5) % NUM_ENTRIES)
-
-
-
 /**
  * Is the tile at (x,y) in cleared state?
  */
@@ -613,3 +602,68 @@ sp_tile_cache_clear(struct softpipe_tile_cache *tc,
    }
    tc->last_tile_addr.bits.invalid = 1;
 }
+
+
+/**
+ * Allocate all the cache entries up front, so that rasterizer threads
+ * sharing the cache never need sp_alloc_tile(), whose fallback steals
+ * other entries.
+ * \return FALSE if out of memory
+ */
+boolean
+sp_tile_cache_reserve(struct softpipe_tile_cache *tc)
+{
+   uint pos;
+
+   for (pos = 0; pos < Elements(tc->entries); pos++) {
+      if (!tc->entries[pos]) {
+         tc->entries[pos] = MALLOC_STRUCT( softpipe_cached_tile );
+         if (!tc->entries[pos])
+            return FALSE;
+      }
+   }
+   return TRUE;
+}
+
+
+/**
+ * Set up 'copy' as a rasterizer thread's view of the cache.  The thread
+ * must only access tiles whose cache position is owned by it, i.e.
+ * CACHE_POS(x, y) % num_threads == thread.  The tile data is shared,
+ * only the bookkeeping is private.
+ */
+void
+sp_tile_cache_fork(struct softpipe_tile_cache *copy,
+                   const struct softpipe_tile_cache *tc)
+{
+   assert(tc->transfer);
+
+   memcpy(copy, tc, sizeof *copy);
+   copy->last_tile_addr.bits.invalid = 1;
+   copy->last_tile = NULL;
+}
+
+
+/**
+ * Take back the bookkeeping of the positions owned by a thread from its
+ * view of the cache.
+ */
+void
+sp_tile_cache_join(struct softpipe_tile_cache *tc,
+                   const struct softpipe_tile_cache *copy,
+                   unsigned thread, unsigned num_threads)
+{
+   uint pos, i;
+
+   for (pos = thread; pos < Elements(tc->tile_addrs); pos += num_threads) {
+      assert(tc->entries[pos] == copy->entries[pos]);
+      tc->tile_addrs[pos] = copy->tile_addrs[pos];
+   }
+
+   /* tiles only ever leave the cleared state while rendering */
+   for (i = 0; i < Elements(tc->clear_flags); i++) {
+      tc->clear_flags[i] &= copy->clear_flags[i];
+   }
+
+   tc->last_tile_addr.bits.invalid = 1;
+}
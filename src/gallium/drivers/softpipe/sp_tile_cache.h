@@ -78,6 +78,16 @@ struct softpipe_cached_tile
 #define NUM_ENTRIES 50
 
 
+/**
+ * Return the position in the cache for the tile at tile address (x,y).
+ * We currently use a direct mapped cache so this is like a hack key.
+ * At some point we should investige something more sophisticated, like
+ * a LRU replacement policy.
+ */
+#define CACHE_POS(x, y) \
+   (((x) + (y) * 5) % NUM_ENTRIES)
+
+
 struct softpipe_tile_cache
 {
    struct pipe_context *pipe;
@@ -124,6 +134,18 @@ extern struct softpipe_cached_tile *
 sp_find_cached_tile(struct softpipe_tile_cache *tc, 
                     union tile_address addr );
 
+extern boolean
+sp_tile_cache_reserve(struct softpipe_tile_cache *tc);
+
+extern void
+sp_tile_cache_fork(struct softpipe_tile_cache *copy,
+                   const struct softpipe_tile_cache *tc);
+
+extern void
+sp_tile_cache_join(struct softpipe_tile_cache *tc,
+                   const struct softpipe_tile_cache *copy,
+                   unsigned thread, unsigned num_threads);
+
 
 static INLINE union tile_address
 tile_address( unsigned x,
@@ -13,6 +13,15 @@ struct drisw_loader_funcs
 {
    void (*put_image) (struct dri_drawable *dri_drawable,
                       void *data, unsigned width, unsigned height);
+
+   /**
+    * Optional.  Put an image held in a System V shared memory segment,
+    * without copying it if possible.  Returns FALSE if it was copied.
+    */
+   boolean (*put_image_shm) (struct dri_drawable *dri_drawable,
+                             int shmid, char *shmaddr, unsigned offset,
+                             unsigned width, unsigned height,
+                             unsigned stride);
 };
 
 /**
@@ -28,10 +28,7 @@
 
 /* TODO:
  *
- * xshm / EGLImage:
- *
- * Allow the loaders to use the XSHM extension. It probably requires callbacks
- * for createImage/destroyImage similar to DRI2 getBuffers.
+ * EGLImage.
  */
 
 #include "util/u_format.h"
@@ -70,6 +67,20 @@ put_image(__DRIdrawable *dPriv, void *data, unsigned width, unsigned height)
                     data, dPriv->loaderPrivate);
 }
 
+static INLINE boolean
+put_image_shm(__DRIdrawable *dPriv, int shmid, char *shmaddr,
+              unsigned offset, unsigned width, unsigned height,
+              unsigned stride)
+{
+   __DRIscreen *sPriv = dPriv->driScreenPriv;
+   const __DRIswrastLoaderExtension *loader = sPriv->swrast_loader;
+
+   return loader->putImageShm(dPriv, __DRI_SWRAST_IMAGE_OP_SWAP,
+                              0, 0, width, height, stride,
+                              shmid, shmaddr, offset,
+                              dPriv->loaderPrivate) != 0;
+}
+
 static INLINE void
 get_image(__DRIdrawable *dPriv, int x, int y, int width, int height, void *data)
 {
@@ -99,6 +110,16 @@ drisw_put_image(struct dri_drawable *drawable,
    put_image(dPriv, data, width, height);
 }
 
+static boolean
+drisw_put_image_shm(struct dri_drawable *drawable,
+                    int shmid, char *shmaddr, unsigned offset,
+                    unsigned width, unsigned height, unsigned stride)
+{
+   __DRIdrawable *dPriv = drawable->dPriv;
+
+   return put_image_shm(dPriv, shmid, shmaddr, offset, width, height, stride);
+}
+
 static INLINE void
 drisw_present_texture(__DRIdrawable *dPriv,
                       struct pipe_resource *ptex)
@@ -291,9 +312,16 @@ static struct drisw_loader_funcs drisw_lf = {
    .put_image = drisw_put_image
 };
 
+static struct drisw_loader_funcs drisw_shm_lf = {
+   .put_image = drisw_put_image,
+   .put_image_shm = drisw_put_image_shm
+};
+
 static const __DRIconfig **
 drisw_init_screen(__DRIscreen * sPriv)
 {
+   const __DRIswrastLoaderExtension *loader = sPriv->swrast_loader;
+   struct drisw_loader_funcs *lf = &drisw_lf;
    const __DRIconfig **configs;
    struct dri_screen *screen;
    struct pipe_screen *pscreen;
@@ -310,7 +338,10 @@ drisw_init_screen(__DRIscreen * sPriv)
    sPriv->driverPrivate = (void *)screen;
    sPriv->extensions = drisw_screen_extensions;
 
-   pscreen = drisw_create_screen(&drisw_lf);
+   if (loader->base.version >= 2 && loader->putImageShm)
+      lf = &drisw_shm_lf;
+
+   pscreen = drisw_create_screen(lf);
    /* dri_init_screen_helper checks pscreen for us */
 
    configs = dri_init_screen_helper(screen, pscreen);
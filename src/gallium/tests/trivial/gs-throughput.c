@@ -0,0 +1,299 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Geometry shader throughput benchmark: draws one million points, each
+ * expanded to a quad by a geometry shader, a number of times and prints
+ * the primitive rate.  All quads are culled, so that the time is spent
+ * running the vertex and geometry shaders rather than rasterizing.
+ *
+ * Usage: gs-throughput [iterations [points]]
+ */
+
+#define WIDTH 256
+#define HEIGHT 256
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pipe/p_state.h"
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_shader_tokens.h"
+#include "util/u_inlines.h"
+#include "cso_cache/cso_context.h"
+#include "os/os_time.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_debug.h"
+#include "util/u_draw_quad.h"
+#include "util/u_memory.h"
+#include "util/u_simple_shaders.h"
+#include "pipe-loader/pipe_loader.h"
+
+/* point sprite: one quad of 4x4 pixels around each input point */
+static const char gs_text[] =
+	"GEOM\n"
+	"PROPERTY GS_INPUT_PRIMITIVE POINTS\n"
+	"PROPERTY GS_OUTPUT_PRIMITIVE TRIANGLE_STRIP\n"
+	"PROPERTY GS_MAX_OUTPUT_VERTICES 4\n"
+	"DCL IN[][0], POSITION, CONSTANT\n"
+	"DCL IN[][1], COLOR, CONSTANT\n"
+	"DCL OUT[0], POSITION, CONSTANT\n"
+	"DCL OUT[1], COLOR, CONSTANT\n"
+	"IMM[0] FLT32 { -0.015625, -0.015625, 0.0, 0.0 }\n"
+	"IMM[1] FLT32 {  0.015625, -0.015625, 0.0, 0.0 }\n"
+	"IMM[2] FLT32 { -0.015625,  0.015625, 0.0, 0.0 }\n"
+	"IMM[3] FLT32 {  0.015625,  0.015625, 0.0, 0.0 }\n"
+	"ADD OUT[0], IN[0][0], IMM[0]\n"
+	"MOV OUT[1], IN[0][1]\n"
+	"EMIT\n"
+	"ADD OUT[0], IN[0][0], IMM[1]\n"
+	"MOV OUT[1], IN[0][1]\n"
+	"EMIT\n"
+	"ADD OUT[0], IN[0][0], IMM[2]\n"
+	"MOV OUT[1], IN[0][1]\n"
+	"EMIT\n"
+	"ADD OUT[0], IN[0][0], IMM[3]\n"
+	"MOV OUT[1], IN[0][1]\n"
+	"EMIT\n"
+	"ENDPRIM\n"
+	"END\n";
+
+struct program
+{
+	struct pipe_loader_device *dev;
+	struct pipe_screen *screen;
+	struct pipe_context *pipe;
+	struct cso_context *cso;
+
+	struct pipe_blend_state blend;
+	struct pipe_depth_stencil_alpha_state depthstencil;
+	struct pipe_rasterizer_state rasterizer;
+	struct pipe_viewport_state viewport;
+	struct pipe_framebuffer_state framebuffer;
+	struct pipe_vertex_element velem[2];
+
+	void *vs;
+	void *gs;
+	void *fs;
+
+	unsigned num_points;
+	struct pipe_resource *vbuf;
+	struct pipe_resource *target;
+};
+
+static void init_prog(struct program *p)
+{
+	struct pipe_surface surf_tmpl;
+	int ret;
+	unsigned i;
+
+	ret = pipe_loader_probe(&p->dev, 1);
+	assert(ret);
+
+	p->screen = pipe_loader_create_screen(p->dev, PIPE_SEARCH_DIR);
+	assert(p->screen);
+
+	if (!p->screen->get_shader_param(p->screen, PIPE_SHADER_GEOMETRY,
+					 PIPE_SHADER_CAP_MAX_INSTRUCTIONS)) {
+		fprintf(stderr, "geometry shaders not supported\n");
+		exit(1);
+	}
+
+	p->pipe = p->screen->context_create(p->screen, NULL);
+	p->cso = cso_create_context(p->pipe);
+
+	/* vertex buffer: position and color of each point */
+	{
+		float (*vertices)[2][4];
+		unsigned size = p->num_points * sizeof(*vertices);
+
+		vertices = MALLOC(size);
+		assert(vertices);
+
+		for (i = 0; i < p->num_points; i++) {
+			vertices[i][0][0] = (float)(i % 1024) / 512.0f - 1.0f;
+			vertices[i][0][1] = (float)(i / 1024 % 1024) / 512.0f - 1.0f;
+			vertices[i][0][2] = 0.0f;
+			vertices[i][0][3] = 1.0f;
+			vertices[i][1][0] = (float)(i % 3 == 0);
+			vertices[i][1][1] = (float)(i % 3 == 1);
+			vertices[i][1][2] = (float)(i % 3 == 2);
+			vertices[i][1][3] = 1.0f;
+		}
+
+		p->vbuf = pipe_buffer_create(p->screen, PIPE_BIND_VERTEX_BUFFER,
+					     PIPE_USAGE_STATIC, size);
+		pipe_buffer_write(p->pipe, p->vbuf, 0, size, vertices);
+		FREE(vertices);
+	}
+
+	/* render target texture */
+	{
+		struct pipe_resource tmplt;
+		memset(&tmplt, 0, sizeof(tmplt));
+		tmplt.target = PIPE_TEXTURE_2D;
+		tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+		tmplt.width0 = WIDTH;
+		tmplt.height0 = HEIGHT;
+		tmplt.depth0 = 1;
+		tmplt.array_size = 1;
+		tmplt.last_level = 0;
+		tmplt.bind = PIPE_BIND_RENDER_TARGET;
+
+		p->target = p->screen->resource_create(p->screen, &tmplt);
+	}
+
+	memset(&p->blend, 0, sizeof(p->blend));
+	p->blend.rt[0].colormask = PIPE_MASK_RGBA;
+
+	memset(&p->depthstencil, 0, sizeof(p->depthstencil));
+
+	/* cull everything, only the vertex and geometry processing is measured */
+	memset(&p->rasterizer, 0, sizeof(p->rasterizer));
+	p->rasterizer.cull_face = PIPE_FACE_FRONT_AND_BACK;
+	p->rasterizer.half_pixel_center = 1;
+	p->rasterizer.bottom_edge_rule = 1;
+	p->rasterizer.depth_clip = 1;
+
+	surf_tmpl.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+	surf_tmpl.u.tex.level = 0;
+	surf_tmpl.u.tex.first_layer = 0;
+	surf_tmpl.u.tex.last_layer = 0;
+	memset(&p->framebuffer, 0, sizeof(p->framebuffer));
+	p->framebuffer.width = WIDTH;
+	p->framebuffer.height = HEIGHT;
+	p->framebuffer.nr_cbufs = 1;
+	p->framebuffer.cbufs[0] = p->pipe->create_surface(p->pipe, p->target, &surf_tmpl);
+
+	p->viewport.scale[0] = WIDTH / 2.0f;
+	p->viewport.scale[1] = HEIGHT / 2.0f;
+	p->viewport.scale[2] = 0.5f;
+	p->viewport.scale[3] = 1.0f;
+	p->viewport.translate[0] = WIDTH / 2.0f;
+	p->viewport.translate[1] = HEIGHT / 2.0f;
+	p->viewport.translate[2] = 0.5f;
+	p->viewport.translate[3] = 0.0f;
+
+	memset(p->velem, 0, sizeof(p->velem));
+	p->velem[0].src_offset = 0 * 4 * sizeof(float);
+	p->velem[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+	p->velem[1].src_offset = 1 * 4 * sizeof(float);
+	p->velem[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+	{
+		const uint semantic_names[] = { TGSI_SEMANTIC_POSITION,
+						TGSI_SEMANTIC_COLOR };
+		const uint semantic_indexes[] = { 0, 0 };
+		p->vs = util_make_vertex_passthrough_shader(p->pipe, 2, semantic_names, semantic_indexes);
+	}
+
+	{
+		struct tgsi_token tokens[1024];
+		struct pipe_shader_state state;
+
+		ret = tgsi_text_translate(gs_text, tokens, Elements(tokens));
+		assert(ret);
+
+		memset(&state, 0, sizeof(state));
+		state.tokens = tokens;
+		p->gs = p->pipe->create_gs_state(p->pipe, &state);
+	}
+
+	p->fs = util_make_fragment_passthrough_shader(p->pipe,
+		    TGSI_SEMANTIC_COLOR, TGSI_INTERPOLATE_PERSPECTIVE, TRUE);
+}
+
+static void close_prog(struct program *p)
+{
+	cso_release_all(p->cso);
+
+	p->pipe->delete_vs_state(p->pipe, p->vs);
+	p->pipe->delete_gs_state(p->pipe, p->gs);
+	p->pipe->delete_fs_state(p->pipe, p->fs);
+
+	pipe_surface_reference(&p->framebuffer.cbufs[0], NULL);
+	pipe_resource_reference(&p->target, NULL);
+	pipe_resource_reference(&p->vbuf, NULL);
+
+	cso_destroy_context(p->cso);
+	p->pipe->destroy(p->pipe);
+	p->screen->destroy(p->screen);
+	pipe_loader_release(&p->dev, 1);
+
+	FREE(p);
+}
+
+static void draw(struct program *p)
+{
+	cso_set_framebuffer(p->cso, &p->framebuffer);
+	cso_set_blend(p->cso, &p->blend);
+	cso_set_depth_stencil_alpha(p->cso, &p->depthstencil);
+	cso_set_rasterizer(p->cso, &p->rasterizer);
+	cso_set_viewport(p->cso, &p->viewport);
+	cso_set_fragment_shader_handle(p->cso, p->fs);
+	cso_set_geometry_shader_handle(p->cso, p->gs);
+	cso_set_vertex_shader_handle(p->cso, p->vs);
+	cso_set_vertex_elements(p->cso, 2, p->velem);
+
+	util_draw_vertex_buffer(p->pipe, p->cso,
+	                        p->vbuf, 0, 0,
+	                        PIPE_PRIM_POINTS,
+	                        p->num_points,
+	                        2); /* attribs/vert */
+
+	p->pipe->flush(p->pipe, NULL, 0);
+}
+
+int main(int argc, char** argv)
+{
+	struct program *p = CALLOC_STRUCT(program);
+	unsigned iterations = argc > 1 ? atoi(argv[1]) : 20;
+	unsigned i;
+	int64_t start, end;
+
+	p->num_points = argc > 2 ? atoi(argv[2]) : 1000000;
+
+	init_prog(p);
+
+	/* compile the shaders outside of the timed loop */
+	draw(p);
+
+	start = os_time_get();
+	for (i = 0; i < iterations; i++)
+		draw(p);
+	end = os_time_get();
+
+	printf("%u x %u points in %.3f sec: %.2f Mquads/sec\n",
+	       iterations, p->num_points, (end - start) / 1000000.0,
+	       (double)iterations * p->num_points / (end - start));
+
+	close_prog(p);
+
+	return 0;
+}
@@ -0,0 +1,358 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Texture sampling benchmark: draws a window-sized quad sampling two
+ * mipmapped textures with trilinear filtering, a number of times, and
+ * prints the fragment rate.  The texture coordinates repeat and minify the
+ * textures, so that the samplers walk through several mipmap levels of
+ * both textures at once.
+ *
+ * Usage: tex-throughput [iterations [texture size]]
+ */
+
+#define WIDTH 512
+#define HEIGHT 512
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pipe/p_state.h"
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_shader_tokens.h"
+#include "util/u_inlines.h"
+#include "cso_cache/cso_context.h"
+#include "os/os_time.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_debug.h"
+#include "util/u_draw_quad.h"
+#include "util/u_memory.h"
+#include "util/u_sampler.h"
+#include "util/u_simple_shaders.h"
+#include "pipe-loader/pipe_loader.h"
+
+#define NUM_TEXTURES 2
+
+struct program
+{
+	struct pipe_loader_device *dev;
+	struct pipe_screen *screen;
+	struct pipe_context *pipe;
+	struct cso_context *cso;
+
+	struct pipe_blend_state blend;
+	struct pipe_depth_stencil_alpha_state depthstencil;
+	struct pipe_rasterizer_state rasterizer;
+	struct pipe_sampler_state sampler;
+	struct pipe_viewport_state viewport;
+	struct pipe_framebuffer_state framebuffer;
+	struct pipe_vertex_element velem[2];
+
+	void *vs;
+	void *fs;
+
+	unsigned tex_size;
+	struct pipe_resource *tex[NUM_TEXTURES];
+	struct pipe_sampler_view *view[NUM_TEXTURES];
+	struct pipe_resource *vbuf;
+	struct pipe_resource *target;
+};
+
+/* the second texture is sampled with three times the frequency */
+static const char *fs_text =
+	"FRAG\n"
+	"DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+	"DCL OUT[0], COLOR\n"
+	"DCL SAMP[0]\n"
+	"DCL SAMP[1]\n"
+	"DCL TEMP[0..1]\n"
+	"IMM[0] FLT32 { 3.0, 3.0, 0.0, 0.0 }\n"
+	"IMM[1] FLT32 { 0.5, 0.5, 0.5, 0.5 }\n"
+	"TEX TEMP[0], IN[0], SAMP[0], 2D\n"
+	"MUL TEMP[1], IN[0], IMM[0]\n"
+	"TEX TEMP[1], TEMP[1], SAMP[1], 2D\n"
+	"ADD TEMP[0], TEMP[0], TEMP[1]\n"
+	"MUL OUT[0], TEMP[0], IMM[1]\n"
+	"END\n";
+
+static struct pipe_resource *
+create_texture(struct program *p, unsigned seed)
+{
+	struct pipe_resource t_tmplt;
+	struct pipe_resource *tex;
+	unsigned level, x, y;
+
+	memset(&t_tmplt, 0, sizeof(t_tmplt));
+	t_tmplt.target = PIPE_TEXTURE_2D;
+	t_tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+	t_tmplt.width0 = p->tex_size;
+	t_tmplt.height0 = p->tex_size;
+	t_tmplt.depth0 = 1;
+	t_tmplt.array_size = 1;
+	t_tmplt.last_level = util_logbase2(p->tex_size);
+	t_tmplt.bind = PIPE_BIND_SAMPLER_VIEW;
+
+	tex = p->screen->resource_create(p->screen, &t_tmplt);
+	assert(tex);
+
+	/* a different pattern in each level, so that no level can be
+	 * mistaken for another
+	 */
+	for (level = 0; level <= t_tmplt.last_level; level++) {
+		unsigned size = u_minify(p->tex_size, level);
+		struct pipe_transfer *t;
+		struct pipe_box box;
+		uint8_t *map;
+
+		u_box_origin_2d(size, size, &box);
+		map = p->pipe->transfer_map(p->pipe, tex, level,
+					    PIPE_TRANSFER_WRITE, &box, &t);
+		assert(map);
+
+		for (y = 0; y < size; y++) {
+			uint32_t *row = (uint32_t *)(map + y * t->stride);
+			for (x = 0; x < size; x++) {
+				row[x] = 0xff000000 |
+					 ((x * 255 / size) << 16) |
+					 ((y * 255 / size) << 8) |
+					 (((x ^ y ^ seed) + level * 32) & 0xff);
+			}
+		}
+
+		p->pipe->transfer_unmap(p->pipe, t);
+	}
+
+	return tex;
+}
+
+static void init_prog(struct program *p)
+{
+	struct pipe_surface surf_tmpl;
+	int ret;
+	unsigned i;
+
+	ret = pipe_loader_probe(&p->dev, 1);
+	assert(ret);
+
+	p->screen = pipe_loader_create_screen(p->dev, PIPE_SEARCH_DIR);
+	assert(p->screen);
+
+	p->pipe = p->screen->context_create(p->screen, NULL);
+	p->cso = cso_create_context(p->pipe);
+
+	/* vertex buffer: position and texcoord of a window-sized quad,
+	 * repeating the texture four times across it
+	 */
+	{
+		float vertices[4][2][4] = {
+			{ { -1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } },
+			{ {  1.0f, -1.0f, 0.0f, 1.0f }, { 4.0f, 0.0f, 0.0f, 1.0f } },
+			{ {  1.0f,  1.0f, 0.0f, 1.0f }, { 4.0f, 4.0f, 0.0f, 1.0f } },
+			{ { -1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 4.0f, 0.0f, 1.0f } }
+		};
+
+		p->vbuf = pipe_buffer_create(p->screen, PIPE_BIND_VERTEX_BUFFER,
+					     PIPE_USAGE_STATIC, sizeof(vertices));
+		pipe_buffer_write(p->pipe, p->vbuf, 0, sizeof(vertices), vertices);
+	}
+
+	/* render target texture */
+	{
+		struct pipe_resource tmplt;
+		memset(&tmplt, 0, sizeof(tmplt));
+		tmplt.target = PIPE_TEXTURE_2D;
+		tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+		tmplt.width0 = WIDTH;
+		tmplt.height0 = HEIGHT;
+		tmplt.depth0 = 1;
+		tmplt.array_size = 1;
+		tmplt.last_level = 0;
+		tmplt.bind = PIPE_BIND_RENDER_TARGET;
+
+		p->target = p->screen->resource_create(p->screen, &tmplt);
+	}
+
+	/* sampler textures */
+	for (i = 0; i < NUM_TEXTURES; i++) {
+		struct pipe_sampler_view v_tmplt;
+
+		p->tex[i] = create_texture(p, i * 0x55);
+
+		u_sampler_view_default_template(&v_tmplt, p->tex[i], p->tex[i]->format);
+		p->view[i] = p->pipe->create_sampler_view(p->pipe, p->tex[i], &v_tmplt);
+	}
+
+	memset(&p->blend, 0, sizeof(p->blend));
+	p->blend.rt[0].colormask = PIPE_MASK_RGBA;
+
+	memset(&p->depthstencil, 0, sizeof(p->depthstencil));
+
+	memset(&p->rasterizer, 0, sizeof(p->rasterizer));
+	p->rasterizer.cull_face = PIPE_FACE_NONE;
+	p->rasterizer.half_pixel_center = 1;
+	p->rasterizer.bottom_edge_rule = 1;
+	p->rasterizer.depth_clip = 1;
+
+	/* trilinear filtering */
+	memset(&p->sampler, 0, sizeof(p->sampler));
+	p->sampler.wrap_s = PIPE_TEX_WRAP_REPEAT;
+	p->sampler.wrap_t = PIPE_TEX_WRAP_REPEAT;
+	p->sampler.wrap_r = PIPE_TEX_WRAP_REPEAT;
+	p->sampler.min_mip_filter = PIPE_TEX_MIPFILTER_LINEAR;
+	p->sampler.min_img_filter = PIPE_TEX_FILTER_LINEAR;
+	p->sampler.mag_img_filter = PIPE_TEX_FILTER_LINEAR;
+	p->sampler.max_lod = 16.0f;
+	p->sampler.normalized_coords = 1;
+
+	surf_tmpl.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+	surf_tmpl.u.tex.level = 0;
+	surf_tmpl.u.tex.first_layer = 0;
+	surf_tmpl.u.tex.last_layer = 0;
+	memset(&p->framebuffer, 0, sizeof(p->framebuffer));
+	p->framebuffer.width = WIDTH;
+	p->framebuffer.height = HEIGHT;
+	p->framebuffer.nr_cbufs = 1;
+	p->framebuffer.cbufs[0] = p->pipe->create_surface(p->pipe, p->target, &surf_tmpl);
+
+	p->viewport.scale[0] = WIDTH / 2.0f;
+	p->viewport.scale[1] = HEIGHT / 2.0f;
+	p->viewport.scale[2] = 0.5f;
+	p->viewport.scale[3] = 1.0f;
+	p->viewport.translate[0] = WIDTH / 2.0f;
+	p->viewport.translate[1] = HEIGHT / 2.0f;
+	p->viewport.translate[2] = 0.5f;
+	p->viewport.translate[3] = 0.0f;
+
+	memset(p->velem, 0, sizeof(p->velem));
+	p->velem[0].src_offset = 0 * 4 * sizeof(float);
+	p->velem[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+	p->velem[1].src_offset = 1 * 4 * sizeof(float);
+	p->velem[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+	{
+		const uint semantic_names[] = { TGSI_SEMANTIC_POSITION,
+						TGSI_SEMANTIC_GENERIC };
+		const uint semantic_indexes[] = { 0, 0 };
+		p->vs = util_make_vertex_passthrough_shader(p->pipe, 2, semantic_names, semantic_indexes);
+	}
+
+	{
+		struct tgsi_token tokens[1000];
+		struct pipe_shader_state state = {tokens};
+
+		ret = tgsi_text_translate(fs_text, tokens, Elements(tokens));
+		assert(ret);
+
+		p->fs = p->pipe->create_fs_state(p->pipe, &state);
+	}
+}
+
+static void close_prog(struct program *p)
+{
+	unsigned i;
+
+	cso_release_all(p->cso);
+
+	p->pipe->delete_vs_state(p->pipe, p->vs);
+	p->pipe->delete_fs_state(p->pipe, p->fs);
+
+	for (i = 0; i < NUM_TEXTURES; i++) {
+		pipe_sampler_view_reference(&p->view[i], NULL);
+		pipe_resource_reference(&p->tex[i], NULL);
+	}
+	pipe_surface_reference(&p->framebuffer.cbufs[0], NULL);
+	pipe_resource_reference(&p->target, NULL);
+	pipe_resource_reference(&p->vbuf, NULL);
+
+	cso_destroy_context(p->cso);
+	p->pipe->destroy(p->pipe);
+	p->screen->destroy(p->screen);
+	pipe_loader_release(&p->dev, 1);
+
+	FREE(p);
+}
+
+static void draw(struct program *p)
+{
+	unsigned i;
+
+	cso_set_framebuffer(p->cso, &p->framebuffer);
+	cso_set_blend(p->cso, &p->blend);
+	cso_set_depth_stencil_alpha(p->cso, &p->depthstencil);
+	cso_set_rasterizer(p->cso, &p->rasterizer);
+	cso_set_viewport(p->cso, &p->viewport);
+
+	for (i = 0; i < NUM_TEXTURES; i++)
+		cso_single_sampler(p->cso, PIPE_SHADER_FRAGMENT, i, &p->sampler);
+	cso_single_sampler_done(p->cso, PIPE_SHADER_FRAGMENT);
+	cso_set_sampler_views(p->cso, PIPE_SHADER_FRAGMENT, NUM_TEXTURES, p->view);
+
+	cso_set_fragment_shader_handle(p->cso, p->fs);
+	cso_set_vertex_shader_handle(p->cso, p->vs);
+	cso_set_vertex_elements(p->cso, 2, p->velem);
+
+	util_draw_vertex_buffer(p->pipe, p->cso,
+	                        p->vbuf, 0, 0,
+	                        PIPE_PRIM_QUADS,
+	                        4,  /* verts */
+	                        2); /* attribs/vert */
+
+	p->pipe->flush(p->pipe, NULL, 0);
+}
+
+int main(int argc, char** argv)
+{
+	struct program *p = CALLOC_STRUCT(program);
+	unsigned iterations = argc > 1 ? atoi(argv[1]) : 100;
+	unsigned i;
+	int64_t start, end;
+
+	p->tex_size = util_next_power_of_two(argc > 2 ? atoi(argv[2]) : 256);
+
+	init_prog(p);
+
+	/* compile the shaders outside of the timed loop */
+	draw(p);
+
+	start = os_time_get();
+	for (i = 0; i < iterations; i++)
+		draw(p);
+	end = os_time_get();
+
+	printf("%u x %ux%u pixels, %u %ux%u textures in %.3f sec: "
+	       "%.2f Mpixels/sec\n",
+	       iterations, WIDTH, HEIGHT, NUM_TEXTURES, p->tex_size, p->tex_size,
+	       (end - start) / 1000000.0,
+	       (double)iterations * WIDTH * HEIGHT / (end - start));
+
+	close_prog(p);
+
+	return 0;
+}
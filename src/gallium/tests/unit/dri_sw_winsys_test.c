@@ -0,0 +1,191 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Headless test of the DRI sw winsys presents: a fake loader stands in for
+ * the X server, and the winsys' copy counter is checked for presents from
+ * shared memory, for the loader falling back to a copy, and for loaders
+ * without shared memory support.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "pipe/p_defines.h"
+#include "pipe/p_format.h"
+#include "util/u_memory.h"
+#include "state_tracker/sw_winsys.h"
+#include "sw/dri/dri_sw_winsys.h"
+
+
+#define WIDTH 64
+#define HEIGHT 16
+
+
+/** Whether the fake server can attach shared memory segments */
+static boolean server_shm = TRUE;
+
+/** Images the fake server got without and with a copy */
+static unsigned num_shm_images = 0;
+static unsigned num_copied_images = 0;
+
+/** Pixel the fake server saw at the start of the last image */
+static uint32_t last_pixel = 0;
+
+
+static void
+put_image(struct dri_drawable *dri_drawable,
+          void *data, unsigned width, unsigned height)
+{
+   num_copied_images++;
+   last_pixel = *(const uint32_t *)data;
+}
+
+
+static boolean
+put_image_shm(struct dri_drawable *dri_drawable,
+              int shmid, char *shmaddr, unsigned offset,
+              unsigned width, unsigned height, unsigned stride)
+{
+   void *addr;
+
+   if (!server_shm) {
+      put_image(dri_drawable, shmaddr + offset, width, height);
+      return FALSE;
+   }
+
+   /* read the image through a mapping of our own, like the server does */
+   addr = shmat(shmid, NULL, SHM_RDONLY);
+   if (addr == (void *) -1)
+      return FALSE;
+
+   num_shm_images++;
+   last_pixel = *(const uint32_t *)((const char *)addr + offset);
+   shmdt(addr);
+   return TRUE;
+}
+
+
+static struct drisw_loader_funcs copy_lf = {
+   put_image,
+   NULL
+};
+
+static struct drisw_loader_funcs shm_lf = {
+   put_image,
+   put_image_shm
+};
+
+
+/**
+ * Create a display target, fill it with the given pixel and present it.
+ */
+static void
+present(struct sw_winsys *ws, uint32_t pixel)
+{
+   struct sw_displaytarget *dt;
+   unsigned stride;
+   uint32_t *map;
+   unsigned i;
+
+   dt = ws->displaytarget_create(ws, PIPE_BIND_DISPLAY_TARGET,
+                                 PIPE_FORMAT_B8G8R8A8_UNORM,
+                                 WIDTH, HEIGHT, 64, &stride);
+   assert(dt);
+
+   map = ws->displaytarget_map(ws, dt, PIPE_TRANSFER_WRITE);
+   for (i = 0; i < stride / 4 * HEIGHT; i++)
+      map[i] = pixel;
+   ws->displaytarget_unmap(ws, dt);
+
+   ws->displaytarget_display(ws, dt, NULL);
+
+   ws->displaytarget_destroy(ws, dt);
+}
+
+
+static boolean
+check(const char *name, struct sw_winsys *ws, uint32_t pixel,
+      unsigned expected_presents, unsigned expected_copies)
+{
+   unsigned num_presents, num_copies;
+
+   dri_sw_winsys_get_present_stats(ws, &num_presents, &num_copies);
+
+   if (num_presents != expected_presents ||
+       num_copies != expected_copies ||
+       last_pixel != pixel) {
+      printf("%s: FAILED: %u presents, %u copied, pixel 0x%08x, "
+             "expected %u presents, %u copied, pixel 0x%08x\n",
+             name, num_presents, num_copies, last_pixel,
+             expected_presents, expected_copies, pixel);
+      return FALSE;
+   }
+
+   printf("%s: passed\n", name);
+   return TRUE;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   struct sw_winsys *ws;
+   boolean success = TRUE;
+
+   /* a loader with shared memory support */
+   ws = dri_create_sw_winsys(&shm_lf);
+
+   present(ws, 0xff0000ff);
+   success &= check("shm", ws, 0xff0000ff, 1, 0);
+   success &= num_shm_images == 1 && num_copied_images == 0;
+
+   /* the server can't attach, the loader falls back to a copy */
+   server_shm = FALSE;
+   present(ws, 0xff00ff00);
+   success &= check("shm fallback", ws, 0xff00ff00, 2, 1);
+   success &= num_shm_images == 1 && num_copied_images == 1;
+
+   ws->destroy(ws);
+
+   /* a loader without shared memory support */
+   ws = dri_create_sw_winsys(&copy_lf);
+
+   present(ws, 0xffff0000);
+   success &= check("copy", ws, 0xffff0000, 1, 1);
+   success &= num_shm_images == 1 && num_copied_images == 2;
+
+   ws->destroy(ws);
+
+   printf("%s\n", success ? "Success!" : "Failure!");
+
+   return success ? 0 : 1;
+}
@@ -0,0 +1,399 @@
+/**************************************************************************
+ *
+ * Copyright 2014 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+/*
+ * Test case for the pre-decoded micro ops of tgsi_exec: runs shaders with
+ * and without them, and checks that the outputs are identical.  Shaders
+ * that can run wide are also checked lane by lane against the quad runs,
+ * and timed at each width.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_shader_tokens.h"
+#include "tgsi/tgsi_exec.h"
+#include "tgsi/tgsi_text.h"
+#include "os/os_time.h"
+#include "util/u_memory.h"
+
+
+#define NUM_INPUTS 4
+#define NUM_OUTPUTS 4
+#define NUM_CONSTS 8
+
+
+static const char *shaders[] = {
+   /* arithmetic, swizzles, modifiers and saturation */
+   "VERT\n"
+   "DCL IN[0..3]\n"
+   "DCL OUT[0], POSITION\n"
+   "DCL OUT[1], GENERIC[0]\n"
+   "DCL OUT[2], GENERIC[1]\n"
+   "DCL OUT[3], GENERIC[2]\n"
+   "DCL CONST[0..7]\n"
+   "DCL TEMP[0..3]\n"
+   "IMM[0] FLT32 { 0.5, -2.0, 3.0, 0.25 }\n"
+   "MUL TEMP[0], IN[0], CONST[0]\n"
+   "MAD TEMP[0], IN[1].yxwz, CONST[1].xxxx, TEMP[0]\n"
+   "ADD TEMP[1], -TEMP[0], |IN[2]|\n"
+   "DP3 TEMP[2].x, TEMP[1], IMM[0]\n"
+   "DP4 TEMP[2].yw, -|TEMP[1]|, IN[3].wzyx\n"
+   "MOV TEMP[0], TEMP[0].yzwx\n"
+   "SUB TEMP[3], TEMP[0], IMM[0].wzyx\n"
+   "MAD_SAT OUT[1], TEMP[3], IMM[0], IN[3]\n"
+   "MOV_SAT OUT[2], TEMP[2]\n"
+   "MIN TEMP[1], TEMP[0], TEMP[2].zzzx\n"
+   "MAX TEMP[1], TEMP[1], -CONST[7]\n"
+   "LRP TEMP[1], IMM[0].xxxx, TEMP[1], IN[2]\n"
+   "CMP OUT[3], TEMP[0], TEMP[1], -TEMP[2]\n"
+   "MOV OUT[0], TEMP[1]\n"
+   "END\n",
+
+   /* scalar and unary operations */
+   "VERT\n"
+   "DCL IN[0..3]\n"
+   "DCL OUT[0], POSITION\n"
+   "DCL OUT[1], GENERIC[0]\n"
+   "DCL OUT[2], GENERIC[1]\n"
+   "DCL OUT[3], GENERIC[2]\n"
+   "DCL CONST[0..7]\n"
+   "DCL TEMP[0..3]\n"
+   "RCP TEMP[0].x, IN[0].yyyy\n"
+   "RSQ TEMP[0].y, |IN[1].xxxx|\n"
+   "EX2 TEMP[0].z, IN[2].wwww\n"
+   "LG2 TEMP[0].w, |IN[3].zzzz|\n"
+   "POW TEMP[1], |IN[0].xxxx|, IN[1].yyyy\n"
+   "SIN TEMP[2].xz, IN[2].xxxx\n"
+   "COS TEMP[2].yw, IN[2].yyyy\n"
+   "FRC TEMP[3], IN[0]\n"
+   "FLR TEMP[3].zw, -IN[1]\n"
+   "ABS OUT[1], TEMP[0]\n"
+   "SLT TEMP[1], TEMP[1], CONST[2]\n"
+   "SGE TEMP[2], TEMP[2], -CONST[3]\n"
+   "ADD OUT[0], TEMP[3], TEMP[2]\n"
+   "MOV OUT[2], TEMP[1]\n"
+   "SQRT OUT[3], |IN[3].xxxx|\n"
+   "END\n",
+
+   /* integer operations */
+   "VERT\n"
+   "DCL IN[0..3]\n"
+   "DCL OUT[0], POSITION\n"
+   "DCL OUT[1], GENERIC[0]\n"
+   "DCL OUT[2], GENERIC[1]\n"
+   "DCL OUT[3], GENERIC[2]\n"
+   "DCL CONST[0..7]\n"
+   "DCL TEMP[0..3]\n"
+   "IMM[0] UINT32 { 1, 7, 255, 3 }\n"
+   "F2I TEMP[0], IN[0]\n"
+   "F2U TEMP[1], |IN[1]|\n"
+   "UADD TEMP[2], TEMP[0], -TEMP[1]\n"
+   "AND TEMP[3], TEMP[2], IMM[0].zzzz\n"
+   "SHL TEMP[3], TEMP[3], IMM[0].xyxw\n"
+   "ISHR TEMP[2], TEMP[2], IMM[0].xxxx\n"
+   "IMAX TEMP[0], TEMP[0], -TEMP[2]\n"
+   "USLT TEMP[1], TEMP[1], TEMP[3]\n"
+   "UCMP TEMP[1], TEMP[1], TEMP[0], TEMP[3]\n"
+   "I2F OUT[0], TEMP[0]\n"
+   "U2F OUT[1], TEMP[3]\n"
+   "XOR OUT[2], TEMP[1], TEMP[2]\n"
+   "UMAD OUT[3], TEMP[0], TEMP[3], IMM[0]\n"
+   "END\n",
+
+   /* flow control: the micro ops must honour the execution mask */
+   "VERT\n"
+   "DCL IN[0..3]\n"
+   "DCL OUT[0], POSITION\n"
+   "DCL OUT[1], GENERIC[0]\n"
+   "DCL OUT[2], GENERIC[1]\n"
+   "DCL OUT[3], GENERIC[2]\n"
+   "DCL CONST[0..7]\n"
+   "DCL TEMP[0..3]\n"
+   "DCL ADDR[0]\n"
+   "IMM[0] FLT32 { 0.0, 1.0, 2.0, 0.5 }\n"
+   "MOV TEMP[0], IN[0]\n"
+   "MOV TEMP[1], IMM[0].xxxx\n"
+   "SLT TEMP[2], IN[1], IMM[0].xxxx\n"
+   "IF TEMP[2].xxxx\n"
+   "   MUL TEMP[0], TEMP[0], IMM[0].zzzz\n"
+   "ELSE\n"
+   "   ADD_SAT TEMP[0], TEMP[0], IN[2]\n"
+   "ENDIF\n"
+   "BGNLOOP\n"
+   "   ADD TEMP[1].x, TEMP[1].xxxx, IMM[0].yyyy\n"
+   "   SGE TEMP[3].x, TEMP[1].xxxx, IN[3].xxxx\n"
+   "   IF TEMP[3].xxxx\n"
+   "      BRK\n"
+   "   ENDIF\n"
+   "   MAD TEMP[0], TEMP[0], IMM[0].wwww, CONST[4]\n"
+   "   SGE TEMP[3].x, TEMP[1].xxxx, IMM[0].zzzz\n"
+   "   IF TEMP[3].xxxx\n"
+   "      BRK\n"
+   "   ENDIF\n"
+   "ENDLOOP\n"
+   "ARL ADDR[0].x, IN[3].yyyy\n"
+   "MOV OUT[0], TEMP[0]\n"
+   "MOV OUT[1], TEMP[1]\n"
+   "MOV OUT[2], CONST[ADDR[0].x+4]\n"
+   "DP4 OUT[3], TEMP[0], CONST[5]\n"
+   "END\n"
+};
+
+/* whether each shader above can run wide */
+static const boolean wide_shaders[] = { TRUE, TRUE, TRUE, FALSE };
+
+
+/* don't use this for serious use */
+static float
+rand_float(void)
+{
+   return ((float) rand() / RAND_MAX) * 8.0f - 4.0f;
+}
+
+
+static void
+run_shader(struct tgsi_exec_machine *mach,
+           const struct tgsi_exec_vector *inputs,
+           unsigned iterations,
+           struct tgsi_exec_vector *outputs)
+{
+   unsigned i;
+
+   for (i = 0; i < iterations; i++) {
+      memcpy(mach->Inputs, inputs, NUM_INPUTS * sizeof *inputs);
+      memset(mach->Outputs, 0, NUM_OUTPUTS * sizeof *outputs);
+      tgsi_exec_machine_run(mach);
+   }
+
+   memcpy(outputs, mach->Outputs, NUM_OUTPUTS * sizeof *outputs);
+}
+
+
+/**
+ * Run the shader on width / TGSI_QUAD_SIZE quads of inputs at once.
+ */
+static void
+run_shader_wide(struct tgsi_exec_machine *mach,
+                const struct tgsi_exec_vector (*inputs)[NUM_INPUTS],
+                unsigned width,
+                unsigned iterations,
+                struct tgsi_exec_vector (*outputs)[NUM_OUTPUTS])
+{
+   unsigned i, j, k, q;
+
+   for (k = 0; k < iterations; k++) {
+      for (q = 0; q < width / TGSI_QUAD_SIZE; q++)
+         for (i = 0; i < NUM_INPUTS; i++)
+            for (j = 0; j < TGSI_NUM_CHANNELS; j++)
+               mach->WideInputs[i].xyzw[j].quad[q] = inputs[q][i].xyzw[j];
+      memset(mach->WideOutputs, 0, NUM_OUTPUTS * sizeof *mach->WideOutputs);
+      tgsi_exec_machine_run_wide(mach, width);
+   }
+
+   for (q = 0; q < width / TGSI_QUAD_SIZE; q++)
+      for (i = 0; i < NUM_OUTPUTS; i++)
+         for (j = 0; j < TGSI_NUM_CHANNELS; j++)
+            outputs[q][i].xyzw[j] = mach->WideOutputs[i].xyzw[j].quad[q];
+}
+
+
+/**
+ * Check the wide runs against quad runs of the same inputs.
+ */
+static boolean
+test_wide(struct tgsi_exec_machine *mach, unsigned s)
+{
+   const unsigned num_quads = TGSI_EXEC_MAX_WIDTH / TGSI_QUAD_SIZE;
+   struct tgsi_exec_vector inputs[TGSI_EXEC_MAX_WIDTH / TGSI_QUAD_SIZE][NUM_INPUTS];
+   struct tgsi_exec_vector outputs[2][TGSI_EXEC_MAX_WIDTH / TGSI_QUAD_SIZE][NUM_OUTPUTS];
+   unsigned width = tgsi_exec_machine_width(mach);
+   unsigned i, j, m, q;
+
+   for (q = 0; q < num_quads; q++)
+      for (i = 0; i < NUM_INPUTS; i++)
+         for (j = 0; j < TGSI_NUM_CHANNELS; j++)
+            for (m = 0; m < TGSI_QUAD_SIZE; m++)
+               inputs[q][i].xyzw[j].f[m] = rand_float();
+
+   for (q = 0; q < width / TGSI_QUAD_SIZE; q++)
+      run_shader(mach, inputs[q], 1, outputs[0][q]);
+   run_shader_wide(mach, inputs, width, 1, outputs[1]);
+
+   if (memcmp(outputs[0], outputs[1],
+              width / TGSI_QUAD_SIZE * sizeof outputs[0][0]) == 0)
+      return TRUE;
+
+   printf("shader %u, width %u: FAILED\n", s, width);
+   for (q = 0; q < width / TGSI_QUAD_SIZE; q++)
+      for (i = 0; i < NUM_OUTPUTS; i++)
+         for (j = 0; j < TGSI_NUM_CHANNELS; j++)
+            for (m = 0; m < TGSI_QUAD_SIZE; m++)
+               if (outputs[0][q][i].xyzw[j].u[m] != outputs[1][q][i].xyzw[j].u[m])
+                  printf("   OUT[%u].%c[%u]: %08x != %08x\n",
+                         i, "xyzw"[j], q * TGSI_QUAD_SIZE + m,
+                         outputs[0][q][i].xyzw[j].u[m],
+                         outputs[1][q][i].xyzw[j].u[m]);
+   return FALSE;
+}
+
+
+/**
+ * Rough timings of the quad and wide runs, per TGSI_EXEC_MAX_WIDTH lanes.
+ */
+static void
+time_wide(struct tgsi_exec_machine *mach, unsigned s, unsigned iterations)
+{
+   struct tgsi_exec_vector inputs[TGSI_EXEC_MAX_WIDTH / TGSI_QUAD_SIZE][NUM_INPUTS];
+   struct tgsi_exec_vector outputs[TGSI_EXEC_MAX_WIDTH / TGSI_QUAD_SIZE][NUM_OUTPUTS];
+   unsigned width;
+   int64_t time;
+
+   memset(inputs, 0, sizeof inputs);
+
+   printf("shader %u:", s);
+   for (width = TGSI_QUAD_SIZE; width <= tgsi_exec_machine_width(mach); width *= 2) {
+      unsigned runs = iterations * (TGSI_EXEC_MAX_WIDTH / width);
+
+      time = os_time_get();
+      if (width == TGSI_QUAD_SIZE)
+         run_shader(mach, inputs[0], runs, outputs[0]);
+      else
+         run_shader_wide(mach, inputs, width, runs, outputs);
+      time = os_time_get() - time;
+
+      printf(" %.3f usec/%u verts at width %u,",
+             (double) time / iterations, TGSI_EXEC_MAX_WIDTH, width);
+   }
+   printf("\n");
+}
+
+
+int main(int argc, char **argv)
+{
+   struct tgsi_exec_machine *mach[2];
+   float consts[NUM_CONSTS][4];
+   const void *bufs[1] = { consts };
+   unsigned buf_sizes[1] = { sizeof consts / sizeof(float) };
+   unsigned iterations = argc > 1 ? atoi(argv[1]) : 1000;
+   unsigned passed = 0, total = 0;
+   unsigned s, i, j, k, m;
+
+   for (i = 0; i < NUM_CONSTS; i++)
+      for (j = 0; j < 4; j++)
+         consts[i][j] = rand_float();
+
+   for (s = 0; s < Elements(shaders); s++) {
+      struct tgsi_token tokens[1024];
+      struct tgsi_exec_vector inputs[NUM_INPUTS];
+      struct tgsi_exec_vector outputs[2][NUM_OUTPUTS];
+      int64_t time[2];
+
+      if (!tgsi_text_translate(shaders[s], tokens, Elements(tokens))) {
+         printf("shader %u: failed to translate\n", s);
+         return 2;
+      }
+
+      for (m = 0; m < 2; m++) {
+         mach[m] = tgsi_exec_machine_create();
+         mach[m]->NoUops = m == 0;
+         tgsi_exec_machine_bind_shader(mach[m], tokens, NULL);
+         tgsi_exec_set_constant_buffers(mach[m], 1, bufs, buf_sizes);
+      }
+
+      if (!mach[1]->Uops) {
+         printf("shader %u: not lowered to micro ops\n", s);
+         return 2;
+      }
+
+      for (k = 0; k < 16; k++) {
+         for (i = 0; i < NUM_INPUTS; i++)
+            for (j = 0; j < TGSI_NUM_CHANNELS; j++)
+               for (m = 0; m < TGSI_QUAD_SIZE; m++)
+                  inputs[i].xyzw[j].f[m] = rand_float();
+
+         for (m = 0; m < 2; m++) {
+            run_shader(mach[m], inputs, 1, outputs[m]);
+         }
+
+         ++total;
+         if (memcmp(outputs[0], outputs[1], sizeof outputs[0]) == 0) {
+            ++passed;
+         }
+         else {
+            printf("shader %u, inputs %u: FAILED\n", s, k);
+            for (i = 0; i < NUM_OUTPUTS; i++)
+               for (j = 0; j < TGSI_NUM_CHANNELS; j++)
+                  for (m = 0; m < TGSI_QUAD_SIZE; m++)
+                     if (outputs[0][i].xyzw[j].u[m] != outputs[1][i].xyzw[j].u[m])
+                        printf("   OUT[%u].%c[%u]: %08x != %08x\n",
+                               i, "xyzw"[j], m,
+                               outputs[0][i].xyzw[j].u[m],
+                               outputs[1][i].xyzw[j].u[m]);
+         }
+      }
+
+      /* rough timings of both paths */
+      for (m = 0; m < 2; m++) {
+         time[m] = os_time_get();
+         run_shader(mach[m], inputs, iterations, outputs[m]);
+         time[m] = os_time_get() - time[m];
+      }
+      printf("shader %u: %.3f usec/run decoded, %.3f usec/run micro ops\n",
+             s, (double) time[0] / iterations, (double) time[1] / iterations);
+
+      if (mach[1]->MaxWidth > TGSI_QUAD_SIZE) {
+         if ((tgsi_exec_machine_width(mach[1]) > TGSI_QUAD_SIZE) !=
+             wide_shaders[s]) {
+            printf("shader %u: unexpected width %u\n",
+                   s, tgsi_exec_machine_width(mach[1]));
+            return 2;
+         }
+
+         if (wide_shaders[s]) {
+            for (k = 0; k < 16; k++) {
+               ++total;
+               if (test_wide(mach[1], s))
+                  ++passed;
+            }
+            time_wide(mach[1], s, iterations);
+         }
+      }
+
+      for (m = 0; m < 2; m++) {
+         tgsi_exec_machine_destroy(mach[m]);
+      }
+   }
+
+   printf("%u tests run, %u passed\n", total, passed);
+
+   return passed != total;
+}
@@ -28,6 +28,7 @@
 #include "util/u_memory.h"
 #include "util/u_format.h"
 #include "util/u_half.h"
+#include "util/u_math.h"
 #include "util/u_cpu_detect.h"
 #include "rtasm/rtasm_cpu.h"
 
@@ -46,6 +47,90 @@ static double rand_double()
    return v;
 }
 
+/* Indexed fetch of two float attributes from two buffers, with more
+ * vertices than translate_sse's eight vertex loop handles at once and
+ * indices past max_index; must match translate_generic bit for bit.
+ */
+static boolean test_elts(struct translate *(*create_fn)(const struct translate_key *key),
+                         unsigned input_format, const float *float_buffer)
+{
+   static const unsigned elts[19] = {
+      5, 0, 17, 3, 3, 90, 12, 1, 8, 2, 16, 1000, 7, 4, 11, 9, 6, 15, 13
+   };
+   const unsigned max_index = 17;
+   struct translate_key key;
+   struct translate *translate[2];
+   unsigned char *out[2][3];
+   unsigned char elts8[19];
+   uint16_t elts16[19];
+   boolean pass = TRUE;
+   boolean used_generic = FALSE;
+   unsigned i, j;
+
+   for (i = 0; i < Elements(elts); ++i)
+   {
+      elts8[i] = elts[i];
+      elts16[i] = elts[i];
+   }
+
+   memset(&key, 0, sizeof key);
+   key.nr_elements = 2;
+   key.output_stride = 36;
+   for (i = 0; i < 2; ++i)
+   {
+      key.element[i].type = TRANSLATE_ELEMENT_NORMAL;
+      key.element[i].input_format = input_format;
+      key.element[i].output_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+      key.element[i].input_buffer = i;
+      key.element[i].input_offset = 4 * i;
+      key.element[i].output_offset = 20 * i;
+   }
+
+   translate[0] = create_fn(&key);
+   if (!translate[0])
+   {
+      used_generic = TRUE;
+      translate[0] = translate_generic_create(&key);
+   }
+   translate[1] = translate_generic_create(&key);
+   if (!translate[0] || !translate[1])
+      return FALSE;
+
+   for (i = 0; i < 2; ++i)
+   {
+      translate[i]->set_buffer(translate[i], 0, float_buffer, 20, max_index);
+      translate[i]->set_buffer(translate[i], 1, float_buffer + 7, 44, max_index);
+
+      for (j = 0; j < 3; ++j)
+      {
+         out[i][j] = align_malloc(Elements(elts) * key.output_stride, 16);
+         memset(out[i][j], 0xcd, Elements(elts) * key.output_stride);
+      }
+
+      translate[i]->run_elts(translate[i], elts, Elements(elts), 0, 0, out[i][0]);
+      translate[i]->run_elts16(translate[i], elts16, Elements(elts), 0, 0, out[i][1]);
+      translate[i]->run_elts8(translate[i], elts8, Elements(elts), 0, 0, out[i][2]);
+   }
+
+   for (j = 0; j < 3; ++j)
+   {
+      if (memcmp(out[0][j], out[1][j], Elements(elts) * key.output_stride))
+         pass = FALSE;
+      align_free(out[0][j]);
+      align_free(out[1][j]);
+   }
+
+   translate[0]->release(translate[0]);
+   translate[1]->release(translate[1]);
+
+   printf("%s%s: elts %s -> %s\n", pass ? "PASS" : "FAIL",
+          used_generic ? "[GENERIC]" : "",
+          util_format_name(input_format),
+          util_format_name(PIPE_FORMAT_R32G32B32A32_FLOAT));
+
+   return pass;
+}
+
 int main(int argc, char** argv)
 {
    struct translate *(*create_fn)(const struct translate_key *key) = 0;
@@ -55,6 +140,7 @@ int main(int argc, char** argv)
    unsigned input_format;
    unsigned buffer_size = 4096;
    unsigned char* buffer[5];
+   unsigned char* ref_buffer;
    unsigned char* byte_buffer;
    float* float_buffer;
    double* double_buffer;
@@ -82,6 +168,7 @@ int main(int argc, char** argv)
       util_cpu_caps.has_sse2 = 0;
       util_cpu_caps.has_sse3 = 0;
       util_cpu_caps.has_sse4_1 = 0;
+      util_cpu_caps.has_avx = 0;
       create_fn = translate_sse2_create;
    }
    else if (!strcmp(argv[1], "sse"))
@@ -94,6 +181,7 @@ int main(int argc, char** argv)
       util_cpu_caps.has_sse2 = 0;
       util_cpu_caps.has_sse3 = 0;
       util_cpu_caps.has_sse4_1 = 0;
+      util_cpu_caps.has_avx = 0;
       create_fn = translate_sse2_create;
    }
    else if (!strcmp(argv[1], "sse2"))
@@ -105,6 +193,7 @@ int main(int argc, char** argv)
       }
       util_cpu_caps.has_sse3 = 0;
       util_cpu_caps.has_sse4_1 = 0;
+      util_cpu_caps.has_avx = 0;
       create_fn = translate_sse2_create;
    }
    else if (!strcmp(argv[1], "sse3"))
@@ -115,6 +204,7 @@ int main(int argc, char** argv)
          return 2;
       }
       util_cpu_caps.has_sse4_1 = 0;
+      util_cpu_caps.has_avx = 0;
       create_fn = translate_sse2_create;
    }
    else if (!strcmp(argv[1], "sse4.1"))
@@ -124,12 +214,22 @@ int main(int argc, char** argv)
          printf("Error: CPU doesn't support SSE4.1 (test with qemu)\n");
          return 2;
       }
+      util_cpu_caps.has_avx = 0;
+      create_fn = translate_sse2_create;
+   }
+   else if (!strcmp(argv[1], "avx2"))
+   {
+      if(!util_cpu_caps.has_avx2 || !util_cpu_caps.has_f16c || !rtasm_cpu_has_sse())
+      {
+         printf("Error: CPU doesn't support AVX2 and F16C (test with qemu)\n");
+         return 2;
+      }
       create_fn = translate_sse2_create;
    }
 
    if (!create_fn)
    {
-      printf("Usage: ./translate_test [generic|x86|nosse|sse|sse2|sse3|sse4.1]\n");
+      printf("Usage: ./translate_test [generic|x86|nosse|sse|sse2|sse3|sse4.1|avx2]\n");
       return 2;
    }
 
@@ -140,6 +240,7 @@ int main(int argc, char** argv)
    float_buffer = align_malloc(buffer_size, 4096);
    double_buffer = align_malloc(buffer_size, 4096);
    half_buffer = align_malloc(buffer_size, 4096);
+   ref_buffer = align_malloc(buffer_size, 4096);
 
    elts = align_malloc(count * sizeof *elts, 4096);
 
@@ -268,6 +369,41 @@ int main(int argc, char** argv)
          translate[1]->set_buffer(translate[1], 0, buffer[3], output_format_size, count - 1);
          translate[1]->run_elts(translate[1], elts, count, 0, 0, buffer[4]);
 
+         /* the first conversion must also match translate_generic's */
+         if (create_fn != translate_generic_create)
+         {
+            struct translate *ref;
+
+            key.element[0].input_format = input_format;
+            key.element[0].output_format = output_format;
+            key.output_stride = output_format_size;
+            ref = translate_generic_create(&key);
+            if (ref)
+            {
+               memset(ref_buffer, 0xcd, 4096);
+               ref->set_buffer(ref, 0, buffer[0], input_format_size, count - 1);
+               ref->run_elts(ref, elts, count, 0, 0, ref_buffer);
+
+               for (i = 0; i < count; ++i)
+               {
+                  float a[4];
+                  float b[4];
+                  output_format_desc->fetch_rgba_float(a, buffer[1] + i * output_format_size, 0, 0);
+                  output_format_desc->fetch_rgba_float(b, ref_buffer + i * output_format_size, 0, 0);
+
+                  for (j = 0; j < 4; ++j)
+                  {
+                     float d = a[j] - b[j];
+                     float tolerance = error * MAX2(1.0f, fabsf(b[j]));
+                     if (d > tolerance || d < -tolerance)
+                        fail = 1;
+                  }
+               }
+
+               ref->release(ref);
+            }
+         }
+
          for (i = 0; i < count; ++i)
          {
             float a[4];
@@ -319,6 +455,13 @@ int main(int argc, char** argv)
       }
    }
 
+   for (input_format = PIPE_FORMAT_R32_FLOAT; input_format <= PIPE_FORMAT_R32G32B32A32_FLOAT; ++input_format)
+   {
+      if (test_elts(create_fn, input_format, float_buffer))
+         ++passed;
+      ++total;
+   }
+
    printf("%u/%u tests passed for translate_%s\n", passed, total, argv[1]);
    return passed != total;
 }
@@ -26,8 +26,12 @@
  *
  **************************************************************************/
 
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
 #include "pipe/p_compiler.h"
 #include "pipe/p_format.h"
+#include "util/u_debug.h"
 #include "util/u_inlines.h"
 #include "util/u_format.h"
 #include "util/u_math.h"
@@ -37,6 +41,10 @@
 #include "dri_sw_winsys.h"
 
 
+DEBUG_GET_ONCE_BOOL_OPTION(swrast_no_shm, "SWRAST_NO_SHM", FALSE)
+DEBUG_GET_ONCE_BOOL_OPTION(swrast_present_stats, "SWRAST_PRESENT_STATS", FALSE)
+
+
 struct dri_sw_displaytarget
 {
    enum pipe_format format;
@@ -46,6 +54,8 @@ struct dri_sw_displaytarget
 
    void *data;
    void *mapped;
+
+   int shmid;  /**< shared memory segment of data, or -1 */
 };
 
 struct dri_sw_winsys
@@ -53,6 +63,9 @@ struct dri_sw_winsys
    struct sw_winsys base;
 
    struct drisw_loader_funcs *lf;
+
+   unsigned num_presents;
+   unsigned num_copies;  /**< presents which copied the image */
 };
 
 static INLINE struct dri_sw_displaytarget *
@@ -77,6 +90,34 @@ dri_sw_is_displaytarget_format_supported( struct sw_winsys *ws,
    return TRUE;
 }
 
+/**
+ * Allocate the image in a shared memory segment the loader can hand to
+ * the X server, so that presenting doesn't need to copy it.
+ */
+static void *
+alloc_shm(struct dri_sw_displaytarget *dri_sw_dt, unsigned size)
+{
+   char *addr;
+
+   dri_sw_dt->shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+   if (dri_sw_dt->shmid < 0)
+      return NULL;
+
+   addr = (char *) shmat(dri_sw_dt->shmid, 0, 0);
+
+   /* Mark the segment for deletion right away, so that it goes away with
+    * the last process using it.
+    */
+   shmctl(dri_sw_dt->shmid, IPC_RMID, 0);
+
+   if (addr == (char *) -1) {
+      dri_sw_dt->shmid = -1;
+      return NULL;
+   }
+
+   return addr;
+}
+
 static struct sw_displaytarget *
 dri_sw_displaytarget_create(struct sw_winsys *winsys,
                             unsigned tex_usage,
@@ -95,6 +136,7 @@ dri_sw_displaytarget_create(struct sw_winsys *winsys,
    dri_sw_dt->format = format;
    dri_sw_dt->width = width;
    dri_sw_dt->height = height;
+   dri_sw_dt->shmid = -1;
 
    format_stride = util_format_get_stride(format, width);
    dri_sw_dt->stride = align(format_stride, alignment);
@@ -102,7 +144,12 @@ dri_sw_displaytarget_create(struct sw_winsys *winsys,
    nblocksy = util_format_get_nblocksy(format, height);
    size = dri_sw_dt->stride * nblocksy;
 
-   dri_sw_dt->data = align_malloc(size, alignment);
+   if (dri_sw_winsys(winsys)->lf->put_image_shm &&
+       !debug_get_option_swrast_no_shm())
+      dri_sw_dt->data = alloc_shm(dri_sw_dt, size);
+
+   if(!dri_sw_dt->data)
+      dri_sw_dt->data = align_malloc(size, alignment);
    if(!dri_sw_dt->data)
       goto no_data;
 
@@ -121,7 +168,10 @@ dri_sw_displaytarget_destroy(struct sw_winsys *ws,
 {
    struct dri_sw_displaytarget *dri_sw_dt = dri_sw_displaytarget(dt);
 
-   FREE(dri_sw_dt->data);
+   if (dri_sw_dt->shmid >= 0)
+      shmdt(dri_sw_dt->data);
+   else
+      align_free(dri_sw_dt->data);
 
    FREE(dri_sw_dt);
 }
@@ -181,6 +231,19 @@ dri_sw_displaytarget_display(struct sw_winsys *ws,
 
    height = dri_sw_dt->height;
 
+   dri_sw_ws->num_presents++;
+
+   if (dri_sw_dt->shmid >= 0) {
+      /* the loader falls back to a copy if the server can't attach */
+      if (!dri_sw_ws->lf->put_image_shm(dri_drawable, dri_sw_dt->shmid,
+                                        dri_sw_dt->data, 0,
+                                        dri_sw_dt->width, height,
+                                        dri_sw_dt->stride))
+         dri_sw_ws->num_copies++;
+      return;
+   }
+
+   dri_sw_ws->num_copies++;
    dri_sw_ws->lf->put_image(dri_drawable, dri_sw_dt->data, width, height);
 }
 
@@ -188,9 +251,29 @@ dri_sw_displaytarget_display(struct sw_winsys *ws,
 static void
 dri_destroy_sw_winsys(struct sw_winsys *winsys)
 {
+   struct dri_sw_winsys *dri_sw_ws = dri_sw_winsys(winsys);
+
+   if (debug_get_option_swrast_present_stats())
+      debug_printf("swrast: %u presents, %u copied\n",
+                   dri_sw_ws->num_presents, dri_sw_ws->num_copies);
+
    FREE(winsys);
 }
 
+/**
+ * Get the number of presents, and of those which copied the image.
+ */
+void
+dri_sw_winsys_get_present_stats(struct sw_winsys *winsys,
+                                unsigned *num_presents,
+                                unsigned *num_copies)
+{
+   struct dri_sw_winsys *dri_sw_ws = dri_sw_winsys(winsys);
+
+   *num_presents = dri_sw_ws->num_presents;
+   *num_copies = dri_sw_ws->num_copies;
+}
+
 struct sw_winsys *
 dri_create_sw_winsys(struct drisw_loader_funcs *lf)
 {
@@ -35,4 +35,8 @@ struct sw_winsys;
 
 struct sw_winsys *dri_create_sw_winsys(struct drisw_loader_funcs *lf);
 
+void dri_sw_winsys_get_present_stats(struct sw_winsys *ws,
+                                     unsigned *num_presents,
+                                     unsigned *num_copies);
+
 #endif
@@ -49,6 +49,7 @@
 #include <X11/extensions/XShm.h>
 
 DEBUG_GET_ONCE_BOOL_OPTION(xlib_no_shm, "XLIB_NO_SHM", FALSE)
+DEBUG_GET_ONCE_BOOL_OPTION(xlib_present_stats, "XLIB_PRESENT_STATS", FALSE)
 
 /**
  * Display target for Xlib winsys.
@@ -86,6 +87,9 @@ struct xlib_sw_winsys
 {
    struct sw_winsys base;
    Display *display;
+
+   unsigned num_presents;
+   unsigned num_copies;  /**< presents which copied the image */
 };
 
 
@@ -378,8 +382,15 @@ xlib_displaytarget_display(struct sw_winsys *ws,
                            struct sw_displaytarget *dt,
                            void *context_private)
 {
+   struct xlib_sw_winsys *xlib_ws = (struct xlib_sw_winsys *)ws;
    struct xlib_drawable *xlib_drawable = (struct xlib_drawable *)context_private;
+
    xlib_sw_display(xlib_drawable, dt);
+
+   /* Shared memory images are read by the server in place */
+   xlib_ws->num_presents++;
+   if (!xlib_displaytarget(dt)->shm)
+      xlib_ws->num_copies++;
 }
 
 
@@ -454,6 +465,12 @@ xlib_displaytarget_get_handle(struct sw_winsys *winsys,
 static void
 xlib_destroy(struct sw_winsys *ws)
 {
+   struct xlib_sw_winsys *xlib_ws = (struct xlib_sw_winsys *)ws;
+
+   if (debug_get_option_xlib_present_stats())
+      debug_printf("xlib: %u presents, %u copied\n",
+                   xlib_ws->num_presents, xlib_ws->num_copies);
+
    FREE(ws);
 }
 
@@ -24,6 +24,7 @@
 #if defined(GLX_DIRECT_RENDERING) && !defined(GLX_USE_APPLEGL)
 
 #include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
 #include "glxclient.h"
 #include <dlfcn.h>
 #include "dri_common.h"
@@ -65,6 +66,10 @@ struct drisw_drawable
    __DRIdrawable *driDrawable;
    XVisualInfo *visinfo;
    XImage *ximage;
+
+   /* Shared memory segment of the driver attached to the X server */
+   XShmSegmentInfo shminfo;
+   Bool shm;
 };
 
 static Bool
@@ -111,12 +116,18 @@ XCreateDrawable(struct drisw_drawable * pdp,
   if (pdp->ximage->bits_per_pixel == 24)
      pdp->ximage->bits_per_pixel = 32;
 
+   pdp->shminfo.shmid = -1;
+   pdp->shm = XShmQueryExtension(dpy);
+
    return True;
 }
 
 static void
 XDestroyDrawable(struct drisw_drawable * pdp, Display * dpy, XID drawable)
 {
+   if (pdp->shminfo.shmid >= 0)
+      XShmDetach(dpy, &pdp->shminfo);
+
    XDestroyImage(pdp->ximage);
    free(pdp->visinfo);
 
@@ -206,6 +217,101 @@ swrastPutImage(__DRIdrawable * draw, int op,
    ximage->data = NULL;
 }
 
+static int xshm_error = 0;
+
+static int
+handle_xerror(Display *dpy, XErrorEvent *event)
+{
+   (void) dpy;
+   (void) event;
+   xshm_error = 1;
+   return 0;
+}
+
+/**
+ * Attach the driver's shared memory segment to the X server, unless it
+ * already is.  Fails for instance with remote displays.
+ */
+static Bool
+XAttachShm(struct drisw_drawable *pdp, Display *dpy,
+           int shmid, char *shmaddr)
+{
+   int (*old_handler)(Display *, XErrorEvent *);
+
+   if (pdp->shminfo.shmid == shmid)
+      return True;
+
+   if (pdp->shminfo.shmid >= 0) {
+      XShmDetach(dpy, &pdp->shminfo);
+      pdp->shminfo.shmid = -1;
+   }
+
+   pdp->shminfo.shmid = shmid;
+   pdp->shminfo.shmaddr = shmaddr;
+   pdp->shminfo.readOnly = True;
+
+   XSync(dpy, False);
+   xshm_error = 0;
+   old_handler = XSetErrorHandler(handle_xerror);
+   XShmAttach(dpy, &pdp->shminfo);
+   XSync(dpy, False);
+   XSetErrorHandler(old_handler);
+
+   if (xshm_error) {
+      pdp->shminfo.shmid = -1;
+      pdp->shm = False;
+      return False;
+   }
+
+   return True;
+}
+
+static int
+swrastPutImageShm(__DRIdrawable * draw, int op,
+                  int x, int y, int w, int h, int stride,
+                  int shmid, char *shmaddr, unsigned offset,
+                  void *loaderPrivate)
+{
+   struct drisw_drawable *pdp = loaderPrivate;
+   __GLXDRIdrawable *pdraw = &(pdp->base);
+   Display *dpy = pdraw->psc->dpy;
+   Drawable drawable;
+   XImage *ximage;
+   GC gc;
+
+   switch (op) {
+   case __DRI_SWRAST_IMAGE_OP_DRAW:
+      gc = pdp->gc;
+      break;
+   case __DRI_SWRAST_IMAGE_OP_SWAP:
+      gc = pdp->swapgc;
+      break;
+   default:
+      return False;
+   }
+
+   drawable = pdraw->xDrawable;
+
+   ximage = pdp->ximage;
+   ximage->data = shmaddr + offset;
+   ximage->width = w;
+   ximage->height = h;
+   ximage->bytes_per_line = stride;
+
+   if (pdp->shm && XAttachShm(pdp, dpy, shmid, shmaddr)) {
+      /* The server reads the pixels straight from the segment */
+      ximage->obdata = (char *) &pdp->shminfo;
+      XShmPutImage(dpy, drawable, gc, ximage, 0, 0, x, y, w, h, False);
+      ximage->obdata = NULL;
+      ximage->data = NULL;
+      return True;
+   }
+
+   XPutImage(dpy, drawable, gc, ximage, 0, 0, x, y, w, h);
+   ximage->data = NULL;
+   return False;
+}
+
 static void
 swrastGetImage(__DRIdrawable * read,
                int x, int y, int w, int h,
@@ -234,7 +340,8 @@ static const __DRIswrastLoaderExtension swrastLoaderExtension = {
    {__DRI_SWRAST_LOADER, __DRI_SWRAST_LOADER_VERSION},
    swrastGetDrawableInfo,
    swrastPutImage,
-   swrastGetImage
+   swrastGetImage,
+   swrastPutImageShm
 };
 
 static const __DRIextension *loader_extensions[] = {